@@ -1,3 +1,34 @@
-C:\VulkanSDK\1.3.283.0\Bin\glslc.exe Vulkan/Shaders/shader.vert -o Vulkan/Shaders/CompiledShaders/vert.spv
-C:\VulkanSDK\1.3.283.0\Bin\glslc.exe Vulkan/Shaders/shader.frag -o Vulkan/Shaders/CompiledShaders/frag.spv
-pause
\ No newline at end of file
+@echo off
+rem Uses the SDK the installer registered in VULKAN_SDK, falling back to the version this project was set up with.
+if "%VULKAN_SDK%"=="" set VULKAN_SDK=C:\VulkanSDK\1.3.283.0
+set GLSLC=%VULKAN_SDK%\Bin\glslc.exe
+
+rem The output directory is not tracked, so a fresh checkout has none.
+if not exist Vulkan\Shaders\CompiledShaders mkdir Vulkan\Shaders\CompiledShaders
+
+rem Binary SPIR-V, only loaded at runtime when built with SHADERS_FROM_DISK.
+%GLSLC% Vulkan/Shaders/shader.vert -o Vulkan/Shaders/CompiledShaders/vert.spv || exit /b 1
+%GLSLC% Vulkan/Shaders/shader.frag -o Vulkan/Shaders/CompiledShaders/frag.spv || exit /b 1
+%GLSLC% Vulkan/Shaders/mesh.vert -o Vulkan/Shaders/CompiledShaders/mesh_vert.spv || exit /b 1
+%GLSLC% Vulkan/Shaders/mesh.frag -o Vulkan/Shaders/CompiledShaders/mesh_frag.spv || exit /b 1
+%GLSLC% Vulkan/Shaders/particle.vert -o Vulkan/Shaders/CompiledShaders/particle_vert.spv || exit /b 1
+%GLSLC% Vulkan/Shaders/particle.frag -o Vulkan/Shaders/CompiledShaders/particle_frag.spv || exit /b 1
+%GLSLC% Vulkan/Shaders/particle.comp -o Vulkan/Shaders/CompiledShaders/particle_comp.spv || exit /b 1
+%GLSLC% Vulkan/Shaders/depth_reduce.comp -o Vulkan/Shaders/CompiledShaders/depth_reduce_comp.spv || exit /b 1
+%GLSLC% Vulkan/Shaders/occlusion_cull.comp -o Vulkan/Shaders/CompiledShaders/occlusion_cull_comp.spv || exit /b 1
+%GLSLC% Vulkan/Shaders/light_assign.comp -o Vulkan/Shaders/CompiledShaders/light_assign_comp.spv || exit /b 1
+
+rem C initialiser lists embedded into the executable by EmbeddedShaders.h.
+%GLSLC% -mfmt=c Vulkan/Shaders/shader.vert -o Vulkan/Shaders/CompiledShaders/vert.spv.inc || exit /b 1
+%GLSLC% -mfmt=c Vulkan/Shaders/shader.frag -o Vulkan/Shaders/CompiledShaders/frag.spv.inc || exit /b 1
+%GLSLC% -mfmt=c Vulkan/Shaders/mesh.vert -o Vulkan/Shaders/CompiledShaders/mesh_vert.spv.inc || exit /b 1
+%GLSLC% -mfmt=c Vulkan/Shaders/mesh.frag -o Vulkan/Shaders/CompiledShaders/mesh_frag.spv.inc || exit /b 1
+%GLSLC% -mfmt=c Vulkan/Shaders/particle.vert -o Vulkan/Shaders/CompiledShaders/particle_vert.spv.inc || exit /b 1
+%GLSLC% -mfmt=c Vulkan/Shaders/particle.frag -o Vulkan/Shaders/CompiledShaders/particle_frag.spv.inc || exit /b 1
+%GLSLC% -mfmt=c Vulkan/Shaders/particle.comp -o Vulkan/Shaders/CompiledShaders/particle_comp.spv.inc || exit /b 1
+%GLSLC% -mfmt=c Vulkan/Shaders/depth_reduce.comp -o Vulkan/Shaders/CompiledShaders/depth_reduce_comp.spv.inc || exit /b 1
+%GLSLC% -mfmt=c Vulkan/Shaders/occlusion_cull.comp -o Vulkan/Shaders/CompiledShaders/occlusion_cull_comp.spv.inc || exit /b 1
+%GLSLC% -mfmt=c Vulkan/Shaders/light_assign.comp -o Vulkan/Shaders/CompiledShaders/light_assign_comp.spv.inc || exit /b 1
+
+rem The Visual Studio pre-build step passes nopause so the build does not block.
+if not "%1"=="nopause" pause
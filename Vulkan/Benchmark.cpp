@@ -0,0 +1,736 @@
+// Headless benchmark for the renderer.
+//
+// Renders a fixed set of scenes offscreen for a fixed number of frames and reports the
+// CPU and GPU frame time distribution of each as JSON, plus the particle simulation time
+// and throughput for scenes with particles. Given a baseline report from an
+// earlier run it also compares the two and fails if any metric regressed past its threshold,
+// which makes it usable as a CI check (lavapipe works, see the 'bench' target in the Makefile).
+//
+// Everything that affects the work done is fixed up front: resolution, frame counts and the
+// scene contents, which come from a seeded generator. Two runs on the same machine draw exactly
+// the same thing, so differences come from the code being measured rather than the workload.
+
+#include <SDL2/SDL.h>
+#include <vulkan/vulkan.h>
+
+#include <algorithm>
+#include <cmath>
+#include <cstdlib>
+#include <cstring>
+#include <iostream>
+#include <random>
+#include <string>
+#include <vector>
+
+#include "HelloTriangleApp.h"
+#include "BenchmarkReport.h"
+#include "HeapTracking.h"
+
+struct BenchmarkScene
+{
+	const char* name;
+	u32 instanceCount;
+	float minScale;
+	float maxScale;
+
+	// 0 draws every instance in one draw. Otherwise the instances are split evenly into this many draws,
+	// each using one of 'permutationCount' pipelines at random, to exercise draw sorting.
+	u32 drawCount;
+	u32 permutationCount;
+
+	// Simulated on the compute queue alongside the scene's draws, 0 for none.
+	u32 particleCount;
+
+	// Draws every instance as the benchmark sphere, with LODs chosen per instance, instead of the triangle.
+	bool mesh;
+
+	// The first instances become a grid of this many large ones covering the screen in front of the rest,
+	// which hides nearly everything else from occlusion culling. 0 scatters every instance at random depths.
+	u32 occluderCount;
+
+	// Point lights scattered through the scene, lighting it through the light clusters.
+	u32 lightCount;
+};
+
+// From the original single triangle up to enough instances to make the vertex work dominate,
+// then many small draws that are dominated by per-draw and state change costs instead.
+// The particle scenes simulate on the compute queue while the 64k instance scene is drawn.
+// The mesh scenes span a wide range of sizes, so most of the LOD chain is in use at once.
+// The occluded scene hides almost everything behind a wall of spheres, the case occlusion culling is for.
+// The light scenes sweep the light count over the same large triangles, to show how the clusters scale.
+static const BenchmarkScene g_scenes[] =
+{
+	{ "triangle",        1,      1.0f,   1.0f,   0,    1, 0,       false, 0,  0 },
+	{ "instanced_1k",    1024,   0.02f,  0.08f,  0,    1, 0,       false, 0,  0 },
+	{ "instanced_64k",   65536,  0.01f,  0.03f,  0,    1, 0,       false, 0,  0 },
+	{ "instanced_256k",  262144, 0.005f, 0.015f, 0,    1, 0,       false, 0,  0 },
+	{ "many_draws_4k",   65536,  0.01f,  0.03f,  4096, 4, 0,       false, 0,  0 },
+	{ "particles_256k",  65536,  0.01f,  0.03f,  0,    1, 262144,  false, 0,  0 },
+	{ "particles_1m",    65536,  0.01f,  0.03f,  0,    1, 1048576, false, 0,  0 },
+	{ "mesh_lod_4k",     4096,   0.005f, 0.1f,   1,    1, 0,       true,  0,  0 },
+	{ "mesh_lod_64k",    65536,  0.002f, 0.03f,  1,    1, 0,       true,  0,  0 },
+	{ "occluded_64k",    65536,  0.01f,  0.03f,  1,    1, 0,       true,  64, 0 },
+	{ "lights_0",        4096,   0.05f,  0.15f,  0,    1, 0,       false, 0,  0 },
+	{ "lights_256",      4096,   0.05f,  0.15f,  0,    1, 0,       false, 0,  256 },
+	{ "lights_1k",       4096,   0.05f,  0.15f,  0,    1, 0,       false, 0,  1024 },
+	{ "lights_4k",       4096,   0.05f,  0.15f,  0,    1, 0,       false, 0,  4096 },
+	{ "lights_16k",      4096,   0.05f,  0.15f,  0,    1, 0,       false, 0,  16384 },
+};
+
+// Covers a cell of the occluder grid, corners included, whatever the cell's aspect on screen.
+constexpr float BENCHMARK_OCCLUDER_COVERAGE = 0.75f;
+
+// Detailed enough that the full mesh is far more than a small instance needs.
+constexpr u32 BENCHMARK_SPHERE_SEGMENTS = 64;
+constexpr u32 BENCHMARK_SPHERE_RINGS = 32;
+
+struct ViewSetup
+{
+	// Appended to the scene names, so each setup is compared with its own baseline.
+	const char* suffix;
+	u32 viewCount;
+	bool multiview;
+};
+
+// The single view setup is always run. The others compare drawing every view in one multiview pass
+// against recording the same draws in a pass per view.
+static const ViewSetup g_viewSetups[] =
+{
+	{ "",               1, true },
+	{ "views_2",        2, true },
+	{ "views_2_passes", 2, false },
+	{ "views_4",        4, true },
+	{ "views_4_passes", 4, false },
+};
+
+struct BenchmarkOptions
+{
+	u32 width{ 1280 };
+	u32 height{ 720 };
+	u32 warmupFrames{ 60 };
+	u32 measuredFrames{ 600 };
+	u32 seed{ 1234 };
+	std::vector<std::string> scenes;
+	std::string outputPath{ "benchmark.json" };
+	std::string baselinePath;
+	RegressionThresholds thresholds;
+
+	// Off by default, so the work per frame stays fixed.
+	DynamicResolutionSettings dynamicResolution;
+
+	// Off measures with the driver's own host allocations instead.
+	bool useHostAllocator{ true };
+
+	// Records every frame rendered, warmup included, for VulkanReplay. Empty for none.
+	std::string capturePath;
+
+	// Steady state frames must not allocate from the heap. When built with TRACK_HEAP_ALLOCATIONS
+	// a run fails if any measured frame does, unless this is set.
+	bool allowHeapAllocations{ false };
+
+	// See AppConfig::lodPixelError. 0 draws every mesh at full detail, for comparison.
+	float lodPixelError{ AppConfig{ }.lodPixelError };
+
+	// Off draws every instance, for comparison.
+	bool occlusionCulling{ AppConfig{ }.occlusionCulling };
+
+	// Off records a command per draw, for comparison.
+	bool multiDraw{ AppConfig{ }.multiDraw };
+
+	// Writes every frame rendered, warmup included, to a directory. Measures what dumping costs the frame loop.
+	FrameDumpSettings frameDump;
+
+	// See VulkanInit::DeviceSelection::preferred. Empty runs on the device scoring highest.
+	std::string device;
+
+	// Also runs every scene with several views, with and without multiview, see g_viewSetups.
+	bool viewSweep{ false };
+};
+
+static void printUsage()
+{
+	std::cout <<
+		"usage: VulkanBench [options]\n"
+		"  --frames <n>            measured frames per scene (default 600)\n"
+		"  --warmup <n>            unmeasured frames before each scene (default 60)\n"
+		"  --size <w> <h>          render resolution (default 1280 720)\n"
+		"  --seed <n>              seed for scene generation (default 1234)\n"
+		"  --scene <name>          only run this scene, may be repeated\n"
+		"  --output <path>         where to write the JSON report (default benchmark.json)\n"
+		"  --baseline <path>       compare against an earlier report, exit 1 on regression\n"
+		"  --threshold <pct>       allowed slowdown for every metric (default 10)\n"
+		"  --metric-threshold <metric> <pct>\n"
+		"                          allowed slowdown for one metric, e.g. gpu.p99 20\n"
+		"  --min-delta-ms <ms>     ignore slowdowns smaller than this (default 0.05)\n"
+		"  --target-ms <ms>        enable dynamic resolution, holding this GPU time per frame\n"
+		"  --scale-range <min> <max>\n"
+		"                          dynamic resolution scale limits (default 0.5 1.0)\n"
+		"  --capture <path>        record the run for VulkanReplay\n"
+		"  --no-host-allocator     leave host allocations to the driver\n"
+		"  --allow-heap-allocations\n"
+		"                          do not fail when measured frames allocate from the heap\n"
+		"  --lod-error <px>        screen space error allowed by mesh LODs, 0 disables them (default 1)\n"
+		"  --no-occlusion-culling  draw every instance, hidden or not\n"
+		"  --no-multi-draw         record a command per draw instead of merging them\n"
+		"  --dump-frames <dir>     write every frame to an existing directory as PNG\n"
+		"  --dump-raw              dump raw pixels instead of PNG\n"
+		"  --device <uuid|name>    run on the device with this UUID, or whose name contains this\n"
+		"  --view-sweep            also run every scene with 2 and 4 views, in one pass and a pass per view\n";
+}
+
+static bool parseArgs(int argc, char** argv, BenchmarkOptions& options)
+{
+	for (int i = 1; i < argc; i++)
+	{
+		std::string arg = argv[i];
+
+		// Number of values following the current flag that are still available.
+		int remaining = argc - i - 1;
+
+		if (arg == "--frames" && remaining >= 1)
+		{
+			options.measuredFrames = static_cast<u32>(std::strtoul(argv[++i], nullptr, 10));
+		}
+		else if (arg == "--warmup" && remaining >= 1)
+		{
+			options.warmupFrames = static_cast<u32>(std::strtoul(argv[++i], nullptr, 10));
+		}
+		else if (arg == "--size" && remaining >= 2)
+		{
+			options.width = static_cast<u32>(std::strtoul(argv[++i], nullptr, 10));
+			options.height = static_cast<u32>(std::strtoul(argv[++i], nullptr, 10));
+		}
+		else if (arg == "--seed" && remaining >= 1)
+		{
+			options.seed = static_cast<u32>(std::strtoul(argv[++i], nullptr, 10));
+		}
+		else if (arg == "--scene" && remaining >= 1)
+		{
+			options.scenes.push_back(argv[++i]);
+		}
+		else if (arg == "--output" && remaining >= 1)
+		{
+			options.outputPath = argv[++i];
+		}
+		else if (arg == "--baseline" && remaining >= 1)
+		{
+			options.baselinePath = argv[++i];
+		}
+		else if (arg == "--threshold" && remaining >= 1)
+		{
+			options.thresholds.percent = std::strtod(argv[++i], nullptr);
+		}
+		else if (arg == "--metric-threshold" && remaining >= 2)
+		{
+			std::string metric = argv[++i];
+			options.thresholds.perMetricPercent[metric] = std::strtod(argv[++i], nullptr);
+		}
+		else if (arg == "--min-delta-ms" && remaining >= 1)
+		{
+			options.thresholds.minDeltaMs = std::strtod(argv[++i], nullptr);
+		}
+		else if (arg == "--target-ms" && remaining >= 1)
+		{
+			options.dynamicResolution.enabled = true;
+			options.dynamicResolution.targetGpuMs = std::strtod(argv[++i], nullptr);
+		}
+		else if (arg == "--scale-range" && remaining >= 2)
+		{
+			options.dynamicResolution.minScale = std::strtof(argv[++i], nullptr);
+			options.dynamicResolution.maxScale = std::strtof(argv[++i], nullptr);
+		}
+		else if (arg == "--no-host-allocator")
+		{
+			options.useHostAllocator = false;
+		}
+		else if (arg == "--capture" && remaining >= 1)
+		{
+			options.capturePath = argv[++i];
+		}
+		else if (arg == "--allow-heap-allocations")
+		{
+			options.allowHeapAllocations = true;
+		}
+		else if (arg == "--lod-error" && remaining >= 1)
+		{
+			options.lodPixelError = std::strtof(argv[++i], nullptr);
+		}
+		else if (arg == "--no-occlusion-culling")
+		{
+			options.occlusionCulling = false;
+		}
+		else if (arg == "--no-multi-draw")
+		{
+			options.multiDraw = false;
+		}
+		else if (arg == "--dump-frames" && remaining >= 1)
+		{
+			options.frameDump.directory = argv[++i];
+		}
+		else if (arg == "--dump-raw")
+		{
+			options.frameDump.format = FrameDumpFormat::Raw;
+		}
+		else if (arg == "--device" && remaining >= 1)
+		{
+			options.device = argv[++i];
+		}
+		else if (arg == "--view-sweep")
+		{
+			options.viewSweep = true;
+		}
+		else
+		{
+			std::cerr << "unknown or incomplete option " << arg << std::endl;
+			return false;
+		}
+	}
+
+	if (options.measuredFrames == 0 || options.width == 0 || options.height == 0)
+	{
+		std::cerr << "frames, width and height must be non-zero" << std::endl;
+		return false;
+	}
+
+	return true;
+}
+
+static std::vector<InstanceData> generateInstances(const BenchmarkScene& scene, u32 seed)
+{
+	// The standard distributions are implementation defined, so they can give different scenes
+	// with different standard libraries. mt19937's raw output is fully specified, so build the
+	// floats from its bits directly.
+	std::mt19937 rng(seed);
+	auto unitFloat = [&rng]() { return static_cast<float>(rng() >> 8) * (1.0f / 16777216.0f); };
+
+	std::vector<InstanceData> instances(scene.instanceCount);
+
+	if (scene.instanceCount == 1)
+	{
+		instances[0] = { { 0.0f, 0.0f }, scene.maxScale, 0.0f };
+		return instances;
+	}
+
+	// Everything else is kept behind the occluders.
+	const float minDepth = scene.occluderCount > 0 ? 0.2f : 0.0f;
+
+	for (InstanceData& instance : instances)
+	{
+		instance.offset[0] = unitFloat() * 2.0f - 1.0f;
+		instance.offset[1] = unitFloat() * 2.0f - 1.0f;
+		instance.scale = scene.minScale + unitFloat() * (scene.maxScale - scene.minScale);
+		instance.depth = minDepth + unitFloat() * (1.0f - minDepth);
+	}
+
+	// A square grid of overlapping instances, all nearer than the rest.
+	const u32 gridSize = static_cast<u32>(std::sqrt(static_cast<float>(scene.occluderCount)));
+	const float cellSize = 2.0f / static_cast<float>(std::max(gridSize, 1u));
+
+	for (u32 i = 0; i < gridSize * gridSize; i++)
+	{
+		InstanceData& occluder = instances[i];
+		occluder.offset[0] = -1.0f + (static_cast<float>(i % gridSize) + 0.5f) * cellSize;
+		occluder.offset[1] = -1.0f + (static_cast<float>(i / gridSize) + 0.5f) * cellSize;
+		occluder.scale = cellSize * BENCHMARK_OCCLUDER_COVERAGE;
+		occluder.depth = 0.05f + unitFloat() * 0.1f;
+	}
+
+	return instances;
+}
+
+static std::vector<SceneDraw> generateDraws(const BenchmarkScene& scene, u32 seed, u32 sphereMesh)
+{
+	std::vector<SceneDraw> draws;
+
+	if (scene.drawCount == 0)
+	{
+		return draws;
+	}
+
+	// Same approach as generateInstances, with a different stream so the two do not correlate.
+	std::mt19937 rng(seed ^ 0x9E3779B9u);
+	auto unitFloat = [&rng]() { return static_cast<float>(rng() >> 8) * (1.0f / 16777216.0f); };
+
+	std::vector<TrianglePermutation> permutations(scene.permutationCount);
+	for (u32 i = 0; i < scene.permutationCount; i++)
+	{
+		permutations[i].Set<Brightness>(1.0f - 0.1f * static_cast<float>(i));
+	}
+
+	u32 instancesPerDraw = scene.instanceCount / scene.drawCount;
+	draws.resize(scene.drawCount);
+
+	for (u32 i = 0; i < scene.drawCount; i++)
+	{
+		draws[i].permutation = permutations[rng() % scene.permutationCount];
+		draws[i].firstInstance = i * instancesPerDraw;
+		draws[i].instanceCount = instancesPerDraw;
+		draws[i].depth = unitFloat();
+		draws[i].mesh = scene.mesh ? sphereMesh : NO_MESH;
+	}
+
+	return draws;
+}
+
+static std::vector<PointLight> generateLights(const BenchmarkScene& scene, u32 seed)
+{
+	std::vector<PointLight> lights(scene.lightCount);
+
+	// Yet another stream, so adding lights to a scene does not move its instances.
+	std::mt19937 rng(seed ^ 0x85EBCA6Bu);
+	auto unitFloat = [&rng]() { return static_cast<float>(rng() >> 8) * (1.0f / 16777216.0f); };
+
+	// Dim enough that the brightest spots, where dozens overlap, do not all saturate.
+	for (PointLight& light : lights)
+	{
+		light.position[0] = unitFloat() * 2.0f - 1.0f;
+		light.position[1] = unitFloat() * 2.0f - 1.0f;
+		light.position[2] = unitFloat();
+		light.radius = 0.05f + unitFloat() * 0.1f;
+		light.color[0] = unitFloat() * 0.5f;
+		light.color[1] = unitFloat() * 0.5f;
+		light.color[2] = unitFloat() * 0.5f;
+		light.padding = 0.0f;
+	}
+
+	return lights;
+}
+
+// A stereo pair over the whole scene, then monitoring views magnifying two of its corners.
+static std::vector<CameraView> generateViews(u32 viewCount)
+{
+	static const CameraView views[MAX_VIEWS] =
+	{
+		{ { -0.02f, 0.0f }, 1.0f },
+		{ { 0.02f, 0.0f }, 1.0f },
+		{ { -0.5f, 0.5f }, 2.0f },
+		{ { 0.5f, -0.5f }, 2.0f },
+	};
+
+	if (viewCount == 1)
+	{
+		return { CameraView{ } };
+	}
+
+	return std::vector<CameraView>(views, views + viewCount);
+}
+
+static bool sceneSelected(const BenchmarkOptions& options, const char* name)
+{
+	if (options.scenes.empty())
+	{
+		return true;
+	}
+
+	for (const std::string& selected : options.scenes)
+	{
+		if (selected == name)
+		{
+			return true;
+		}
+	}
+
+	return false;
+}
+
+// Runs every selected scene on an app that has just been initialised, adding their results to the report.
+// The names of the results have the setup's suffix appended.
+static void runScenes(HelloTriangleApp& app, const BenchmarkOptions& options, const ViewSetup& setup, BenchmarkReport& report,
+	u64& totalHeapAllocations)
+{
+	const u32 sphereMesh = app.AddMesh(CreateSphereMesh(BENCHMARK_SPHERE_SEGMENTS, BENCHMARK_SPHERE_RINGS));
+
+	FrameTimings timings;
+	timings.cpuMs.reserve(options.measuredFrames);
+	timings.gpuMs.reserve(options.measuredFrames);
+	timings.computeMs.reserve(options.measuredFrames);
+
+	app.SetViews(generateViews(setup.viewCount));
+
+	for (const BenchmarkScene& scene : g_scenes)
+	{
+		if (!sceneSelected(options, scene.name))
+		{
+			continue;
+		}
+
+		app.SetInstances(generateInstances(scene, options.seed));
+		app.SetDraws(generateDraws(scene, options.seed, sphereMesh));
+		app.SetParticles(scene.particleCount, options.seed);
+		app.SetLights(generateLights(scene, options.seed));
+
+		// Warm up caches, clocks and any lazily created driver state before measuring.
+		for (u32 i = 0; i < options.warmupFrames; i++)
+		{
+			app.DrawFrame();
+		}
+		app.WaitIdle();
+
+		timings.Clear();
+		app.SetFrameTimings(&timings);
+
+		const u64 hostAllocationsBefore = app.GetHostAllocationStats().TotalAllocations();
+		const FrameDumpStats frameDumpsBefore = app.GetFrameDumpStats();
+
+		// Frames are drawn on this thread, so its count is what they allocate. Driver threads are not included.
+		u64 heapAllocations = 0;
+		u32 allocatingFrames = 0;
+
+		for (u32 i = 0; i < options.measuredFrames; i++)
+		{
+			const u64 heapAllocationsBefore = GetThreadHeapAllocationCount();
+
+			app.DrawFrame();
+
+			const u64 frameHeapAllocations = GetThreadHeapAllocationCount() - heapAllocationsBefore;
+			heapAllocations += frameHeapAllocations;
+			allocatingFrames += frameHeapAllocations > 0;
+		}
+
+		totalHeapAllocations += heapAllocations;
+
+		// Collects the GPU times of the last frames still in flight.
+		app.WaitIdle();
+		app.SetFrameTimings(nullptr);
+
+		// Steady state frames should not need the driver to allocate at all, so this is a total rather than a rate.
+		HostAllocationStats hostAllocations = app.GetHostAllocationStats();
+		const u64 frameHostAllocations = hostAllocations.TotalAllocations() - hostAllocationsBefore;
+
+		SceneResult result;
+		result.name = scene.name;
+		if (setup.suffix[0] != '\0')
+		{
+			result.name = result.name + "/" + setup.suffix;
+		}
+		result.instanceCount = scene.instanceCount;
+		result.cpu = ComputeStats(timings.cpuMs);
+		result.gpu = ComputeStats(timings.gpuMs);
+		result.compute = ComputeStats(timings.computeMs);
+
+		// The scene is static, so the last frame's counts are every frame's counts.
+		const DrawStats& drawStats = app.GetDrawStats();
+		result.counters =
+		{
+			{ "draws", drawStats.draws },
+			{ "indirect_draws", drawStats.indirectDraws },
+			{ "draw_commands", drawStats.drawCommands },
+			{ "pipeline_binds", drawStats.pipelineBinds },
+			{ "descriptor_set_binds", drawStats.descriptorSetBinds },
+			{ "vertex_buffer_binds", drawStats.vertexBufferBinds },
+			{ "index_buffer_binds", drawStats.indexBufferBinds },
+			{ "unsorted_binds", drawStats.unsortedBinds },
+			{ "triangles", drawStats.triangles },
+		};
+
+		if (options.useHostAllocator)
+		{
+			result.counters.emplace_back("host_allocations", frameHostAllocations);
+			result.counters.emplace_back("host_memory_kb", hostAllocations.TotalLiveBytes() / 1024);
+		}
+
+		result.counters.emplace_back("frame_memory_kb", app.GetFrameMemoryPeak() / 1024);
+
+		// Whether the views were drawn in one pass, which falls back to a pass per view where the device cannot.
+		if (setup.viewCount > 1)
+		{
+			result.counters.emplace_back("views", setup.viewCount);
+			result.counters.emplace_back("multiview", app.IsMultiviewEnabled() ? 1 : 0);
+		}
+
+		// Read back from a frame or two before the last, which for a static scene is the same.
+		if (app.IsOcclusionCullingEnabled())
+		{
+			const OcclusionStats& occlusionStats = app.GetOcclusionStats();
+			result.counters.emplace_back("occlusion_tested", occlusionStats.tested);
+			result.counters.emplace_back("occlusion_drawn_early", occlusionStats.drawnEarly);
+			result.counters.emplace_back("occlusion_drawn_late", occlusionStats.drawnLate);
+			result.counters.emplace_back("occlusion_culled", occlusionStats.Culled());
+		}
+
+		if (scene.lightCount > 0)
+		{
+			const LightingStats& lightingStats = app.GetLightingStats();
+			result.counters.emplace_back("lights", lightingStats.lights);
+			result.counters.emplace_back("cluster_lights", lightingStats.assignedLights);
+			result.counters.emplace_back("cluster_lights_max", lightingStats.maxClusterLights);
+			result.counters.emplace_back("cluster_overflows", lightingStats.overflowedClusters);
+		}
+
+		if (HEAP_TRACKING_ENABLED)
+		{
+			result.counters.emplace_back("heap_allocations", heapAllocations);
+		}
+
+		// Dropped frames mean the encoders could not keep up with the frame rate.
+		if (!options.frameDump.directory.empty())
+		{
+			const FrameDumpStats frameDumps = app.GetFrameDumpStats();
+			result.counters.emplace_back("frames_dumped", frameDumps.copied - frameDumpsBefore.copied);
+			result.counters.emplace_back("frames_dropped", frameDumps.dropped - frameDumpsBefore.dropped);
+		}
+
+		// Where dynamic resolution settled by the end of the scene.
+		if (options.dynamicResolution.enabled)
+		{
+			result.counters.emplace_back("render_width", app.GetRenderExtent().width);
+			result.counters.emplace_back("render_height", app.GetRenderExtent().height);
+		}
+
+		if (scene.particleCount > 0 && result.compute.p50 > 0.0)
+		{
+			// Throughput from the median rather than the mean, so a few slow frames do not skew it.
+			result.counters.emplace_back("particles", scene.particleCount);
+			result.counters.emplace_back("particles_per_ms", static_cast<u64>(scene.particleCount / result.compute.p50));
+		}
+
+		report.scenes.push_back(result);
+
+		std::cout << result.name << ": cpu mean " << result.cpu.mean << " ms p99 " << result.cpu.p99 << " ms";
+		if (result.gpu.count > 0)
+		{
+			std::cout << ", gpu mean " << result.gpu.mean << " ms p99 " << result.gpu.p99 << " ms";
+		}
+		std::cout << ", " << drawStats.TotalBinds() << " binds for " << drawStats.draws << " draws (" << drawStats.unsortedBinds << " unsorted) in "
+			<< drawStats.drawCommands << " commands";
+		if (options.useHostAllocator)
+		{
+			std::cout << ", " << frameHostAllocations << " host allocations";
+		}
+		if (HEAP_TRACKING_ENABLED)
+		{
+			std::cout << ", " << heapAllocations << " heap allocations in " << allocatingFrames << " frames";
+		}
+		if (scene.particleCount > 0 && result.compute.p50 > 0.0)
+		{
+			std::cout << ", particles " << result.compute.p50 << " ms p50, " << static_cast<u64>(scene.particleCount / result.compute.p50) << " particles/ms";
+		}
+		std::cout << std::endl;
+	}
+}
+
+int main(int argc, char** argv)
+{
+	BenchmarkOptions options;
+
+	if (argc > 1 && (std::strcmp(argv[1], "--help") == 0 || std::strcmp(argv[1], "-h") == 0))
+	{
+		printUsage();
+		return EXIT_SUCCESS;
+	}
+
+	if (!parseArgs(argc, argv, options))
+	{
+		printUsage();
+		return EXIT_FAILURE;
+	}
+
+	AppConfig config;
+	config.headless = true;
+	config.width = options.width;
+	config.height = options.height;
+	config.dynamicResolution = options.dynamicResolution;
+	config.capturePath = options.capturePath;
+	config.useHostAllocator = options.useHostAllocator;
+	config.lodPixelError = options.lodPixelError;
+	config.occlusionCulling = options.occlusionCulling;
+	config.multiDraw = options.multiDraw;
+	config.frameDump = options.frameDump;
+	config.deviceSelection.preferred = options.device;
+
+	// Room for the scene with the most lights.
+	for (const BenchmarkScene& scene : g_scenes)
+	{
+		config.maxLights = std::max(config.maxLights, scene.lightCount);
+	}
+
+	BenchmarkReport report;
+	report.width = options.width;
+	report.height = options.height;
+	report.warmupFrames = options.warmupFrames;
+	report.measuredFrames = options.measuredFrames;
+
+	// Capturing writes every frame out as it goes, which is allowed to allocate.
+	const bool checkHeapAllocations = HEAP_TRACKING_ENABLED && !options.allowHeapAllocations && options.capturePath.empty();
+	u64 totalHeapAllocations = 0;
+
+	try
+	{
+		for (const ViewSetup& setup : g_viewSetups)
+		{
+			if (!options.viewSweep && setup.viewCount > 1)
+			{
+				continue;
+			}
+
+			// The view count shapes the render targets and passes, so each setup gets an app of its own.
+			config.viewCount = setup.viewCount;
+			config.multiview = setup.multiview;
+
+			// A capture replays a single view, so only the first setup records one.
+			if (setup.viewCount > 1)
+			{
+				config.capturePath.clear();
+			}
+
+			HelloTriangleApp app(config);
+			app.Init();
+
+			report.device = app.GetDeviceName();
+			std::cout << "Benchmarking on " << report.device << " at " << options.width << "x" << options.height;
+			if (setup.viewCount > 1)
+			{
+				std::cout << " with " << setup.viewCount << " views" << (app.IsMultiviewEnabled() ? " (multiview)" : " (a pass per view)");
+			}
+			std::cout << std::endl;
+
+			runScenes(app, options, setup, report, totalHeapAllocations);
+
+			app.Shutdown();
+
+			// Every setup picks the same device, it only needs listing once.
+			config.deviceSelection.log = false;
+		}
+	}
+	catch (const std::exception& e)
+	{
+		std::cerr << e.what() << std::endl;
+		return EXIT_FAILURE;
+	}
+
+	if (!WriteReportJson(report, options.outputPath))
+	{
+		std::cerr << "failed to write " << options.outputPath << std::endl;
+		return EXIT_FAILURE;
+	}
+
+	std::cout << "Wrote " << options.outputPath << std::endl;
+
+	if (checkHeapAllocations && totalHeapAllocations > 0)
+	{
+		std::cerr << totalHeapAllocations << " heap allocation(s) in measured frames, steady state frames must not allocate" << std::endl;
+		return EXIT_FAILURE;
+	}
+
+	if (options.baselinePath.empty())
+	{
+		return EXIT_SUCCESS;
+	}
+
+	BenchmarkReport baseline;
+	if (!ReadReportJson(options.baselinePath, baseline))
+	{
+		std::cerr << "failed to read baseline " << options.baselinePath << std::endl;
+		return EXIT_FAILURE;
+	}
+
+	u32 regressions = CompareReports(baseline, report, options.thresholds, std::cout);
+	if (regressions > 0)
+	{
+		std::cout << regressions << " metric(s) regressed against " << options.baselinePath << std::endl;
+		return EXIT_FAILURE;
+	}
+
+	std::cout << "No regressions against " << options.baselinePath << std::endl;
+	return EXIT_SUCCESS;
+}
@@ -0,0 +1,467 @@
+#include "BenchmarkReport.h"
+
+#include <algorithm>
+#include <cctype>
+#include <cmath>
+#include <cstdlib>
+#include <fstream>
+#include <iomanip>
+#include <iostream>
+#include <numeric>
+#include <sstream>
+
+MetricStats ComputeStats(std::vector<double> samples)
+{
+	MetricStats stats;
+
+	if (samples.empty())
+	{
+		return stats;
+	}
+
+	std::sort(samples.begin(), samples.end());
+
+	auto percentile = [&samples](double p)
+	{
+		// Nearest rank: the smallest sample with at least p% of the samples at or below it.
+		size_t rank = static_cast<size_t>(std::ceil(p / 100.0 * samples.size()));
+		return samples[std::clamp<size_t>(rank, 1, samples.size()) - 1];
+	};
+
+	stats.count = static_cast<u32>(samples.size());
+	stats.mean = std::accumulate(samples.begin(), samples.end(), 0.0) / samples.size();
+	stats.p50 = percentile(50.0);
+	stats.p95 = percentile(95.0);
+	stats.p99 = percentile(99.0);
+	stats.min = samples.front();
+	stats.max = samples.back();
+
+	return stats;
+}
+
+void WriteStatsJson(std::ostream& out, const MetricStats& stats)
+{
+	if (stats.count == 0)
+	{
+		out << "null";
+		return;
+	}
+
+	out << "{ \"count\": " << stats.count
+		<< ", \"mean\": " << stats.mean
+		<< ", \"p50\": " << stats.p50
+		<< ", \"p95\": " << stats.p95
+		<< ", \"p99\": " << stats.p99
+		<< ", \"min\": " << stats.min
+		<< ", \"max\": " << stats.max << " }";
+}
+
+static std::string escapeJson(const std::string& text)
+{
+	std::string escaped;
+	for (char c : text)
+	{
+		if (c == '"' || c == '\\')
+		{
+			escaped += '\\';
+		}
+		escaped += c;
+	}
+	return escaped;
+}
+
+bool WriteReportJson(const BenchmarkReport& report, const std::string& path)
+{
+	std::ofstream file(path);
+	if (!file.is_open())
+	{
+		return false;
+	}
+
+	// Nanosecond resolution, which is finer than either the CPU or GPU timers are accurate to.
+	file << std::setprecision(6) << std::fixed;
+
+	file << "{\n";
+	file << "\t\"device\": \"" << escapeJson(report.device) << "\",\n";
+	file << "\t\"width\": " << report.width << ",\n";
+	file << "\t\"height\": " << report.height << ",\n";
+	file << "\t\"warmup_frames\": " << report.warmupFrames << ",\n";
+	file << "\t\"measured_frames\": " << report.measuredFrames << ",\n";
+	file << "\t\"scenes\": [\n";
+
+	for (size_t i = 0; i < report.scenes.size(); i++)
+	{
+		const SceneResult& scene = report.scenes[i];
+
+		file << "\t\t{\n";
+		file << "\t\t\t\"name\": \"" << escapeJson(scene.name) << "\",\n";
+		file << "\t\t\t\"instances\": " << scene.instanceCount << ",\n";
+		file << "\t\t\t\"cpu_ms\": ";
+		WriteStatsJson(file, scene.cpu);
+		file << ",\n";
+		file << "\t\t\t\"gpu_ms\": ";
+		WriteStatsJson(file, scene.gpu);
+		file << ",\n";
+		file << "\t\t\t\"compute_ms\": ";
+		WriteStatsJson(file, scene.compute);
+		file << ",\n";
+		file << "\t\t\t\"counters\": {";
+		for (size_t c = 0; c < scene.counters.size(); c++)
+		{
+			file << (c > 0 ? ", " : " ") << "\"" << escapeJson(scene.counters[c].first) << "\": " << scene.counters[c].second;
+		}
+		file << (scene.counters.empty() ? "}" : " }") << "\n";
+		file << "\t\t}" << (i + 1 < report.scenes.size() ? "," : "") << "\n";
+	}
+
+	file << "\t]\n";
+	file << "}\n";
+
+	return file.good();
+}
+
+// A small JSON reader, just enough to load reports back in for comparison.
+// Keeps the benchmark free of third party dependencies.
+namespace
+{
+	struct JsonValue
+	{
+		enum class Type { Null, Bool, Number, String, Array, Object };
+
+		Type type{ Type::Null };
+		bool boolean{ false };
+		double number{ 0.0 };
+		std::string string;
+		std::vector<JsonValue> array;
+		std::vector<std::pair<std::string, JsonValue>> object;
+
+		const JsonValue* Find(const std::string& key) const
+		{
+			for (const auto& [name, value] : object)
+			{
+				if (name == key)
+				{
+					return &value;
+				}
+			}
+			return nullptr;
+		}
+
+		double NumberOr(const std::string& key, double fallback) const
+		{
+			const JsonValue* value = Find(key);
+			return value != nullptr && value->type == Type::Number ? value->number : fallback;
+		}
+
+		std::string StringOr(const std::string& key, const std::string& fallback) const
+		{
+			const JsonValue* value = Find(key);
+			return value != nullptr && value->type == Type::String ? value->string : fallback;
+		}
+	};
+
+	class JsonParser
+	{
+	public:
+		explicit JsonParser(const std::string& text) : m_text(text) {}
+
+		bool Parse(JsonValue& value)
+		{
+			return parseValue(value) && (skipWhitespace(), m_pos == m_text.size());
+		}
+
+	private:
+		void skipWhitespace()
+		{
+			while (m_pos < m_text.size() && std::isspace(static_cast<unsigned char>(m_text[m_pos])))
+			{
+				m_pos++;
+			}
+		}
+
+		bool consume(char c)
+		{
+			skipWhitespace();
+			if (m_pos < m_text.size() && m_text[m_pos] == c)
+			{
+				m_pos++;
+				return true;
+			}
+			return false;
+		}
+
+		bool consumeWord(const char* word)
+		{
+			size_t length = std::char_traits<char>::length(word);
+			if (m_text.compare(m_pos, length, word) == 0)
+			{
+				m_pos += length;
+				return true;
+			}
+			return false;
+		}
+
+		bool parseString(std::string& out)
+		{
+			if (!consume('"'))
+			{
+				return false;
+			}
+
+			while (m_pos < m_text.size() && m_text[m_pos] != '"')
+			{
+				if (m_text[m_pos] == '\\' && m_pos + 1 < m_text.size())
+				{
+					m_pos++;
+				}
+				out += m_text[m_pos++];
+			}
+
+			return consume('"');
+		}
+
+		bool parseValue(JsonValue& value)
+		{
+			skipWhitespace();
+			if (m_pos >= m_text.size())
+			{
+				return false;
+			}
+
+			char c = m_text[m_pos];
+			if (c == '{')
+			{
+				value.type = JsonValue::Type::Object;
+				m_pos++;
+				if (consume('}'))
+				{
+					return true;
+				}
+				do
+				{
+					std::pair<std::string, JsonValue> member;
+					if (!parseString(member.first) || !consume(':') || !parseValue(member.second))
+					{
+						return false;
+					}
+					value.object.push_back(std::move(member));
+				} while (consume(','));
+				return consume('}');
+			}
+			else if (c == '[')
+			{
+				value.type = JsonValue::Type::Array;
+				m_pos++;
+				if (consume(']'))
+				{
+					return true;
+				}
+				do
+				{
+					value.array.emplace_back();
+					if (!parseValue(value.array.back()))
+					{
+						return false;
+					}
+				} while (consume(','));
+				return consume(']');
+			}
+			else if (c == '"')
+			{
+				value.type = JsonValue::Type::String;
+				return parseString(value.string);
+			}
+			else if (consumeWord("null"))
+			{
+				value.type = JsonValue::Type::Null;
+				return true;
+			}
+			else if (consumeWord("true"))
+			{
+				value.type = JsonValue::Type::Bool;
+				value.boolean = true;
+				return true;
+			}
+			else if (consumeWord("false"))
+			{
+				value.type = JsonValue::Type::Bool;
+				return true;
+			}
+
+			const char* start = m_text.c_str() + m_pos;
+			char* end = nullptr;
+			value.number = std::strtod(start, &end);
+			if (end == start)
+			{
+				return false;
+			}
+			value.type = JsonValue::Type::Number;
+			m_pos += end - start;
+			return true;
+		}
+
+		const std::string& m_text;
+		size_t m_pos{ 0 };
+	};
+
+	MetricStats readStats(const JsonValue* value)
+	{
+		MetricStats stats;
+
+		if (value == nullptr || value->type != JsonValue::Type::Object)
+		{
+			return stats;
+		}
+
+		stats.count = static_cast<u32>(value->NumberOr("count", 0.0));
+		stats.mean = value->NumberOr("mean", 0.0);
+		stats.p50 = value->NumberOr("p50", 0.0);
+		stats.p95 = value->NumberOr("p95", 0.0);
+		stats.p99 = value->NumberOr("p99", 0.0);
+		stats.min = value->NumberOr("min", 0.0);
+		stats.max = value->NumberOr("max", 0.0);
+
+		return stats;
+	}
+}
+
+bool ReadReportJson(const std::string& path, BenchmarkReport& report)
+{
+	std::ifstream file(path);
+	if (!file.is_open())
+	{
+		return false;
+	}
+
+	std::stringstream contents;
+	contents << file.rdbuf();
+	std::string text = contents.str();
+
+	JsonValue root;
+	if (!JsonParser(text).Parse(root) || root.type != JsonValue::Type::Object)
+	{
+		return false;
+	}
+
+	report = BenchmarkReport{ };
+	report.device = root.StringOr("device", "");
+	report.width = static_cast<u32>(root.NumberOr("width", 0.0));
+	report.height = static_cast<u32>(root.NumberOr("height", 0.0));
+	report.warmupFrames = static_cast<u32>(root.NumberOr("warmup_frames", 0.0));
+	report.measuredFrames = static_cast<u32>(root.NumberOr("measured_frames", 0.0));
+
+	const JsonValue* scenes = root.Find("scenes");
+	if (scenes == nullptr || scenes->type != JsonValue::Type::Array)
+	{
+		return false;
+	}
+
+	for (const JsonValue& sceneValue : scenes->array)
+	{
+		SceneResult scene;
+		scene.name = sceneValue.StringOr("name", "");
+		scene.instanceCount = static_cast<u32>(sceneValue.NumberOr("instances", 0.0));
+		scene.cpu = readStats(sceneValue.Find("cpu_ms"));
+		scene.gpu = readStats(sceneValue.Find("gpu_ms"));
+		scene.compute = readStats(sceneValue.Find("compute_ms"));
+
+		const JsonValue* counters = sceneValue.Find("counters");
+		if (counters != nullptr && counters->type == JsonValue::Type::Object)
+		{
+			for (const auto& [name, value] : counters->object)
+			{
+				scene.counters.emplace_back(name, static_cast<u64>(value.number));
+			}
+		}
+		report.scenes.push_back(scene);
+	}
+
+	return true;
+}
+
+u32 CompareReports(const BenchmarkReport& baseline, const BenchmarkReport& current, const RegressionThresholds& thresholds, std::ostream& out)
+{
+	u32 regressions = 0;
+
+	if (baseline.device != current.device)
+	{
+		out << "warning: baseline was recorded on '" << baseline.device << "', this run is on '" << current.device << "'\n";
+	}
+
+	if (baseline.width != current.width || baseline.height != current.height || baseline.measuredFrames != current.measuredFrames)
+	{
+		out << "warning: baseline resolution or frame count differs from this run\n";
+	}
+
+	out << std::fixed << std::setprecision(4);
+
+	for (const SceneResult& scene : current.scenes)
+	{
+		auto it = std::find_if(baseline.scenes.begin(), baseline.scenes.end(),
+			[&scene](const SceneResult& other) { return other.name == scene.name; });
+
+		if (it == baseline.scenes.end())
+		{
+			out << scene.name << ": not in baseline\n";
+			continue;
+		}
+
+		out << scene.name << ":\n";
+
+		auto compareMetric = [&](const char* metric, const MetricStats& before, const MetricStats& after)
+		{
+			if (before.count == 0 || after.count == 0)
+			{
+				return;
+			}
+
+			const std::pair<const char*, double> values[] =
+			{
+				{ "mean", after.mean - before.mean },
+				{ "p50", after.p50 - before.p50 },
+				{ "p95", after.p95 - before.p95 },
+				{ "p99", after.p99 - before.p99 },
+			};
+			const double baseValues[] = { before.mean, before.p50, before.p95, before.p99 };
+
+			for (size_t i = 0; i < std::size(values); i++)
+			{
+				std::string key = std::string(metric) + "." + values[i].first;
+
+				auto overrideIt = thresholds.perMetricPercent.find(key);
+				double allowedPercent = overrideIt != thresholds.perMetricPercent.end() ? overrideIt->second : thresholds.percent;
+
+				double delta = values[i].second;
+				double percent = baseValues[i] > 0.0 ? delta / baseValues[i] * 100.0 : 0.0;
+				bool regressed = percent > allowedPercent && delta > thresholds.minDeltaMs;
+
+				out << "  " << std::left << std::setw(10) << key << std::right
+					<< std::setw(10) << baseValues[i] << " -> " << std::setw(10) << baseValues[i] + delta << " ms"
+					<< "  (" << std::showpos << percent << std::noshowpos << "%)"
+					<< (regressed ? "  REGRESSION" : "") << "\n";
+
+				if (regressed)
+				{
+					regressions++;
+				}
+			}
+		};
+
+		compareMetric("cpu", it->cpu, scene.cpu);
+		compareMetric("gpu", it->gpu, scene.gpu);
+		compareMetric("compute", it->compute, scene.compute);
+	}
+
+	for (const SceneResult& scene : baseline.scenes)
+	{
+		auto it = std::find_if(current.scenes.begin(), current.scenes.end(),
+			[&scene](const SceneResult& other) { return other.name == scene.name; });
+
+		if (it == current.scenes.end())
+		{
+			out << scene.name << ": in baseline but not run\n";
+		}
+	}
+
+	return regressions;
+}
@@ -0,0 +1,72 @@
+#pragma once
+
+#include <iosfwd>
+#include <map>
+#include <string>
+#include <utility>
+#include <vector>
+
+#include "Types.h"
+
+// Summary statistics over one metric's per-frame samples, in milliseconds.
+struct MetricStats
+{
+	u32 count{ 0 };
+	double mean{ 0.0 };
+	double p50{ 0.0 };
+	double p95{ 0.0 };
+	double p99{ 0.0 };
+	double min{ 0.0 };
+	double max{ 0.0 };
+};
+
+struct SceneResult
+{
+	std::string name;
+	u32 instanceCount{ 0 };
+	MetricStats cpu;
+	// Empty (count 0) when the device does not support timestamps on the graphics queue.
+	MetricStats gpu;
+	// Particle simulation time on the compute queue. Empty for scenes without particles.
+	MetricStats compute;
+
+	// Per frame counts such as state changes, reported alongside the timings but not compared.
+	std::vector<std::pair<std::string, u64>> counters;
+};
+
+struct BenchmarkReport
+{
+	std::string device;
+	u32 width{ 0 };
+	u32 height{ 0 };
+	u32 warmupFrames{ 0 };
+	u32 measuredFrames{ 0 };
+	std::vector<SceneResult> scenes;
+};
+
+// How much slower a metric may get before it counts as a regression.
+// A metric regresses only if it is both 'percent' slower and 'minDeltaMs' slower than the baseline,
+// so tiny timings (e.g. a 0.01ms GPU frame on a fast card) do not trip the check on noise alone.
+struct RegressionThresholds
+{
+	double percent{ 10.0 };
+	double minDeltaMs{ 0.05 };
+
+	// Per metric overrides of 'percent', keyed as "cpu.p95", "gpu.mean", "compute.p99" and so on.
+	std::map<std::string, double> perMetricPercent;
+};
+
+// Percentiles use the nearest rank method, so they are always one of the samples.
+MetricStats ComputeStats(std::vector<double> samples);
+
+// Writes the stats as a single line JSON object, or null if there are no samples.
+void WriteStatsJson(std::ostream& out, const MetricStats& stats);
+
+bool WriteReportJson(const BenchmarkReport& report, const std::string& path);
+
+// Only understands the layout written by WriteReportJson.
+bool ReadReportJson(const std::string& path, BenchmarkReport& report);
+
+// Prints a per scene comparison to 'out' and returns the number of regressed metrics.
+// Scenes missing from either report are reported but not counted as regressions.
+u32 CompareReports(const BenchmarkReport& baseline, const BenchmarkReport& current, const RegressionThresholds& thresholds, std::ostream& out);
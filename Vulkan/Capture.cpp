@@ -0,0 +1,441 @@
+#include "Capture.h"
+
+#include <cstring>
+#include <stdexcept>
+
+bool CaptureWriter::Open(const std::string& path, const CaptureHeader& header)
+{
+	Close();
+
+	m_file.open(path, std::ios::binary | std::ios::trunc);
+	if (!m_file.is_open())
+	{
+		return false;
+	}
+
+	m_lastId = 0;
+	m_frameCount = 0;
+	m_bufferIds.clear();
+	m_shaderModuleIds.clear();
+	m_pipelineIds.clear();
+	m_descriptorSetIds.clear();
+
+	// The header is written straight out, it is not a record.
+	m_record.clear();
+	put(CAPTURE_MAGIC);
+	put(CAPTURE_VERSION);
+	put(static_cast<u32>(header.device.size()));
+	putBytes(header.device.data(), header.device.size());
+	put(header.width);
+	put(header.height);
+	put(static_cast<u32>(header.colorFormat));
+	m_file.write(reinterpret_cast<const char*>(m_record.data()), m_record.size());
+
+	return m_file.good();
+}
+
+void CaptureWriter::Close()
+{
+	if (m_file.is_open())
+	{
+		m_file.close();
+	}
+}
+
+void CaptureWriter::AddBuffer(VkBuffer buffer, VkDeviceSize size, VkBufferUsageFlags usage, VkMemoryPropertyFlags memoryProperties, const void* data)
+{
+	u32 id = assignId(m_bufferIds, buffer);
+
+	beginRecord(CaptureRecordType::Buffer);
+	put(id);
+	put(static_cast<u64>(size));
+	put(static_cast<u32>(usage));
+	put(static_cast<u32>(memoryProperties));
+	put(static_cast<u64>(data != nullptr ? size : 0));
+	if (data != nullptr)
+	{
+		putBytes(data, static_cast<size_t>(size));
+	}
+	endRecord();
+}
+
+void CaptureWriter::CopyBuffer(VkBuffer srcBuffer, VkBuffer dstBuffer, VkDeviceSize size)
+{
+	beginRecord(CaptureRecordType::BufferCopy);
+	put(findId(m_bufferIds, srcBuffer));
+	put(findId(m_bufferIds, dstBuffer));
+	put(static_cast<u64>(size));
+	endRecord();
+}
+
+void CaptureWriter::DestroyBuffer(VkBuffer buffer)
+{
+	u32 id = findId(m_bufferIds, buffer);
+	if (id == 0)
+	{
+		return;
+	}
+
+	m_bufferIds.erase(handleKey(buffer));
+
+	beginRecord(CaptureRecordType::DestroyBuffer);
+	put(id);
+	endRecord();
+}
+
+void CaptureWriter::AddShaderModule(VkShaderModule shaderModule, const u32* pCode, size_t codeSize)
+{
+	u32 id = assignId(m_shaderModuleIds, shaderModule);
+
+	beginRecord(CaptureRecordType::ShaderModule);
+	put(id);
+	put(static_cast<u32>(codeSize / sizeof(u32)));
+	putBytes(pCode, codeSize);
+	endRecord();
+}
+
+void CaptureWriter::AddGraphicsPipeline(VkPipeline pipeline, VkShaderModule vertShader, VkShaderModule fragShader,
+	const VkSpecializationInfo* pSpecializationInfo, u32 vertexBindingCount, const VkVertexInputBindingDescription* pVertexBindings,
+	u32 vertexAttributeCount, const VkVertexInputAttributeDescription* pVertexAttributes)
+{
+	u32 id = assignId(m_pipelineIds, pipeline);
+
+	beginRecord(CaptureRecordType::GraphicsPipeline);
+	put(id);
+	put(findId(m_shaderModuleIds, vertShader));
+	put(findId(m_shaderModuleIds, fragShader));
+
+	// Map entries are written field by field, as their size member is a size_t.
+	u32 entryCount = pSpecializationInfo != nullptr ? pSpecializationInfo->mapEntryCount : 0;
+	put(entryCount);
+	for (u32 i = 0; i < entryCount; i++)
+	{
+		const VkSpecializationMapEntry& entry = pSpecializationInfo->pMapEntries[i];
+		put(entry.constantID);
+		put(entry.offset);
+		put(static_cast<u32>(entry.size));
+	}
+
+	u32 dataSize = pSpecializationInfo != nullptr ? static_cast<u32>(pSpecializationInfo->dataSize) : 0;
+	put(dataSize);
+	putBytes(dataSize > 0 ? pSpecializationInfo->pData : nullptr, dataSize);
+
+	put(vertexBindingCount);
+	putBytes(pVertexBindings, sizeof(VkVertexInputBindingDescription) * vertexBindingCount);
+	put(vertexAttributeCount);
+	putBytes(pVertexAttributes, sizeof(VkVertexInputAttributeDescription) * vertexAttributeCount);
+	endRecord();
+}
+
+void CaptureWriter::AddComputePipeline(VkPipeline pipeline, VkShaderModule shader, u32 storageBufferCount, u32 pushConstantSize)
+{
+	u32 id = assignId(m_pipelineIds, pipeline);
+
+	beginRecord(CaptureRecordType::ComputePipeline);
+	put(id);
+	put(findId(m_shaderModuleIds, shader));
+	put(storageBufferCount);
+	put(pushConstantSize);
+	endRecord();
+}
+
+void CaptureWriter::AddDescriptorSet(VkDescriptorSet descriptorSet, VkPipeline pipeline, const std::vector<VkBuffer>& storageBuffers)
+{
+	u32 id = assignId(m_descriptorSetIds, descriptorSet);
+
+	beginRecord(CaptureRecordType::DescriptorSet);
+	put(id);
+	put(findId(m_pipelineIds, pipeline));
+	put(static_cast<u32>(storageBuffers.size()));
+	for (VkBuffer buffer : storageBuffers)
+	{
+		put(findId(m_bufferIds, buffer));
+	}
+	endRecord();
+}
+
+void CaptureWriter::BeginFrame()
+{
+	m_frame.dispatches.clear();
+	m_frame.draws.clear();
+}
+
+void CaptureWriter::AddDispatch(VkPipeline pipeline, VkDescriptorSet descriptorSet, const void* pPushConstants, u32 pushConstantSize,
+	u32 groupCountX, u32 groupCountY, u32 groupCountZ)
+{
+	CaptureDispatch& dispatch = m_frame.dispatches.emplace_back();
+	dispatch.pipeline = findId(m_pipelineIds, pipeline);
+	dispatch.descriptorSet = findId(m_descriptorSetIds, descriptorSet);
+	dispatch.groupCount[0] = groupCountX;
+	dispatch.groupCount[1] = groupCountY;
+	dispatch.groupCount[2] = groupCountZ;
+
+	const u8* pushBytes = static_cast<const u8*>(pPushConstants);
+	dispatch.pushConstants.assign(pushBytes, pushBytes + pushConstantSize);
+}
+
+void CaptureWriter::AddDraw(const DrawPacket& packet)
+{
+	CaptureDraw draw{};
+	draw.key = packet.key;
+	draw.pipeline = findId(m_pipelineIds, packet.pipeline);
+	draw.vertexBuffer = findId(m_bufferIds, packet.vertexBuffer);
+	draw.vertexBufferOffset = packet.vertexBufferOffset;
+	draw.meshVertexBuffer = findId(m_bufferIds, packet.meshVertexBuffer);
+	draw.indexBuffer = findId(m_bufferIds, packet.indexBuffer);
+	draw.vertexCount = packet.vertexCount;
+	draw.instanceCount = packet.instanceCount;
+	draw.firstVertex = packet.firstVertex;
+	draw.firstInstance = packet.firstInstance;
+	draw.vertexOffset = packet.vertexOffset;
+
+	m_frame.draws.push_back(draw);
+}
+
+void CaptureWriter::EndFrame(VkExtent2D renderExtent)
+{
+	beginRecord(CaptureRecordType::Frame);
+	put(renderExtent.width);
+	put(renderExtent.height);
+
+	put(static_cast<u32>(m_frame.dispatches.size()));
+	for (const CaptureDispatch& dispatch : m_frame.dispatches)
+	{
+		put(dispatch.pipeline);
+		put(dispatch.descriptorSet);
+		put(dispatch.groupCount);
+		put(static_cast<u32>(dispatch.pushConstants.size()));
+		putBytes(dispatch.pushConstants.data(), dispatch.pushConstants.size());
+	}
+
+	put(static_cast<u32>(m_frame.draws.size()));
+	for (const CaptureDraw& draw : m_frame.draws)
+	{
+		put(draw.key);
+		put(draw.pipeline);
+		put(draw.vertexBuffer);
+		put(static_cast<u64>(draw.vertexBufferOffset));
+		put(draw.meshVertexBuffer);
+		put(draw.indexBuffer);
+		put(draw.vertexCount);
+		put(draw.instanceCount);
+		put(draw.firstVertex);
+		put(draw.firstInstance);
+		put(draw.vertexOffset);
+	}
+	endRecord();
+
+	m_frameCount++;
+}
+
+void CaptureWriter::beginRecord(CaptureRecordType type)
+{
+	// The size is patched in by endRecord().
+	m_record.clear();
+	put(type);
+	put(u32{ 0 });
+}
+
+void CaptureWriter::endRecord()
+{
+	if (!m_file.is_open())
+	{
+		return;
+	}
+
+	u32 payloadSize = static_cast<u32>(m_record.size() - 2 * sizeof(u32));
+	memcpy(m_record.data() + sizeof(u32), &payloadSize, sizeof(u32));
+
+	m_file.write(reinterpret_cast<const char*>(m_record.data()), m_record.size());
+}
+
+void CaptureWriter::putBytes(const void* data, size_t size)
+{
+	if (size == 0)
+	{
+		return;
+	}
+
+	size_t offset = m_record.size();
+	m_record.resize(offset + size);
+	memcpy(m_record.data() + offset, data, size);
+}
+
+bool CaptureReader::Open(const std::string& path, CaptureHeader& header)
+{
+	std::ifstream file(path, std::ios::ate | std::ios::binary);
+	if (!file.is_open())
+	{
+		return false;
+	}
+
+	size_t fileSize = static_cast<size_t>(file.tellg());
+	m_data.resize(fileSize);
+	file.seekg(0);
+	file.read(reinterpret_cast<char*>(m_data.data()), fileSize);
+
+	if (!file)
+	{
+		return false;
+	}
+
+	m_offset = 0;
+	m_recordEnd = m_data.size();
+
+	try
+	{
+		if (get<u32>() != CAPTURE_MAGIC || get<u32>() != CAPTURE_VERSION)
+		{
+			return false;
+		}
+
+		header.device.resize(get<u32>());
+		getBytes(header.device.data(), header.device.size());
+		header.width = get<u32>();
+		header.height = get<u32>();
+		header.colorFormat = static_cast<VkFormat>(get<u32>());
+	}
+	catch (const std::exception&)
+	{
+		return false;
+	}
+
+	return true;
+}
+
+bool CaptureReader::Next(CaptureRecord& record)
+{
+	if (m_offset == m_data.size())
+	{
+		return false;
+	}
+
+	m_recordEnd = m_data.size();
+	record.type = get<CaptureRecordType>();
+	u32 payloadSize = get<u32>();
+
+	if (payloadSize > m_data.size() - m_offset)
+	{
+		throw std::runtime_error("capture record runs past the end of the file!");
+	}
+
+	m_recordEnd = m_offset + payloadSize;
+
+	switch (record.type)
+	{
+	case CaptureRecordType::Buffer:
+	{
+		CaptureBuffer& buffer = record.buffer;
+		buffer.id = get<u32>();
+		buffer.size = get<u64>();
+		buffer.usage = get<u32>();
+		buffer.memoryProperties = get<u32>();
+		getVector(buffer.data, static_cast<size_t>(get<u64>()));
+		break;
+	}
+	case CaptureRecordType::BufferCopy:
+		record.bufferCopy.srcBuffer = get<u32>();
+		record.bufferCopy.dstBuffer = get<u32>();
+		record.bufferCopy.size = get<u64>();
+		break;
+	case CaptureRecordType::DestroyBuffer:
+		record.destroyedBuffer = get<u32>();
+		break;
+	case CaptureRecordType::ShaderModule:
+		record.shaderModule.id = get<u32>();
+		getVector(record.shaderModule.spirv, get<u32>());
+		break;
+	case CaptureRecordType::GraphicsPipeline:
+	{
+		CaptureGraphicsPipeline& pipeline = record.graphicsPipeline;
+		pipeline.id = get<u32>();
+		pipeline.vertShader = get<u32>();
+		pipeline.fragShader = get<u32>();
+
+		// Each entry is written as its constant id, offset and size.
+		resizeVector(pipeline.specializationEntries, get<u32>(), sizeof(u32) * 3);
+		for (VkSpecializationMapEntry& entry : pipeline.specializationEntries)
+		{
+			entry.constantID = get<u32>();
+			entry.offset = get<u32>();
+			entry.size = get<u32>();
+		}
+
+		getVector(pipeline.specializationData, get<u32>());
+		getVector(pipeline.vertexBindings, get<u32>());
+		getVector(pipeline.vertexAttributes, get<u32>());
+		break;
+	}
+	case CaptureRecordType::ComputePipeline:
+		record.computePipeline.id = get<u32>();
+		record.computePipeline.shader = get<u32>();
+		record.computePipeline.storageBufferCount = get<u32>();
+		record.computePipeline.pushConstantSize = get<u32>();
+		break;
+	case CaptureRecordType::DescriptorSet:
+		record.descriptorSet.id = get<u32>();
+		record.descriptorSet.pipeline = get<u32>();
+		getVector(record.descriptorSet.storageBuffers, get<u32>());
+		break;
+	case CaptureRecordType::Frame:
+	{
+		CaptureFrame& frame = record.frame;
+		frame.renderExtent.width = get<u32>();
+		frame.renderExtent.height = get<u32>();
+
+		// Each dispatch is written as its pipeline, descriptor set, group counts and push constant count, then the push constants.
+		resizeVector(frame.dispatches, get<u32>(), sizeof(u32) * 2 + sizeof(CaptureDispatch::groupCount) + sizeof(u32));
+		for (CaptureDispatch& dispatch : frame.dispatches)
+		{
+			dispatch.pipeline = get<u32>();
+			dispatch.descriptorSet = get<u32>();
+			getBytes(dispatch.groupCount, sizeof(dispatch.groupCount));
+			getVector(dispatch.pushConstants, get<u32>());
+		}
+
+		// Each draw is written as the fields below.
+		constexpr size_t drawSize = sizeof(u64) * 2 + sizeof(u32) * 8 + sizeof(int32_t);
+		resizeVector(frame.draws, get<u32>(), drawSize);
+		for (CaptureDraw& draw : frame.draws)
+		{
+			draw.key = get<u64>();
+			draw.pipeline = get<u32>();
+			draw.vertexBuffer = get<u32>();
+			draw.vertexBufferOffset = get<u64>();
+			draw.meshVertexBuffer = get<u32>();
+			draw.indexBuffer = get<u32>();
+			draw.vertexCount = get<u32>();
+			draw.instanceCount = get<u32>();
+			draw.firstVertex = get<u32>();
+			draw.firstInstance = get<u32>();
+			draw.vertexOffset = get<int32_t>();
+		}
+		break;
+	}
+	default:
+		// Unknown records are skipped, so older replayers can still read newer captures.
+		m_offset = m_recordEnd;
+		return Next(record);
+	}
+
+	if (m_offset != m_recordEnd)
+	{
+		throw std::runtime_error("capture record size does not match its contents!");
+	}
+
+	return true;
+}
+
+void CaptureReader::getBytes(void* data, size_t size)
+{
+	if (size > m_recordEnd - m_offset)
+	{
+		throw std::runtime_error("capture record is truncated!");
+	}
+
+	if (size > 0)
+	{
+		memcpy(data, m_data.data() + m_offset, size);
+		m_offset += size;
+	}
+}
@@ -0,0 +1,307 @@
+#pragma once
+
+#include <fstream>
+#include <stdexcept>
+#include <string>
+#include <type_traits>
+#include <unordered_map>
+#include <vector>
+#include <vulkan/vulkan.h>
+
+#include "Types.h"
+#include "DrawQueue.h"
+
+// Command stream capture, for replaying a session without the app (see Replay.cpp).
+//
+// The app reports what it creates and submits to a CaptureWriter as it goes: buffers and their
+// uploads, shader modules, pipelines, descriptor sets, and each frame's dispatches and sorted draws.
+// The stream is recorded at the level of the renderer's own packets rather than raw Vulkan calls,
+// so the replayer rebuilds the same resources and then drives the same DrawQueue recording path
+// the app uses, which is what makes it useful for measuring changes to that path.
+//
+// Vulkan handles are replaced by small ids, assigned in creation order.
+// Id 0 always means VK_NULL_HANDLE.
+//
+// File layout: a header, then a sequence of records, each a u32 CaptureRecordType and a u32
+// payload size followed by the payload. Values are written in native byte order (little endian
+// on every platform the app targets). Resource records are replayed as they are met, so resources
+// created mid-session (e.g. a new scene's instance buffer) appear at the right point between frames.
+
+constexpr u32 CAPTURE_MAGIC = 0x50434B56; // "VKCP"
+constexpr u32 CAPTURE_VERSION = 2;
+
+enum class CaptureRecordType : u32
+{
+	Buffer = 1,
+	BufferCopy,
+	DestroyBuffer,
+	ShaderModule,
+	GraphicsPipeline,
+	ComputePipeline,
+	DescriptorSet,
+	Frame,
+};
+
+struct CaptureHeader
+{
+	std::string device;
+	u32 width{ 0 };
+	u32 height{ 0 };
+	VkFormat colorFormat{ VK_FORMAT_UNDEFINED };
+};
+
+struct CaptureBuffer
+{
+	u32 id;
+	VkDeviceSize size;
+	VkBufferUsageFlags usage;
+	VkMemoryPropertyFlags memoryProperties;
+	// The contents at creation. Empty if the buffer starts uninitialised.
+	std::vector<u8> data;
+};
+
+struct CaptureBufferCopy
+{
+	u32 srcBuffer;
+	u32 dstBuffer;
+	VkDeviceSize size;
+};
+
+struct CaptureShaderModule
+{
+	u32 id;
+	std::vector<u32> spirv;
+};
+
+struct CaptureGraphicsPipeline
+{
+	u32 id;
+	u32 vertShader;
+	u32 fragShader;
+
+	std::vector<VkSpecializationMapEntry> specializationEntries;
+	std::vector<u8> specializationData;
+
+	std::vector<VkVertexInputBindingDescription> vertexBindings;
+	std::vector<VkVertexInputAttributeDescription> vertexAttributes;
+};
+
+// Compute pipelines use a single descriptor set of storage buffers, bindings 0..n-1, plus push constants.
+struct CaptureComputePipeline
+{
+	u32 id;
+	u32 shader;
+	u32 storageBufferCount;
+	u32 pushConstantSize;
+};
+
+struct CaptureDescriptorSet
+{
+	u32 id;
+	// The set is allocated with this compute pipeline's set layout.
+	u32 pipeline;
+	std::vector<u32> storageBuffers;
+};
+
+struct CaptureDispatch
+{
+	u32 pipeline;
+	u32 descriptorSet;
+	u32 groupCount[3];
+	std::vector<u8> pushConstants;
+};
+
+struct CaptureDraw
+{
+	u64 key;
+	u32 pipeline;
+	u32 vertexBuffer;
+	VkDeviceSize vertexBufferOffset;
+	// 0 unless the draw is of a mesh, see DrawPacket.
+	u32 meshVertexBuffer;
+	u32 indexBuffer;
+	u32 vertexCount;
+	u32 instanceCount;
+	u32 firstVertex;
+	u32 firstInstance;
+	int32_t vertexOffset;
+};
+
+struct CaptureFrame
+{
+	// The area of the output the scene was drawn at, smaller than the output with dynamic resolution.
+	VkExtent2D renderExtent;
+
+	// Simulation work submitted ahead of the frame's draws, in submission order.
+	std::vector<CaptureDispatch> dispatches;
+
+	// In the order they were recorded, i.e. after sorting.
+	std::vector<CaptureDraw> draws;
+};
+
+class CaptureWriter
+{
+public:
+	// Starts a new capture, replacing any existing file. Returns false if the file could not be created.
+	bool Open(const std::string& path, const CaptureHeader& header);
+
+	// Flushes and closes the file. Safe to call when not open.
+	void Close();
+
+	bool IsOpen() const { return m_file.is_open(); }
+
+	u64 GetFrameCount() const { return m_frameCount; }
+
+	// 'data' may be null for buffers whose contents are written later (e.g. by CopyBuffer) or on the GPU.
+	void AddBuffer(VkBuffer buffer, VkDeviceSize size, VkBufferUsageFlags usage, VkMemoryPropertyFlags memoryProperties, const void* data);
+
+	void CopyBuffer(VkBuffer srcBuffer, VkBuffer dstBuffer, VkDeviceSize size);
+
+	void DestroyBuffer(VkBuffer buffer);
+
+	void AddShaderModule(VkShaderModule shaderModule, const u32* pCode, size_t codeSize);
+
+	void AddGraphicsPipeline(VkPipeline pipeline, VkShaderModule vertShader, VkShaderModule fragShader,
+		const VkSpecializationInfo* pSpecializationInfo, u32 vertexBindingCount, const VkVertexInputBindingDescription* pVertexBindings,
+		u32 vertexAttributeCount, const VkVertexInputAttributeDescription* pVertexAttributes);
+
+	void AddComputePipeline(VkPipeline pipeline, VkShaderModule shader, u32 storageBufferCount, u32 pushConstantSize);
+
+	void AddDescriptorSet(VkDescriptorSet descriptorSet, VkPipeline pipeline, const std::vector<VkBuffer>& storageBuffers);
+
+	// The frame's work is collected between BeginFrame and EndFrame and written as one record,
+	// so dispatches and draws may be added in any order relative to each other.
+	void BeginFrame();
+
+	void AddDispatch(VkPipeline pipeline, VkDescriptorSet descriptorSet, const void* pPushConstants, u32 pushConstantSize,
+		u32 groupCountX, u32 groupCountY, u32 groupCountZ);
+
+	void AddDraw(const DrawPacket& packet);
+
+	void EndFrame(VkExtent2D renderExtent);
+
+private:
+	template<typename Handle>
+	static u64 handleKey(Handle handle)
+	{
+		if constexpr (std::is_pointer_v<Handle>)
+		{
+			return reinterpret_cast<u64>(handle);
+		}
+		else
+		{
+			return static_cast<u64>(handle);
+		}
+	}
+
+	// Handle values are only unique per object type, so each type has its own map.
+	using IdMap = std::unordered_map<u64, u32>;
+
+	// Gives the handle a new id. A handle value reused after a destroy simply gets a new one.
+	template<typename Handle>
+	u32 assignId(IdMap& ids, Handle handle)
+	{
+		u32 id = ++m_lastId;
+		ids[handleKey(handle)] = id;
+		return id;
+	}
+
+	// 0 for VK_NULL_HANDLE or a handle created before the capture started.
+	template<typename Handle>
+	static u32 findId(const IdMap& ids, Handle handle)
+	{
+		auto found = ids.find(handleKey(handle));
+		return found != ids.end() ? found->second : 0;
+	}
+
+	void beginRecord(CaptureRecordType type);
+
+	void endRecord();
+
+	template<typename T>
+	void put(const T& value)
+	{
+		static_assert(std::is_trivially_copyable_v<T>, "Only plain values can be written directly.");
+		putBytes(&value, sizeof(T));
+	}
+
+	void putBytes(const void* data, size_t size);
+
+	std::ofstream m_file;
+	u32 m_lastId{ 0 };
+	u64 m_frameCount{ 0 };
+
+	IdMap m_bufferIds;
+	IdMap m_shaderModuleIds;
+	IdMap m_pipelineIds;
+	IdMap m_descriptorSetIds;
+
+	// The record being built. Kept between records so writing does not allocate once it has grown.
+	std::vector<u8> m_record;
+
+	CaptureFrame m_frame;
+};
+
+// Everything a record can hold. Only the member matching 'type' is filled in by CaptureReader::Next.
+struct CaptureRecord
+{
+	CaptureRecordType type;
+
+	CaptureBuffer buffer;
+	CaptureBufferCopy bufferCopy;
+	// DestroyBuffer
+	u32 destroyedBuffer;
+	CaptureShaderModule shaderModule;
+	CaptureGraphicsPipeline graphicsPipeline;
+	CaptureComputePipeline computePipeline;
+	CaptureDescriptorSet descriptorSet;
+	CaptureFrame frame;
+};
+
+class CaptureReader
+{
+public:
+	// Reads the whole file into memory up front, so replay never waits on disk.
+	bool Open(const std::string& path, CaptureHeader& header);
+
+	// Reads the next record into 'record'. Returns false at the end of the file.
+	// Throws on a truncated or malformed record.
+	bool Next(CaptureRecord& record);
+
+private:
+	template<typename T>
+	T get()
+	{
+		static_assert(std::is_trivially_copyable_v<T>, "Only plain values can be read directly.");
+		T value;
+		getBytes(&value, sizeof(T));
+		return value;
+	}
+
+	void getBytes(void* data, size_t size);
+
+	template<typename T>
+	void getVector(std::vector<T>& values, size_t count)
+	{
+		resizeVector(values, count, sizeof(T));
+		getBytes(values.data(), sizeof(T) * count);
+	}
+
+	// Sizes 'values' for 'count' elements that take at least 'encodedSize' bytes each in the record.
+	// Checked before resizing, so a corrupt count cannot trigger a huge allocation.
+	template<typename T>
+	void resizeVector(std::vector<T>& values, size_t count, size_t encodedSize)
+	{
+		if (count > (m_recordEnd - m_offset) / encodedSize)
+		{
+			throw std::runtime_error("capture record is truncated!");
+		}
+
+		values.resize(count);
+	}
+
+	std::vector<u8> m_data;
+	size_t m_offset{ 0 };
+	// End of the record being read, reads past it are malformed.
+	size_t m_recordEnd{ 0 };
+};
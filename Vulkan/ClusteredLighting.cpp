@@ -0,0 +1,282 @@
+#include "ClusteredLighting.h"
+#include "VulkanInit.h"
+
+#include <algorithm>
+#include <cstring>
+#include <stdexcept>
+
+// Matches the Counters block in Shaders/light_assign.comp.
+struct LightCounters
+{
+	u32 indexCount;
+	u32 overflowedClusters;
+	u32 maxClusterLights;
+};
+
+// Matches the push constant block in Shaders/light_assign.comp.
+struct LightAssignParams
+{
+	u32 lightCount;
+};
+
+void ClusteredLighting::Init(const ClusteredLightingDesc& desc)
+{
+	m_physicalDevice = desc.physicalDevice;
+	m_device = desc.device;
+	m_pipelineCache = desc.pipelineCache;
+	m_pAllocator = desc.pAllocator;
+	m_maxLights = desc.maxLights;
+
+	m_setLayout = CreateSetLayout(m_device, m_pAllocator);
+
+	if (desc.assignShader != VK_NULL_HANDLE)
+	{
+		createPipeline(desc.assignShader);
+	}
+
+	createFrames(desc.slotCount, desc.maxLights);
+}
+
+void ClusteredLighting::Destroy()
+{
+	if (m_device == VK_NULL_HANDLE)
+	{
+		return;
+	}
+
+	for (FrameBuffers& frame : m_frames)
+	{
+		vkDestroyBuffer(m_device, frame.lightBuffer, m_pAllocator);
+		vkFreeMemory(m_device, frame.lightMemory, m_pAllocator);
+		vkDestroyBuffer(m_device, frame.clusterBuffer, m_pAllocator);
+		vkFreeMemory(m_device, frame.clusterMemory, m_pAllocator);
+		vkDestroyBuffer(m_device, frame.indexBuffer, m_pAllocator);
+		vkFreeMemory(m_device, frame.indexMemory, m_pAllocator);
+		vkDestroyBuffer(m_device, frame.counterBuffer, m_pAllocator);
+		vkFreeMemory(m_device, frame.counterMemory, m_pAllocator);
+	}
+
+	vkDestroyDescriptorPool(m_device, m_descriptorPool, m_pAllocator);
+	vkDestroyPipeline(m_device, m_pipeline, m_pAllocator);
+	vkDestroyPipelineLayout(m_device, m_pipelineLayout, m_pAllocator);
+	vkDestroyDescriptorSetLayout(m_device, m_setLayout, m_pAllocator);
+
+	m_frames.clear();
+	m_pipeline = VK_NULL_HANDLE;
+	m_pipelineLayout = VK_NULL_HANDLE;
+	m_stats = LightingStats{ };
+	m_device = VK_NULL_HANDLE;
+}
+
+VkDescriptorSetLayout ClusteredLighting::CreateSetLayout(VkDevice device, const VkAllocationCallbacks* pAllocator)
+{
+	// The lights, clusters and index list are read by the fragment shaders. The counters are only the assignment's.
+	VkDescriptorSetLayoutBinding bindings[4]{};
+	for (u32 i = 0; i < 3; i++)
+	{
+		bindings[i] = { i, VK_DESCRIPTOR_TYPE_STORAGE_BUFFER, 1, VK_SHADER_STAGE_COMPUTE_BIT | VK_SHADER_STAGE_FRAGMENT_BIT, nullptr };
+	}
+	bindings[3] = { 3, VK_DESCRIPTOR_TYPE_STORAGE_BUFFER, 1, VK_SHADER_STAGE_COMPUTE_BIT, nullptr };
+
+	VkDescriptorSetLayoutCreateInfo layoutInfo{};
+	layoutInfo.sType = VK_STRUCTURE_TYPE_DESCRIPTOR_SET_LAYOUT_CREATE_INFO;
+	layoutInfo.bindingCount = 4;
+	layoutInfo.pBindings = bindings;
+
+	VkDescriptorSetLayout setLayout;
+	if (vkCreateDescriptorSetLayout(device, &layoutInfo, pAllocator, &setLayout) != VK_SUCCESS)
+	{
+		throw std::runtime_error("failed to create light cluster descriptor set layout!");
+	}
+
+	return setLayout;
+}
+
+void ClusteredLighting::BeginFrame(u32 slot, const PointLight* pLights, u32 lightCount)
+{
+	FrameBuffers& frame = m_frames[slot];
+
+	if (lightCount > m_maxLights)
+	{
+		throw std::runtime_error("more lights than the clustered lighting was created for!");
+	}
+
+	// The frame last recorded in this slot has finished, and its assignment made the counters available to the host.
+	m_stats = LightingStats{ };
+	if (frame.assigned)
+	{
+		const LightCounters* pCounters = static_cast<const LightCounters*>(frame.pCounters);
+		m_stats.lights = frame.lightCount;
+		m_stats.assignedLights = pCounters->indexCount;
+		m_stats.maxClusterLights = pCounters->maxClusterLights;
+		m_stats.overflowedClusters = pCounters->overflowedClusters;
+	}
+
+	if (lightCount > 0)
+	{
+		memcpy(frame.pLights, pLights, sizeof(PointLight) * lightCount);
+	}
+
+	frame.lightCount = lightCount;
+}
+
+void ClusteredLighting::RecordLightAssignment(VkCommandBuffer commandBuffer, u32 slot)
+{
+	FrameBuffers& frame = m_frames[slot];
+	frame.assigned = false;
+
+	// Without lights every cluster is empty, which only needs writing once.
+	if (frame.lightCount == 0 || m_pipeline == VK_NULL_HANDLE)
+	{
+		if (!frame.cleared)
+		{
+			vkCmdFillBuffer(commandBuffer, frame.clusterBuffer, 0, VK_WHOLE_SIZE, 0);
+
+			VkMemoryBarrier barrier{};
+			barrier.sType = VK_STRUCTURE_TYPE_MEMORY_BARRIER;
+			barrier.srcAccessMask = VK_ACCESS_TRANSFER_WRITE_BIT;
+			barrier.dstAccessMask = VK_ACCESS_SHADER_READ_BIT;
+
+			vkCmdPipelineBarrier(commandBuffer, VK_PIPELINE_STAGE_TRANSFER_BIT, VK_PIPELINE_STAGE_FRAGMENT_SHADER_BIT, 0,
+				1, &barrier, 0, nullptr, 0, nullptr);
+
+			frame.cleared = true;
+		}
+
+		return;
+	}
+
+	// The index list is appended to by atomics, so it starts each frame empty.
+	vkCmdFillBuffer(commandBuffer, frame.counterBuffer, 0, VK_WHOLE_SIZE, 0);
+
+	VkMemoryBarrier clearBarrier{};
+	clearBarrier.sType = VK_STRUCTURE_TYPE_MEMORY_BARRIER;
+	clearBarrier.srcAccessMask = VK_ACCESS_TRANSFER_WRITE_BIT;
+	clearBarrier.dstAccessMask = VK_ACCESS_SHADER_READ_BIT | VK_ACCESS_SHADER_WRITE_BIT;
+
+	vkCmdPipelineBarrier(commandBuffer, VK_PIPELINE_STAGE_TRANSFER_BIT, VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT, 0,
+		1, &clearBarrier, 0, nullptr, 0, nullptr);
+
+	LightAssignParams params{ frame.lightCount };
+
+	// One workgroup per cluster.
+	vkCmdBindPipeline(commandBuffer, VK_PIPELINE_BIND_POINT_COMPUTE, m_pipeline);
+	vkCmdBindDescriptorSets(commandBuffer, VK_PIPELINE_BIND_POINT_COMPUTE, m_pipelineLayout, 0, 1, &frame.descriptorSet, 0, nullptr);
+	vkCmdPushConstants(commandBuffer, m_pipelineLayout, VK_SHADER_STAGE_COMPUTE_BIT, 0, sizeof(params), &params);
+	vkCmdDispatch(commandBuffer, LIGHT_CLUSTER_COUNT, 1, 1);
+
+	// The clusters and indices are read by the frame's fragments. The counters are read back by
+	// BeginFrame() once the frame's timeline point is reached, which makes them visible to the host.
+	VkMemoryBarrier barrier{};
+	barrier.sType = VK_STRUCTURE_TYPE_MEMORY_BARRIER;
+	barrier.srcAccessMask = VK_ACCESS_SHADER_WRITE_BIT;
+	barrier.dstAccessMask = VK_ACCESS_SHADER_READ_BIT | VK_ACCESS_HOST_READ_BIT;
+
+	vkCmdPipelineBarrier(commandBuffer, VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT, VK_PIPELINE_STAGE_FRAGMENT_SHADER_BIT | VK_PIPELINE_STAGE_HOST_BIT, 0,
+		1, &barrier, 0, nullptr, 0, nullptr);
+
+	frame.assigned = true;
+	frame.cleared = false;
+}
+
+VkPipeline ClusteredLighting::ReplacePipeline(VkShaderModule assignShader)
+{
+	VkPipeline oldPipeline = m_pipeline;
+	m_pipeline = VulkanInit::CreateComputePipeline(m_device, m_pipelineCache, assignShader, m_pipelineLayout, nullptr, m_pAllocator);
+	return oldPipeline;
+}
+
+void ClusteredLighting::createPipeline(VkShaderModule assignShader)
+{
+	VkPushConstantRange pushConstantRange{};
+	pushConstantRange.stageFlags = VK_SHADER_STAGE_COMPUTE_BIT;
+	pushConstantRange.offset = 0;
+	pushConstantRange.size = sizeof(LightAssignParams);
+
+	VkPipelineLayoutCreateInfo pipelineLayoutInfo{};
+	pipelineLayoutInfo.sType = VK_STRUCTURE_TYPE_PIPELINE_LAYOUT_CREATE_INFO;
+	pipelineLayoutInfo.setLayoutCount = 1;
+	pipelineLayoutInfo.pSetLayouts = &m_setLayout;
+	pipelineLayoutInfo.pushConstantRangeCount = 1;
+	pipelineLayoutInfo.pPushConstantRanges = &pushConstantRange;
+
+	if (vkCreatePipelineLayout(m_device, &pipelineLayoutInfo, m_pAllocator, &m_pipelineLayout) != VK_SUCCESS)
+	{
+		throw std::runtime_error("failed to create light assignment pipeline layout!");
+	}
+
+	m_pipeline = VulkanInit::CreateComputePipeline(m_device, m_pipelineCache, assignShader, m_pipelineLayout, nullptr, m_pAllocator);
+}
+
+void ClusteredLighting::createFrames(u32 slotCount, u32 maxLights)
+{
+	VkDescriptorPoolSize poolSize{ VK_DESCRIPTOR_TYPE_STORAGE_BUFFER, 4 * slotCount };
+
+	VkDescriptorPoolCreateInfo poolInfo{};
+	poolInfo.sType = VK_STRUCTURE_TYPE_DESCRIPTOR_POOL_CREATE_INFO;
+	poolInfo.maxSets = slotCount;
+	poolInfo.poolSizeCount = 1;
+	poolInfo.pPoolSizes = &poolSize;
+
+	if (vkCreateDescriptorPool(m_device, &poolInfo, m_pAllocator, &m_descriptorPool) != VK_SUCCESS)
+	{
+		throw std::runtime_error("failed to create clustered lighting descriptor pool!");
+	}
+
+	std::vector<VkDescriptorSetLayout> setLayouts(slotCount, m_setLayout);
+	std::vector<VkDescriptorSet> descriptorSets(slotCount);
+
+	VkDescriptorSetAllocateInfo allocInfo{};
+	allocInfo.sType = VK_STRUCTURE_TYPE_DESCRIPTOR_SET_ALLOCATE_INFO;
+	allocInfo.descriptorPool = m_descriptorPool;
+	allocInfo.descriptorSetCount = slotCount;
+	allocInfo.pSetLayouts = setLayouts.data();
+
+	if (vkAllocateDescriptorSets(m_device, &allocInfo, descriptorSets.data()) != VK_SUCCESS)
+	{
+		throw std::runtime_error("failed to allocate clustered lighting descriptor sets!");
+	}
+
+	// Vulkan has no empty buffers, so a lighting without lights still gets room for one.
+	const VkDeviceSize lightBytes = sizeof(PointLight) * std::max(maxLights, 1u);
+	const VkDeviceSize clusterBytes = sizeof(u32) * 2 * LIGHT_CLUSTER_COUNT;
+	// Room for every cluster to be full, so the list itself can never overflow. Without lights nothing is ever written.
+	const VkDeviceSize indexBytes = sizeof(u32) * (maxLights > 0 ? LIGHT_CLUSTER_COUNT * std::min(maxLights, MAX_LIGHTS_PER_CLUSTER) : 1);
+
+	m_frames.assign(slotCount, FrameBuffers{ });
+
+	for (u32 slot = 0; slot < slotCount; slot++)
+	{
+		FrameBuffers& frame = m_frames[slot];
+
+		VulkanInit::CreateBuffer(m_physicalDevice, m_device, lightBytes, VK_BUFFER_USAGE_STORAGE_BUFFER_BIT,
+			VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT | VK_MEMORY_PROPERTY_HOST_COHERENT_BIT, frame.lightBuffer, frame.lightMemory, { }, m_pAllocator);
+		VulkanInit::CreateBuffer(m_physicalDevice, m_device, clusterBytes, VK_BUFFER_USAGE_STORAGE_BUFFER_BIT | VK_BUFFER_USAGE_TRANSFER_DST_BIT,
+			VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT, frame.clusterBuffer, frame.clusterMemory, { }, m_pAllocator);
+		VulkanInit::CreateBuffer(m_physicalDevice, m_device, indexBytes, VK_BUFFER_USAGE_STORAGE_BUFFER_BIT,
+			VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT, frame.indexBuffer, frame.indexMemory, { }, m_pAllocator);
+		VulkanInit::CreateBuffer(m_physicalDevice, m_device, sizeof(LightCounters), VK_BUFFER_USAGE_STORAGE_BUFFER_BIT | VK_BUFFER_USAGE_TRANSFER_DST_BIT,
+			VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT | VK_MEMORY_PROPERTY_HOST_COHERENT_BIT, frame.counterBuffer, frame.counterMemory, { }, m_pAllocator);
+
+		vkMapMemory(m_device, frame.lightMemory, 0, lightBytes, 0, &frame.pLights);
+		vkMapMemory(m_device, frame.counterMemory, 0, sizeof(LightCounters), 0, &frame.pCounters);
+
+		frame.descriptorSet = descriptorSets[slot];
+
+		VkDescriptorBufferInfo bufferInfos[4]{};
+		bufferInfos[0] = { frame.lightBuffer, 0, VK_WHOLE_SIZE };
+		bufferInfos[1] = { frame.clusterBuffer, 0, VK_WHOLE_SIZE };
+		bufferInfos[2] = { frame.indexBuffer, 0, VK_WHOLE_SIZE };
+		bufferInfos[3] = { frame.counterBuffer, 0, VK_WHOLE_SIZE };
+
+		VkWriteDescriptorSet write{};
+		write.sType = VK_STRUCTURE_TYPE_WRITE_DESCRIPTOR_SET;
+		write.dstSet = frame.descriptorSet;
+		write.dstBinding = 0;
+		write.descriptorCount = 4;
+		write.descriptorType = VK_DESCRIPTOR_TYPE_STORAGE_BUFFER;
+		write.pBufferInfo = bufferInfos;
+
+		vkUpdateDescriptorSets(m_device, 1, &write, 0, nullptr);
+	}
+}
@@ -0,0 +1,159 @@
+#pragma once
+
+#include <vector>
+#include <vulkan/vulkan.h>
+
+#include "Types.h"
+
+// Clustered forward lighting for many dynamic point lights.
+//
+// The view is split into a grid of clusters: LIGHT_CLUSTER_COUNT_X by LIGHT_CLUSTER_COUNT_Y tiles
+// across the screen, each cut into LIGHT_CLUSTER_COUNT_Z slices of depth. Every frame a compute pass
+// tests every light against every cluster and writes, per cluster, an offset and count into one compact
+// list of light indices. The lit fragment shaders find their cluster from their position and only loop
+// over the lights in it, so the cost per fragment follows the lights that can reach it rather than the
+// total, and no draw needs a light list of its own.
+//
+// This renderer draws straight into clip space with no camera, so view space is clip space: x and y
+// in [-1, 1] and depth in [0, 1]. The depth is linear in it, so the slices are evenly spaced. With several
+// views (see SceneViews.h) the clusters stay over that scene space, shared by every view, so a zoomed
+// view finds fewer, larger clusters under it rather than needing an assignment of its own.
+//
+// Each workgroup of the assignment gathers one cluster's lights into shared memory, then reserves
+// room for them in the index list with a single atomic, so the list is compact whatever the counts.
+// A cluster keeps at most MAX_LIGHTS_PER_CLUSTER lights, any beyond that are dropped and counted.
+//
+// The lights, clusters and index list are kept per frame in flight, so a frame's assignment never
+// waits for the previous frame's fragments to stop reading them.
+
+// Must match clusterCounts in Shaders/light_assign.comp, Shaders/shader.frag and Shaders/mesh.frag.
+constexpr u32 LIGHT_CLUSTER_COUNT_X = 16;
+constexpr u32 LIGHT_CLUSTER_COUNT_Y = 9;
+constexpr u32 LIGHT_CLUSTER_COUNT_Z = 24;
+constexpr u32 LIGHT_CLUSTER_COUNT = LIGHT_CLUSTER_COUNT_X * LIGHT_CLUSTER_COUNT_Y * LIGHT_CLUSTER_COUNT_Z;
+
+// Must match MAX_CLUSTER_LIGHTS in Shaders/light_assign.comp.
+constexpr u32 MAX_LIGHTS_PER_CLUSTER = 256;
+
+// Must match local_size_x in Shaders/light_assign.comp.
+constexpr u32 LIGHT_ASSIGN_WORKGROUP_SIZE = 64;
+
+// Matches the std430 layout of Light in the lighting shaders.
+struct PointLight
+{
+	// In clip space, like InstanceData: x and y in [-1, 1], z a [0, 1] depth.
+	float position[3];
+	// Where the light's falloff reaches zero, in the same units.
+	float radius;
+	float color[3];
+	float padding;
+};
+
+struct ClusteredLightingDesc
+{
+	VkPhysicalDevice physicalDevice{ VK_NULL_HANDLE };
+	VkDevice device{ VK_NULL_HANDLE };
+
+	// VK_NULL_HANDLE for users that never have lights, such as replays. The clusters are then kept empty.
+	VkShaderModule assignShader{ VK_NULL_HANDLE };
+	VkPipelineCache pipelineCache{ VK_NULL_HANDLE };
+
+	// The most lights a frame may have.
+	u32 maxLights{ 0 };
+
+	// The number of frames in flight. Every buffer and descriptor set is kept per slot.
+	u32 slotCount{ 2 };
+
+	// Host allocator for every object the lighting creates. Must outlive it.
+	const VkAllocationCallbacks* pAllocator{ nullptr };
+};
+
+// What the assignment of the last frame recorded in a slot produced, read back once the frame has been waited for.
+struct LightingStats
+{
+	u32 lights{ 0 };
+	// The length of the index list, i.e. the cluster light counts summed.
+	u32 assignedLights{ 0 };
+	u32 maxClusterLights{ 0 };
+	// Clusters reached by more than MAX_LIGHTS_PER_CLUSTER lights, which lost the rest.
+	u32 overflowedClusters{ 0 };
+};
+
+class ClusteredLighting
+{
+public:
+	void Init(const ClusteredLightingDesc& desc);
+
+	void Destroy();
+
+	// The layout of set 0 of the lit graphics pipelines. Owned by the lighting.
+	VkDescriptorSetLayout GetSetLayout() const { return m_setLayout; }
+
+	// Creates the same layout, for building pipelines from the lit shaders without a ClusteredLighting.
+	static VkDescriptorSetLayout CreateSetLayout(VkDevice device, const VkAllocationCallbacks* pAllocator);
+
+	// Copies the lights of the frame in 'slot', whose previous frame the caller has waited for, and
+	// reads back that frame's stats. At most ClusteredLightingDesc::maxLights.
+	void BeginFrame(u32 slot, const PointLight* pLights, u32 lightCount);
+
+	// Assigns the frame's lights to clusters, ready for the fragment shaders. Outside a render pass.
+	void RecordLightAssignment(VkCommandBuffer commandBuffer, u32 slot);
+
+	// Bound as set 0 by the frame's lit draws.
+	VkDescriptorSet GetDescriptorSet(u32 slot) const { return m_frames[slot].descriptorSet; }
+
+	// Of the frame read back by the last BeginFrame().
+	const LightingStats& GetStats() const { return m_stats; }
+
+	// Builds the pipeline from a new shader module and returns the old one, which the caller
+	// destroys once no frame in flight can still be using it.
+	VkPipeline ReplacePipeline(VkShaderModule assignShader);
+
+private:
+	void createPipeline(VkShaderModule assignShader);
+
+	void createFrames(u32 slotCount, u32 maxLights);
+
+	VkPhysicalDevice m_physicalDevice{ VK_NULL_HANDLE };
+	VkDevice m_device{ VK_NULL_HANDLE };
+	VkPipelineCache m_pipelineCache{ VK_NULL_HANDLE };
+	const VkAllocationCallbacks* m_pAllocator{ nullptr };
+
+	u32 m_maxLights{ 0 };
+
+	VkDescriptorSetLayout m_setLayout{ VK_NULL_HANDLE };
+	VkPipelineLayout m_pipelineLayout{ VK_NULL_HANDLE };
+	VkPipeline m_pipeline{ VK_NULL_HANDLE };
+	VkDescriptorPool m_descriptorPool{ VK_NULL_HANDLE };
+
+	struct FrameBuffers
+	{
+		// Host visible and kept mapped, rewritten every frame.
+		VkBuffer lightBuffer;
+		VkDeviceMemory lightMemory;
+		void* pLights;
+
+		// An offset and count into the index list per cluster.
+		VkBuffer clusterBuffer;
+		VkDeviceMemory clusterMemory;
+		VkBuffer indexBuffer;
+		VkDeviceMemory indexMemory;
+
+		// The list's length and the stats, host visible so they can be read back.
+		VkBuffer counterBuffer;
+		VkDeviceMemory counterMemory;
+		void* pCounters;
+
+		VkDescriptorSet descriptorSet;
+
+		u32 lightCount;
+		// Whether the last frame in this slot ran the assignment, so its counters are worth reading.
+		bool assigned;
+		// Whether the clusters hold no lights, which frames without any can then skip the assignment for.
+		bool cleared;
+	};
+
+	std::vector<FrameBuffers> m_frames;
+
+	LightingStats m_stats;
+};
@@ -0,0 +1,248 @@
+#include "DrawQueue.h"
+
+#include <algorithm>
+#include <array>
+#include <memory>
+
+void DrawQueue::Clear()
+{
+	m_packets.clear();
+	m_sorted.clear();
+	m_unsortedBinds = 0;
+}
+
+void DrawQueue::Clear(std::pmr::memory_resource* pFrameMemory, u32 expectedCount)
+{
+	// A pmr container keeps the memory resource it was constructed with, so moving to new memory means new containers.
+	for (std::pmr::vector<SortEntry>* pEntries : { &m_sorted, &m_scratch })
+	{
+		std::destroy_at(pEntries);
+		std::construct_at(pEntries, pFrameMemory);
+		pEntries->reserve(expectedCount);
+	}
+
+	std::destroy_at(&m_packets);
+	std::construct_at(&m_packets, pFrameMemory);
+	m_packets.reserve(expectedCount);
+
+	m_unsortedBinds = 0;
+}
+
+template<typename GetPacket>
+u32 DrawQueue::countBinds(u32 count, GetPacket getPacket)
+{
+	u32 binds = 0;
+
+	VkPipeline pipeline = VK_NULL_HANDLE;
+	VkDescriptorSet descriptorSet = VK_NULL_HANDLE;
+	VkBuffer vertexBuffer = VK_NULL_HANDLE;
+	VkDeviceSize vertexBufferOffset = 0;
+	VkBuffer meshVertexBuffer = VK_NULL_HANDLE;
+	VkBuffer indexBuffer = VK_NULL_HANDLE;
+
+	for (u32 i = 0; i < count; i++)
+	{
+		const DrawPacket& packet = getPacket(i);
+
+		binds += packet.pipeline != pipeline;
+		binds += packet.descriptorSet != VK_NULL_HANDLE && packet.descriptorSet != descriptorSet;
+		binds += packet.vertexBuffer != vertexBuffer || packet.vertexBufferOffset != vertexBufferOffset;
+		binds += packet.meshVertexBuffer != VK_NULL_HANDLE && packet.meshVertexBuffer != meshVertexBuffer;
+		binds += packet.indexBuffer != VK_NULL_HANDLE && packet.indexBuffer != indexBuffer;
+
+		pipeline = packet.pipeline;
+		descriptorSet = packet.descriptorSet != VK_NULL_HANDLE ? packet.descriptorSet : descriptorSet;
+		vertexBuffer = packet.vertexBuffer;
+		vertexBufferOffset = packet.vertexBufferOffset;
+		meshVertexBuffer = packet.meshVertexBuffer != VK_NULL_HANDLE ? packet.meshVertexBuffer : meshVertexBuffer;
+		indexBuffer = packet.indexBuffer != VK_NULL_HANDLE ? packet.indexBuffer : indexBuffer;
+	}
+
+	return binds;
+}
+
+void DrawQueue::Sort()
+{
+	const u32 count = GetCount();
+
+	m_unsortedBinds = countBinds(count, [this](u32 i) -> const DrawPacket& { return m_packets[i]; });
+
+	m_sorted.resize(count);
+	m_scratch.resize(count);
+
+	// LSD radix sort, one byte of the key per pass. The histograms for every byte are built
+	// in a single read of the keys, and a pass whose byte is the same for every key is skipped.
+	// Most frames only vary in a few bytes (few pipelines, few materials), so only those are sorted.
+	std::array<std::array<u32, 256>, 8> histograms{ };
+
+	for (u32 i = 0; i < count; i++)
+	{
+		u64 key = m_packets[i].key;
+		m_sorted[i] = { key, i };
+
+		for (u32 byte = 0; byte < 8; byte++)
+		{
+			histograms[byte][(key >> (byte * 8)) & 0xFF]++;
+		}
+	}
+
+	for (u32 byte = 0; byte < 8; byte++)
+	{
+		std::array<u32, 256>& histogram = histograms[byte];
+
+		if (count == 0 || histogram[(m_sorted[0].key >> (byte * 8)) & 0xFF] == count)
+		{
+			continue;
+		}
+
+		// Turn the counts into the first output position of each bucket.
+		u32 offset = 0;
+		for (u32& bucket : histogram)
+		{
+			u32 bucketCount = bucket;
+			bucket = offset;
+			offset += bucketCount;
+		}
+
+		// Scattering in input order keeps each pass stable, which is what makes LSD sorting work.
+		for (const SortEntry& entry : m_sorted)
+		{
+			m_scratch[histogram[(entry.key >> (byte * 8)) & 0xFF]++] = entry;
+		}
+
+		m_sorted.swap(m_scratch);
+	}
+}
+
+u32 DrawQueue::countMergedDraws(SortIterator first, SortIterator end) const
+{
+	const DrawPacket& packet = m_packets[first->packetIndex];
+
+	if (packet.indirectStride == 0)
+	{
+		return 1;
+	}
+
+	// Everything the first draw binds must match, as the merged draws are recorded without binding anything.
+	u32 count = 1;
+	for (auto it = first + 1; it != end && count < m_maxDrawIndirectCount; ++it, count++)
+	{
+		const DrawPacket& next = m_packets[it->packetIndex];
+
+		const bool sameState = next.pipeline == packet.pipeline && next.descriptorSet == packet.descriptorSet &&
+			next.vertexBuffer == packet.vertexBuffer && next.vertexBufferOffset == packet.vertexBufferOffset &&
+			next.meshVertexBuffer == packet.meshVertexBuffer && next.indexBuffer == packet.indexBuffer;
+
+		const bool nextCommand = next.indirectBuffer == packet.indirectBuffer && next.indirectStride == packet.indirectStride &&
+			next.indirectOffset == packet.indirectOffset + static_cast<VkDeviceSize>(packet.indirectStride) * count;
+
+		if (!sameState || !nextCommand)
+		{
+			break;
+		}
+	}
+
+	return count;
+}
+
+void DrawQueue::Record(VkCommandBuffer commandBuffer, VkPipelineLayout pipelineLayout, DrawStats& stats) const
+{
+	stats = DrawStats{ };
+	RecordPasses(commandBuffer, pipelineLayout, DrawPass::Opaque, static_cast<DrawPass>(static_cast<u8>(DrawPass::Count) - 1), stats);
+}
+
+void DrawQueue::RecordPasses(VkCommandBuffer commandBuffer, VkPipelineLayout pipelineLayout, DrawPass firstPass, DrawPass lastPass, DrawStats& stats) const
+{
+	stats.unsortedBinds = m_unsortedBinds;
+
+	// The pass is the top byte of the key, so each pass is a contiguous run of the sorted packets.
+	auto begin = std::partition_point(m_sorted.begin(), m_sorted.end(),
+		[firstPass](const SortEntry& entry) { return GetDrawKeyPass(entry.key) < firstPass; });
+	auto end = std::partition_point(begin, m_sorted.end(),
+		[lastPass](const SortEntry& entry) { return GetDrawKeyPass(entry.key) <= lastPass; });
+
+	// Bound state is tracked per call, so a new render pass starts by binding everything again.
+	VkPipeline boundPipeline = VK_NULL_HANDLE;
+	VkDescriptorSet boundDescriptorSet = VK_NULL_HANDLE;
+	VkBuffer boundVertexBuffer = VK_NULL_HANDLE;
+	VkDeviceSize boundVertexBufferOffset = 0;
+	VkBuffer boundMeshVertexBuffer = VK_NULL_HANDLE;
+	VkBuffer boundIndexBuffer = VK_NULL_HANDLE;
+
+	for (auto it = begin; it != end; )
+	{
+		const DrawPacket& packet = m_packets[it->packetIndex];
+		u32 drawCount = 1;
+
+		if (packet.pipeline != boundPipeline)
+		{
+			vkCmdBindPipeline(commandBuffer, VK_PIPELINE_BIND_POINT_GRAPHICS, packet.pipeline);
+			boundPipeline = packet.pipeline;
+			stats.pipelineBinds++;
+		}
+
+		if (packet.descriptorSet != VK_NULL_HANDLE && packet.descriptorSet != boundDescriptorSet)
+		{
+			vkCmdBindDescriptorSets(commandBuffer, VK_PIPELINE_BIND_POINT_GRAPHICS, pipelineLayout, 0, 1, &packet.descriptorSet, 0, nullptr);
+			boundDescriptorSet = packet.descriptorSet;
+			stats.descriptorSetBinds++;
+		}
+
+		if (packet.vertexBuffer != boundVertexBuffer || packet.vertexBufferOffset != boundVertexBufferOffset)
+		{
+			vkCmdBindVertexBuffers(commandBuffer, 0, 1, &packet.vertexBuffer, &packet.vertexBufferOffset);
+			boundVertexBuffer = packet.vertexBuffer;
+			boundVertexBufferOffset = packet.vertexBufferOffset;
+			stats.vertexBufferBinds++;
+		}
+
+		// Draws without a mesh leave binding 1 and the index buffer alone, so they stay bound for the next mesh draw.
+		if (packet.meshVertexBuffer != VK_NULL_HANDLE && packet.meshVertexBuffer != boundMeshVertexBuffer)
+		{
+			const VkDeviceSize offset = 0;
+			vkCmdBindVertexBuffers(commandBuffer, 1, 1, &packet.meshVertexBuffer, &offset);
+			boundMeshVertexBuffer = packet.meshVertexBuffer;
+			stats.vertexBufferBinds++;
+		}
+
+		if (packet.indexBuffer != VK_NULL_HANDLE)
+		{
+			if (packet.indexBuffer != boundIndexBuffer)
+			{
+				vkCmdBindIndexBuffer(commandBuffer, packet.indexBuffer, 0, VK_INDEX_TYPE_UINT32);
+				boundIndexBuffer = packet.indexBuffer;
+				stats.indexBufferBinds++;
+			}
+
+			if (packet.indirectBuffer != VK_NULL_HANDLE)
+			{
+				drawCount = countMergedDraws(it, end);
+				vkCmdDrawIndexedIndirect(commandBuffer, packet.indirectBuffer, packet.indirectOffset, drawCount, packet.indirectStride);
+			}
+			else
+			{
+				vkCmdDrawIndexed(commandBuffer, packet.vertexCount, packet.instanceCount, packet.firstVertex, packet.vertexOffset, packet.firstInstance);
+			}
+		}
+		else if (packet.indirectBuffer != VK_NULL_HANDLE)
+		{
+			drawCount = countMergedDraws(it, end);
+			vkCmdDrawIndirect(commandBuffer, packet.indirectBuffer, packet.indirectOffset, drawCount, packet.indirectStride);
+		}
+		else
+		{
+			vkCmdDraw(commandBuffer, packet.vertexCount, packet.instanceCount, packet.firstVertex, packet.firstInstance);
+		}
+
+		stats.drawCommands++;
+
+		for (u32 i = 0; i < drawCount; i++, ++it)
+		{
+			const DrawPacket& drawn = m_packets[it->packetIndex];
+
+			stats.draws++;
+			stats.indirectDraws += drawn.indirectBuffer != VK_NULL_HANDLE;
+			stats.triangles += static_cast<u64>(drawn.vertexCount / 3) * drawn.instanceCount;
+		}
+	}
+}
@@ -0,0 +1,180 @@
+#pragma once
+
+#include <memory_resource>
+#include <vector>
+#include <vulkan/vulkan.h>
+
+#include "Types.h"
+
+// Draws are not recorded as they are submitted. Each one is queued as a DrawPacket with a
+// 64-bit sort key, the queue is sorted once per frame, and only then recorded. Because the
+// most expensive state lives in the highest bits of the key, sorting groups draws that share
+// it, and recording only binds what actually changed from the previous draw.
+//
+// Key layout, most significant first:
+//
+//   63..56  pass        Render passes/phases, in the order they are drawn.
+//   55..40  pipeline    Pipeline variant. The most expensive bind, so it changes least often.
+//   39..24  material    Descriptor set / material within a pipeline.
+//   23..0   depth       Quantised depth, front to back, so opaque draws reject hidden pixels early.
+//
+// Indirect draws that end up next to each other in sorted order, with the same state and commands
+// next to each other in the same buffer, are recorded as one multi-draw-indirect command. Submitting
+// draws already in key order, with their commands written in that order, turns each run of draws
+// sharing a pipeline and buffers into a single command however many meshes and LODs it covers.
+
+enum class DrawPass : u8
+{
+	Opaque,
+	// Opaque draws that had to wait for the depth pyramid built from the Opaque pass,
+	// see OcclusionCulling.h. Empty when occlusion culling is off.
+	OpaqueLate,
+	// Blended over the opaque passes, e.g. particles.
+	Transparent,
+	Count
+};
+
+constexpr u64 MakeDrawKey(DrawPass pass, u32 pipelineIndex, u32 materialIndex, u32 depthBucket)
+{
+	return (static_cast<u64>(pass) << 56) |
+		(static_cast<u64>(pipelineIndex & 0xFFFF) << 40) |
+		(static_cast<u64>(materialIndex & 0xFFFF) << 24) |
+		static_cast<u64>(depthBucket & 0xFFFFFF);
+}
+
+// The same key moved to another pass.
+constexpr u64 SetDrawKeyPass(u64 key, DrawPass pass)
+{
+	return (key & ~(0xFFull << 56)) | (static_cast<u64>(pass) << 56);
+}
+
+constexpr DrawPass GetDrawKeyPass(u64 key)
+{
+	return static_cast<DrawPass>(key >> 56);
+}
+
+// Maps a [0, 1] depth to the 24-bit depth field.
+inline u32 QuantiseDepth(float depth)
+{
+	depth = depth < 0.0f ? 0.0f : (depth > 1.0f ? 1.0f : depth);
+	return static_cast<u32>(depth * static_cast<float>(0xFFFFFF));
+}
+
+struct DrawPacket
+{
+	u64 key;
+
+	VkPipeline pipeline;
+	// Optional, VK_NULL_HANDLE draws without binding set 0.
+	VkDescriptorSet descriptorSet;
+	// Vertex binding 0, the per-instance data.
+	VkBuffer vertexBuffer;
+	VkDeviceSize vertexBufferOffset;
+
+	// Mesh draws only, VK_NULL_HANDLE for draws whose vertices come from the shader.
+	// The mesh's vertices are bound to binding 1 and its 32-bit indices are drawn with vkCmdDrawIndexed.
+	VkBuffer meshVertexBuffer;
+	VkBuffer indexBuffer;
+
+	// With an index buffer these are the index count and first index.
+	u32 vertexCount;
+	u32 instanceCount;
+	u32 firstVertex;
+	u32 firstInstance;
+
+	// Added to every index, indexed draws only.
+	int32_t vertexOffset;
+
+	// Optional. When set the counts and offsets above are ignored and read from a VkDrawIndirectCommand,
+	// or a VkDrawIndexedIndirectCommand for indexed draws, at this offset instead. instanceCount is
+	// still filled in as the most instances the GPU may write, so the stats have an upper bound.
+	VkBuffer indirectBuffer;
+	VkDeviceSize indirectOffset;
+
+	// The distance between the commands of consecutive draws in 'indirectBuffer', at least the size of the command.
+	// A draw whose command follows the previous draw's at this distance, with the same state, is merged into its
+	// multi-draw. 0 never merges the draw.
+	u32 indirectStride;
+};
+
+// Per frame counts of the commands Record() emitted.
+struct DrawStats
+{
+	u32 draws{ 0 };
+	// The draws whose counts came from the GPU or a table of draw commands, included in 'draws'.
+	u32 indirectDraws{ 0 };
+	// The draw commands recorded, fewer than 'draws' when indirect draws were merged into multi-draws.
+	u32 drawCommands{ 0 };
+	u32 pipelineBinds{ 0 };
+	u32 descriptorSetBinds{ 0 };
+	u32 vertexBufferBinds{ 0 };
+	u32 indexBufferBinds{ 0 };
+
+	// The binds the same draws would have needed in submission order, i.e. without sorting.
+	u32 unsortedBinds{ 0 };
+
+	// Every triangle drawn, counting each instance's. Indirect draws count every instance they might draw.
+	u64 triangles{ 0 };
+
+	u32 TotalBinds() const { return pipelineBinds + descriptorSetBinds + vertexBufferBinds + indexBufferBinds; }
+};
+
+class DrawQueue
+{
+public:
+	// Empties the queue, keeping its storage so a queue at its working size does not allocate.
+	void Clear();
+
+	// Empties the queue and moves it to 'pFrameMemory', e.g. the frame's LinearArena, with room for
+	// 'expectedCount' packets. The previous storage is given back to its own memory resource,
+	// which for an arena does nothing, so it is fine if that arena has been reset since.
+	void Clear(std::pmr::memory_resource* pFrameMemory, u32 expectedCount);
+
+	void Submit(const DrawPacket& packet) { m_packets.push_back(packet); }
+
+	u32 GetCount() const { return static_cast<u32>(m_packets.size()); }
+
+	// Orders the queued packets by key. Stable, so draws with equal keys keep their submission order.
+	void Sort();
+
+	// The packet at position 'index' in sorted order. Only valid after Sort().
+	const DrawPacket& GetSorted(u32 index) const { return m_packets[m_sorted[index].packetIndex]; }
+
+	// The most draws merged into one multi-draw-indirect command, VkPhysicalDeviceLimits::maxDrawIndirectCount
+	// when the multiDrawIndirect feature is enabled. 1, the default, records every draw on its own.
+	void SetMaxDrawIndirectCount(u32 count) { m_maxDrawIndirectCount = count; }
+
+	// Records every packet in sorted order, skipping binds that match the currently bound state.
+	// Must be called inside a render pass, after Sort().
+	void Record(VkCommandBuffer commandBuffer, VkPipelineLayout pipelineLayout, DrawStats& stats) const;
+
+	// Records the packets of passes 'firstPass' to 'lastPass' inclusive, for frames split over several
+	// render passes. Adds to 'stats' rather than replacing them.
+	void RecordPasses(VkCommandBuffer commandBuffer, VkPipelineLayout pipelineLayout, DrawPass firstPass, DrawPass lastPass, DrawStats& stats) const;
+
+private:
+	struct SortEntry
+	{
+		u64 key;
+		u32 packetIndex;
+	};
+
+	using SortIterator = std::pmr::vector<SortEntry>::const_iterator;
+
+	// How many of the sorted packets from 'first' on can be recorded as one multi-draw, at least 1.
+	u32 countMergedDraws(SortIterator first, SortIterator end) const;
+
+	// Counts the binds needed to draw 'count' packets in the given order.
+	template<typename GetPacket>
+	static u32 countBinds(u32 count, GetPacket getPacket);
+
+	std::pmr::vector<DrawPacket> m_packets;
+
+	// Kept between frames by Clear() so sorting does not allocate once the queue has reached its working size.
+	std::pmr::vector<SortEntry> m_sorted;
+	std::pmr::vector<SortEntry> m_scratch;
+
+	u32 m_unsortedBinds{ 0 };
+
+	u32 m_maxDrawIndirectCount{ 1 };
+};
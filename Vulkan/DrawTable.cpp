@@ -0,0 +1,107 @@
+#include "DrawTable.h"
+#include "VulkanInit.h"
+
+#include <stdexcept>
+
+// Laid out as a VkDrawIndexedIndirectCommand, whose first four members read as a VkDrawIndirectCommand
+// with firstInstance taking the vertex offset's place, as in OcclusionCulling.
+struct DrawTableCommand
+{
+	u32 count;
+	u32 instanceCount;
+	u32 first;
+	u32 vertexOffsetOrFirstInstance;
+	u32 firstInstance;
+};
+
+static_assert(sizeof(DrawTableCommand) == sizeof(VkDrawIndexedIndirectCommand));
+
+void DrawTable::Init(const DrawTableDesc& desc)
+{
+	m_physicalDevice = desc.physicalDevice;
+	m_device = desc.device;
+	m_pAllocator = desc.pAllocator;
+
+	m_tables.assign(desc.slotCount, Table{ });
+}
+
+void DrawTable::Destroy()
+{
+	if (m_device == VK_NULL_HANDLE)
+	{
+		return;
+	}
+
+	destroyTables();
+
+	m_tables.clear();
+	m_capacity = 0;
+	m_device = VK_NULL_HANDLE;
+}
+
+void DrawTable::Reserve(u32 capacity)
+{
+	if (capacity <= m_capacity)
+	{
+		return;
+	}
+
+	destroyTables();
+
+	m_capacity = capacity;
+
+	const VkDeviceSize tableBytes = sizeof(DrawTableCommand) * static_cast<VkDeviceSize>(m_capacity);
+
+	for (Table& table : m_tables)
+	{
+		VulkanInit::CreateBuffer(m_physicalDevice, m_device, tableBytes, VK_BUFFER_USAGE_INDIRECT_BUFFER_BIT,
+			VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT | VK_MEMORY_PROPERTY_HOST_COHERENT_BIT, table.buffer, table.memory, { }, m_pAllocator);
+
+		vkMapMemory(m_device, table.memory, 0, tableBytes, 0, &table.pCommands);
+		table.count = 0;
+	}
+}
+
+void DrawTable::BeginFrame(u32 slot)
+{
+	m_tables[slot].count = 0;
+}
+
+DrawPacket DrawTable::AddDraw(u32 slot, const DrawPacket& packet)
+{
+	Table& table = m_tables[slot];
+
+	if (table.count == m_capacity)
+	{
+		throw std::runtime_error("draw table is full!");
+	}
+
+	const u32 index = table.count++;
+	const bool indexed = packet.indexBuffer != VK_NULL_HANDLE;
+
+	DrawTableCommand* pCommands = static_cast<DrawTableCommand*>(table.pCommands);
+	pCommands[index] = { packet.vertexCount, packet.instanceCount, packet.firstVertex,
+		indexed ? static_cast<u32>(packet.vertexOffset) : packet.firstInstance, packet.firstInstance };
+
+	DrawPacket indirect = packet;
+	indirect.indirectBuffer = table.buffer;
+	indirect.indirectOffset = sizeof(DrawTableCommand) * static_cast<VkDeviceSize>(index);
+	indirect.indirectStride = sizeof(DrawTableCommand);
+	return indirect;
+}
+
+void DrawTable::destroyTables()
+{
+	for (Table& table : m_tables)
+	{
+		if (table.buffer == VK_NULL_HANDLE)
+		{
+			continue;
+		}
+
+		vkDestroyBuffer(m_device, table.buffer, m_pAllocator);
+		vkFreeMemory(m_device, table.memory, m_pAllocator);
+
+		table = Table{ };
+	}
+}
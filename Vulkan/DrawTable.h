@@ -0,0 +1,75 @@
+#pragma once
+
+#include <vector>
+#include <vulkan/vulkan.h>
+
+#include "Types.h"
+#include "DrawQueue.h"
+
+// A table of draw commands, written by the CPU each frame, that turns direct draws into indirect ones.
+//
+// Every mesh and LOD already lives in MeshLibrary's shared vertex and index buffers, so a draw differs from
+// its neighbours only in its counts, first index, vertex offset and first instance. Written to the table,
+// those become a VkDrawIndexedIndirectCommand (or a VkDrawIndirectCommand for draws without a mesh), and
+// DrawQueue records a run of draws with the same state and consecutive commands as one multi-draw, see
+// DrawPacket::indirectStride. Draws are added in the order they are recorded in, so the run covers every
+// draw that shares a pipeline, whatever mesh, LOD or material each of them is.
+//
+// The commands keep each draw's first instance, rather than binding the instance buffer at an offset per
+// draw as OcclusionCulling does without it, so the table needs the multiDrawIndirect and
+// drawIndirectFirstInstance features.
+//
+// Each frame in flight has its own host visible table, kept mapped, and rewritten when the frame's slot comes round.
+
+struct DrawTableDesc
+{
+	VkPhysicalDevice physicalDevice{ VK_NULL_HANDLE };
+	VkDevice device{ VK_NULL_HANDLE };
+
+	// The number of frames in flight. A table is kept per slot.
+	u32 slotCount{ 2 };
+
+	// Host allocator for every object the table creates. Must outlive it.
+	const VkAllocationCallbacks* pAllocator{ nullptr };
+};
+
+class DrawTable
+{
+public:
+	void Init(const DrawTableDesc& desc);
+
+	void Destroy();
+
+	// Room for 'capacity' draws a frame. Only grows, so a smaller scene keeps the tables it has.
+	// The GPU must not be using any of them.
+	void Reserve(u32 capacity);
+
+	u32 GetCapacity() const { return m_capacity; }
+
+	// Starts writing the table of the frame in 'slot', whose previous frame the caller has waited for.
+	void BeginFrame(u32 slot);
+
+	// Writes the counts and offsets of 'packet', a direct draw, into the slot's table and returns the same draw
+	// reading them from there. Draws added one after another have consecutive commands. Throws when the table is full.
+	DrawPacket AddDraw(u32 slot, const DrawPacket& packet);
+
+private:
+	void destroyTables();
+
+	VkPhysicalDevice m_physicalDevice{ VK_NULL_HANDLE };
+	VkDevice m_device{ VK_NULL_HANDLE };
+	const VkAllocationCallbacks* m_pAllocator{ nullptr };
+
+	u32 m_capacity{ 0 };
+
+	// Per slot, host visible and kept mapped.
+	struct Table
+	{
+		VkBuffer buffer;
+		VkDeviceMemory memory;
+		void* pCommands;
+		u32 count;
+	};
+
+	std::vector<Table> m_tables;
+};
@@ -0,0 +1,62 @@
+#include "DynamicResolution.h"
+
+#include <algorithm>
+#include <cmath>
+#include <stdexcept>
+
+// Weight of the newest sample in the moving average.
+constexpr double SMOOTHING = 0.1;
+
+// GPU times within this fraction of the target do not change the scale.
+constexpr double DEAD_BAND = 0.05;
+
+// The scale only moves in steps of this size, and at most a few steps per update.
+constexpr float SCALE_STEP = 1.0f / 32.0f;
+constexpr float MAX_STEPS_PER_UPDATE = 2.0f;
+
+void DynamicResolution::Init(const DynamicResolutionSettings& settings, VkExtent2D outputExtent)
+{
+	if (settings.minScale <= 0.0f || settings.minScale > settings.maxScale)
+	{
+		throw std::runtime_error("invalid dynamic resolution scale limits!");
+	}
+
+	m_settings = settings;
+	m_outputExtent = outputExtent;
+	m_scale = settings.maxScale;
+	m_smoothedGpuMs = 0.0;
+	m_hasSample = false;
+}
+
+void DynamicResolution::Update(double gpuMs)
+{
+	if (!m_settings.enabled || gpuMs <= 0.0)
+	{
+		return;
+	}
+
+	m_smoothedGpuMs = m_hasSample ? m_smoothedGpuMs + (gpuMs - m_smoothedGpuMs) * SMOOTHING : gpuMs;
+	m_hasSample = true;
+
+	double ratio = m_settings.targetGpuMs / m_smoothedGpuMs;
+	if (std::abs(ratio - 1.0) < DEAD_BAND)
+	{
+		return;
+	}
+
+	// Pixel count goes with scale squared, so the scale goes with the square root of the time ratio.
+	float desired = m_scale * static_cast<float>(std::sqrt(ratio));
+	float steps = std::clamp(std::round((desired - m_scale) / SCALE_STEP), -MAX_STEPS_PER_UPDATE, MAX_STEPS_PER_UPDATE);
+
+	m_scale = std::clamp(m_scale + steps * SCALE_STEP, m_settings.minScale, m_settings.maxScale);
+}
+
+VkExtent2D DynamicResolution::scaleExtent(float scale) const
+{
+	// Rounded up, so the maximum extent always covers the output at a scale of 1.
+	return
+	{
+		std::max(1u, static_cast<u32>(std::ceil(m_outputExtent.width * scale))),
+		std::max(1u, static_cast<u32>(std::ceil(m_outputExtent.height * scale))),
+	};
+}
@@ -0,0 +1,57 @@
+#pragma once
+
+#include <vulkan/vulkan.h>
+
+#include "Types.h"
+
+// Picks the resolution the scene is rendered at from measured GPU frame times.
+//
+// The scene is drawn into an offscreen target at 'scale' times the output size, then scaled
+// up (or down) into the swapchain image. GPU cost is roughly proportional to the number of
+// pixels shaded, i.e. to scale squared, so each update moves the scale by the square root of
+// how far the smoothed GPU time is from the target. Times within a small band around the target
+// leave the scale alone, and the scale moves in coarse steps, so it settles instead of changing
+// (and visibly shimmering) every frame.
+
+struct DynamicResolutionSettings
+{
+	bool enabled{ false };
+
+	// The GPU time per frame to hold, e.g. a bit under 16.6ms for 60Hz.
+	double targetGpuMs{ 15.0 };
+
+	// Limits on the render scale, as a fraction of the output size on each axis.
+	// A maximum above 1 renders at a higher resolution than the output when there is headroom.
+	float minScale{ 0.5f };
+	float maxScale{ 1.0f };
+};
+
+class DynamicResolution
+{
+public:
+	// Starts at the maximum scale. Throws if the scale limits are not valid.
+	void Init(const DynamicResolutionSettings& settings, VkExtent2D outputExtent);
+
+	// Feeds in the GPU time of a completed frame and updates the scale for the frames recorded after it.
+	void Update(double gpuMs);
+
+	float GetScale() const { return m_scale; }
+
+	// The area of the scene target drawn this frame.
+	VkExtent2D GetRenderExtent() const { return scaleExtent(m_scale); }
+
+	// The size the scene target has to be allocated at, so it never needs recreating.
+	VkExtent2D GetMaxExtent() const { return scaleExtent(m_settings.maxScale); }
+
+private:
+	VkExtent2D scaleExtent(float scale) const;
+
+	DynamicResolutionSettings m_settings;
+	VkExtent2D m_outputExtent{ };
+
+	float m_scale{ 1.0f };
+
+	// Exponential moving average of the GPU time, so a single slow frame does not drop the resolution.
+	double m_smoothedGpuMs{ 0.0 };
+	bool m_hasSample{ false };
+};
@@ -0,0 +1,66 @@
+#pragma once
+
+#include <cstdint>
+#include <cstddef>
+
+// SPIR-V for each shader, compiled into the executable at build time.
+// The .inc files are generated by the Makefile or CompileShaders.bat using glslc -mfmt=c,
+// which writes the module as a brace-enclosed list of 32-bit words.
+// vkCreateShaderModule requires the code to be 4-byte aligned, which uint32_t arrays already are,
+// but it is spelled out here so the requirement is not lost if the element type ever changes.
+struct EmbeddedShader
+{
+	const uint32_t* pCode;
+	size_t codeSize; // In bytes, as expected by VkShaderModuleCreateInfo.
+};
+
+alignas(4) inline constexpr uint32_t g_vertShaderSpv[] =
+#include "Shaders/CompiledShaders/vert.spv.inc"
+;
+
+alignas(4) inline constexpr uint32_t g_fragShaderSpv[] =
+#include "Shaders/CompiledShaders/frag.spv.inc"
+;
+
+alignas(4) inline constexpr uint32_t g_meshVertShaderSpv[] =
+#include "Shaders/CompiledShaders/mesh_vert.spv.inc"
+;
+
+alignas(4) inline constexpr uint32_t g_meshFragShaderSpv[] =
+#include "Shaders/CompiledShaders/mesh_frag.spv.inc"
+;
+
+alignas(4) inline constexpr uint32_t g_particleVertShaderSpv[] =
+#include "Shaders/CompiledShaders/particle_vert.spv.inc"
+;
+
+alignas(4) inline constexpr uint32_t g_particleFragShaderSpv[] =
+#include "Shaders/CompiledShaders/particle_frag.spv.inc"
+;
+
+alignas(4) inline constexpr uint32_t g_particleCompShaderSpv[] =
+#include "Shaders/CompiledShaders/particle_comp.spv.inc"
+;
+
+alignas(4) inline constexpr uint32_t g_depthReduceCompShaderSpv[] =
+#include "Shaders/CompiledShaders/depth_reduce_comp.spv.inc"
+;
+
+alignas(4) inline constexpr uint32_t g_occlusionCullCompShaderSpv[] =
+#include "Shaders/CompiledShaders/occlusion_cull_comp.spv.inc"
+;
+
+alignas(4) inline constexpr uint32_t g_lightAssignCompShaderSpv[] =
+#include "Shaders/CompiledShaders/light_assign_comp.spv.inc"
+;
+
+inline constexpr EmbeddedShader g_vertShader{ g_vertShaderSpv, sizeof(g_vertShaderSpv) };
+inline constexpr EmbeddedShader g_fragShader{ g_fragShaderSpv, sizeof(g_fragShaderSpv) };
+inline constexpr EmbeddedShader g_meshVertShader{ g_meshVertShaderSpv, sizeof(g_meshVertShaderSpv) };
+inline constexpr EmbeddedShader g_meshFragShader{ g_meshFragShaderSpv, sizeof(g_meshFragShaderSpv) };
+inline constexpr EmbeddedShader g_particleVertShader{ g_particleVertShaderSpv, sizeof(g_particleVertShaderSpv) };
+inline constexpr EmbeddedShader g_particleFragShader{ g_particleFragShaderSpv, sizeof(g_particleFragShaderSpv) };
+inline constexpr EmbeddedShader g_particleCompShader{ g_particleCompShaderSpv, sizeof(g_particleCompShaderSpv) };
+inline constexpr EmbeddedShader g_depthReduceCompShader{ g_depthReduceCompShaderSpv, sizeof(g_depthReduceCompShaderSpv) };
+inline constexpr EmbeddedShader g_occlusionCullCompShader{ g_occlusionCullCompShaderSpv, sizeof(g_occlusionCullCompShaderSpv) };
+inline constexpr EmbeddedShader g_lightAssignCompShader{ g_lightAssignCompShaderSpv, sizeof(g_lightAssignCompShaderSpv) };
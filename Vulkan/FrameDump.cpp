@@ -0,0 +1,549 @@
+#include "FrameDump.h"
+#include "VulkanInit.h"
+
+#include <algorithm>
+#include <array>
+#include <cstdio>
+#include <cstring>
+#include <fstream>
+#include <iostream>
+#include <stdexcept>
+
+// Stored deflate blocks hold at most this many bytes each.
+constexpr size_t DEFLATE_STORED_BLOCK_SIZE = 65535;
+
+// Host cached memory makes the encoders' reads fast, but not every device has host visible memory that is.
+static VkMemoryPropertyFlags chooseReadbackMemory(VkPhysicalDevice physicalDevice)
+{
+	VkPhysicalDeviceMemoryProperties memProperties;
+	vkGetPhysicalDeviceMemoryProperties(physicalDevice, &memProperties);
+
+	const VkMemoryPropertyFlags cached = VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT | VK_MEMORY_PROPERTY_HOST_CACHED_BIT;
+
+	for (u32 i = 0; i < memProperties.memoryTypeCount; i++)
+	{
+		if ((memProperties.memoryTypes[i].propertyFlags & cached) == cached)
+		{
+			return cached;
+		}
+	}
+
+	return VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT | VK_MEMORY_PROPERTY_HOST_COHERENT_BIT;
+}
+
+static void putBigEndian(u8* pOut, u32 value)
+{
+	pOut[0] = static_cast<u8>(value >> 24);
+	pOut[1] = static_cast<u8>(value >> 16);
+	pOut[2] = static_cast<u8>(value >> 8);
+	pOut[3] = static_cast<u8>(value);
+}
+
+// The CRC-32 PNG chunks end with. 'crc' is the running value, starting at 0.
+static u32 updateCrc32(u32 crc, const u8* pData, size_t size)
+{
+	static const std::array<u32, 256> table = []()
+	{
+		std::array<u32, 256> values{ };
+		for (u32 i = 0; i < 256; i++)
+		{
+			u32 c = i;
+			for (u32 bit = 0; bit < 8; bit++)
+			{
+				c = (c & 1) ? 0xEDB88320u ^ (c >> 1) : c >> 1;
+			}
+			values[i] = c;
+		}
+		return values;
+	}();
+
+	crc = ~crc;
+	for (size_t i = 0; i < size; i++)
+	{
+		crc = table[(crc ^ pData[i]) & 0xFF] ^ (crc >> 8);
+	}
+	return ~crc;
+}
+
+// The Adler-32 the zlib stream ends with. 'adler' is the running value, starting at 1.
+static u32 updateAdler32(u32 adler, const u8* pData, size_t size)
+{
+	// The largest run whose sums cannot overflow 32 bits before they are reduced.
+	constexpr size_t MAX_RUN = 5552;
+
+	u32 a = adler & 0xFFFF;
+	u32 b = adler >> 16;
+
+	while (size > 0)
+	{
+		const size_t run = std::min(size, MAX_RUN);
+		for (size_t i = 0; i < run; i++)
+		{
+			a += pData[i];
+			b += a;
+		}
+		a %= 65521;
+		b %= 65521;
+
+		pData += run;
+		size -= run;
+	}
+
+	return (b << 16) | a;
+}
+
+static bool writeChunk(std::ofstream& file, const char* type, const u8* pData, u32 size)
+{
+	u8 header[8];
+	putBigEndian(header, size);
+	std::memcpy(header + 4, type, 4);
+
+	u8 crc[4];
+	putBigEndian(crc, updateCrc32(updateCrc32(0, header + 4, 4), pData, size));
+
+	file.write(reinterpret_cast<const char*>(header), sizeof(header));
+	file.write(reinterpret_cast<const char*>(pData), size);
+	file.write(reinterpret_cast<const char*>(crc), sizeof(crc));
+
+	return file.good();
+}
+
+void FrameDump::Init(const FrameDumpDesc& desc)
+{
+	switch (desc.format)
+	{
+	case VK_FORMAT_B8G8R8A8_UNORM:
+	case VK_FORMAT_B8G8R8A8_SRGB:
+		m_bgra = true;
+		break;
+	case VK_FORMAT_R8G8B8A8_UNORM:
+	case VK_FORMAT_R8G8B8A8_SRGB:
+		m_bgra = false;
+		break;
+	default:
+		throw std::runtime_error("unsupported image format for frame dumps!");
+	}
+
+	if (desc.settings.ringSize == 0)
+	{
+		throw std::runtime_error("frame dump ring must hold at least one frame!");
+	}
+
+	m_physicalDevice = desc.physicalDevice;
+	m_device = desc.device;
+	m_pSync = desc.pSync;
+	m_pAllocator = desc.pAllocator;
+	m_settings = desc.settings;
+	m_extent = desc.extent;
+
+	createSlots(m_settings.ringSize);
+
+	m_jobs.assign(m_settings.ringSize, 0);
+	m_jobHead = 0;
+	m_jobCount = 0;
+	m_encodingCount = 0;
+	m_stopRequested = false;
+
+	u32 workerCount = m_settings.workerCount;
+	if (workerCount == 0)
+	{
+		const u32 hardwareThreads = std::thread::hardware_concurrency();
+		workerCount = hardwareThreads > 1 ? hardwareThreads - 1 : 1;
+	}
+
+	// More encoders than frames in the ring would never all have work.
+	workerCount = std::min(workerCount, m_settings.ringSize);
+
+	for (u32 i = 0; i < workerCount; i++)
+	{
+		m_workers.emplace_back(&FrameDump::workerThread, this);
+	}
+
+	std::cout << "Dumping " << m_extent.width << "x" << m_extent.height << " frames to " << m_settings.directory
+		<< " as " << (m_settings.format == FrameDumpFormat::Png ? "PNG" : (m_bgra ? "raw BGRA" : "raw RGBA"))
+		<< " on " << workerCount << " threads" << std::endl;
+}
+
+void FrameDump::Destroy()
+{
+	if (m_slots.empty())
+	{
+		return;
+	}
+
+	Flush();
+
+	{
+		std::lock_guard<std::mutex> lock(m_mutex);
+		m_stopRequested = true;
+	}
+	m_jobReady.notify_all();
+
+	for (std::thread& worker : m_workers)
+	{
+		worker.join();
+	}
+	m_workers.clear();
+
+	for (Slot& slot : m_slots)
+	{
+		vkUnmapMemory(m_device, slot.memory);
+		vkDestroyBuffer(m_device, slot.buffer, m_pAllocator);
+		vkFreeMemory(m_device, slot.memory, m_pAllocator);
+	}
+
+	m_slots.clear();
+	m_jobs.clear();
+	m_nextSlot = 0;
+	m_recordedSlot = ~0u;
+}
+
+void FrameDump::Poll()
+{
+	for (u32 i = 0; i < m_slots.size(); i++)
+	{
+		Slot& slot = m_slots[i];
+		if (slot.state.load(std::memory_order_relaxed) == SlotCopying && m_pSync->IsComplete(slot.copied))
+		{
+			startEncoding(i);
+		}
+	}
+}
+
+bool FrameDump::RecordCopy(VkCommandBuffer commandBuffer, VkImage image, VkImageLayout layout, u64 frameNumber)
+{
+	// Round robin from the last slot used, so frames are normally written in order.
+	u32 slotIndex = ~0u;
+	for (u32 i = 0; i < m_slots.size(); i++)
+	{
+		const u32 candidate = (m_nextSlot + i) % static_cast<u32>(m_slots.size());
+
+		// Acquire, so the encoder that freed the slot has finished reading it before the copy can overwrite it.
+		if (m_slots[candidate].state.load(std::memory_order_acquire) == SlotFree)
+		{
+			slotIndex = candidate;
+			break;
+		}
+	}
+
+	if (slotIndex == ~0u)
+	{
+		m_dropped++;
+		return false;
+	}
+
+	Slot& slot = m_slots[slotIndex];
+	slot.frameNumber = frameNumber;
+	slot.state.store(SlotRecorded, std::memory_order_relaxed);
+
+	m_nextSlot = (slotIndex + 1) % static_cast<u32>(m_slots.size());
+	m_recordedSlot = slotIndex;
+	m_copied++;
+
+	// The image was last written by the render pass or, with dynamic resolution, the upscaling blit.
+	VkImageMemoryBarrier imageBarrier{};
+	imageBarrier.sType = VK_STRUCTURE_TYPE_IMAGE_MEMORY_BARRIER;
+	imageBarrier.srcAccessMask = VK_ACCESS_COLOR_ATTACHMENT_WRITE_BIT | VK_ACCESS_TRANSFER_WRITE_BIT;
+	imageBarrier.dstAccessMask = VK_ACCESS_TRANSFER_READ_BIT;
+	imageBarrier.oldLayout = layout;
+	imageBarrier.newLayout = VK_IMAGE_LAYOUT_TRANSFER_SRC_OPTIMAL;
+	imageBarrier.srcQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED;
+	imageBarrier.dstQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED;
+	imageBarrier.image = image;
+	imageBarrier.subresourceRange = { VK_IMAGE_ASPECT_COLOR_BIT, 0, 1, 0, 1 };
+
+	vkCmdPipelineBarrier(commandBuffer, VK_PIPELINE_STAGE_COLOR_ATTACHMENT_OUTPUT_BIT | VK_PIPELINE_STAGE_TRANSFER_BIT, VK_PIPELINE_STAGE_TRANSFER_BIT, 0,
+		0, nullptr, 0, nullptr, 1, &imageBarrier);
+
+	// Tightly packed, rows top to bottom.
+	VkBufferImageCopy region{};
+	region.imageSubresource = { VK_IMAGE_ASPECT_COLOR_BIT, 0, 0, 1 };
+	region.imageExtent = { m_extent.width, m_extent.height, 1 };
+
+	vkCmdCopyImageToBuffer(commandBuffer, image, VK_IMAGE_LAYOUT_TRANSFER_SRC_OPTIMAL, slot.buffer, 1, &region);
+
+	// The image goes back to the layout it came in, e.g. for presenting, and the copy is made visible to the host.
+	imageBarrier.srcAccessMask = VK_ACCESS_TRANSFER_READ_BIT;
+	imageBarrier.dstAccessMask = 0;
+	imageBarrier.oldLayout = VK_IMAGE_LAYOUT_TRANSFER_SRC_OPTIMAL;
+	imageBarrier.newLayout = layout;
+
+	VkBufferMemoryBarrier bufferBarrier{};
+	bufferBarrier.sType = VK_STRUCTURE_TYPE_BUFFER_MEMORY_BARRIER;
+	bufferBarrier.srcAccessMask = VK_ACCESS_TRANSFER_WRITE_BIT;
+	bufferBarrier.dstAccessMask = VK_ACCESS_HOST_READ_BIT;
+	bufferBarrier.srcQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED;
+	bufferBarrier.dstQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED;
+	bufferBarrier.buffer = slot.buffer;
+	bufferBarrier.offset = 0;
+	bufferBarrier.size = VK_WHOLE_SIZE;
+
+	vkCmdPipelineBarrier(commandBuffer, VK_PIPELINE_STAGE_TRANSFER_BIT, VK_PIPELINE_STAGE_HOST_BIT | VK_PIPELINE_STAGE_BOTTOM_OF_PIPE_BIT, 0,
+		0, nullptr, 1, &bufferBarrier, 1, &imageBarrier);
+
+	return true;
+}
+
+void FrameDump::Submitted(SyncPoint point)
+{
+	if (m_recordedSlot == ~0u)
+	{
+		return;
+	}
+
+	Slot& slot = m_slots[m_recordedSlot];
+	m_recordedSlot = ~0u;
+
+	slot.copied = point;
+	slot.state.store(SlotCopying, std::memory_order_relaxed);
+}
+
+void FrameDump::Flush()
+{
+	for (u32 i = 0; i < m_slots.size(); i++)
+	{
+		Slot& slot = m_slots[i];
+		if (slot.state.load(std::memory_order_relaxed) == SlotCopying)
+		{
+			m_pSync->Wait(slot.copied);
+			startEncoding(i);
+		}
+	}
+
+	std::unique_lock<std::mutex> lock(m_mutex);
+	m_jobDone.wait(lock, [this]() { return m_encodingCount == 0; });
+}
+
+FrameDumpStats FrameDump::GetStats() const
+{
+	FrameDumpStats stats;
+	stats.copied = m_copied;
+	stats.dropped = m_dropped;
+	stats.written = m_written.load(std::memory_order_relaxed);
+	stats.failed = m_failed.load(std::memory_order_relaxed);
+	return stats;
+}
+
+void FrameDump::createSlots(u32 count)
+{
+	const VkMemoryPropertyFlags properties = chooseReadbackMemory(m_physicalDevice);
+
+	// Cached memory is not necessarily coherent, and invalidating memory that is does no harm.
+	m_invalidate = (properties & VK_MEMORY_PROPERTY_HOST_CACHED_BIT) != 0;
+
+	const VkDeviceSize size = VkDeviceSize(m_extent.width) * m_extent.height * 4;
+
+	m_slots = std::vector<Slot>(count);
+
+	for (Slot& slot : m_slots)
+	{
+		VulkanInit::CreateBuffer(m_physicalDevice, m_device, size, VK_BUFFER_USAGE_TRANSFER_DST_BIT, properties,
+			slot.buffer, slot.memory, { }, m_pAllocator);
+
+		void* pMapped;
+		vkMapMemory(m_device, slot.memory, 0, size, 0, &pMapped);
+		slot.pPixels = static_cast<const u8*>(pMapped);
+	}
+}
+
+void FrameDump::startEncoding(u32 slotIndex)
+{
+	Slot& slot = m_slots[slotIndex];
+
+	if (m_invalidate)
+	{
+		VkMappedMemoryRange range{};
+		range.sType = VK_STRUCTURE_TYPE_MAPPED_MEMORY_RANGE;
+		range.memory = slot.memory;
+		range.offset = 0;
+		range.size = VK_WHOLE_SIZE;
+		vkInvalidateMappedMemoryRanges(m_device, 1, &range);
+	}
+
+	slot.state.store(SlotEncoding, std::memory_order_relaxed);
+
+	{
+		std::lock_guard<std::mutex> lock(m_mutex);
+		m_jobs[(m_jobHead + m_jobCount) % m_jobs.size()] = slotIndex;
+		m_jobCount++;
+		m_encodingCount++;
+	}
+	m_jobReady.notify_one();
+}
+
+void FrameDump::workerThread()
+{
+	// Kept across frames, so an encoder only allocates for its first.
+	std::vector<u8> scratch;
+
+	for (;;)
+	{
+		u32 slotIndex;
+
+		{
+			std::unique_lock<std::mutex> lock(m_mutex);
+			m_jobReady.wait(lock, [this]() { return m_jobCount > 0 || m_stopRequested; });
+
+			// Stopping only once the queue is empty, so nothing queued is lost.
+			if (m_jobCount == 0)
+			{
+				return;
+			}
+
+			slotIndex = m_jobs[m_jobHead];
+			m_jobHead = (m_jobHead + 1) % static_cast<u32>(m_jobs.size());
+			m_jobCount--;
+		}
+
+		Slot& slot = m_slots[slotIndex];
+
+		if (writeFrame(slot, scratch))
+		{
+			m_written.fetch_add(1, std::memory_order_relaxed);
+		}
+		else if (m_failed.fetch_add(1, std::memory_order_relaxed) == 0)
+		{
+			// Only the first, a directory that cannot be written to would otherwise report every frame.
+			std::cerr << "failed to write frame " << slot.frameNumber << " to " << m_settings.directory << std::endl;
+		}
+
+		// Release, so the render thread cannot reuse the buffer before the reads above are done.
+		slot.state.store(SlotFree, std::memory_order_release);
+
+		{
+			std::lock_guard<std::mutex> lock(m_mutex);
+			m_encodingCount--;
+		}
+		m_jobDone.notify_all();
+	}
+}
+
+bool FrameDump::writeFrame(const Slot& slot, std::vector<u8>& scratch) const
+{
+	char name[64];
+
+	if (m_settings.format == FrameDumpFormat::Png)
+	{
+		std::snprintf(name, sizeof(name), "frame_%06llu.png", static_cast<unsigned long long>(slot.frameNumber));
+		return writePng(m_settings.directory + '/' + name, slot.pPixels, scratch);
+	}
+
+	std::snprintf(name, sizeof(name), "frame_%06llu_%ux%u.raw", static_cast<unsigned long long>(slot.frameNumber), m_extent.width, m_extent.height);
+	return writeRaw(m_settings.directory + '/' + name, slot.pPixels);
+}
+
+bool FrameDump::writePng(const std::string& path, const u8* pPixels, std::vector<u8>& scratch) const
+{
+	const u32 width = m_extent.width;
+	const u32 height = m_extent.height;
+
+	// Each row is a filter type byte, 0 for none, then the RGB pixels.
+	const size_t rowSize = 1 + size_t(width) * 3;
+	const size_t imageSize = rowSize * height;
+	const size_t blockCount = std::max<size_t>((imageSize + DEFLATE_STORED_BLOCK_SIZE - 1) / DEFLATE_STORED_BLOCK_SIZE, 1);
+
+	// The row being converted, then the zlib stream: a 2 byte header, each block's 5 byte header and data, and the Adler-32.
+	const size_t streamSize = 2 + blockCount * 5 + imageSize + 4;
+	scratch.resize(rowSize + streamSize);
+
+	u8* pRow = scratch.data();
+	u8* pStream = pRow + rowSize;
+	u8* pOut = pStream;
+
+	// zlib header: deflate with a 32K window (the largest), the fastest compression level and the check bits the header needs.
+	// Every block below is stored uncompressed, so no window is ever used.
+	*pOut++ = 0x78;
+	*pOut++ = 0x01;
+
+	const int red = m_bgra ? 2 : 0;
+	const int blue = m_bgra ? 0 : 2;
+
+	u32 adler = 1;
+	size_t imageRemaining = imageSize;
+	size_t blockRemaining = 0;
+
+	for (u32 y = 0; y < height; y++)
+	{
+		const u8* pSource = pPixels + size_t(y) * width * 4;
+
+		pRow[0] = 0;
+		for (u32 x = 0; x < width; x++)
+		{
+			pRow[1 + x * 3 + 0] = pSource[x * 4 + red];
+			pRow[1 + x * 3 + 1] = pSource[x * 4 + 1];
+			pRow[1 + x * 3 + 2] = pSource[x * 4 + blue];
+		}
+
+		adler = updateAdler32(adler, pRow, rowSize);
+
+		// Rows are not aligned to blocks, so a row may straddle two.
+		const u8* pData = pRow;
+		size_t dataRemaining = rowSize;
+
+		while (dataRemaining > 0)
+		{
+			if (blockRemaining == 0)
+			{
+				const u16 blockSize = static_cast<u16>(std::min(imageRemaining, DEFLATE_STORED_BLOCK_SIZE));
+				const u16 inverseSize = static_cast<u16>(~blockSize);
+				const bool finalBlock = blockSize == imageRemaining;
+
+				// The final flag and stored type, then the length and its complement, little endian.
+				*pOut++ = finalBlock ? 1 : 0;
+				*pOut++ = static_cast<u8>(blockSize);
+				*pOut++ = static_cast<u8>(blockSize >> 8);
+				*pOut++ = static_cast<u8>(inverseSize);
+				*pOut++ = static_cast<u8>(inverseSize >> 8);
+
+				blockRemaining = blockSize;
+			}
+
+			const size_t count = std::min(dataRemaining, blockRemaining);
+			std::memcpy(pOut, pData, count);
+
+			pOut += count;
+			pData += count;
+			dataRemaining -= count;
+			blockRemaining -= count;
+			imageRemaining -= count;
+		}
+	}
+
+	putBigEndian(pOut, adler);
+	pOut += 4;
+
+	std::ofstream file(path, std::ios::binary | std::ios::trunc);
+	if (!file)
+	{
+		return false;
+	}
+
+	static const u8 signature[8] = { 0x89, 'P', 'N', 'G', '\r', '\n', 0x1A, '\n' };
+	file.write(reinterpret_cast<const char*>(signature), sizeof(signature));
+
+	// 8 bits per channel RGB, no interlacing.
+	u8 header[13];
+	putBigEndian(header, width);
+	putBigEndian(header + 4, height);
+	header[8] = 8;
+	header[9] = 2;
+	header[10] = 0;
+	header[11] = 0;
+	header[12] = 0;
+
+	return writeChunk(file, "IHDR", header, sizeof(header))
+		&& writeChunk(file, "IDAT", pStream, static_cast<u32>(pOut - pStream))
+		&& writeChunk(file, "IEND", nullptr, 0);
+}
+
+bool FrameDump::writeRaw(const std::string& path, const u8* pPixels) const
+{
+	std::ofstream file(path, std::ios::binary | std::ios::trunc);
+	if (!file)
+	{
+		return false;
+	}
+
+	file.write(reinterpret_cast<const char*>(pPixels), std::streamsize(m_extent.width) * m_extent.height * 4);
+	return file.good();
+}
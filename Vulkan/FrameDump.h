@@ -0,0 +1,183 @@
+#pragma once
+
+#include <atomic>
+#include <condition_variable>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <vector>
+#include <vulkan/vulkan.h>
+
+#include "Types.h"
+#include "QueueSync.h"
+
+// Asynchronous readback of rendered frames, written out as image files, e.g. for golden image tests or video.
+//
+// Each dumped frame's output image is copied into one of a ring of host visible buffers at the end of the
+// frame's own command buffer. The copy is done once the graphics timeline passes the frame's submit, and
+// the frame loop only ever polls for that, so it never waits on the GPU for a dump. Finished copies
+// are handed to a pool of encoding threads, which read straight from the mapped buffer and give it back
+// to the ring once the file is written.
+//
+// When every buffer in the ring is still being copied or encoded the frame is dropped and counted rather
+// than waited for, so dumping costs the frame loop no more than the copy itself. A ring that drops frames
+// is too small for the rate the encoders keep up with; raw output is the cheapest to encode.
+//
+// The readback buffers are host cached where the device has such memory, as the encoders read every byte.
+
+enum class FrameDumpFormat : u32
+{
+	// RGB PNG with stored (uncompressed) deflate blocks. The alpha channel is dropped.
+	Png,
+	// The image's bytes as copied, 4 per pixel in the order of its format, rows top to bottom, no header.
+	Raw,
+};
+
+struct FrameDumpSettings
+{
+	// The directory the frames are written to, which must already exist. Empty disables dumping.
+	// Files are named after the frame number, frame_000042.png or frame_000042_<w>x<h>.raw.
+	std::string directory;
+
+	FrameDumpFormat format{ FrameDumpFormat::Png };
+
+	// Frames that can be waiting on their copy or being encoded at once.
+	u32 ringSize{ 8 };
+
+	// Encoding threads. 0 uses one per hardware thread, leaving one for the render thread.
+	u32 workerCount{ 0 };
+};
+
+struct FrameDumpDesc
+{
+	VkPhysicalDevice physicalDevice{ VK_NULL_HANDLE };
+	VkDevice device{ VK_NULL_HANDLE };
+
+	// Polled for the copies' submits. Must outlive the dump.
+	QueueSync* pSync{ nullptr };
+
+	// Of the images RecordCopy() is given. Only 8 bit RGBA and BGRA formats are supported.
+	VkExtent2D extent{ };
+	VkFormat format{ VK_FORMAT_UNDEFINED };
+
+	FrameDumpSettings settings;
+
+	// Host allocator for every object the dump creates. Must outlive it.
+	const VkAllocationCallbacks* pAllocator{ nullptr };
+};
+
+struct FrameDumpStats
+{
+	// Frames whose copy was recorded.
+	u64 copied{ 0 };
+	// Frames skipped because the ring was full.
+	u64 dropped{ 0 };
+	u64 written{ 0 };
+	// Frames whose file could not be written.
+	u64 failed{ 0 };
+};
+
+class FrameDump
+{
+public:
+	~FrameDump() { Destroy(); }
+
+	// Throws if the format is not supported. Starts the encoding threads.
+	void Init(const FrameDumpDesc& desc);
+
+	// Finishes every frame still being dumped, then stops the threads and frees the ring.
+	void Destroy();
+
+	bool IsEnabled() const { return !m_slots.empty(); }
+
+	// Hands every frame whose copy has finished to the encoders. Never waits, so it can be called every frame.
+	void Poll();
+
+	// Copies 'image' into the next free buffer of the ring, for the frame numbered 'frameNumber'.
+	// The image must be in 'layout', after colour attachment or transfer writes, and is left in it.
+	// Returns false, recording nothing, when the ring is full and the frame is dropped.
+	bool RecordCopy(VkCommandBuffer commandBuffer, VkImage image, VkImageLayout layout, u64 frameNumber);
+
+	// Gives the copy recorded since the last call, if any, the point of the submit it was recorded into.
+	void Submitted(SyncPoint point);
+
+	// Waits for every recorded copy to finish and be written out.
+	void Flush();
+
+	FrameDumpStats GetStats() const;
+
+private:
+	enum SlotState : u32
+	{
+		SlotFree,
+		// Recorded, waiting for Submitted().
+		SlotRecorded,
+		// Submitted, waiting for the submit's point.
+		SlotCopying,
+		// With the encoders, which free it.
+		SlotEncoding,
+	};
+
+	struct Slot
+	{
+		VkBuffer buffer{ VK_NULL_HANDLE };
+		VkDeviceMemory memory{ VK_NULL_HANDLE };
+		const u8* pPixels{ nullptr };
+		SyncPoint copied;
+		u64 frameNumber{ 0 };
+		std::atomic<u32> state{ SlotFree };
+	};
+
+	void createSlots(u32 count);
+
+	// Queues the slot for the encoders. Its copy must have finished.
+	void startEncoding(u32 slot);
+
+	void workerThread();
+
+	// Returns false if the file could not be written.
+	bool writeFrame(const Slot& slot, std::vector<u8>& scratch) const;
+
+	bool writePng(const std::string& path, const u8* pPixels, std::vector<u8>& scratch) const;
+
+	bool writeRaw(const std::string& path, const u8* pPixels) const;
+
+	VkPhysicalDevice m_physicalDevice{ VK_NULL_HANDLE };
+	VkDevice m_device{ VK_NULL_HANDLE };
+	QueueSync* m_pSync{ nullptr };
+	const VkAllocationCallbacks* m_pAllocator{ nullptr };
+
+	FrameDumpSettings m_settings;
+	VkExtent2D m_extent{ };
+	// Whether the red and blue channels need swapping to give RGB.
+	bool m_bgra{ false };
+	// Whether the mapped memory has to be invalidated before the encoders read it.
+	bool m_invalidate{ false };
+
+	// Never resized once created, the slots are shared with the encoding threads.
+	std::vector<Slot> m_slots;
+	u32 m_nextSlot{ 0 };
+	// Recorded this frame, ~0u if nothing was.
+	u32 m_recordedSlot{ ~0u };
+
+	u64 m_copied{ 0 };
+	u64 m_dropped{ 0 };
+	std::atomic<u64> m_written{ 0 };
+	std::atomic<u64> m_failed{ 0 };
+
+	std::vector<std::thread> m_workers;
+
+	// Guards the job queue, m_encodingCount and m_stopRequested.
+	std::mutex m_mutex;
+	std::condition_variable m_jobReady;
+	std::condition_variable m_jobDone;
+
+	// Slots waiting for an encoder, a ring as big as the slot ring so queueing never allocates.
+	std::vector<u32> m_jobs;
+	u32 m_jobHead{ 0 };
+	u32 m_jobCount{ 0 };
+
+	// Slots queued or being encoded.
+	u32 m_encodingCount{ 0 };
+	bool m_stopRequested{ false };
+};
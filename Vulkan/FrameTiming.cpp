@@ -0,0 +1,97 @@
+#include "FrameTiming.h"
+
+#include <stdexcept>
+
+#include "LinearArena.h"
+
+void GpuTimer::Init(VkPhysicalDevice physicalDevice, VkDevice device, u32 queueFamilyIndex, u32 slotCount, const VkAllocationCallbacks* pAllocator)
+{
+	m_device = device;
+	m_pAllocator = pAllocator;
+
+	VkPhysicalDeviceProperties properties;
+	vkGetPhysicalDeviceProperties(physicalDevice, &properties);
+
+	u32 queueFamilyCount = 0;
+	vkGetPhysicalDeviceQueueFamilyProperties(physicalDevice, &queueFamilyCount, nullptr);
+
+	ScratchScope scratch;
+	std::pmr::vector<VkQueueFamilyProperties> queueFamilies(queueFamilyCount, scratch.Get());
+	vkGetPhysicalDeviceQueueFamilyProperties(physicalDevice, &queueFamilyCount, queueFamilies.data());
+
+	// Zero valid bits means the queue cannot write timestamps at all.
+	u32 validBits = queueFamilies[queueFamilyIndex].timestampValidBits;
+	if (validBits == 0)
+	{
+		return;
+	}
+
+	m_timestampPeriod = properties.limits.timestampPeriod;
+	m_timestampMask = validBits >= 64 ? ~0ull : ((1ull << validBits) - 1);
+
+	// Two queries per slot, one at the start and one at the end of the frame.
+	VkQueryPoolCreateInfo queryPoolInfo{};
+	queryPoolInfo.sType = VK_STRUCTURE_TYPE_QUERY_POOL_CREATE_INFO;
+	queryPoolInfo.queryType = VK_QUERY_TYPE_TIMESTAMP;
+	queryPoolInfo.queryCount = slotCount * 2;
+
+	if (vkCreateQueryPool(m_device, &queryPoolInfo, m_pAllocator, &m_queryPool) != VK_SUCCESS)
+	{
+		throw std::runtime_error("failed to create timestamp query pool!");
+	}
+
+	m_slotPending.assign(slotCount, false);
+}
+
+void GpuTimer::Destroy()
+{
+	if (m_queryPool != VK_NULL_HANDLE)
+	{
+		vkDestroyQueryPool(m_device, m_queryPool, m_pAllocator);
+		m_queryPool = VK_NULL_HANDLE;
+	}
+}
+
+void GpuTimer::Begin(VkCommandBuffer commandBuffer, u32 slot)
+{
+	if (!IsSupported())
+	{
+		return;
+	}
+
+	vkCmdResetQueryPool(commandBuffer, m_queryPool, slot * 2, 2);
+	vkCmdWriteTimestamp(commandBuffer, VK_PIPELINE_STAGE_TOP_OF_PIPE_BIT, m_queryPool, slot * 2);
+}
+
+void GpuTimer::End(VkCommandBuffer commandBuffer, u32 slot)
+{
+	if (!IsSupported())
+	{
+		return;
+	}
+
+	vkCmdWriteTimestamp(commandBuffer, VK_PIPELINE_STAGE_BOTTOM_OF_PIPE_BIT, m_queryPool, slot * 2 + 1);
+	m_slotPending[slot] = true;
+}
+
+bool GpuTimer::Resolve(u32 slot, double& gpuMs)
+{
+	if (!IsSupported() || !m_slotPending[slot])
+	{
+		return false;
+	}
+
+	m_slotPending[slot] = false;
+
+	// This slot's last frame has already been waited for, so the results are available without VK_QUERY_RESULT_WAIT_BIT.
+	u64 timestamps[2];
+	if (vkGetQueryPoolResults(m_device, m_queryPool, slot * 2, 2, sizeof(timestamps), timestamps, sizeof(u64), VK_QUERY_RESULT_64_BIT) != VK_SUCCESS)
+	{
+		return false;
+	}
+
+	u64 ticks = (timestamps[1] - timestamps[0]) & m_timestampMask;
+	gpuMs = static_cast<double>(ticks) * m_timestampPeriod / 1e6;
+
+	return true;
+}
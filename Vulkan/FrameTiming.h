@@ -0,0 +1,58 @@
+#pragma once
+
+#include <vector>
+#include <vulkan/vulkan.h>
+
+#include "Types.h"
+
+// Per-frame CPU, GPU and particle simulation times in milliseconds, appended to as frames complete.
+// GPU times arrive a few frames after the CPU times, once the GPU has finished the frame,
+// so the two lists only line up once every frame has been resolved (see HelloTriangleApp::WaitIdle).
+struct FrameTimings
+{
+	std::vector<double> cpuMs;
+	std::vector<double> gpuMs;
+	// Only frames that ran the particle simulation, see ParticleSystem.
+	std::vector<double> computeMs;
+
+	void Clear()
+	{
+		cpuMs.clear();
+		gpuMs.clear();
+		computeMs.clear();
+	}
+};
+
+// Measures GPU time with a pair of timestamps around each frame's command buffer.
+// Timestamps are written per frame in flight slot and read back once that slot's last frame
+// has been waited for, so reading never stalls.
+class GpuTimer
+{
+public:
+	void Init(VkPhysicalDevice physicalDevice, VkDevice device, u32 queueFamilyIndex, u32 slotCount, const VkAllocationCallbacks* pAllocator = nullptr);
+
+	void Destroy();
+
+	// Some queues (and some software drivers) do not support timestamps. Every other call is a no-op then.
+	bool IsSupported() const { return m_queryPool != VK_NULL_HANDLE; }
+
+	// Must be recorded outside of a render pass, as it also resets the slot's queries.
+	void Begin(VkCommandBuffer commandBuffer, u32 slot);
+
+	void End(VkCommandBuffer commandBuffer, u32 slot);
+
+	// Reads back the GPU time for the last frame recorded into this slot.
+	// Only call once the slot's last frame has been waited for. Returns false if there was nothing to read.
+	bool Resolve(u32 slot, double& gpuMs);
+
+private:
+	VkDevice m_device{ VK_NULL_HANDLE };
+	const VkAllocationCallbacks* m_pAllocator{ nullptr };
+	VkQueryPool m_queryPool{ VK_NULL_HANDLE };
+
+	// Nanoseconds per timestamp tick.
+	double m_timestampPeriod{ 1.0 };
+	u64 m_timestampMask{ ~0ull };
+
+	std::vector<bool> m_slotPending;
+};
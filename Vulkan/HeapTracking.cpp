@@ -0,0 +1,165 @@
+#include "HeapTracking.h"
+
+#ifdef TRACK_HEAP_ALLOCATIONS
+
+#include <cstdlib>
+#include <new>
+
+// Trivially constructed, so reading it never allocates, even on a thread's first allocation.
+static thread_local u64 t_heapAllocations = 0;
+
+u64 GetThreadHeapAllocationCount()
+{
+	return t_heapAllocations;
+}
+
+static void* trackedAllocate(size_t size)
+{
+	t_heapAllocations++;
+
+	// operator new must return a unique pointer even for zero bytes.
+	return std::malloc(size != 0 ? size : 1);
+}
+
+static void* trackedAllocateAligned(size_t size, std::align_val_t alignment)
+{
+	t_heapAllocations++;
+
+	const size_t align = static_cast<size_t>(alignment);
+
+#ifdef _WIN32
+	return _aligned_malloc(size != 0 ? size : 1, align);
+#else
+	// aligned_alloc wants the size to be a multiple of the alignment.
+	const size_t roundedSize = size != 0 ? (size + align - 1) & ~(align - 1) : align;
+	return std::aligned_alloc(align, roundedSize);
+#endif
+}
+
+static void trackedFreeAligned(void* pMemory)
+{
+#ifdef _WIN32
+	_aligned_free(pMemory);
+#else
+	std::free(pMemory);
+#endif
+}
+
+void* operator new(size_t size)
+{
+	if (void* pMemory = trackedAllocate(size))
+	{
+		return pMemory;
+	}
+
+	throw std::bad_alloc();
+}
+
+void* operator new[](size_t size)
+{
+	return operator new(size);
+}
+
+void* operator new(size_t size, const std::nothrow_t&) noexcept
+{
+	return trackedAllocate(size);
+}
+
+void* operator new[](size_t size, const std::nothrow_t&) noexcept
+{
+	return trackedAllocate(size);
+}
+
+void* operator new(size_t size, std::align_val_t alignment)
+{
+	if (void* pMemory = trackedAllocateAligned(size, alignment))
+	{
+		return pMemory;
+	}
+
+	throw std::bad_alloc();
+}
+
+void* operator new[](size_t size, std::align_val_t alignment)
+{
+	return operator new(size, alignment);
+}
+
+void* operator new(size_t size, std::align_val_t alignment, const std::nothrow_t&) noexcept
+{
+	return trackedAllocateAligned(size, alignment);
+}
+
+void* operator new[](size_t size, std::align_val_t alignment, const std::nothrow_t&) noexcept
+{
+	return trackedAllocateAligned(size, alignment);
+}
+
+void operator delete(void* pMemory) noexcept
+{
+	std::free(pMemory);
+}
+
+void operator delete[](void* pMemory) noexcept
+{
+	std::free(pMemory);
+}
+
+void operator delete(void* pMemory, size_t) noexcept
+{
+	std::free(pMemory);
+}
+
+void operator delete[](void* pMemory, size_t) noexcept
+{
+	std::free(pMemory);
+}
+
+void operator delete(void* pMemory, const std::nothrow_t&) noexcept
+{
+	std::free(pMemory);
+}
+
+void operator delete[](void* pMemory, const std::nothrow_t&) noexcept
+{
+	std::free(pMemory);
+}
+
+void operator delete(void* pMemory, std::align_val_t) noexcept
+{
+	trackedFreeAligned(pMemory);
+}
+
+void operator delete[](void* pMemory, std::align_val_t) noexcept
+{
+	trackedFreeAligned(pMemory);
+}
+
+void operator delete(void* pMemory, size_t, std::align_val_t) noexcept
+{
+	trackedFreeAligned(pMemory);
+}
+
+void operator delete[](void* pMemory, size_t, std::align_val_t) noexcept
+{
+	trackedFreeAligned(pMemory);
+}
+
+void operator delete(void* pMemory, std::align_val_t, const std::nothrow_t&) noexcept
+{
+	trackedFreeAligned(pMemory);
+}
+
+void operator delete[](void* pMemory, std::align_val_t, const std::nothrow_t&) noexcept
+{
+	trackedFreeAligned(pMemory);
+}
+
+#else
+
+u64 GetThreadHeapAllocationCount()
+{
+	return 0;
+}
+
+#endif
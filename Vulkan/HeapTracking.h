@@ -0,0 +1,19 @@
+#pragma once
+
+#include "Types.h"
+
+// Debug counting of global heap allocations, so a frame loop can check it stays off the heap.
+//
+// Built with TRACK_HEAP_ALLOCATIONS, HeapTracking.cpp replaces the global operator new and delete
+// with versions that count every operator new call made by each thread before going to malloc.
+// Without it nothing is replaced and the count stays at 0. Direct malloc calls are not counted,
+// nor are allocations drivers make through the Vulkan allocation callbacks (see HostAllocator).
+
+#ifdef TRACK_HEAP_ALLOCATIONS
+constexpr bool HEAP_TRACKING_ENABLED = true;
+#else
+constexpr bool HEAP_TRACKING_ENABLED = false;
+#endif
+
+// Calls to the global operator new made by the calling thread so far.
+u64 GetThreadHeapAllocationCount();
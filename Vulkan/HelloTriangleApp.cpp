@@ -4,15 +4,90 @@
 #include <SDL2/SDL.h>
 #include <SDL2/SDL_vulkan.h>
 #include "HelloTriangleApp.h"
+#include "EmbeddedShaders.h"
+#include "VulkanInit.h"
 #include <assert.h>
 #include <vector>
-#include <set>
 #include <algorithm>
-#include <limits>
 #include <fstream>
+#include <cstring>
+#include <chrono>
+#include <limits>
+
+// Where each ShaderId comes from. Indexed by ShaderId.
+struct ShaderInfo
+{
+	// The entry's own id, so the table can check it is in ShaderId order.
+	ShaderId id;
+	const char* sourcePath;
+	const char* spirvPath;
+	EmbeddedShader embedded;
+};
+
+static constexpr std::array<ShaderInfo, static_cast<size_t>(ShaderId::Count)> g_shaderInfos
+{ {
+	{ ShaderId::TriangleVert, "Shaders/shader.vert", "Shaders/CompiledShaders/vert.spv", g_vertShader },
+	{ ShaderId::TriangleFrag, "Shaders/shader.frag", "Shaders/CompiledShaders/frag.spv", g_fragShader },
+	{ ShaderId::ParticleVert, "Shaders/particle.vert", "Shaders/CompiledShaders/particle_vert.spv", g_particleVertShader },
+	{ ShaderId::ParticleFrag, "Shaders/particle.frag", "Shaders/CompiledShaders/particle_frag.spv", g_particleFragShader },
+	{ ShaderId::ParticleComp, "Shaders/particle.comp", "Shaders/CompiledShaders/particle_comp.spv", g_particleCompShader },
+	{ ShaderId::MeshVert, "Shaders/mesh.vert", "Shaders/CompiledShaders/mesh_vert.spv", g_meshVertShader },
+	{ ShaderId::MeshFrag, "Shaders/mesh.frag", "Shaders/CompiledShaders/mesh_frag.spv", g_meshFragShader },
+	{ ShaderId::DepthReduceComp, "Shaders/depth_reduce.comp", "Shaders/CompiledShaders/depth_reduce_comp.spv", g_depthReduceCompShader },
+	{ ShaderId::OcclusionCullComp, "Shaders/occlusion_cull.comp", "Shaders/CompiledShaders/occlusion_cull_comp.spv", g_occlusionCullCompShader },
+	{ ShaderId::LightAssignComp, "Shaders/light_assign.comp", "Shaders/CompiledShaders/light_assign_comp.spv", g_lightAssignCompShader },
+} };
+
+// An entry out of place would load another shader's module under its id, and build its pipelines from the wrong code.
+static constexpr bool shaderInfosInIdOrder()
+{
+	for (size_t i = 0; i < g_shaderInfos.size(); i++)
+	{
+		if (g_shaderInfos[i].id != static_cast<ShaderId>(i))
+		{
+			return false;
+		}
+	}
+	return true;
+}
+
+static_assert(shaderInfosInIdOrder(), "g_shaderInfos must list every shader in ShaderId order");
+
+// The particle simulation advances by a fixed step each frame rather than by wall clock time,
+// so a benchmark run does the same work whatever the frame rate.
+constexpr float PARTICLE_TIME_STEP = 1.0f / 60.0f;
+
+// The farthest corner of the triangle in Shaders/shader.vert from its origin, at a scale of 1.
+constexpr float TRIANGLE_BOUNDING_RADIUS = 0.70710678f;
+
+HelloTriangleApp::HelloTriangleApp(const AppConfig& config)
+	: m_config(config)
+	, m_windWidth(config.width)
+	, m_windHeight(config.height)
+{
+	if (m_config.headless)
+	{
+		// Offscreen images are never presented, so they can be read back (and blitted from) directly.
+		m_finalColorLayout = VK_IMAGE_LAYOUT_TRANSFER_SRC_OPTIMAL;
+	}
+	else
+	{
+		m_deviceExtensions = g_deviceExtensions;
+	}
+
+	if (m_config.useHostAllocator)
+	{
+		m_pAllocator = m_hostAllocator.GetCallbacks();
+	}
+}
 
 void HelloTriangleApp::InitWindow()
 {
+	if (m_config.headless)
+	{
+		return;
+	}
+
 	SDL_Init(SDL_INIT_EVENTS);
 
 	m_pWindow = SDL_CreateWindow("Vulkan", SDL_WINDOWPOS_UNDEFINED, SDL_WINDOWPOS_UNDEFINED, m_windWidth, m_windHeight, SDL_WINDOW_VULKAN);
@@ -26,20 +101,72 @@ void HelloTriangleApp::InitWindow()
 void HelloTriangleApp::InitVulkan()
 {
 	createInstance();
-	setupDebugMessenger(*this);
-	createSurface();
+
+	if (!m_config.headless)
+	{
+		createSurface();
+	}
+
 	pickPhysicalDevice();
 	createLogicalDevice();
 	createSwapchain();
+	startCapture();
 	createImageViews();
+	initViews();
+	initDynamicResolution();
+	createDepthBuffer();
 	createRenderPass();
 	createGraphicsPipeline();
+
+	if (sceneTargetsEnabled())
+	{
+		createSceneTargets();
+	}
+	else
+	{
+		createFramebuffers();
+	}
+	createCommandPool();
+	createCommandBuffers();
+	createSyncObjects();
+	createFrameDump();
+
+	m_gpuTimer.Init(m_physicalDevice, m_logicalDevice, m_queueFamilies.graphicsFamily.value(), MAX_FRAMES_IN_FLIGHT, m_pAllocator);
+
+	MeshLibraryDesc meshDesc;
+	meshDesc.physicalDevice = m_physicalDevice;
+	meshDesc.device = m_logicalDevice;
+	meshDesc.graphicsFamily = m_queueFamilies.graphicsFamily.value();
+	meshDesc.transferFamily = m_queueFamilies.transferFamily.value();
+	meshDesc.pSync = &m_sync;
+	meshDesc.pAllocator = m_pAllocator;
+	meshDesc.pCapture = &m_capture;
+	m_meshes.Init(meshDesc);
+
+	createDrawTable();
+	createOcclusionCulling();
+
+	// A single triangle in the middle of the screen until the caller provides a scene.
+	createInstanceBuffer({ { { 0.0f, 0.0f }, 1.0f, 0.0f } });
+	updateOcclusionScene();
+	updateDrawTable();
+
+	createParticleSystem(m_config.particleCount, 0);
+
+#ifdef SHADER_HOT_RELOAD
+	startShaderHotReload();
+#endif
 }
 
 void HelloTriangleApp::MainLoop()
 {
 	bool HasQuit = false;
 
+	m_lastParticleReport = std::chrono::steady_clock::now();
+	m_lastHostAllocationReport = m_lastParticleReport;
+	m_lastHostAllocationCount = m_hostAllocator.GetStats().TotalAllocations();
+	m_lastHostAllocationFrame = m_frameNumber;
+
 	while (!HasQuit)
 	{
 		SDL_Event event;
@@ -51,852 +178,2057 @@ void HelloTriangleApp::MainLoop()
 				HasQuit = true;
 			}
 		}
+
+		drawFrame();
+
+		reportParticleThroughput();
+
+		reportHostAllocations();
 	}
+
+	// Let the GPU finish any in flight frames before Cleanup() destroys what they use.
+	vkDeviceWaitIdle(m_logicalDevice);
 }
 
 void HelloTriangleApp::Cleanup()
 {
-	if (enableValidationLayers) {
-		DestroyDebugUtilsMessengerEXT(m_vkInstance, m_debugMessenger, nullptr);
+	if (m_config.enableValidation) {
+		DestroyDebugUtilsMessengerEXT(m_vkInstance, m_debugMessenger, m_pAllocator);
 	}
 
-	vkDestroyPipelineLayout(m_logicalDevice, m_pipelineLayout, nullptr);
+#ifdef SHADER_HOT_RELOAD
+	m_shaderWatcher.Stop();
+#endif
 
-	for (auto imageView : m_swapchainImageViews) 
-	{
-		vkDestroyImageView(m_logicalDevice, imageView, nullptr);
-	}
+	destroyInstanceBuffer();
 
-	vkDestroySwapchainKHR(m_logicalDevice, m_vkSwapchainKHR, nullptr);
+	// Nothing is in flight any more, so every retired object, the instance buffer included, goes now.
+	m_sync.WaitIdle();
+	destroyRetiredObjects();
 
-	vkDestroyDevice(m_logicalDevice, nullptr);
-	
-	vkDestroySurfaceKHR(m_vkInstance, m_vkSurfaceKHR, nullptr);
+	m_meshes.Destroy();
 
-	vkDestroyInstance(m_vkInstance, nullptr);
+	m_occlusion.Destroy();
 
-	SDL_DestroyWindow(m_pWindow);
+	m_drawTable.Destroy();
 
-	SDL_Quit();
-}
+	m_lighting.Destroy();
 
-void HelloTriangleApp::createSurface()
-{
-	if (SDL_Vulkan_CreateSurface(m_pWindow, m_vkInstance, &m_vkSurfaceKHR) == SDL_FALSE)
+	m_particles.Destroy();
+
+	m_gpuTimer.Destroy();
+
+	// Writes out whatever is still being dumped first.
+	m_frameDump.Destroy();
+
+	for (size_t i = 0; i < MAX_FRAMES_IN_FLIGHT; i++)
 	{
-		throw std::runtime_error("Failed to create valid surface!");
+		vkDestroySemaphore(m_logicalDevice, m_imageAvailableSemaphores[i], m_pAllocator);
 	}
-}
 
-void HelloTriangleApp::createInstance()
-{
-	//Check if we want validation layers + if they are supported.
-	if (enableValidationLayers && !checkValidationLayerSupport())
+	for (VkSemaphore semaphore : m_renderFinishedSemaphores)
 	{
-		throw std::runtime_error("Validation layers requested, but not available.");
+		vkDestroySemaphore(m_logicalDevice, semaphore, m_pAllocator);
 	}
 
-	VkApplicationInfo appInfo{ };
-	appInfo.sType = VK_STRUCTURE_TYPE_APPLICATION_INFO;
-	appInfo.pApplicationName = "Vulkan Triangle";
-	appInfo.applicationVersion = VK_MAKE_VERSION(1, 0, 0);
-	appInfo.pEngineName = "No Engine";
-	appInfo.engineVersion = VK_MAKE_VERSION(1, 0, 0);
-	appInfo.apiVersion = VK_API_VERSION_1_0;
+	m_sync.Destroy();
 
-	VkInstanceCreateInfo createInfo{ };
+	vkDestroyCommandPool(m_logicalDevice, m_commandPool, m_pAllocator);
 
-	// If validation layers are enabled, add them to the create info.
-	if (enableValidationLayers)
+	for (VkFramebuffer framebuffer : m_swapchainFramebuffers)
 	{
-		createInfo.enabledLayerCount = static_cast<u32>(validationLayers.size());
-		createInfo.ppEnabledLayerNames = validationLayers.data();
+		vkDestroyFramebuffer(m_logicalDevice, framebuffer, m_pAllocator);
 	}
-	else
+
+	destroySceneTargets();
+
+	destroyDepthBuffer();
+
+	for (const auto& [hash, variant] : m_pipelineVariants)
 	{
-		createInfo.enabledLayerCount = 0;
+		vkDestroyPipeline(m_logicalDevice, variant.handle, m_pAllocator);
 	}
 
-	memset(&createInfo, 0, sizeof(VkInstanceCreateInfo));
+	savePipelineCache();
 
-	createInfo.sType = VK_STRUCTURE_TYPE_INSTANCE_CREATE_INFO;
-	createInfo.pApplicationInfo = &appInfo;
+	if (m_capture.IsOpen())
+	{
+		std::cout << "Captured " << m_capture.GetFrameCount() << " frames to " << m_config.capturePath << '\n';
+		m_capture.Close();
+	}
+
+	vkDestroyPipelineCache(m_logicalDevice, m_pipelineCache, m_pAllocator);
+
+	for (VkShaderModule shaderModule : m_shaderModules)
+	{
+		vkDestroyShaderModule(m_logicalDevice, shaderModule, m_pAllocator);
+	}
 
-	std::vector<const char*> sdlExtensionNames = getRequiredExtensions();
+	vkDestroyPipelineLayout(m_logicalDevice, m_pipelineLayout, m_pAllocator);
 
-	createInfo.enabledExtensionCount = static_cast<u32>(sdlExtensionNames.size());
-	createInfo.ppEnabledExtensionNames = sdlExtensionNames.data();
+	vkDestroyRenderPass(m_logicalDevice, m_renderPass, m_pAllocator);
+	vkDestroyRenderPass(m_logicalDevice, m_lateRenderPass, m_pAllocator);
 
-	VkDebugUtilsMessengerCreateInfoEXT debugCreateInfo{};
+	for (auto imageView : m_swapchainImageViews) 
+	{
+		vkDestroyImageView(m_logicalDevice, imageView, m_pAllocator);
+	}
 
-	if (enableValidationLayers) 
+	if (m_config.headless)
+	{
+		for (size_t i = 0; i < m_swapchainImages.size(); i++)
+		{
+			vkDestroyImage(m_logicalDevice, m_swapchainImages[i], m_pAllocator);
+			vkFreeMemory(m_logicalDevice, m_offscreenImageMemory[i], m_pAllocator);
+		}
+	}
+	else
 	{
-		createInfo.enabledLayerCount = static_cast<uint32_t>(validationLayers.size());
-		createInfo.ppEnabledLayerNames = validationLayers.data();
+		vkDestroySwapchainKHR(m_logicalDevice, m_vkSwapchainKHR, m_pAllocator);
+	}
+
+	vkDestroyDevice(m_logicalDevice, m_pAllocator);
 
-		populateDebugMessengerCreateInfo(debugCreateInfo);
-		createInfo.pNext = (VkDebugUtilsMessengerCreateInfoEXT*)&debugCreateInfo;
+	// SDL created the surface with the default allocator, so it is destroyed with it too.
+	if (!m_config.headless)
+	{
+		vkDestroySurfaceKHR(m_vkInstance, m_vkSurfaceKHR, nullptr);
 	}
-	else 
+
+	vkDestroyInstance(m_vkInstance, m_pAllocator);
+
+	// Everything created through the host allocator is gone now, so anything still live was leaked by us or the driver.
+	if (m_config.useHostAllocator)
 	{
-		createInfo.enabledLayerCount = 0;
+		HostAllocationStats stats = m_hostAllocator.GetStats();
+		if (stats.TotalLiveBytes() > 0)
+		{
+			std::cout << "Vulkan host memory still allocated after shutdown: " << stats.TotalLiveBytes() << " bytes" << std::endl;
+		}
+	}
 
-		createInfo.pNext = nullptr;
+	if (m_config.headless)
+	{
+		return;
 	}
 
-	VkResult result = vkCreateInstance(&createInfo, nullptr, &m_vkInstance);
+	SDL_DestroyWindow(m_pWindow);
 
-	assert(result == VK_SUCCESS);
+	SDL_Quit();
 }
 
-bool HelloTriangleApp::checkValidationLayerSupport()
+void HelloTriangleApp::WaitIdle()
 {
-	u32 layerCount;
-	vkEnumerateInstanceLayerProperties(&layerCount, nullptr);
-
-	std::vector<VkLayerProperties> availableLayers(layerCount);
-	vkEnumerateInstanceLayerProperties(&layerCount, availableLayers.data());
+	m_sync.WaitIdle();
 
-	for (const char* layerName : validationLayers)
+	// Every slot is now complete, so any outstanding GPU times can be collected.
+	for (u32 i = 0; i < MAX_FRAMES_IN_FLIGHT; i++)
 	{
-		bool layerFound = false;
+		// Resolve in submission order, oldest slot first.
+		u32 slot = (m_currentFrame + i) % MAX_FRAMES_IN_FLIGHT;
 
-		for (const auto& layerProperties : availableLayers) 
+		double gpuMs;
+		if (m_gpuTimer.Resolve(slot, gpuMs) && m_pFrameTimings != nullptr)
 		{
-			if (strcmp(layerName, layerProperties.layerName) == 0) {
-				layerFound = true;
-				break;
-			}
+			m_pFrameTimings->gpuMs.push_back(gpuMs);
 		}
 
-		if (!layerFound) {
-			return false;
-		}
+		resolveParticleTiming(slot);
 	}
 
-	return true;
+	// Their dumps are finished copying too, and are written out before returning.
+	m_frameDump.Flush();
 }
 
-void HelloTriangleApp::pickPhysicalDevice()
+void HelloTriangleApp::SetInstances(const std::vector<InstanceData>& instances)
 {
-	u32 deviceCount{ 0 };
-	vkEnumeratePhysicalDevices(m_vkInstance, &deviceCount, nullptr);
-
-	if (deviceCount == 0)
+	// The occlusion culling's buffers, sized from the instances, may still be read by frames in flight.
+	// The instance buffer itself is retired, so the frames reading it keep it until they finish.
+	if (m_occlusionCullingEnabled)
 	{
-		throw std::runtime_error("Failed to find GPUs with Vulkan Support!");
+		m_sync.WaitIdle();
 	}
 
-	std::vector<VkPhysicalDevice> devices(deviceCount);
+	destroyInstanceBuffer();
+	createInstanceBuffer(instances);
 
-	vkEnumeratePhysicalDevices(m_vkInstance, &deviceCount, devices.data());
+	m_sceneDraws.clear();
+	updateOcclusionScene();
+	updateDrawTable();
+}
 
-	for (const VkPhysicalDevice& device : devices)
+void HelloTriangleApp::SetDraws(const std::vector<SceneDraw>& draws)
+{
+	for (const SceneDraw& draw : draws)
 	{
-		if (isDeviceSuitable(device))
+		if (draw.firstInstance + draw.instanceCount > m_instanceCount)
+		{
+			throw std::runtime_error("draw references instances past the end of the instance buffer!");
+		}
+
+		if (draw.mesh != NO_MESH && draw.mesh >= m_meshes.GetMeshCount())
 		{
-			m_physicalDevice = device;
-			break;
+			throw std::runtime_error("draw references a mesh that has not been added!");
 		}
+
+		// Compile any new permutation now, so the first frame using it does not hitch.
+		getPipeline(draw.mesh == NO_MESH ? PipelineId::Triangle : PipelineId::Mesh, draw.permutation);
 	}
 
-	if (m_physicalDevice == VK_NULL_HANDLE)
+	// Each LOD of a mesh draw is a separate draw of a contiguous range of its instances. Ordering the
+	// instances from largest to smallest makes the range needing each LOD contiguous, whatever the
+	// resolution, so choosing LODs each frame is a binary search per LOD rather than a pass over the instances.
+	std::vector<InstanceData> sorted = m_instances;
+	for (const SceneDraw& draw : draws)
 	{
-		throw std::runtime_error("Failed to find a suitable GPU!");
+		if (draw.mesh != NO_MESH)
+		{
+			std::stable_sort(sorted.begin() + draw.firstInstance, sorted.begin() + draw.firstInstance + draw.instanceCount,
+				[](const InstanceData& a, const InstanceData& b) { return a.scale > b.scale; });
+		}
 	}
-}
 
+	const bool instancesChanged = memcmp(sorted.data(), m_instances.data(), sizeof(InstanceData) * sorted.size()) != 0;
 
-// Example function for how to check if device supports features we require.
-// 
-//bool HelloTriangleApp::isDeviceSuitable(VkPhysicalDevice device)
-//{
-//	// Queries basice properties
-//	// Name, type, supported VK version etc.
-//	VkPhysicalDeviceProperties deviceProperties;
-//	vkGetPhysicalDeviceProperties(device, &deviceProperties);
-//
-//	// Queries supported features
-//	// Texture compression, 64bit float, multi-viewport rendering etc.
-//	VkPhysicalDeviceFeatures deviceFeatures;
-//	vkGetPhysicalDeviceFeatures(device, &deviceFeatures);
-//
-//	// We want out GPU to be dedicated and support geometry shaders.
-//	// Return a check for that.
-//	return deviceProperties.deviceType == VK_PHYSICAL_DEVICE_TYPE_DISCRETE_GPU &&
-//		deviceFeatures.geometryShader;
-//}
+	// The occlusion culling's buffers sized from the draws may still be read by frames in flight.
+	// A replaced instance buffer is retired instead.
+	if (m_occlusionCullingEnabled)
+	{
+		m_sync.WaitIdle();
+	}
 
-bool HelloTriangleApp::isDeviceSuitable(VkPhysicalDevice device)
-{
-	QueueFamilyIndices indices = findQueueFamilies(device);
+	if (instancesChanged)
+	{
+		// Recreated rather than rewritten in place, so a capture sees the new contents.
+		destroyInstanceBuffer();
+		createInstanceBuffer(sorted);
+	}
+
+	// Submitted in key order, the draws' commands are written in the order DrawQueue records them, so each run
+	// sharing a pipeline is one multi-draw. Stable, so draws with equal keys keep the order they were given in.
+	std::vector<std::pair<u64, u32>> order(draws.size());
+	for (u32 i = 0; i < draws.size(); i++)
+	{
+		order[i] = { getSceneDrawKey(draws[i]), i };
+	}
 
-	bool extensionsSupported = checkDeviceExtensionSupport(device);
+	std::stable_sort(order.begin(), order.end(), [](const auto& a, const auto& b) { return a.first < b.first; });
 
-	bool swapChainAdequate = false;
-	if (extensionsSupported) 
+	m_sceneDraws.clear();
+	for (const auto& entry : order)
 	{
-		SwapChainSupportDetails swapChainSupport = querySwapChainSupport(device);
-		swapChainAdequate = !swapChainSupport.formats.empty() && !swapChainSupport.presentModes.empty();
+		m_sceneDraws.push_back(draws[entry.second]);
 	}
 
-	return indices.isComplete() && extensionsSupported && swapChainAdequate;
+	updateOcclusionScene();
+	updateDrawTable();
 }
 
-bool HelloTriangleApp::checkDeviceExtensionSupport(VkPhysicalDevice device)
+void HelloTriangleApp::SetParticles(u32 count, u32 seed)
 {
-	uint32_t extensionCount;
-	vkEnumerateDeviceExtensionProperties(device, nullptr, &extensionCount, nullptr);
+	// The particle buffers may still be read by frames in flight.
+	m_sync.WaitIdle();
 
-	std::vector<VkExtensionProperties> availableExtensions(extensionCount);
-	vkEnumerateDeviceExtensionProperties(device, nullptr, &extensionCount, availableExtensions.data());
+	// Timings still pending in the old system's slots are dropped with it.
+	m_particles.Destroy();
+	createParticleSystem(count, seed);
+}
 
-	std::set<std::string> requiredExtensions(g_deviceExtensions.begin(), g_deviceExtensions.end());
+void HelloTriangleApp::SetViews(const std::vector<CameraView>& views)
+{
+	if (views.size() != m_viewCount)
+	{
+		throw std::runtime_error("view count does not match AppConfig::viewCount!");
+	}
 
-	for (const auto& extension : availableExtensions) {
-		requiredExtensions.erase(extension.extensionName);
+	for (const CameraView& view : views)
+	{
+		if (!(view.zoom > 0.0f))
+		{
+			throw std::runtime_error("view zoom must be greater than 0!");
+		}
 	}
 
-	return requiredExtensions.empty();
+	// Only copied here. Each frame pushes them as it is recorded, so frames in flight keep the views they were recorded with.
+	std::copy(views.begin(), views.end(), m_views.begin());
+
+	if (m_occlusionCullingEnabled)
+	{
+		m_occlusion.SetViews(m_views.data(), m_viewCount);
+	}
 }
 
-void HelloTriangleApp::createLogicalDevice()
+void HelloTriangleApp::SetLights(const std::vector<PointLight>& lights)
 {
-	QueueFamilyIndices indices = findQueueFamilies(m_physicalDevice);
-
-	std::vector<VkDeviceQueueCreateInfo> queueCreateInfos;
-	std::set<u32> uniqueQueueFamilies = { indices.graphicsFamily.value(), indices.presentFamily.value() };
-
-	float queuePriority = 1.0f;
-	for (uint32_t queueFamily : uniqueQueueFamilies) {
-		VkDeviceQueueCreateInfo queueCreateInfo{};
-		queueCreateInfo.sType = VK_STRUCTURE_TYPE_DEVICE_QUEUE_CREATE_INFO;
-		queueCreateInfo.queueFamilyIndex = queueFamily;
-		queueCreateInfo.queueCount = 1;
-		queueCreateInfo.pQueuePriorities = &queuePriority;
-		queueCreateInfos.push_back(queueCreateInfo);
+	if (lights.size() > m_config.maxLights)
+	{
+		throw std::runtime_error("more lights than AppConfig::maxLights!");
 	}
 
-	VkPhysicalDeviceFeatures deviceFeatures{ };
-
-	VkDeviceCreateInfo createInfo{ };
-	createInfo.sType = VK_STRUCTURE_TYPE_DEVICE_CREATE_INFO;
+	// Only copied here. Each frame uploads its own copy, so frames in flight keep the lights they were recorded with.
+	m_lights = lights;
+}
 
-	createInfo.queueCreateInfoCount = static_cast<uint32_t>(queueCreateInfos.size());
-	createInfo.pQueueCreateInfos = queueCreateInfos.data();
+u32 HelloTriangleApp::AddMesh(const MeshData& mesh)
+{
+	// The shared mesh buffers are replaced, and may still be read by frames in flight.
+	m_sync.WaitIdle();
 
-	createInfo.pEnabledFeatures = &deviceFeatures;
+	const u32 meshIndex = m_meshes.AddMesh(mesh);
 
-	createInfo.enabledExtensionCount = static_cast<uint32_t>(g_deviceExtensions.size());
-	createInfo.ppEnabledExtensionNames = g_deviceExtensions.data();
+	// The next frame's submit waits for the upload on the transfer queue.
+	m_pendingMeshUpload = m_meshes.GetUploadPoint();
 
-	if (enableValidationLayers) {
-		createInfo.enabledLayerCount = static_cast<uint32_t>(validationLayers.size());
-		createInfo.ppEnabledLayerNames = validationLayers.data();
-	}
-	else {
-		createInfo.enabledLayerCount = 0;
-	}
+	return meshIndex;
+}
 
-	if (vkCreateDevice(m_physicalDevice, &createInfo, nullptr, &m_logicalDevice) != VK_SUCCESS) 
+size_t HelloTriangleApp::GetFrameMemoryPeak() const
+{
+	size_t peak = 0;
+	for (const LinearArena& arena : m_frameArenas)
 	{
-		throw std::runtime_error("failed to create logical device!");
+		peak = arena.GetPeak() > peak ? arena.GetPeak() : peak;
 	}
 
-	vkGetDeviceQueue(m_logicalDevice, indices.graphicsFamily.value(), 0, &m_graphicsQueue);
-	vkGetDeviceQueue(m_logicalDevice, indices.presentFamily.value(), 0, &m_presentQueue);
+	return peak;
 }
 
-void HelloTriangleApp::createSwapchain()
+std::string HelloTriangleApp::GetDeviceName() const
 {
-	SwapChainSupportDetails swapChainSupport = querySwapChainSupport(m_physicalDevice);
-
-	VkSurfaceFormatKHR surfaceFormat = chooseSwapSurfaceFormat(swapChainSupport.formats);
-	VkPresentModeKHR presentMode = chooseSwapPresentMode(swapChainSupport.presentModes);
-	VkExtent2D extent = chooseSwapExtent(swapChainSupport.capabilities);
-
-	// Recommended to request 1 more image than the minimum for swap chain.
-	u32 imageCount = swapChainSupport.capabilities.minImageCount + 1;
+	return m_deviceProfile.properties.deviceName;
+}
 
-	// Make sure we do not exceed the maximum support number of images for the swap chain.
-	if (swapChainSupport.capabilities.maxImageCount > 0 && imageCount > swapChainSupport.capabilities.maxImageCount) 
+void HelloTriangleApp::createSurface()
+{
+	if (SDL_Vulkan_CreateSurface(m_pWindow, m_vkInstance, &m_vkSurfaceKHR) == SDL_FALSE)
 	{
-		imageCount = swapChainSupport.capabilities.maxImageCount;
+		throw std::runtime_error("Failed to create valid surface!");
 	}
+}
 
-	VkSwapchainCreateInfoKHR createInfo{};
-	createInfo.sType = VK_STRUCTURE_TYPE_SWAPCHAIN_CREATE_INFO_KHR;
-	createInfo.surface = m_vkSurfaceKHR;
-
-	createInfo.minImageCount = imageCount;
-	createInfo.imageFormat = surfaceFormat.format;
-	createInfo.imageColorSpace = surfaceFormat.colorSpace;
-	createInfo.imageExtent = extent;
-	createInfo.imageArrayLayers = 1;
-	createInfo.imageUsage = VK_IMAGE_USAGE_COLOR_ATTACHMENT_BIT;
+void HelloTriangleApp::createInstance()
+{
+	VulkanInit::InstanceSettings settings;
+	settings.enableValidation = m_config.enableValidation;
+	settings.extensions = getRequiredExtensions();
+	settings.pAllocator = m_pAllocator;
 
-	QueueFamilyIndices indices = findQueueFamilies(m_physicalDevice);
-	uint32_t queueFamilyIndices[] = { indices.graphicsFamily.value(), indices.presentFamily.value() };
+	m_vkInstance = VulkanInit::CreateInstance(settings);
 
-	// If the graphics queue family and present queue family are not the same queue family,
-	// then we can allow concurrent use of images between these queues.
-	// This requires two distinct family queues.
-	if (indices.graphicsFamily != indices.presentFamily) 
-	{
-		createInfo.imageSharingMode = VK_SHARING_MODE_CONCURRENT;
-		createInfo.queueFamilyIndexCount = 2;
-		createInfo.pQueueFamilyIndices = queueFamilyIndices;
-	}
-	// If the queues are the same, which is usually the case on most hardware,
-	// we need to use exclsive mode due to the minimum distinct queue requirement.
-	else 
+	if (m_config.enableValidation)
 	{
-		createInfo.imageSharingMode = VK_SHARING_MODE_EXCLUSIVE;
-		createInfo.queueFamilyIndexCount = 0; // Optional
-		createInfo.pQueueFamilyIndices = nullptr; // Optional
+		m_debugMessenger = VulkanInit::CreateDebugMessenger(m_vkInstance, m_pAllocator);
 	}
+}
 
-	createInfo.preTransform = swapChainSupport.capabilities.currentTransform;
-
-	// Prevents alpha channel from blending this window with other windows.
-	createInfo.compositeAlpha = VK_COMPOSITE_ALPHA_OPAQUE_BIT_KHR;
+void HelloTriangleApp::pickPhysicalDevice()
+{
+	m_deviceProfile = VulkanInit::PickPhysicalDevice(m_vkInstance, m_vkSurfaceKHR, m_deviceExtensions, m_config.deviceSelection);
+	m_physicalDevice = m_deviceProfile.device;
+}
 
-	createInfo.presentMode = presentMode;
+void HelloTriangleApp::createLogicalDevice()
+{
+	VulkanInit::LogicalDevice logicalDevice = VulkanInit::CreateLogicalDevice(m_deviceProfile, m_deviceExtensions, m_config.enableValidation, m_pAllocator);
 
-	// Enabling clipped means pixels obscured by other windows will be clipped.
-	createInfo.clipped = VK_TRUE;
+	m_logicalDevice = logicalDevice.device;
+	m_graphicsQueue = logicalDevice.graphicsQueue;
+	m_presentQueue = logicalDevice.presentQueue;
+	m_computeQueue = logicalDevice.computeQueue;
+	m_transferQueue = logicalDevice.transferQueue;
+	m_queueFamilies = logicalDevice.queueFamilies;
 
-	// This parameter is only used when the window is resized.
-	// During resizing, a new window is created and a reference to the old one is required for initialization.
-	createInfo.oldSwapchain = VK_NULL_HANDLE;
+	// Indexed by QueueId.
+	m_sync.Init(m_logicalDevice, { m_graphicsQueue, m_computeQueue, m_transferQueue }, m_pAllocator);
+}
 
-	if (vkCreateSwapchainKHR(m_logicalDevice, &createInfo, nullptr, &m_vkSwapchainKHR) != VK_SUCCESS)
+void HelloTriangleApp::createSwapchain()
+{
+	if (m_config.headless)
 	{
-		throw std::runtime_error("Failed to create swapchain!");
+		createOffscreenTargets();
+		return;
 	}
 
+	int width, height;
+	SDL_Vulkan_GetDrawableSize(m_pWindow, &width, &height);
 
-	// Retrieve the swapchain images from the newly created swapchain
-	// and store them for later use.
-	vkGetSwapchainImagesKHR(m_logicalDevice, m_vkSwapchainKHR, &imageCount, nullptr);
-	m_swapchainImages.resize(imageCount);
-	vkGetSwapchainImagesKHR(m_logicalDevice, m_vkSwapchainKHR, &imageCount, m_swapchainImages.data());
+	// With dynamic resolution or several views the swapchain images are not rendered to directly, the scene is blitted or copied into them.
+	VkImageUsageFlags extraUsage = m_config.dynamicResolution.enabled || m_config.viewCount > 1 ? VK_IMAGE_USAGE_TRANSFER_DST_BIT : 0;
+
+	// Frame dumps copy out of them.
+	if (!m_config.frameDump.directory.empty())
+	{
+		extraUsage |= VK_IMAGE_USAGE_TRANSFER_SRC_BIT;
+	}
 
-	// Store format and extent for later use too.
-	m_swapchainImageFormat = surfaceFormat.format;
-	m_swapchainExtent = extent;
+	VulkanInit::Swapchain swapchain = VulkanInit::CreateSwapchain(m_physicalDevice, m_logicalDevice, m_vkSurfaceKHR, m_queueFamilies,
+		{ static_cast<u32>(width), static_cast<u32>(height) }, extraUsage, m_pAllocator);
+
+	m_vkSwapchainKHR = swapchain.handle;
+	m_swapchainImages = std::move(swapchain.images);
+	m_swapchainImageFormat = swapchain.format;
+	m_swapchainExtent = swapchain.extent;
 }
 
-void HelloTriangleApp::createImageViews()
+void HelloTriangleApp::createOffscreenTargets()
 {
-	m_swapchainImageViews.resize(m_swapchainImages.size());
+	// Stand in for the swapchain with a couple of plain images, so the rest of the renderer
+	// (image views, framebuffers, recording) does not need to know it is headless.
+	// Two images are enough, as a new one is only started once its previous frame is waited for.
+	const u32 imageCount = MAX_FRAMES_IN_FLIGHT;
 
-	for (size_t i = 0; i < m_swapchainImages.size(); i++)
-	{
-		VkImageViewCreateInfo createInfo{};
-		createInfo.sType = VK_STRUCTURE_TYPE_IMAGE_VIEW_CREATE_INFO;
-		createInfo.image = m_swapchainImages[i];
+	m_swapchainImageFormat = VK_FORMAT_R8G8B8A8_UNORM;
+	m_swapchainExtent = { m_windWidth, m_windHeight };
 
-		// Defines the image as 1D, 2D, 3D or a cubemap
-		createInfo.viewType = VK_IMAGE_VIEW_TYPE_2D;
-		// Inits the image format to the same as the swapchain
-		createInfo.format = m_swapchainImageFormat;
+	m_swapchainImages.resize(imageCount);
+	m_offscreenImageMemory.resize(imageCount);
 
-		// This allows mapping of each channel, as you may want to map them all to the same channel
-		// for monochrome images. This initialization just leaves them as default mapping.
-		createInfo.components.r = VK_COMPONENT_SWIZZLE_IDENTITY;
-		createInfo.components.g = VK_COMPONENT_SWIZZLE_IDENTITY;
-		createInfo.components.b = VK_COMPONENT_SWIZZLE_IDENTITY;
-		createInfo.components.a = VK_COMPONENT_SWIZZLE_IDENTITY;
+	for (u32 i = 0; i < imageCount; i++)
+	{
+		VkImageCreateInfo imageInfo{};
+		imageInfo.sType = VK_STRUCTURE_TYPE_IMAGE_CREATE_INFO;
+		imageInfo.imageType = VK_IMAGE_TYPE_2D;
+		imageInfo.format = m_swapchainImageFormat;
+		imageInfo.extent = { m_swapchainExtent.width, m_swapchainExtent.height, 1 };
+		imageInfo.mipLevels = 1;
+		imageInfo.arrayLayers = 1;
+		imageInfo.samples = VK_SAMPLE_COUNT_1_BIT;
+		imageInfo.tiling = VK_IMAGE_TILING_OPTIMAL;
+		// Transfer source so the results can be copied out, e.g. to check the output,
+		// and destination so a scene target can be blitted or copied in.
+		imageInfo.usage = VK_IMAGE_USAGE_COLOR_ATTACHMENT_BIT | VK_IMAGE_USAGE_TRANSFER_SRC_BIT | VK_IMAGE_USAGE_TRANSFER_DST_BIT;
+		imageInfo.sharingMode = VK_SHARING_MODE_EXCLUSIVE;
+		imageInfo.initialLayout = VK_IMAGE_LAYOUT_UNDEFINED;
+
+		if (vkCreateImage(m_logicalDevice, &imageInfo, m_pAllocator, &m_swapchainImages[i]) != VK_SUCCESS)
+		{
+			throw std::runtime_error("failed to create offscreen image!");
+		}
 
-		// The subresource range describes the images purpose and which parts can be accessed.
-		// In our case, we access them as colour targets without mipmaps or layers.
-		createInfo.subresourceRange.aspectMask = VK_IMAGE_ASPECT_COLOR_BIT;
-		createInfo.subresourceRange.baseMipLevel = 0;
-		createInfo.subresourceRange.levelCount = 1;
-		createInfo.subresourceRange.baseArrayLayer = 0;
-		createInfo.subresourceRange.layerCount = 1;
+		VkMemoryRequirements memRequirements;
+		vkGetImageMemoryRequirements(m_logicalDevice, m_swapchainImages[i], &memRequirements);
+
+		VkMemoryAllocateInfo allocInfo{};
+		allocInfo.sType = VK_STRUCTURE_TYPE_MEMORY_ALLOCATE_INFO;
+		allocInfo.allocationSize = memRequirements.size;
+		allocInfo.memoryTypeIndex = findMemoryType(memRequirements.memoryTypeBits, VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT);
 
-		if (vkCreateImageView(m_logicalDevice, &createInfo, nullptr, &m_swapchainImageViews[i]) != VK_SUCCESS) 
+		if (vkAllocateMemory(m_logicalDevice, &allocInfo, m_pAllocator, &m_offscreenImageMemory[i]) != VK_SUCCESS)
 		{
-			throw std::runtime_error("failed to create image views!");
+			throw std::runtime_error("failed to allocate offscreen image memory!");
 		}
+
+		vkBindImageMemory(m_logicalDevice, m_swapchainImages[i], m_offscreenImageMemory[i], 0);
 	}
 }
 
-void HelloTriangleApp::createRenderPass()
+void HelloTriangleApp::createBuffer(VkDeviceSize size, VkBufferUsageFlags usage, VkMemoryPropertyFlags properties, VkBuffer& buffer, VkDeviceMemory& bufferMemory)
 {
-	// Attachment descriptions are render targets
-	// This is where we tell Vulkan how many render targets
-	// there are, what they will be and how to sample/handle them.
-	VkAttachmentDescription colorAttachment{ };
-	colorAttachment.format = m_swapchainImageFormat;
-	colorAttachment.samples = VK_SAMPLE_COUNT_1_BIT;
-
-	// loadOp and storeOp determine what is done with data
-	// before and after rendering respectively. 
-	// VK_ATTACHMENT_LOAD_OP_LOAD: Preserve the existing contents of the attachment
-	// VK_ATTACHMENT_LOAD_OP_CLEAR: Clear the values to a constant at the start
-	// VK_ATTACHMENT_LOAD_OP_DONT_CARE : Existing contents are undefined; we dont care about them
-	colorAttachment.loadOp = VK_ATTACHMENT_LOAD_OP_CLEAR;
-
-	// VK_ATTACHMENT_STORE_OP_STORE: Rendered contents will be stored in memory and can be read later
-	// VK_ATTACHMENT_STORE_OP_DONT_CARE : Contents of the framebuffer will be undefined after the rendering operation
-	// We want to render, so should store the operation.
-	colorAttachment.storeOp = VK_ATTACHMENT_STORE_OP_STORE;
-
-	// These are the same as the above, but for stencil data.
-	colorAttachment.stencilLoadOp = VK_ATTACHMENT_LOAD_OP_DONT_CARE;
-	colorAttachment.stencilStoreOp = VK_ATTACHMENT_STORE_OP_DONT_CARE;
-
-	// VkImage represent Textures and framebuffers. Their layout in memory
-	// can change based on their usage. The below parameters describe the 
-	// VkImage layout before and after the render pass respectively. 
-	// VK_IMAGE_LAYOUT_UNDEFINED - don't care about the layout, can't guarantee data is preserved
-	// VK_IMAGE_LAYOUT_COLOR_ATTACHMENT_OPTIMAL: Images used as color attachment
-	// VK_IMAGE_LAYOUT_PRESENT_SRC_KHR : Images to be presented in the swap chain
-	// VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL : Images to be used as destination for a memory copy operation
-	colorAttachment.initialLayout = VK_IMAGE_LAYOUT_UNDEFINED;
-	colorAttachment.finalLayout = VK_IMAGE_LAYOUT_PRESENT_SRC_KHR;
-
-	// Vulkan allows for subpasses within a render pass.
-	// These are just subsequent rendering operations that rely
-	// on a previous one. Good use case is Post Processing effects.
-	// Using these allows Vulkan to try reorder operations for better
-	// optimisation.
-
-	// The attachment parameter specifies which attachment to reference
-	// by its index in the attachment descriptions array.
-	VkAttachmentReference colorAttachmentRef{};
-	colorAttachmentRef.attachment = 0;
-	colorAttachmentRef.layout = VK_IMAGE_LAYOUT_COLOR_ATTACHMENT_OPTIMAL;
-
-	// Describes subpass.
-	VkSubpassDescription subpass{};
-	subpass.pipelineBindPoint = VK_PIPELINE_BIND_POINT_GRAPHICS;
-
-
-	subpass.colorAttachmentCount = 1;
-	subpass.pColorAttachments = &colorAttachmentRef;
+	VulkanInit::CreateBuffer(m_physicalDevice, m_logicalDevice, size, usage, properties, buffer, bufferMemory, { }, m_pAllocator);
 }
 
-void HelloTriangleApp::createGraphicsPipeline()
+u32 HelloTriangleApp::findMemoryType(u32 typeFilter, VkMemoryPropertyFlags properties)
 {
-	auto vertShaderCode = readFile("Shaders/CompiledShaders/vert.spv");
-	auto fragShaderCode = readFile("Shaders/CompiledShaders/frag.spv");
-
-	VkShaderModule vertShaderModule = createShaderModule(vertShaderCode);
-	VkShaderModule fragShaderModule = createShaderModule(fragShaderCode);
-
-	// Create the Vertex Shader portion of the pipeline
-	VkPipelineShaderStageCreateInfo vertShaderStageInfo{ };
-	vertShaderStageInfo.sType = VK_STRUCTURE_TYPE_PIPELINE_SHADER_STAGE_CREATE_INFO;
-	vertShaderStageInfo.stage = VK_SHADER_STAGE_VERTEX_BIT;
-
-	// Specify the shader module to attach to the pipeline stage
-	vertShaderStageInfo.module = vertShaderModule;
-
-	// Specify the entry point for that module.
-	vertShaderStageInfo.pName = "main";
-
-	// Create the Fragment Shader portion of the pipeline
-	VkPipelineShaderStageCreateInfo fragShaderStageInfo{};
-	fragShaderStageInfo.sType = VK_STRUCTURE_TYPE_PIPELINE_SHADER_STAGE_CREATE_INFO;
-	fragShaderStageInfo.stage = VK_SHADER_STAGE_FRAGMENT_BIT;
-
-	// Specify the shader module to attach to the pipeline stage
-	fragShaderStageInfo.module = fragShaderModule;
-
-	// Specify the entry point for that module.
-	fragShaderStageInfo.pName = "main";
-
-	// Store these Pipeline Stage create infos in an array for use in pipeline creation.
-	VkPipelineShaderStageCreateInfo shaderStages[] = { vertShaderStageInfo, fragShaderStageInfo };
-
-	// Pipelines in Vulkan are generally immutable, but some parts can be dynamic.
-	// For that to be the case, we have to specify which we want to be dynamic.
-	// Having these states be dynamic *can* reduce complexity later down the lane,
-	// as opposed to creating a new pipeline representing each state.
-	std::vector<VkDynamicState> dynamicStates
-	{
-		// Viewport and scissor rect can both be dynamic.
-		// It is often recommended to do so. 
-		// These are setup later.
-		VK_DYNAMIC_STATE_VIEWPORT,
-		VK_DYNAMIC_STATE_SCISSOR
-	};
-
-	VkPipelineDynamicStateCreateInfo dynamicState{ };
-	dynamicState.sType = VK_STRUCTURE_TYPE_PIPELINE_DYNAMIC_STATE_CREATE_INFO;
-	dynamicState.dynamicStateCount = static_cast<u32>(dynamicStates.size());
-	dynamicState.pDynamicStates = dynamicStates.data();
-
-	// Structure used to describe vertex data format.
-	// Specifies bindings, that being spacing between data and whether it is instanced.
-	// Specifices attributes, the extra data like Vertex Colours.
-	// Leaving this empty for now, as we are hardcoding the vertex data in the shader.
-	VkPipelineVertexInputStateCreateInfo vertexInputInfo{};
-	vertexInputInfo.sType = VK_STRUCTURE_TYPE_PIPELINE_VERTEX_INPUT_STATE_CREATE_INFO;
-	vertexInputInfo.vertexBindingDescriptionCount = 0;
-	vertexInputInfo.pVertexBindingDescriptions = nullptr; // Optional
-	vertexInputInfo.vertexAttributeDescriptionCount = 0;
-	vertexInputInfo.pVertexAttributeDescriptions = nullptr; // Optional
-
-	// Structure used to describe the geometry (topology) and primitive restart.
-	// Primitve restart allows STRIP modes to break up geometry when enabled.
-	// We are using LIST mode so this is disabled.
-	VkPipelineInputAssemblyStateCreateInfo inputAssembly{};
-	inputAssembly.sType = VK_STRUCTURE_TYPE_PIPELINE_INPUT_ASSEMBLY_STATE_CREATE_INFO;
-	inputAssembly.topology = VK_PRIMITIVE_TOPOLOGY_TRIANGLE_LIST;
-	inputAssembly.primitiveRestartEnable = VK_FALSE;
-
-	// Viewport is the area being drawn to.
-	// They describe the transformation of the image to the framebuffer.
-	VkViewport viewport{ };
-	viewport.x = 0.0f;
-	viewport.y = 0.0f;
-	viewport.width = (float)m_swapchainExtent.width;
-	viewport.height = (float)m_swapchainExtent.height;
-	viewport.minDepth = 0.0f;
-	viewport.maxDepth = 1.0f;
+	return VulkanInit::FindMemoryType(m_physicalDevice, typeFilter, properties);
+}
 
-	// Scissor rect is used by the rasterizer to clip pixels outside of it.
-	// Essentially defines the area of the viewport that can be drawn to.
-	// If the viewport is bigger than the scissor rect, pixels outside the bounds
-	// will be clipped by the rasterizer.
-	VkRect2D scissor{ };
-	scissor.offset = { 0, 0 };
-	scissor.extent = m_swapchainExtent;
-
-	// Here we describe the Viewport with the above information.
-	VkPipelineViewportStateCreateInfo viewportState{};
-	viewportState.sType = VK_STRUCTURE_TYPE_PIPELINE_VIEWPORT_STATE_CREATE_INFO;
-	viewportState.viewportCount = 1;
-	viewportState.scissorCount = 1;
-
-	// If we were creating non-dynamic viewport and scissor,
-	// they would have to be assigned as below.
-	// This would make them immutable along with the pipeline.
-	// viewportState.pViewports = &viewport;
-	// viewportState.pScissors = &scissor;
-
-	// Setup the structure which describes rasterizer state.
-	// Depth clamp will clamp fragments beyond the near and far planes
-	// rather than discarding them. Can be useful for shadow maps.
-	VkPipelineRasterizationStateCreateInfo rasterizer{};
-	rasterizer.sType = VK_STRUCTURE_TYPE_PIPELINE_RASTERIZATION_STATE_CREATE_INFO;
-	rasterizer.depthClampEnable = VK_FALSE;
-
-	// This will cull all geometry passed to the rasterizer. We do not want this.
-	rasterizer.rasterizerDiscardEnable = VK_FALSE;
-
-	// Determines how geometry from the vertex shader is converted to fragments.
-	// Modes other than fill require enabling specific GPU features.
-	// VK_POLYGON_MODE_FILL: fill the area of the polygon with fragments
-	// VK_POLYGON_MODE_LINE : polygon edges are drawn as lines
-	// VK_POLYGON_MODE_POINT : polygon vertices are drawn as point
-	rasterizer.polygonMode = VK_POLYGON_MODE_FILL;
-
-	// Determines the thickness of lines in fragments. 
-	// Max value is hardware dependent, we generally want value of 1.
-	// Value greater then 1 also requires enabling GPU features.
-	rasterizer.lineWidth = 1.0f;
-
-	// Cull mode determines face culling.
-	// frontFace specifies which vertices to consider forward facing,
-	// and their winding order.
-	rasterizer.cullMode = VK_CULL_MODE_BACK_BIT;
-	rasterizer.frontFace = VK_FRONT_FACE_CLOCKWISE;
-
-	// These values allow the rasterizer to bias depth values.
-	// Can be useful for shadow maps.
-	rasterizer.depthBiasEnable = VK_FALSE;
-	rasterizer.depthBiasConstantFactor = 0.0f; // Optional
-	rasterizer.depthBiasClamp = 0.0f; // Optional
-	rasterizer.depthBiasSlopeFactor = 0.0f; // Optional
-
-	// The below structure describes the multisampling state of the pipeline.
-	// Multisampling is a means of anti-aliasing (MSAA).
-	// Having the hardware do it is more efficient.
-	// Requires enabling of GPU features.
-	VkPipelineMultisampleStateCreateInfo multisampling{};
-	multisampling.sType = VK_STRUCTURE_TYPE_PIPELINE_MULTISAMPLE_STATE_CREATE_INFO;
-	multisampling.sampleShadingEnable = VK_FALSE;
-	multisampling.rasterizationSamples = VK_SAMPLE_COUNT_1_BIT;
-	multisampling.minSampleShading = 1.0f; // Optional
-	multisampling.pSampleMask = nullptr; // Optional
-	multisampling.alphaToCoverageEnable = VK_FALSE; // Optional
-	multisampling.alphaToOneEnable = VK_FALSE; // Optional
-
-	// Describes per framebuffer data for blendmodes.
-	VkPipelineColorBlendAttachmentState colorBlendAttachment{};
-	colorBlendAttachment.colorWriteMask = VK_COLOR_COMPONENT_R_BIT | VK_COLOR_COMPONENT_G_BIT | VK_COLOR_COMPONENT_B_BIT | VK_COLOR_COMPONENT_A_BIT;
-	colorBlendAttachment.blendEnable = VK_TRUE;
-	colorBlendAttachment.srcColorBlendFactor = VK_BLEND_FACTOR_SRC_ALPHA;
-	colorBlendAttachment.dstColorBlendFactor = VK_BLEND_FACTOR_ONE_MINUS_SRC_ALPHA;
-	colorBlendAttachment.colorBlendOp = VK_BLEND_OP_ADD;
-	colorBlendAttachment.srcAlphaBlendFactor = VK_BLEND_FACTOR_ONE;
-	colorBlendAttachment.dstAlphaBlendFactor = VK_BLEND_FACTOR_ZERO;
-	colorBlendAttachment.alphaBlendOp = VK_BLEND_OP_ADD;
-
-	// Describes global data for blendmodes.
-	VkPipelineColorBlendStateCreateInfo colorBlending{};
-	colorBlending.sType = VK_STRUCTURE_TYPE_PIPELINE_COLOR_BLEND_STATE_CREATE_INFO;
-	colorBlending.logicOpEnable = VK_FALSE;
-	colorBlending.logicOp = VK_LOGIC_OP_COPY; // Optional
-	colorBlending.attachmentCount = 1;
-	colorBlending.pAttachments = &colorBlendAttachment;
-	colorBlending.blendConstants[0] = 0.0f; // Optional
-	colorBlending.blendConstants[1] = 0.0f; // Optional
-	colorBlending.blendConstants[2] = 0.0f; // Optional
-	colorBlending.blendConstants[3] = 0.0f; // Optional
+void HelloTriangleApp::createInstanceBuffer(const std::vector<InstanceData>& instances)
+{
+	m_instanceCount = static_cast<u32>(instances.size());
+	m_instances = instances;
 
-	VkPipelineLayoutCreateInfo pipelineLayoutInfo{};
-	pipelineLayoutInfo.sType = VK_STRUCTURE_TYPE_PIPELINE_LAYOUT_CREATE_INFO;
-	pipelineLayoutInfo.setLayoutCount = 0; // Optional
-	pipelineLayoutInfo.pSetLayouts = nullptr; // Optional
-	pipelineLayoutInfo.pushConstantRangeCount = 0; // Optional
-	pipelineLayoutInfo.pPushConstantRanges = nullptr; // Optional
+	VkDeviceSize bufferSize = sizeof(InstanceData) * std::max<size_t>(instances.size(), 1);
+
+	// Instance data only changes between scenes, so a host visible buffer written once is enough.
+	createBuffer(bufferSize, VK_BUFFER_USAGE_VERTEX_BUFFER_BIT,
+		VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT | VK_MEMORY_PROPERTY_HOST_COHERENT_BIT,
+		m_instanceBuffer, m_instanceBufferMemory);
 
-	if (vkCreatePipelineLayout(m_logicalDevice, &pipelineLayoutInfo, nullptr, &m_pipelineLayout) != VK_SUCCESS) 
+	void* data;
+	vkMapMemory(m_logicalDevice, m_instanceBufferMemory, 0, bufferSize, 0, &data);
+	memcpy(data, instances.data(), sizeof(InstanceData) * instances.size());
+	vkUnmapMemory(m_logicalDevice, m_instanceBufferMemory);
+
+	if (m_capture.IsOpen())
 	{
-		throw std::runtime_error("failed to create pipeline layout!");
+		// An empty scene still gets a one element buffer, which is never drawn and so needs no contents.
+		m_capture.AddBuffer(m_instanceBuffer, bufferSize, VK_BUFFER_USAGE_VERTEX_BUFFER_BIT,
+			VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT | VK_MEMORY_PROPERTY_HOST_COHERENT_BIT,
+			instances.empty() ? nullptr : instances.data());
 	}
-
-	// We can destroy the shader modules after we are done linking them to the piepline.
-	vkDestroyShaderModule(m_logicalDevice, fragShaderModule, nullptr);
-	vkDestroyShaderModule(m_logicalDevice, vertShaderModule, nullptr);
 }
 
-VkSurfaceFormatKHR HelloTriangleApp::chooseSwapSurfaceFormat(const std::vector<VkSurfaceFormatKHR>& availableFormats)
+void HelloTriangleApp::destroyInstanceBuffer()
 {
-	for (const auto& availableFormat : availableFormats) 
+	if (m_capture.IsOpen())
 	{
-		if (availableFormat.format == VK_FORMAT_B8G8R8A8_SRGB && availableFormat.colorSpace == VK_COLOR_SPACE_SRGB_NONLINEAR_KHR) 
-		{
-			return availableFormat;
-		}
+		m_capture.DestroyBuffer(m_instanceBuffer);
 	}
 
-	return availableFormats[0];
+	// Frames in flight may still be drawing from it.
+	retireBuffer(m_instanceBuffer, m_instanceBufferMemory);
+
+	m_instanceBuffer = VK_NULL_HANDLE;
+	m_instanceBufferMemory = VK_NULL_HANDLE;
+	m_instanceCount = 0;
+	m_instances.clear();
 }
 
-VkPresentModeKHR HelloTriangleApp::chooseSwapPresentMode(const std::vector<VkPresentModeKHR>& availablePresentModes)
+void HelloTriangleApp::createParticleSystem(u32 count, u32 seed)
 {
-	for (const auto& availablePresentMode : availablePresentModes) 
+	if (count == 0)
 	{
-		if (availablePresentMode == VK_PRESENT_MODE_MAILBOX_KHR) 
-		{
-			return availablePresentMode;
-		}
+		return;
 	}
-	return VK_PRESENT_MODE_FIFO_KHR;
+
+	ParticleSystemDesc desc;
+	desc.physicalDevice = m_physicalDevice;
+	desc.device = m_logicalDevice;
+	desc.graphicsFamily = m_queueFamilies.graphicsFamily.value();
+	desc.computeFamily = m_queueFamilies.computeFamily.value();
+	desc.pSync = &m_sync;
+	desc.computeShader = m_shaderModules[static_cast<size_t>(ShaderId::ParticleComp)];
+	desc.pipelineCache = m_pipelineCache;
+	desc.particleCount = count;
+	desc.seed = seed;
+	desc.slotCount = MAX_FRAMES_IN_FLIGHT;
+	desc.pAllocator = m_pAllocator;
+	desc.pCapture = &m_capture;
+
+	m_particles.Init(desc);
+
+	// Compile the draw pipeline now, rather than hitching on the first frame with particles.
+	getPipeline(PipelineId::Particles, m_particlePermutation);
+
+	m_particleComputeMs = 0.0;
+	m_particleComputeSamples = 0;
 }
 
-VkExtent2D HelloTriangleApp::chooseSwapExtent(const VkSurfaceCapabilitiesKHR& capabilities)
+void HelloTriangleApp::createDrawTable()
 {
-	if (capabilities.currentExtent.width != std::numeric_limits<u32>::max()) 
+	// Captures record direct draws, which the table's commands cannot be replayed as.
+	const VkPhysicalDeviceFeatures& features = m_deviceProfile.features;
+	m_multiDrawEnabled = m_config.multiDraw && features.multiDrawIndirect && features.drawIndirectFirstInstance && !m_capture.IsOpen();
+
+	m_drawQueue.SetMaxDrawIndirectCount(m_multiDrawEnabled ? m_deviceProfile.properties.limits.maxDrawIndirectCount : 1);
+
+	if (!m_multiDrawEnabled || m_occlusionCullingEnabled)
 	{
-		return capabilities.currentExtent;
+		return;
 	}
-	else 
-	{
-		int width, height;
-		SDL_Vulkan_GetDrawableSize(m_pWindow, &width, &height);
 
-		VkExtent2D actualExtent
-		{
-			static_cast<u32>(width),
-			static_cast<u32>(height)
-		};
+	DrawTableDesc desc;
+	desc.physicalDevice = m_physicalDevice;
+	desc.device = m_logicalDevice;
+	desc.slotCount = MAX_FRAMES_IN_FLIGHT;
+	desc.pAllocator = m_pAllocator;
 
-		actualExtent.width = std::clamp(actualExtent.width, capabilities.minImageExtent.width, capabilities.maxImageExtent.width);
-		actualExtent.height = std::clamp(actualExtent.height, capabilities.minImageExtent.height, capabilities.maxImageExtent.height);
+	m_drawTable.Init(desc);
+}
 
-		return actualExtent;
+void HelloTriangleApp::createOcclusionCulling()
+{
+	if (!m_occlusionCullingEnabled)
+	{
+		return;
 	}
+
+	OcclusionCullingDesc desc;
+	desc.physicalDevice = m_physicalDevice;
+	desc.device = m_logicalDevice;
+	desc.depthImage = m_depthImage;
+	desc.depthView = m_depthView;
+	desc.depthFormat = m_depthFormat;
+	desc.depthExtent = getFramebufferExtent();
+	desc.reduceShader = m_shaderModules[static_cast<size_t>(ShaderId::DepthReduceComp)];
+	desc.cullShader = m_shaderModules[static_cast<size_t>(ShaderId::OcclusionCullComp)];
+	desc.pipelineCache = m_pipelineCache;
+	desc.slotCount = MAX_FRAMES_IN_FLIGHT;
+	desc.multiDraw = m_multiDrawEnabled;
+	desc.pAllocator = m_pAllocator;
+
+	m_occlusion.Init(desc);
+	m_occlusion.SetViews(m_views.data(), m_viewCount);
 }
 
-VkShaderModule HelloTriangleApp::createShaderModule(const std::vector<char>& bytecode)
+void HelloTriangleApp::createClusteredLighting()
 {
-	VkShaderModuleCreateInfo createInfo{};
-	createInfo.sType = VK_STRUCTURE_TYPE_SHADER_MODULE_CREATE_INFO;
-	createInfo.codeSize = bytecode.size();
-	createInfo.pCode = reinterpret_cast<const uint32_t*>(bytecode.data());
+	ClusteredLightingDesc desc;
+	desc.physicalDevice = m_physicalDevice;
+	desc.device = m_logicalDevice;
+	desc.assignShader = m_shaderModules[static_cast<size_t>(ShaderId::LightAssignComp)];
+	desc.pipelineCache = m_pipelineCache;
+	desc.maxLights = m_config.maxLights;
+	desc.slotCount = MAX_FRAMES_IN_FLIGHT;
+	desc.pAllocator = m_pAllocator;
+
+	m_lighting.Init(desc);
+}
 
-	VkShaderModule shaderModule;
-	if (vkCreateShaderModule(m_logicalDevice, &createInfo, nullptr, &shaderModule) != VK_SUCCESS) 
+void HelloTriangleApp::createFrameDump()
+{
+	if (m_config.frameDump.directory.empty())
 	{
-		throw std::runtime_error("failed to create shader module!");
+		return;
 	}
 
-	return shaderModule;
+	FrameDumpDesc desc;
+	desc.physicalDevice = m_physicalDevice;
+	desc.device = m_logicalDevice;
+	desc.pSync = &m_sync;
+	desc.extent = m_swapchainExtent;
+	desc.format = m_swapchainImageFormat;
+	desc.settings = m_config.frameDump;
+	desc.pAllocator = m_pAllocator;
+
+	m_frameDump.Init(desc);
 }
 
-QueueFamilyIndices HelloTriangleApp::findQueueFamilies(VkPhysicalDevice device)
+void HelloTriangleApp::updateOcclusionScene()
 {
-	QueueFamilyIndices familyIndices;
-
-	u32 queueFamilyCount = 0;
-	vkGetPhysicalDeviceQueueFamilyProperties(device, &queueFamilyCount, nullptr);
+	if (!m_occlusionCullingEnabled)
+	{
+		return;
+	}
 
-	std::vector<VkQueueFamilyProperties> queueFamilies(queueFamilyCount);
-	vkGetPhysicalDeviceQueueFamilyProperties(device, &queueFamilyCount, queueFamilies.data());
+	// Entries are handed out in draw order, see submitSceneDraws(). Every draw gets its own, even
+	// triangle draws sharing instances, and a batch per draw it could be split into.
+	u32 entryCount = m_sceneDraws.empty() ? m_instanceCount : 0;
 
-	int i = 0;
-	for (const auto& queueFamily : queueFamilies)
+	for (const SceneDraw& draw : m_sceneDraws)
 	{
-		// Use a bitwise & to check if queue family supports Graphics_Bit.
-		if (queueFamily.queueFlags & VK_QUEUE_GRAPHICS_BIT)
-		{
-			familyIndices.graphicsFamily = i;
-		}
+		entryCount += draw.instanceCount;
+	}
 
-		if (familyIndices.isComplete())
-		{
-			break;
-		}
+	m_occlusion.SetScene(m_instanceBuffer, sizeof(InstanceData), entryCount, getMaxOpaqueDraws());
+}
+
+void HelloTriangleApp::updateDrawTable()
+{
+	if (!m_multiDrawEnabled || m_occlusionCullingEnabled)
+	{
+		return;
+	}
 
-		VkBool32 presentSupport = false;
-		vkGetPhysicalDeviceSurfaceSupportKHR(device, i, m_vkSurfaceKHR, &presentSupport);
+	// Growing the tables replaces them, which frames in flight may still be reading.
+	const u32 maxDraws = getMaxOpaqueDraws();
+	if (maxDraws > m_drawTable.GetCapacity())
+	{
+		m_sync.WaitIdle();
+		m_drawTable.Reserve(maxDraws);
+	}
+}
 
-		if (presentSupport)
-		{
-			familyIndices.presentFamily = i;
-		}
+u32 HelloTriangleApp::getMaxOpaqueDraws() const
+{
+	u32 maxDraws = m_sceneDraws.empty() ? 1 : 0;
 
-		i++;
+	for (const SceneDraw& draw : m_sceneDraws)
+	{
+		maxDraws += draw.mesh == NO_MESH ? 1 : m_meshes.GetMesh(draw.mesh).lodCount;
 	}
 
-	return familyIndices;
+	return maxDraws;
 }
 
-SwapChainSupportDetails HelloTriangleApp::querySwapChainSupport(VkPhysicalDevice device)
+void HelloTriangleApp::reportParticleThroughput()
 {
-	SwapChainSupportDetails details;
+	auto now = std::chrono::steady_clock::now();
 
-	vkGetPhysicalDeviceSurfaceCapabilitiesKHR(device, m_vkSurfaceKHR, &details.capabilities);
+	if (!m_particles.IsEnabled() || now - m_lastParticleReport < std::chrono::seconds(1))
+	{
+		return;
+	}
 
-	uint32_t formatCount;
-	vkGetPhysicalDeviceSurfaceFormatsKHR(device, m_vkSurfaceKHR, &formatCount, nullptr);
+	m_lastParticleReport = now;
 
-	if (formatCount != 0) 
+	// No samples means the compute queue does not support timestamps.
+	if (m_particleComputeSamples == 0)
 	{
-		details.formats.resize(formatCount);
-		vkGetPhysicalDeviceSurfaceFormatsKHR(device, m_vkSurfaceKHR, &formatCount, details.formats.data());
+		return;
 	}
 
-	uint32_t presentModeCount;
-	vkGetPhysicalDeviceSurfacePresentModesKHR(device, m_vkSurfaceKHR, &presentModeCount, nullptr);
+	double averageMs = m_particleComputeMs / m_particleComputeSamples;
 
-	if (presentModeCount != 0) {
-		details.presentModes.resize(presentModeCount);
-		vkGetPhysicalDeviceSurfacePresentModesKHR(device, m_vkSurfaceKHR, &presentModeCount, details.presentModes.data());
-	}
+	std::cout << "Particles: " << m_particles.GetCount() << " in " << averageMs << " ms, "
+		<< static_cast<u64>(m_particles.GetCount() / averageMs) << " particles/ms"
+		<< (m_particles.IsAsync() ? " (async compute queue)" : " (graphics queue)") << std::endl;
 
-	return details;
+	m_particleComputeMs = 0.0;
+	m_particleComputeSamples = 0;
 }
 
-std::vector<const char*> HelloTriangleApp::getRequiredExtensions()
+void HelloTriangleApp::startCapture()
 {
-	u32 sdlExtensionCount;
+	if (m_config.capturePath.empty())
+	{
+		return;
+	}
 
-	SDL_bool sdl_result = SDL_Vulkan_GetInstanceExtensions(m_pWindow, &sdlExtensionCount, nullptr);
+	// The replay renders at the output size in the output format, which are known once the swapchain exists.
+	CaptureHeader header;
+	header.device = GetDeviceName();
+	header.width = m_swapchainExtent.width;
+	header.height = m_swapchainExtent.height;
+	header.colorFormat = m_swapchainImageFormat;
 
-	std::vector<const char*> sdlExtensionNames(sdlExtensionCount);
+	if (!m_capture.Open(m_config.capturePath, header))
+	{
+		throw std::runtime_error("failed to open capture file " + m_config.capturePath + "!");
+	}
+
+	std::cout << "Capturing to " << m_config.capturePath << '\n';
+}
+
+void HelloTriangleApp::reportHostAllocations()
+{
+	auto now = std::chrono::steady_clock::now();
+
+	if (!m_config.useHostAllocator || now - m_lastHostAllocationReport < std::chrono::seconds(1) || m_frameNumber == m_lastHostAllocationFrame)
+	{
+		return;
+	}
+
+	HostAllocationStats stats = m_hostAllocator.GetStats();
+	u64 allocations = stats.TotalAllocations();
+
+	double perFrame = static_cast<double>(allocations - m_lastHostAllocationCount) / (m_frameNumber - m_lastHostAllocationFrame);
+
+	std::cout << "Host allocations: " << perFrame << " per frame, " << stats.TotalLiveBytes() / 1024 << " KB live (";
+	for (u32 scope = 0; scope < HOST_ALLOCATION_SCOPE_COUNT; scope++)
+	{
+		const HostAllocationScopeStats& scopeStats = stats.scopes[scope];
+		std::cout << (scope > 0 ? ", " : "") << GetAllocationScopeName(scope) << " " << (scopeStats.liveBytes + scopeStats.internalBytes) / 1024 << " KB";
+	}
+	std::cout << ")" << std::endl;
+
+	m_lastHostAllocationReport = now;
+	m_lastHostAllocationCount = allocations;
+	m_lastHostAllocationFrame = m_frameNumber;
+}
+
+void HelloTriangleApp::createImageViews()
+{
+	m_swapchainImageViews.resize(m_swapchainImages.size());
+
+	for (size_t i = 0; i < m_swapchainImages.size(); i++)
+	{
+		VkImageViewCreateInfo createInfo{};
+		createInfo.sType = VK_STRUCTURE_TYPE_IMAGE_VIEW_CREATE_INFO;
+		createInfo.image = m_swapchainImages[i];
+
+		// Defines the image as 1D, 2D, 3D or a cubemap
+		createInfo.viewType = VK_IMAGE_VIEW_TYPE_2D;
+		// Inits the image format to the same as the swapchain
+		createInfo.format = m_swapchainImageFormat;
+
+		// This allows mapping of each channel, as you may want to map them all to the same channel
+		// for monochrome images. This initialization just leaves them as default mapping.
+		createInfo.components.r = VK_COMPONENT_SWIZZLE_IDENTITY;
+		createInfo.components.g = VK_COMPONENT_SWIZZLE_IDENTITY;
+		createInfo.components.b = VK_COMPONENT_SWIZZLE_IDENTITY;
+		createInfo.components.a = VK_COMPONENT_SWIZZLE_IDENTITY;
+
+		// The subresource range describes the images purpose and which parts can be accessed.
+		// In our case, we access them as colour targets without mipmaps or layers.
+		createInfo.subresourceRange.aspectMask = VK_IMAGE_ASPECT_COLOR_BIT;
+		createInfo.subresourceRange.baseMipLevel = 0;
+		createInfo.subresourceRange.levelCount = 1;
+		createInfo.subresourceRange.baseArrayLayer = 0;
+		createInfo.subresourceRange.layerCount = 1;
+
+		if (vkCreateImageView(m_logicalDevice, &createInfo, m_pAllocator, &m_swapchainImageViews[i]) != VK_SUCCESS) 
+		{
+			throw std::runtime_error("failed to create image views!");
+		}
+	}
+}
+
+void HelloTriangleApp::initViews()
+{
+	if (m_config.viewCount == 0 || m_config.viewCount > MAX_VIEWS)
+	{
+		throw std::runtime_error("AppConfig::viewCount must be between 1 and MAX_VIEWS!");
+	}
+
+	m_viewCount = m_config.viewCount;
+	m_viewPassCount = m_viewCount;
+
+	if (m_viewCount > 1 && m_config.multiview)
+	{
+		// Every device the app picks supports multiview (see VulkanInit::DeviceProfile::featuresSupported), but may take fewer views in a pass.
+		const u32 maxViewCount = m_deviceProfile.maxMultiviewViewCount;
+
+		if (m_viewCount <= maxViewCount)
+		{
+			m_multiviewEnabled = true;
+			m_viewPassCount = 1;
+		}
+		else
+		{
+			std::cerr << "Multiview disabled: the device draws at most " << maxViewCount
+				<< " views in a pass, drawing each view in its own" << std::endl;
+		}
+	}
+
+	// Every view gets the same size of tile, so the layers they are drawn into can share one size too.
+	m_viewExtent = { m_swapchainExtent.width / GetViewColumns(m_viewCount), m_swapchainExtent.height / GetViewRows(m_viewCount) };
+}
+
+void HelloTriangleApp::initDynamicResolution()
+{
+	m_renderExtent = m_viewExtent;
+
+	if (!m_config.dynamicResolution.enabled)
+	{
+		return;
+	}
+
+	// The scene target has the swapchain's format, so both ends of the blit need blit support for it.
+	VkFormatProperties formatProperties;
+	vkGetPhysicalDeviceFormatProperties(m_physicalDevice, m_swapchainImageFormat, &formatProperties);
+
+	VkFormatFeatureFlags blitFeatures = VK_FORMAT_FEATURE_BLIT_SRC_BIT | VK_FORMAT_FEATURE_BLIT_DST_BIT;
+	if ((formatProperties.optimalTilingFeatures & blitFeatures) != blitFeatures)
+	{
+		std::cerr << "Dynamic resolution disabled: the output format does not support blits" << std::endl;
+		return;
+	}
+
+	// Linear filtering is not guaranteed for every format, nearest is.
+	m_upscaleFilter = (formatProperties.optimalTilingFeatures & VK_FORMAT_FEATURE_SAMPLED_IMAGE_FILTER_LINEAR_BIT) ? VK_FILTER_LINEAR : VK_FILTER_NEAREST;
+
+	m_dynamicResolution.Init(m_config.dynamicResolution, m_viewExtent);
+	m_dynamicResolutionEnabled = true;
+}
+
+void HelloTriangleApp::createSceneTargets()
+{
+	VkExtent2D maxExtent = getFramebufferExtent();
+
+	for (SceneTarget& target : m_sceneTargets)
+	{
+		VkImageCreateInfo imageInfo{};
+		imageInfo.sType = VK_STRUCTURE_TYPE_IMAGE_CREATE_INFO;
+		imageInfo.imageType = VK_IMAGE_TYPE_2D;
+		imageInfo.format = m_swapchainImageFormat;
+		imageInfo.extent = { maxExtent.width, maxExtent.height, 1 };
+		imageInfo.mipLevels = 1;
+		imageInfo.arrayLayers = m_viewCount;
+		imageInfo.samples = VK_SAMPLE_COUNT_1_BIT;
+		imageInfo.tiling = VK_IMAGE_TILING_OPTIMAL;
+		imageInfo.usage = VK_IMAGE_USAGE_COLOR_ATTACHMENT_BIT | VK_IMAGE_USAGE_TRANSFER_SRC_BIT;
+		imageInfo.sharingMode = VK_SHARING_MODE_EXCLUSIVE;
+		imageInfo.initialLayout = VK_IMAGE_LAYOUT_UNDEFINED;
+
+		if (vkCreateImage(m_logicalDevice, &imageInfo, m_pAllocator, &target.image) != VK_SUCCESS)
+		{
+			throw std::runtime_error("failed to create scene target image!");
+		}
+
+		VkMemoryRequirements memRequirements;
+		vkGetImageMemoryRequirements(m_logicalDevice, target.image, &memRequirements);
+
+		VkMemoryAllocateInfo allocInfo{};
+		allocInfo.sType = VK_STRUCTURE_TYPE_MEMORY_ALLOCATE_INFO;
+		allocInfo.allocationSize = memRequirements.size;
+		allocInfo.memoryTypeIndex = findMemoryType(memRequirements.memoryTypeBits, VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT);
+
+		if (vkAllocateMemory(m_logicalDevice, &allocInfo, m_pAllocator, &target.memory) != VK_SUCCESS)
+		{
+			throw std::runtime_error("failed to allocate scene target memory!");
+		}
+
+		vkBindImageMemory(m_logicalDevice, target.image, target.memory, 0);
+
+		for (u32 pass = 0; pass < m_viewPassCount; pass++)
+		{
+			// A multiview pass draws every layer through one array view, otherwise each pass draws its view's layer.
+			VkImageViewCreateInfo viewInfo{};
+			viewInfo.sType = VK_STRUCTURE_TYPE_IMAGE_VIEW_CREATE_INFO;
+			viewInfo.image = target.image;
+			viewInfo.viewType = m_multiviewEnabled ? VK_IMAGE_VIEW_TYPE_2D_ARRAY : VK_IMAGE_VIEW_TYPE_2D;
+			viewInfo.format = m_swapchainImageFormat;
+			viewInfo.subresourceRange = { VK_IMAGE_ASPECT_COLOR_BIT, 0, 1, pass, m_multiviewEnabled ? m_viewCount : 1 };
+
+			if (vkCreateImageView(m_logicalDevice, &viewInfo, m_pAllocator, &target.views[pass]) != VK_SUCCESS)
+			{
+				throw std::runtime_error("failed to create scene target image view!");
+			}
+
+			// The framebuffer covers the whole image. Each frame's render area picks the part actually drawn.
+			// Multiview framebuffers have a single layer, the pass's view mask picks the layers drawn.
+			VkImageView attachments[] = { target.views[pass], m_depthPassViews[pass] };
+
+			VkFramebufferCreateInfo framebufferInfo{};
+			framebufferInfo.sType = VK_STRUCTURE_TYPE_FRAMEBUFFER_CREATE_INFO;
+			framebufferInfo.renderPass = m_renderPass;
+			framebufferInfo.attachmentCount = 2;
+			framebufferInfo.pAttachments = attachments;
+			framebufferInfo.width = maxExtent.width;
+			framebufferInfo.height = maxExtent.height;
+			framebufferInfo.layers = 1;
+
+			if (vkCreateFramebuffer(m_logicalDevice, &framebufferInfo, m_pAllocator, &target.framebuffers[pass]) != VK_SUCCESS)
+			{
+				throw std::runtime_error("failed to create scene target framebuffer!");
+			}
+		}
+	}
+}
+
+void HelloTriangleApp::destroySceneTargets()
+{
+	for (SceneTarget& target : m_sceneTargets)
+	{
+		for (u32 pass = 0; pass < MAX_VIEWS; pass++)
+		{
+			vkDestroyFramebuffer(m_logicalDevice, target.framebuffers[pass], m_pAllocator);
+			vkDestroyImageView(m_logicalDevice, target.views[pass], m_pAllocator);
+		}
+		vkDestroyImage(m_logicalDevice, target.image, m_pAllocator);
+		vkFreeMemory(m_logicalDevice, target.memory, m_pAllocator);
+
+		target = SceneTarget{ };
+	}
+}
+
+void HelloTriangleApp::createDepthBuffer()
+{
+	// Occlusion culling builds its depth pyramid from the depth buffer, so it also needs a format shaders can sample.
+	// Captures record direct draws, which the culled frames' GPU written counts cannot be replayed as.
+	m_occlusionCullingEnabled = m_config.occlusionCulling && !m_capture.IsOpen();
+
+	if (m_occlusionCullingEnabled)
+	{
+		m_depthFormat = VulkanInit::FindDepthFormat(m_physicalDevice,
+			VK_FORMAT_FEATURE_DEPTH_STENCIL_ATTACHMENT_BIT | VK_FORMAT_FEATURE_SAMPLED_IMAGE_BIT);
+
+		if (m_depthFormat == VK_FORMAT_UNDEFINED)
+		{
+			std::cerr << "Occlusion culling disabled: no depth format can be sampled" << std::endl;
+			m_occlusionCullingEnabled = false;
+		}
+	}
+
+	if (!m_occlusionCullingEnabled)
+	{
+		m_depthFormat = VulkanInit::FindDepthFormat(m_physicalDevice, VK_FORMAT_FEATURE_DEPTH_STENCIL_ATTACHMENT_BIT);
+	}
+
+	if (m_depthFormat == VK_FORMAT_UNDEFINED)
+	{
+		throw std::runtime_error("failed to find a supported depth format!");
+	}
+
+	VkExtent2D extent = getFramebufferExtent();
+
+	VkImageCreateInfo imageInfo{};
+	imageInfo.sType = VK_STRUCTURE_TYPE_IMAGE_CREATE_INFO;
+	imageInfo.imageType = VK_IMAGE_TYPE_2D;
+	imageInfo.format = m_depthFormat;
+	imageInfo.extent = { extent.width, extent.height, 1 };
+	imageInfo.mipLevels = 1;
+	imageInfo.arrayLayers = m_viewCount;
+	imageInfo.samples = VK_SAMPLE_COUNT_1_BIT;
+	imageInfo.tiling = VK_IMAGE_TILING_OPTIMAL;
+	imageInfo.usage = VK_IMAGE_USAGE_DEPTH_STENCIL_ATTACHMENT_BIT | (m_occlusionCullingEnabled ? VK_IMAGE_USAGE_SAMPLED_BIT : 0);
+	imageInfo.sharingMode = VK_SHARING_MODE_EXCLUSIVE;
+	imageInfo.initialLayout = VK_IMAGE_LAYOUT_UNDEFINED;
+
+	if (vkCreateImage(m_logicalDevice, &imageInfo, m_pAllocator, &m_depthImage) != VK_SUCCESS)
+	{
+		throw std::runtime_error("failed to create depth image!");
+	}
+
+	VkMemoryRequirements memRequirements;
+	vkGetImageMemoryRequirements(m_logicalDevice, m_depthImage, &memRequirements);
+
+	VkMemoryAllocateInfo allocInfo{};
+	allocInfo.sType = VK_STRUCTURE_TYPE_MEMORY_ALLOCATE_INFO;
+	allocInfo.allocationSize = memRequirements.size;
+	allocInfo.memoryTypeIndex = findMemoryType(memRequirements.memoryTypeBits, VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT);
+
+	if (vkAllocateMemory(m_logicalDevice, &allocInfo, m_pAllocator, &m_depthMemory) != VK_SUCCESS)
+	{
+		throw std::runtime_error("failed to allocate depth image memory!");
+	}
+
+	vkBindImageMemory(m_logicalDevice, m_depthImage, m_depthMemory, 0);
+
+	// Depth only, even for formats with stencil, as that is the aspect the culling samples.
+	VkImageViewCreateInfo viewInfo{};
+	viewInfo.sType = VK_STRUCTURE_TYPE_IMAGE_VIEW_CREATE_INFO;
+	viewInfo.image = m_depthImage;
+	viewInfo.viewType = VK_IMAGE_VIEW_TYPE_2D;
+	viewInfo.format = m_depthFormat;
+	viewInfo.subresourceRange = { VK_IMAGE_ASPECT_DEPTH_BIT, 0, 1, 0, 1 };
+
+	if (vkCreateImageView(m_logicalDevice, &viewInfo, m_pAllocator, &m_depthView) != VK_SUCCESS)
+	{
+		throw std::runtime_error("failed to create depth image view!");
+	}
+
+	// The layers each pass draws into, the same way as the scene targets'.
+	for (u32 pass = 0; pass < m_viewPassCount; pass++)
+	{
+		viewInfo.viewType = m_multiviewEnabled ? VK_IMAGE_VIEW_TYPE_2D_ARRAY : VK_IMAGE_VIEW_TYPE_2D;
+		viewInfo.subresourceRange = { VK_IMAGE_ASPECT_DEPTH_BIT, 0, 1, pass, m_multiviewEnabled ? m_viewCount : 1 };
+
+		if (vkCreateImageView(m_logicalDevice, &viewInfo, m_pAllocator, &m_depthPassViews[pass]) != VK_SUCCESS)
+		{
+			throw std::runtime_error("failed to create depth image view!");
+		}
+	}
+}
+
+void HelloTriangleApp::destroyDepthBuffer()
+{
+	for (VkImageView& view : m_depthPassViews)
+	{
+		vkDestroyImageView(m_logicalDevice, view, m_pAllocator);
+		view = VK_NULL_HANDLE;
+	}
+
+	vkDestroyImageView(m_logicalDevice, m_depthView, m_pAllocator);
+	vkDestroyImage(m_logicalDevice, m_depthImage, m_pAllocator);
+	vkFreeMemory(m_logicalDevice, m_depthMemory, m_pAllocator);
+
+	m_depthView = VK_NULL_HANDLE;
+	m_depthImage = VK_NULL_HANDLE;
+	m_depthMemory = VK_NULL_HANDLE;
+}
+
+void HelloTriangleApp::createRenderPass()
+{
+	// A scene target is blitted or copied from once the pass ends, rather than presented.
+	VulkanInit::RenderPassDesc desc;
+	desc.colorFormat = m_swapchainImageFormat;
+	desc.finalColorLayout = sceneTargetsEnabled() ? VK_IMAGE_LAYOUT_TRANSFER_SRC_OPTIMAL : m_finalColorLayout;
+	desc.depthFormat = m_depthFormat;
+	desc.viewCount = m_multiviewEnabled ? m_viewCount : 1;
+
+	if (!m_occlusionCullingEnabled)
+	{
+		m_renderPass = VulkanInit::CreateRenderPass(m_logicalDevice, desc, m_pAllocator);
+		return;
+	}
+
+	// The early pass leaves its colour and depth for the late pass, which ends the way the single pass would.
+	VulkanInit::RenderPassDesc earlyDesc = desc;
+	earlyDesc.finalColorLayout = VK_IMAGE_LAYOUT_COLOR_ATTACHMENT_OPTIMAL;
+	earlyDesc.storeDepth = true;
+	m_renderPass = VulkanInit::CreateRenderPass(m_logicalDevice, earlyDesc, m_pAllocator);
+
+	desc.loadContents = true;
+	m_lateRenderPass = VulkanInit::CreateRenderPass(m_logicalDevice, desc, m_pAllocator);
+}
+
+void HelloTriangleApp::createGraphicsPipeline()
+{
+	createShaderModules();
+	createPipelineCache();
+
+	// The lit fragment shaders read the light clusters through set 0. Pipelines that do not light, such as
+	// the particles, share the layout anyway, so the set stays bound across every pipeline in a pass.
+	createClusteredLighting();
+	VkDescriptorSetLayout lightingSetLayout = m_lighting.GetSetLayout();
+
+	// Every vertex shader places its vertices through the views in the push constants, see SceneViews.h.
+	VkPushConstantRange viewRange{};
+	viewRange.stageFlags = VK_SHADER_STAGE_VERTEX_BIT;
+	viewRange.offset = 0;
+	viewRange.size = sizeof(ViewConstants);
+
+	VkPipelineLayoutCreateInfo pipelineLayoutInfo{};
+	pipelineLayoutInfo.sType = VK_STRUCTURE_TYPE_PIPELINE_LAYOUT_CREATE_INFO;
+	pipelineLayoutInfo.setLayoutCount = 1;
+	pipelineLayoutInfo.pSetLayouts = &lightingSetLayout;
+	pipelineLayoutInfo.pushConstantRangeCount = 1;
+	pipelineLayoutInfo.pPushConstantRanges = &viewRange;
+
+	if (vkCreatePipelineLayout(m_logicalDevice, &pipelineLayoutInfo, m_pAllocator, &m_pipelineLayout) != VK_SUCCESS) 
+	{
+		throw std::runtime_error("failed to create pipeline layout!");
+	}
+
+	// Each pipeline records which shader modules it was built from,
+	// so a hot reload only has to rebuild the pipelines that use the changed module.
+	// The triangle's vertices are still hardcoded in the shader, so its only vertex input is the
+	// per-instance data. Particles are drawn straight from the simulation's storage buffer, also per instance.
+	// Meshes take the same instance data as the triangle, and their vertices from the mesh library.
+	// The triangle and meshes are opaque and depth tested, the particles blend over them.
+	m_pipelines[static_cast<size_t>(PipelineId::Triangle)] = { ShaderId::TriangleVert, ShaderId::TriangleFrag,
+		1, &g_instanceBinding, static_cast<u32>(std::size(g_instanceAttributes)), g_instanceAttributes, true };
+	m_pipelines[static_cast<size_t>(PipelineId::Particles)] = { ShaderId::ParticleVert, ShaderId::ParticleFrag,
+		1, &g_particleBinding, static_cast<u32>(std::size(g_particleAttributes)), g_particleAttributes, false };
+	m_pipelines[static_cast<size_t>(PipelineId::Mesh)] = { ShaderId::MeshVert, ShaderId::MeshFrag,
+		static_cast<u32>(std::size(g_meshBindings)), g_meshBindings, static_cast<u32>(std::size(g_meshAttributes)), g_meshAttributes, true };
+
+	// Compile the permutation used on the first frame up front, rather than hitching mid-frame.
+	getPipeline(PipelineId::Triangle, m_trianglePermutation);
+}
+
+void HelloTriangleApp::createPipelineCache()
+{
+	// Start from the cache saved by the last run, if there is one. Without it every pipeline
+	// is compiled from scratch on every launch, which is a large part of startup time.
+	std::vector<u8> cacheData;
+	if (!m_config.pipelineCachePath.empty())
+	{
+		cacheData = VulkanInit::LoadPipelineCacheFile(m_config.pipelineCachePath, m_physicalDevice);
+	}
+
+	m_pipelineCache = VulkanInit::CreatePipelineCache(m_logicalDevice, cacheData, m_pAllocator);
+}
+
+void HelloTriangleApp::savePipelineCache()
+{
+	if (m_config.pipelineCachePath.empty())
+	{
+		return;
+	}
+
+	if (!VulkanInit::SavePipelineCacheFile(m_config.pipelineCachePath, VulkanInit::GetPipelineCacheData(m_logicalDevice, m_pipelineCache)))
+	{
+		// Not fatal, the next run just starts with a cold cache.
+		std::cerr << "failed to save pipeline cache to " << m_config.pipelineCachePath << std::endl;
+	}
+}
+
+const PipelineVariant& HelloTriangleApp::getPipelineVariant(PipelineId pipelineId, u64 keyHash, const VkSpecializationInfo& specializationInfo)
+{
+	// Fold the pipeline id into the key hash so different pipelines can share permutation keys.
+	u64 variantHash = (keyHash ^ static_cast<u64>(pipelineId)) * 1099511628211ull;
+
+	// The hash only narrows the search. A collision must build its own variant rather than bind another's.
+	auto [first, last] = m_pipelineVariants.equal_range(variantHash);
+	for (auto it = first; it != last; ++it)
+	{
+		const PipelineVariant& found = it->second;
+
+		if (found.pipelineId == pipelineId && found.specializationData.size() * sizeof(u32) == specializationInfo.dataSize &&
+			memcmp(found.specializationData.data(), specializationInfo.pData, specializationInfo.dataSize) == 0)
+		{
+			return found;
+		}
+	}
+
+	PipelineVariant variant{};
+	variant.pipelineId = pipelineId;
+	variant.specializationData.resize(specializationInfo.dataSize / sizeof(u32));
+	memcpy(variant.specializationData.data(), specializationInfo.pData, specializationInfo.dataSize);
+	variant.pMapEntries = specializationInfo.pMapEntries;
+	variant.mapEntryCount = specializationInfo.mapEntryCount;
+	variant.handle = createPipeline(m_pipelines[static_cast<size_t>(pipelineId)], &specializationInfo);
+	variant.sortIndex = static_cast<u32>(m_pipelineVariants.size());
+
+	return m_pipelineVariants.emplace(variantHash, std::move(variant))->second;
+}
+
+void HelloTriangleApp::createShaderModules()
+{
+	for (size_t i = 0; i < g_shaderInfos.size(); i++)
+	{
+#ifdef SHADERS_FROM_DISK
+		// Development path: read the SPIR-V from the working directory so shaders
+		// can be recompiled without relinking the executable.
+		auto shaderCode = readFile(g_shaderInfos[i].spirvPath);
+
+		m_shaderModules[i] = createShaderModule(shaderCode);
+#else
+		// The SPIR-V is embedded in the executable, so the modules are built
+		// straight from the static arrays with no file reads or copies.
+		m_shaderModules[i] = createShaderModule(g_shaderInfos[i].embedded.pCode, g_shaderInfos[i].embedded.codeSize);
+#endif
+	}
+}
+
+VkPipeline HelloTriangleApp::createPipeline(const GraphicsPipeline& pipeline, const VkSpecializationInfo* pSpecializationInfo)
+{
+	VulkanInit::GraphicsPipelineDesc desc;
+	desc.vertShader = m_shaderModules[static_cast<size_t>(pipeline.vertShader)];
+	desc.fragShader = m_shaderModules[static_cast<size_t>(pipeline.fragShader)];
+	desc.pSpecializationInfo = pSpecializationInfo;
+
+	desc.vertexBindingCount = pipeline.vertexBindingCount;
+	desc.pVertexBindings = pipeline.pVertexBindings;
+	desc.vertexAttributeCount = pipeline.vertexAttributeCount;
+	desc.pVertexAttributes = pipeline.pVertexAttributes;
+
+	desc.depthTest = pipeline.depth;
+	desc.depthWrite = pipeline.depth;
+
+	desc.layout = m_pipelineLayout;
+	desc.renderPass = m_renderPass;
+
+	// The shader modules are kept alive after linking, rather than destroyed here,
+	// so pipelines can be rebuilt when only one of their shaders is hot reloaded.
+	VkPipeline handle = VulkanInit::CreateGraphicsPipeline(m_logicalDevice, m_pipelineCache, desc, m_pAllocator);
+
+	if (m_capture.IsOpen())
+	{
+		m_capture.AddGraphicsPipeline(handle, desc.vertShader, desc.fragShader, pSpecializationInfo,
+			pipeline.vertexBindingCount, pipeline.pVertexBindings, pipeline.vertexAttributeCount, pipeline.pVertexAttributes);
+	}
+
+	return handle;
+}
+
+void HelloTriangleApp::createFramebuffers()
+{
+	// A framebuffer binds the render pass attachments to actual image views.
+	// We need one per swapchain image, as the image we render to changes every frame.
+	m_swapchainFramebuffers.resize(m_swapchainImageViews.size());
+
+	for (size_t i = 0; i < m_swapchainImageViews.size(); i++)
+	{
+		VkImageView attachments[] = { m_swapchainImageViews[i], m_depthPassViews[0] };
+
+		VkFramebufferCreateInfo framebufferInfo{};
+		framebufferInfo.sType = VK_STRUCTURE_TYPE_FRAMEBUFFER_CREATE_INFO;
+		framebufferInfo.renderPass = m_renderPass;
+		framebufferInfo.attachmentCount = 2;
+		framebufferInfo.pAttachments = attachments;
+		framebufferInfo.width = m_swapchainExtent.width;
+		framebufferInfo.height = m_swapchainExtent.height;
+		framebufferInfo.layers = 1;
+
+		if (vkCreateFramebuffer(m_logicalDevice, &framebufferInfo, m_pAllocator, &m_swapchainFramebuffers[i]) != VK_SUCCESS)
+		{
+			throw std::runtime_error("failed to create framebuffer!");
+		}
+	}
+}
+
+void HelloTriangleApp::createCommandPool()
+{
+	// Command buffers are re-recorded every frame, so allow them to be reset individually.
+	VkCommandPoolCreateInfo poolInfo{};
+	poolInfo.sType = VK_STRUCTURE_TYPE_COMMAND_POOL_CREATE_INFO;
+	poolInfo.flags = VK_COMMAND_POOL_CREATE_RESET_COMMAND_BUFFER_BIT;
+	poolInfo.queueFamilyIndex = m_queueFamilies.graphicsFamily.value();
+
+	if (vkCreateCommandPool(m_logicalDevice, &poolInfo, m_pAllocator, &m_commandPool) != VK_SUCCESS)
+	{
+		throw std::runtime_error("failed to create command pool!");
+	}
+}
+
+void HelloTriangleApp::createCommandBuffers()
+{
+	// One command buffer per frame in flight, so the CPU can record
+	// the next frame while the GPU is still working on the previous one.
+	VkCommandBufferAllocateInfo allocInfo{};
+	allocInfo.sType = VK_STRUCTURE_TYPE_COMMAND_BUFFER_ALLOCATE_INFO;
+	allocInfo.commandPool = m_commandPool;
+	allocInfo.level = VK_COMMAND_BUFFER_LEVEL_PRIMARY;
+	allocInfo.commandBufferCount = static_cast<u32>(m_commandBuffers.size());
+
+	if (vkAllocateCommandBuffers(m_logicalDevice, &allocInfo, m_commandBuffers.data()) != VK_SUCCESS)
+	{
+		throw std::runtime_error("failed to allocate command buffers!");
+	}
+}
+
+void HelloTriangleApp::createSyncObjects()
+{
+	// Only the swapchain's semaphores. Frames are tracked on the graphics timeline, where a slot's
+	// point starts at value 0, so the very first wait in drawFrame() returns straight away.
+	VkSemaphoreCreateInfo semaphoreInfo{};
+	semaphoreInfo.sType = VK_STRUCTURE_TYPE_SEMAPHORE_CREATE_INFO;
+
+	for (size_t i = 0; i < MAX_FRAMES_IN_FLIGHT; i++)
+	{
+		if (vkCreateSemaphore(m_logicalDevice, &semaphoreInfo, m_pAllocator, &m_imageAvailableSemaphores[i]) != VK_SUCCESS)
+		{
+			throw std::runtime_error("failed to create frame synchronization objects!");
+		}
+	}
+
+	// The render finished semaphore is waited on by presentation, which is tracked per swapchain image
+	// rather than per frame in flight. Keeping one per image guarantees we never re-signal
+	// a semaphore the presentation engine has not consumed yet.
+	m_renderFinishedSemaphores.resize(m_swapchainImages.size());
+
+	for (VkSemaphore& semaphore : m_renderFinishedSemaphores)
+	{
+		if (vkCreateSemaphore(m_logicalDevice, &semaphoreInfo, m_pAllocator, &semaphore) != VK_SUCCESS)
+		{
+			throw std::runtime_error("failed to create frame synchronization objects!");
+		}
+	}
+}
+
+void HelloTriangleApp::drawFrame()
+{
+	auto cpuStart = std::chrono::steady_clock::now();
+
+	// Wait until the GPU has finished the last frame that used this slot, and nothing submitted after it.
+	m_sync.Wait(m_framePoints[m_currentFrame]);
+
+	// That frame's timestamps are now available too.
+	double gpuMs;
+	if (m_gpuTimer.Resolve(m_currentFrame, gpuMs))
+	{
+		if (m_pFrameTimings != nullptr)
+		{
+			m_pFrameTimings->gpuMs.push_back(gpuMs);
+		}
+
+		// Sets the resolution of the frames recorded from here on. The time is a couple of frames old
+		// by now, which the controller's smoothing and step limit already allow for.
+		if (m_dynamicResolutionEnabled)
+		{
+			m_dynamicResolution.Update(gpuMs);
+		}
+	}
+
+	resolveParticleTiming(m_currentFrame);
+
+	// This is the frame boundary. Nothing is being recorded, so reloaded pipelines can be swapped in
+	// and anything retired long enough ago is guaranteed to be finished with by the GPU.
+#ifdef SHADER_HOT_RELOAD
+	processShaderReloads();
+#endif
+	destroyRetiredObjects();
+
+	// Dumps whose copies have landed since go to the encoders. Only polls the timeline, so never waits.
+	if (m_frameDump.IsEnabled())
+	{
+		m_frameDump.Poll();
+	}
+
+	u32 imageIndex;
+	VkResult result = VK_SUCCESS;
+
+	if (m_config.headless)
+	{
+		// Offscreen images are used round robin. Each is only touched by the frame that renders to it,
+		// which the wait above has already covered.
+		imageIndex = static_cast<u32>(m_frameNumber % m_swapchainImages.size());
+	}
+	else
+	{
+		result = vkAcquireNextImageKHR(m_logicalDevice, m_vkSwapchainKHR, UINT64_MAX, m_imageAvailableSemaphores[m_currentFrame], VK_NULL_HANDLE, &imageIndex);
+
+		// The window is not resizable, so an out of date swapchain only happens transiently (e.g. minimised).
+		// Skip the frame rather than recreating the swapchain.
+		if (result == VK_ERROR_OUT_OF_DATE_KHR)
+		{
+			return;
+		}
+		else if (result != VK_SUCCESS && result != VK_SUBOPTIMAL_KHR)
+		{
+			throw std::runtime_error("failed to acquire swapchain image!");
+		}
+	}
+
+	// What this slot's last frame built is no longer needed.
+	m_frameArenas[m_currentFrame].Reset();
+
+	// Opened here rather than at the top, so a skipped frame is not captured.
+	if (m_capture.IsOpen())
+	{
+		m_capture.BeginFrame();
+	}
+
+	// Work on other queues this frame reads, each waited for at the stage that first reads it.
+	u32 waitCount = 0;
+	SyncPoint waits[2];
+	VkPipelineStageFlags waitStages[2];
+
+	// The simulation is submitted first so the compute queue can start on it while this frame is recorded.
+	// The graphics queue only waits for it where the particles are first read, as vertex input.
+	if (m_particles.IsEnabled())
+	{
+		waits[waitCount] = m_particles.Simulate(m_currentFrame, m_frameNumber, PARTICLE_TIME_STEP);
+		waitStages[waitCount++] = VK_PIPELINE_STAGE_VERTEX_INPUT_BIT;
+	}
+
+	// Once one submit has waited for a mesh upload, every later one on the queue is ordered after it too.
+	if (m_pendingMeshUpload.value != 0)
+	{
+		waits[waitCount] = m_pendingMeshUpload;
+		waitStages[waitCount++] = VK_PIPELINE_STAGE_VERTEX_INPUT_BIT;
+		m_pendingMeshUpload.value = 0;
+	}
+
+	VkCommandBuffer commandBuffer = m_commandBuffers[m_currentFrame];
+	vkResetCommandBuffer(commandBuffer, 0);
+	recordCommandBuffer(commandBuffer, imageIndex);
+
+	if (m_capture.IsOpen())
+	{
+		for (u32 i = 0; i < m_drawQueue.GetCount(); i++)
+		{
+			m_capture.AddDraw(m_drawQueue.GetSorted(i));
+		}
+
+		m_capture.EndFrame(m_renderExtent);
+	}
 
-	sdl_result = SDL_Vulkan_GetInstanceExtensions(m_pWindow, &sdlExtensionCount, sdlExtensionNames.data());
+	VkSemaphore signalSemaphores[] = { m_renderFinishedSemaphores[imageIndex] };
 
-	if (enableValidationLayers)
+	SubmitBatch batch;
+	batch.commandBufferCount = 1;
+	batch.pCommandBuffers = &commandBuffer;
+	batch.waitCount = waitCount;
+	batch.pWaits = waits;
+	batch.pWaitStages = waitStages;
+
+	// Headless frames have no acquire to wait on and no present to signal.
+	if (!m_config.headless)
 	{
-		sdlExtensionNames.push_back(VK_EXT_DEBUG_UTILS_EXTENSION_NAME);
+		batch.binaryWait = m_imageAvailableSemaphores[m_currentFrame];
+		batch.binaryWaitStage = VK_PIPELINE_STAGE_COLOR_ATTACHMENT_OUTPUT_BIT;
+		batch.binarySignal = signalSemaphores[0];
 	}
 
-	return sdlExtensionNames;
+	m_framePoints[m_currentFrame] = m_sync.Submit(QueueId::Graphics, batch);
+
+	// The frame's dump is copied by the same point.
+	m_frameDump.Submitted(m_framePoints[m_currentFrame]);
+
+	if (m_config.headless)
+	{
+		finishFrame(cpuStart);
+		return;
+	}
+
+	VkPresentInfoKHR presentInfo{};
+	presentInfo.sType = VK_STRUCTURE_TYPE_PRESENT_INFO_KHR;
+	presentInfo.waitSemaphoreCount = 1;
+	presentInfo.pWaitSemaphores = signalSemaphores;
+	presentInfo.swapchainCount = 1;
+	presentInfo.pSwapchains = &m_vkSwapchainKHR;
+	presentInfo.pImageIndices = &imageIndex;
+
+	result = vkQueuePresentKHR(m_presentQueue, &presentInfo);
+
+	if (result != VK_SUCCESS && result != VK_SUBOPTIMAL_KHR && result != VK_ERROR_OUT_OF_DATE_KHR)
+	{
+		throw std::runtime_error("failed to present swapchain image!");
+	}
+
+	finishFrame(cpuStart);
 }
 
-std::vector<char> readFile(const std::string& filename)
+void HelloTriangleApp::finishFrame(std::chrono::steady_clock::time_point cpuStart)
 {
-	// 'ate' allows us to start reading from the end of the file. 
-	// This can be used to determine the file size at the start,
-	// for use in allocating a buffer size.
-	std::ifstream file(filename, std::ios::ate | std::ios::binary);
+	if (m_pFrameTimings != nullptr)
+	{
+		std::chrono::duration<double, std::milli> cpuTime = std::chrono::steady_clock::now() - cpuStart;
+		m_pFrameTimings->cpuMs.push_back(cpuTime.count());
+	}
 
-	if (!file.is_open())
+	m_currentFrame = (m_currentFrame + 1) % MAX_FRAMES_IN_FLIGHT;
+	m_frameNumber++;
+}
+
+void HelloTriangleApp::resolveParticleTiming(u32 slot)
+{
+	double computeMs;
+	if (!m_particles.IsEnabled() || !m_particles.ResolveTiming(slot, computeMs))
 	{
-		throw std::runtime_error("failed to open file!");
+		return;
 	}
 
-	// Create a buffer of the same size as the bytecode.
-	size_t fileSize = static_cast<size_t>(file.tellg());
-	std::vector<char> buffer(fileSize);
+	if (m_pFrameTimings != nullptr)
+	{
+		m_pFrameTimings->computeMs.push_back(computeMs);
+	}
 
-	// Return to the start of the file and read the data into the buffer.
-	file.seekg(0);
-	file.read(buffer.data(), fileSize);
+	m_particleComputeMs += computeMs;
+	m_particleComputeSamples++;
+}
 
-	file.close();
+void HelloTriangleApp::recordCommandBuffer(VkCommandBuffer commandBuffer, u32 imageIndex)
+{
+	VkCommandBufferBeginInfo beginInfo{};
+	beginInfo.sType = VK_STRUCTURE_TYPE_COMMAND_BUFFER_BEGIN_INFO;
+	beginInfo.flags = VK_COMMAND_BUFFER_USAGE_ONE_TIME_SUBMIT_BIT;
 
-	return buffer;
+	if (vkBeginCommandBuffer(commandBuffer, &beginInfo) != VK_SUCCESS)
+	{
+		throw std::runtime_error("failed to begin recording command buffer!");
+	}
+
+	m_gpuTimer.Begin(commandBuffer, m_currentFrame);
+
+	// With dynamic resolution only the top left of each view's layer is drawn, at the current scale.
+	m_renderExtent = m_dynamicResolutionEnabled ? m_dynamicResolution.GetRenderExtent() : m_viewExtent;
+
+	// Build and sort the draw list before the pass begins, then record it in one go.
+	// Room is made up front for every scene draw at every LOD, twice when each is split into
+	// an early and a late draw, plus the particles, so the queue never grows.
+	const u32 packetsPerDraw = MESH_MAX_LODS * (m_occlusionCullingEnabled ? 2 : 1);
+	m_drawQueue.Clear(&m_frameArenas[m_currentFrame], static_cast<u32>(std::max<size_t>(m_sceneDraws.size(), 1)) * packetsPerDraw + 2);
+
+	if (m_occlusionCullingEnabled)
+	{
+		m_occlusion.BeginFrame(m_currentFrame);
+	}
+	else if (m_multiDrawEnabled)
+	{
+		m_drawTable.BeginFrame(m_currentFrame);
+	}
+
+	m_lighting.BeginFrame(m_currentFrame, m_lights.data(), static_cast<u32>(m_lights.size()));
+
+	submitSceneDraws();
+	m_drawQueue.Sort();
+
+	// Before any pass, so every lit fragment of the frame reads the same clusters.
+	m_lighting.RecordLightAssignment(commandBuffer, m_currentFrame);
+
+	m_drawStats = DrawStats{ };
+
+	if (!m_occlusionCullingEnabled)
+	{
+		recordScenePasses(commandBuffer, m_renderPass, imageIndex, DrawPass::Opaque, DrawPass::Transparent);
+	}
+	else
+	{
+		// Last frame's visible instances first, then everything the pyramid built from their depth does not hide.
+		m_occlusion.RecordEarlyCull(commandBuffer, m_currentFrame);
+
+		recordScenePasses(commandBuffer, m_renderPass, imageIndex, DrawPass::Opaque, DrawPass::Opaque);
+
+		m_occlusion.RecordDepthPyramid(commandBuffer, m_renderExtent);
+		m_occlusion.RecordLateCull(commandBuffer, m_currentFrame);
+
+		recordScenePasses(commandBuffer, m_lateRenderPass, imageIndex, DrawPass::OpaqueLate, DrawPass::Transparent);
+	}
+
+	if (sceneTargetsEnabled())
+	{
+		recordComposite(commandBuffer, imageIndex);
+	}
+
+	// After everything that writes the output, and inside the timed part of the frame, as the copy is part of its cost.
+	// A full ring drops the frame rather than waiting for an earlier dump.
+	if (m_frameDump.IsEnabled())
+	{
+		m_frameDump.RecordCopy(commandBuffer, m_swapchainImages[imageIndex], m_finalColorLayout, m_frameNumber);
+	}
+
+	m_gpuTimer.End(commandBuffer, m_currentFrame);
+
+	if (vkEndCommandBuffer(commandBuffer) != VK_SUCCESS)
+	{
+		throw std::runtime_error("failed to record command buffer!");
+	}
+}
+
+void HelloTriangleApp::recordScenePasses(VkCommandBuffer commandBuffer, VkRenderPass renderPass, u32 imageIndex, DrawPass firstPass, DrawPass lastPass)
+{
+	// Colour, then depth cleared to the far plane. Ignored by the late pass, which loads both.
+	VkClearValue clearValues[2]{};
+	clearValues[0].color = { { 0.0f, 0.0f, 0.0f, 1.0f } };
+	clearValues[1].depthStencil = { 1.0f, 0 };
+
+	VkRenderPassBeginInfo renderPassInfo{};
+	renderPassInfo.sType = VK_STRUCTURE_TYPE_RENDER_PASS_BEGIN_INFO;
+	renderPassInfo.renderPass = renderPass;
+	renderPassInfo.renderArea.offset = { 0, 0 };
+	renderPassInfo.renderArea.extent = m_renderExtent;
+	renderPassInfo.clearValueCount = 2;
+	renderPassInfo.pClearValues = clearValues;
+
+	// Viewport and scissor are dynamic state, so they are set here rather than baked into the pipeline.
+	// Every pipeline declares them dynamic, so they stay set across the pipeline binds below.
+	// Every view is drawn at the same place in its own layer, so one of each serves all of them.
+	VkViewport viewport{};
+	viewport.x = 0.0f;
+	viewport.y = 0.0f;
+	viewport.width = static_cast<float>(m_renderExtent.width);
+	viewport.height = static_cast<float>(m_renderExtent.height);
+	viewport.minDepth = 0.0f;
+	viewport.maxDepth = 1.0f;
+
+	VkRect2D scissor{};
+	scissor.offset = { 0, 0 };
+	scissor.extent = m_renderExtent;
+
+	ViewConstants constants = MakeViewConstants(m_views.data(), m_viewCount, 0);
+
+	for (u32 pass = 0; pass < m_viewPassCount; pass++)
+	{
+		renderPassInfo.framebuffer = sceneTargetsEnabled() ? m_sceneTargets[m_currentFrame].framebuffers[pass] : m_swapchainFramebuffers[imageIndex];
+
+		vkCmdBeginRenderPass(commandBuffer, &renderPassInfo, VK_SUBPASS_CONTENTS_INLINE);
+		vkCmdSetViewport(commandBuffer, 0, 1, &viewport);
+		vkCmdSetScissor(commandBuffer, 0, 1, &scissor);
+
+		// A multiview pass starts from view 0 and draws them all. Without multiview gl_ViewIndex is always 0,
+		// so the base selects the pass's view.
+		constants.baseView = static_cast<int32_t>(pass);
+		vkCmdPushConstants(commandBuffer, m_pipelineLayout, VK_SHADER_STAGE_VERTEX_BIT, 0, sizeof(constants), &constants);
+
+		m_drawQueue.RecordPasses(commandBuffer, m_pipelineLayout, firstPass, lastPass, m_drawStats);
+
+		vkCmdEndRenderPass(commandBuffer);
+	}
 }
 
-VkResult CreateDebugUtilsMessengerEXT(VkInstance instance,
-									  const VkDebugUtilsMessengerCreateInfoEXT* pCreateInfo, 
-									  const VkAllocationCallbacks* pAllocator, 
-									  VkDebugUtilsMessengerEXT* pDebugMessenger)
+void HelloTriangleApp::recordComposite(VkCommandBuffer commandBuffer, u32 imageIndex)
 {
-	auto func = (PFN_vkCreateDebugUtilsMessengerEXT)vkGetInstanceProcAddr(instance, "vkCreateDebugUtilsMessengerEXT");
+	VkImage sceneImage = m_sceneTargets[m_currentFrame].image;
+	VkImage outputImage = m_swapchainImages[imageIndex];
+
+	const u32 columns = GetViewColumns(m_viewCount);
+	const u32 rows = GetViewRows(m_viewCount);
+
+	// E.g. three views leave a tile empty, and an output that does not divide evenly leaves a few pixels over.
+	const bool tilesCoverOutput = columns * rows == m_viewCount &&
+		m_viewExtent.width * columns == m_swapchainExtent.width && m_viewExtent.height * rows == m_swapchainExtent.height;
+
+	VkImageMemoryBarrier barriers[2]{};
+
+	// The render pass already left the scene target in TRANSFER_SRC, but its colour writes
+	// still have to be made visible to the transfer.
+	barriers[0].sType = VK_STRUCTURE_TYPE_IMAGE_MEMORY_BARRIER;
+	barriers[0].srcAccessMask = VK_ACCESS_COLOR_ATTACHMENT_WRITE_BIT;
+	barriers[0].dstAccessMask = VK_ACCESS_TRANSFER_READ_BIT;
+	barriers[0].oldLayout = VK_IMAGE_LAYOUT_TRANSFER_SRC_OPTIMAL;
+	barriers[0].newLayout = VK_IMAGE_LAYOUT_TRANSFER_SRC_OPTIMAL;
+	barriers[0].srcQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED;
+	barriers[0].dstQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED;
+	barriers[0].image = sceneImage;
+	barriers[0].subresourceRange = { VK_IMAGE_ASPECT_COLOR_BIT, 0, 1, 0, m_viewCount };
+
+	// The old contents of the output image are cleared or written over, so can be discarded.
+	// Starting at the colour output stage chains this onto the wait for the acquire semaphore.
+	barriers[1] = barriers[0];
+	barriers[1].srcAccessMask = 0;
+	barriers[1].dstAccessMask = VK_ACCESS_TRANSFER_WRITE_BIT;
+	barriers[1].oldLayout = VK_IMAGE_LAYOUT_UNDEFINED;
+	barriers[1].newLayout = VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL;
+	barriers[1].image = outputImage;
+	barriers[1].subresourceRange = { VK_IMAGE_ASPECT_COLOR_BIT, 0, 1, 0, 1 };
+
+	vkCmdPipelineBarrier(commandBuffer, VK_PIPELINE_STAGE_COLOR_ATTACHMENT_OUTPUT_BIT, VK_PIPELINE_STAGE_TRANSFER_BIT, 0,
+		0, nullptr, 0, nullptr, 2, barriers);
+
+	if (!tilesCoverOutput)
+	{
+		VkClearColorValue clearColor = { { 0.0f, 0.0f, 0.0f, 1.0f } };
+		vkCmdClearColorImage(commandBuffer, outputImage, VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL, &clearColor, 1, &barriers[1].subresourceRange);
+
+		// The tiles are written over the clear.
+		VkMemoryBarrier clearBarrier{};
+		clearBarrier.sType = VK_STRUCTURE_TYPE_MEMORY_BARRIER;
+		clearBarrier.srcAccessMask = VK_ACCESS_TRANSFER_WRITE_BIT;
+		clearBarrier.dstAccessMask = VK_ACCESS_TRANSFER_WRITE_BIT;
+
+		vkCmdPipelineBarrier(commandBuffer, VK_PIPELINE_STAGE_TRANSFER_BIT, VK_PIPELINE_STAGE_TRANSFER_BIT, 0,
+			1, &clearBarrier, 0, nullptr, 0, nullptr);
+	}
+
+	// One region per view, from its layer to its tile, all in one command.
+	std::array<VkImageBlit, MAX_VIEWS> blits{};
+	std::array<VkImageCopy, MAX_VIEWS> copies{};
+
+	for (u32 view = 0; view < m_viewCount; view++)
+	{
+		const int32_t tileX = static_cast<int32_t>((view % columns) * m_viewExtent.width);
+		const int32_t tileY = static_cast<int32_t>((view / columns) * m_viewExtent.height);
+
+		blits[view].srcSubresource = { VK_IMAGE_ASPECT_COLOR_BIT, 0, view, 1 };
+		blits[view].srcOffsets[1] = { static_cast<int32_t>(m_renderExtent.width), static_cast<int32_t>(m_renderExtent.height), 1 };
+		blits[view].dstSubresource = { VK_IMAGE_ASPECT_COLOR_BIT, 0, 0, 1 };
+		blits[view].dstOffsets[0] = { tileX, tileY, 0 };
+		blits[view].dstOffsets[1] = { tileX + static_cast<int32_t>(m_viewExtent.width), tileY + static_cast<int32_t>(m_viewExtent.height), 1 };
+
+		copies[view].srcSubresource = blits[view].srcSubresource;
+		copies[view].dstSubresource = blits[view].dstSubresource;
+		copies[view].dstOffset = { tileX, tileY, 0 };
+		copies[view].extent = { m_viewExtent.width, m_viewExtent.height, 1 };
+	}
 
-	if (func != nullptr)
+	// Without dynamic resolution every view is rendered at its tile's size, so a plain copy does, which unlike
+	// a blit needs no format support.
+	if (m_dynamicResolutionEnabled)
 	{
-		return func(instance, pCreateInfo, pAllocator, pDebugMessenger);
+		vkCmdBlitImage(commandBuffer, sceneImage, VK_IMAGE_LAYOUT_TRANSFER_SRC_OPTIMAL, outputImage, VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL,
+			m_viewCount, blits.data(), m_upscaleFilter);
 	}
 	else
 	{
-		return VK_ERROR_EXTENSION_NOT_PRESENT;
+		vkCmdCopyImage(commandBuffer, sceneImage, VK_IMAGE_LAYOUT_TRANSFER_SRC_OPTIMAL, outputImage, VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL,
+			m_viewCount, copies.data());
+	}
+
+	// Hand the output image over in the layout the render pass would have left it in.
+	VkImageMemoryBarrier presentBarrier = barriers[1];
+	presentBarrier.srcAccessMask = VK_ACCESS_TRANSFER_WRITE_BIT;
+	presentBarrier.dstAccessMask = 0;
+	presentBarrier.oldLayout = VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL;
+	presentBarrier.newLayout = m_finalColorLayout;
+
+	vkCmdPipelineBarrier(commandBuffer, VK_PIPELINE_STAGE_TRANSFER_BIT, VK_PIPELINE_STAGE_BOTTOM_OF_PIPE_BIT, 0,
+		0, nullptr, 0, nullptr, 1, &presentBarrier);
+}
+
+void HelloTriangleApp::submitSceneDraws()
+{
+	DrawPacket packet{};
+	packet.descriptorSet = m_lighting.GetDescriptorSet(m_currentFrame);
+	packet.vertexBuffer = m_instanceBuffer;
+	packet.vertexBufferOffset = 0;
+
+	// The vertices are hardcoded in the vertex shader, indexed by gl_VertexIndex.
+	// Each instance offsets and scales its copy of the triangle.
+	packet.vertexCount = 3;
+
+	if (m_sceneDraws.empty())
+	{
+		const PipelineVariant& variant = getPipeline(PipelineId::Triangle, m_trianglePermutation);
+
+		packet.key = MakeDrawKey(DrawPass::Opaque, variant.sortIndex, 0, 0);
+		packet.pipeline = variant.handle;
+		packet.instanceCount = m_instanceCount;
+		submitOpaqueDraw(packet, 0, TRIANGLE_BOUNDING_RADIUS * m_trianglePermutation.Get<TriangleScale>());
+	}
+
+	// Each draw's occlusion culling entries follow the previous draw's, see updateOcclusionScene().
+	u32 firstEntry = 0;
+
+	for (const SceneDraw& draw : m_sceneDraws)
+	{
+		if (draw.mesh != NO_MESH)
+		{
+			submitMeshDraw(draw, firstEntry);
+			firstEntry += draw.instanceCount;
+			continue;
+		}
+
+		const PipelineVariant& variant = getPipeline(PipelineId::Triangle, draw.permutation);
+
+		packet.key = getSceneDrawKey(draw);
+		packet.pipeline = variant.handle;
+		packet.instanceCount = draw.instanceCount;
+		packet.firstInstance = draw.firstInstance;
+		submitOpaqueDraw(packet, firstEntry, TRIANGLE_BOUNDING_RADIUS * draw.permutation.Get<TriangleScale>());
+		firstEntry += draw.instanceCount;
+	}
+
+	if (m_particles.IsEnabled())
+	{
+		const PipelineVariant& variant = getPipeline(PipelineId::Particles, m_particlePermutation);
+
+		// Every particle is an instance of a six vertex quad, read from the buffer this frame's step writes.
+		// They are blended in one draw, in buffer order, so there is no depth to sort by.
+		DrawPacket particlePacket{};
+		particlePacket.key = MakeDrawKey(DrawPass::Transparent, variant.sortIndex, 0, 0);
+		particlePacket.pipeline = variant.handle;
+		particlePacket.vertexBuffer = m_particles.GetOutputBuffer(m_frameNumber);
+		particlePacket.vertexCount = 6;
+		particlePacket.instanceCount = m_particles.GetCount();
+		m_drawQueue.Submit(particlePacket);
+	}
+}
+
+void HelloTriangleApp::submitMeshDraw(const SceneDraw& draw, u32 firstEntry)
+{
+	const PipelineVariant& variant = getPipeline(PipelineId::Mesh, draw.permutation);
+	const MeshInfo& mesh = m_meshes.GetMesh(draw.mesh);
+
+	DrawPacket packet{};
+	packet.key = getSceneDrawKey(draw);
+	packet.pipeline = variant.handle;
+	packet.descriptorSet = m_lighting.GetDescriptorSet(m_currentFrame);
+	packet.vertexBuffer = m_instanceBuffer;
+	packet.meshVertexBuffer = m_meshes.GetVertexBuffer();
+	packet.indexBuffer = m_meshes.GetIndexBuffer();
+
+	// The mesh is placed in clip space, which is half the render target across in each direction,
+	// so one mesh unit at an instance scale of 1 covers this many pixels. The larger side is used,
+	// the shader does not correct for aspect so that is the direction errors are stretched most.
+	// The LODs are shared by every view, so they are chosen for the one that magnifies the most.
+	float maxZoom = 0.0f;
+	for (u32 i = 0; i < m_viewCount; i++)
+	{
+		maxZoom = std::max(maxZoom, m_views[i].zoom);
+	}
+
+	const float pixelsPerUnit = draw.permutation.Get<TriangleScale>() * std::max(m_renderExtent.width, m_renderExtent.height) * 0.5f * maxZoom;
+	const float maxPixelError = m_config.lodPixelError;
+	const float radius = mesh.boundingRadius * draw.permutation.Get<TriangleScale>();
+
+	// The instances are sorted largest first (see SetDraws()), so each LOD takes the next contiguous
+	// range: those too large for the following, coarser LOD's error to stay under the threshold.
+	auto first = m_instances.begin() + draw.firstInstance;
+	auto last = first + draw.instanceCount;
+	auto begin = first;
+
+	for (u32 lodIndex = 0; lodIndex < mesh.lodCount && begin != last; lodIndex++)
+	{
+		auto end = last;
+		if (maxPixelError <= 0.0f)
+		{
+			// LODs are disabled, everything is drawn at full detail.
+		}
+		else if (lodIndex + 1 < mesh.lodCount)
+		{
+			const float nextError = m_meshes.GetLod(draw.mesh, lodIndex + 1).error * pixelsPerUnit;
+			const float maxScale = nextError > 0.0f ? maxPixelError / nextError : std::numeric_limits<float>::max();
+			end = std::partition_point(begin, last, [maxScale](const InstanceData& instance) { return instance.scale > maxScale; });
+		}
+
+		if (end == begin)
+		{
+			continue;
+		}
+
+		const MeshLod& lod = m_meshes.GetLod(draw.mesh, lodIndex);
+		packet.vertexCount = lod.indexCount;
+		packet.firstVertex = lod.firstIndex;
+		packet.vertexOffset = static_cast<int32_t>(lod.firstVertex);
+		packet.instanceCount = static_cast<u32>(end - begin);
+		packet.firstInstance = static_cast<u32>(begin - m_instances.begin());
+		submitOpaqueDraw(packet, firstEntry + static_cast<u32>(begin - first), radius);
+
+		begin = end;
+	}
+}
+
+u64 HelloTriangleApp::getSceneDrawKey(const SceneDraw& draw)
+{
+	const PipelineVariant& variant = getPipeline(draw.mesh == NO_MESH ? PipelineId::Triangle : PipelineId::Mesh, draw.permutation);
+	return MakeDrawKey(DrawPass::Opaque, variant.sortIndex, draw.material, QuantiseDepth(draw.depth));
+}
+
+void HelloTriangleApp::submitOpaqueDraw(const DrawPacket& packet, u32 firstEntry, float radius)
+{
+	if (!m_occlusionCullingEnabled)
+	{
+		m_drawQueue.Submit(m_multiDrawEnabled ? m_drawTable.AddDraw(m_currentFrame, packet) : packet);
+		return;
 	}
+
+	DrawPacket early;
+	DrawPacket late;
+	m_occlusion.AddBatch(m_currentFrame, packet, firstEntry, radius, early, late);
+
+	m_drawQueue.Submit(early);
+	m_drawQueue.Submit(late);
+}
+
+void HelloTriangleApp::retireObject(VkPipeline pipeline, VkShaderModule shaderModule)
+{
+	m_retiredObjects.push_back({ m_sync.GetLastSubmitted(), pipeline, shaderModule, VK_NULL_HANDLE, VK_NULL_HANDLE });
+}
+
+void HelloTriangleApp::retireBuffer(VkBuffer buffer, VkDeviceMemory memory)
+{
+	m_retiredObjects.push_back({ m_sync.GetLastSubmitted(), VK_NULL_HANDLE, VK_NULL_HANDLE, buffer, memory });
 }
 
-void DestroyDebugUtilsMessengerEXT(VkInstance instance, 
-								   VkDebugUtilsMessengerEXT debugMessenger, 
-								   const VkAllocationCallbacks* pAllocator)
+void HelloTriangleApp::destroyRetiredObjects()
 {
-	auto func = (PFN_vkDestroyDebugUtilsMessengerEXT)vkGetInstanceProcAddr(instance, "vkDestroyDebugUtilsMessengerEXT");
+	// An object can only have been used by work submitted before it was retired. Once every queue's
+	// timeline has passed its last submit at that time, the GPU is done with it. This replaces a
+	// vkDeviceWaitIdle() per reload or scene change with a delay of a couple of frames.
+	// Checked once per object, as a later check may see more of the timelines complete.
+	size_t keptCount = 0;
+	for (const RetiredObject& retired : m_retiredObjects)
+	{
+		if (!m_sync.IsComplete(retired.lastUse))
+		{
+			m_retiredObjects[keptCount++] = retired;
+			continue;
+		}
+
+		vkDestroyPipeline(m_logicalDevice, retired.pipeline, m_pAllocator);
+		vkDestroyShaderModule(m_logicalDevice, retired.shaderModule, m_pAllocator);
+		vkDestroyBuffer(m_logicalDevice, retired.buffer, m_pAllocator);
+		vkFreeMemory(m_logicalDevice, retired.memory, m_pAllocator);
+	}
+
+	m_retiredObjects.resize(keptCount);
+}
 
-	if (func != nullptr) 
+#ifdef SHADER_HOT_RELOAD
+void HelloTriangleApp::startShaderHotReload()
+{
+	for (size_t i = 0; i < g_shaderInfos.size(); i++)
 	{
-		func(instance, debugMessenger, pAllocator);
+		m_shaderWatcher.Watch(static_cast<u32>(i), g_shaderInfos[i].sourcePath);
 	}
+
+	m_shaderWatcher.Start("Shaders");
 }
 
-VKAPI_ATTR VkBool32 VKAPI_CALL debugCallback(VkDebugUtilsMessageSeverityFlagBitsEXT messagSeverity, 
-											 VkDebugUtilsMessageTypeFlagsEXT messageType, 
-											 const VkDebugUtilsMessengerCallbackDataEXT* pCallbackData, 
-											 void* pUserData)
+void HelloTriangleApp::processShaderReloads()
 {
-	std::cerr << "Validation layer: " << pCallbackData->pMessage << std::endl;
+	m_shaderWatcher.TakeCompiled(m_reloadedShaders);
+
+	if (m_reloadedShaders.empty())
+	{
+		return;
+	}
+
+	// Swap in every new module first, so a pipeline using two changed shaders is only rebuilt once.
+	std::array<bool, static_cast<size_t>(ShaderId::Count)> changed{};
+
+	for (ShaderWatcher::CompiledShader& shader : m_reloadedShaders)
+	{
+		VkShaderModule newModule;
+
+		try
+		{
+			newModule = createShaderModule(shader.spirv.data(), shader.spirv.size() * sizeof(u32));
+		}
+		catch (const std::exception& e)
+		{
+			std::cerr << "Shader hot reload: " << e.what() << std::endl;
+			continue;
+		}
+
+		retireObject(VK_NULL_HANDLE, m_shaderModules[shader.shaderId]);
+		m_shaderModules[shader.shaderId] = newModule;
+		changed[shader.shaderId] = true;
+	}
+
+	// Every compiled permutation of an affected pipeline is rebuilt with its original specialization data.
+	for (auto& [hash, variant] : m_pipelineVariants)
+	{
+		const GraphicsPipeline& pipeline = m_pipelines[static_cast<size_t>(variant.pipelineId)];
+
+		if (!changed[static_cast<size_t>(pipeline.vertShader)] && !changed[static_cast<size_t>(pipeline.fragShader)])
+		{
+			continue;
+		}
+
+		VkSpecializationInfo specializationInfo{};
+		specializationInfo.mapEntryCount = variant.mapEntryCount;
+		specializationInfo.pMapEntries = variant.pMapEntries;
+		specializationInfo.dataSize = variant.specializationData.size() * sizeof(u32);
+		specializationInfo.pData = variant.specializationData.data();
+
+		// If the new shaders fail to link, keep drawing with the old pipeline.
+		try
+		{
+			VkPipeline newPipeline = createPipeline(pipeline, &specializationInfo);
+			retireObject(variant.handle, VK_NULL_HANDLE);
+			variant.handle = newPipeline;
+		}
+		catch (const std::exception& e)
+		{
+			std::cerr << "Shader hot reload: " << e.what() << std::endl;
+		}
+	}
+
+	if (changed[static_cast<size_t>(ShaderId::ParticleComp)] && m_particles.IsEnabled())
+	{
+		try
+		{
+			retireObject(m_particles.ReplacePipeline(m_shaderModules[static_cast<size_t>(ShaderId::ParticleComp)]), VK_NULL_HANDLE);
+		}
+		catch (const std::exception& e)
+		{
+			std::cerr << "Shader hot reload: " << e.what() << std::endl;
+		}
+	}
+
+	if (m_occlusionCullingEnabled)
+	{
+		try
+		{
+			if (changed[static_cast<size_t>(ShaderId::DepthReduceComp)])
+			{
+				retireObject(m_occlusion.ReplaceReducePipeline(m_shaderModules[static_cast<size_t>(ShaderId::DepthReduceComp)]), VK_NULL_HANDLE);
+			}
+
+			if (changed[static_cast<size_t>(ShaderId::OcclusionCullComp)])
+			{
+				retireObject(m_occlusion.ReplaceCullPipeline(m_shaderModules[static_cast<size_t>(ShaderId::OcclusionCullComp)]), VK_NULL_HANDLE);
+			}
+		}
+		catch (const std::exception& e)
+		{
+			std::cerr << "Shader hot reload: " << e.what() << std::endl;
+		}
+	}
+
+	if (changed[static_cast<size_t>(ShaderId::LightAssignComp)])
+	{
+		try
+		{
+			retireObject(m_lighting.ReplacePipeline(m_shaderModules[static_cast<size_t>(ShaderId::LightAssignComp)]), VK_NULL_HANDLE);
+		}
+		catch (const std::exception& e)
+		{
+			std::cerr << "Shader hot reload: " << e.what() << std::endl;
+		}
+	}
+}
+#endif
 
-	return VK_FALSE;
+VkShaderModule HelloTriangleApp::createShaderModule(const std::vector<char>& bytecode)
+{
+	// std::vector's default allocator returns memory aligned for any fundamental type,
+	// so the data can be reinterpreted as the 32-bit words Vulkan expects.
+	return createShaderModule(reinterpret_cast<const u32*>(bytecode.data()), bytecode.size());
 }
 
-void populateDebugMessengerCreateInfo(VkDebugUtilsMessengerCreateInfoEXT& createInfo)
+VkShaderModule HelloTriangleApp::createShaderModule(const u32* pCode, size_t codeSize)
 {
-	createInfo = {};
-	createInfo.sType = VK_STRUCTURE_TYPE_DEBUG_UTILS_MESSENGER_CREATE_INFO_EXT;
-	createInfo.messageSeverity = VK_DEBUG_UTILS_MESSAGE_SEVERITY_VERBOSE_BIT_EXT | VK_DEBUG_UTILS_MESSAGE_SEVERITY_WARNING_BIT_EXT | VK_DEBUG_UTILS_MESSAGE_SEVERITY_ERROR_BIT_EXT;
-	createInfo.messageType = VK_DEBUG_UTILS_MESSAGE_TYPE_GENERAL_BIT_EXT | VK_DEBUG_UTILS_MESSAGE_TYPE_VALIDATION_BIT_EXT | VK_DEBUG_UTILS_MESSAGE_TYPE_PERFORMANCE_BIT_EXT;
-	createInfo.pfnUserCallback = debugCallback;
+	VkShaderModule shaderModule = VulkanInit::CreateShaderModule(m_logicalDevice, pCode, codeSize, m_pAllocator);
+
+	if (m_capture.IsOpen())
+	{
+		m_capture.AddShaderModule(shaderModule, pCode, codeSize);
+	}
+
+	return shaderModule;
 }
 
-void setupDebugMessenger(HelloTriangleApp& app)
+std::vector<const char*> HelloTriangleApp::getRequiredExtensions()
 {
-	if (!enableValidationLayers) return;
+	// Headless rendering needs no window system extensions.
+	if (m_config.headless)
+	{
+		return { };
+	}
+
+	u32 sdlExtensionCount;
+
+	SDL_bool sdl_result = SDL_Vulkan_GetInstanceExtensions(m_pWindow, &sdlExtensionCount, nullptr);
+
+	std::vector<const char*> sdlExtensionNames(sdlExtensionCount);
+
+	sdl_result = SDL_Vulkan_GetInstanceExtensions(m_pWindow, &sdlExtensionCount, sdlExtensionNames.data());
+
+	return sdlExtensionNames;
+}
 
-	VkDebugUtilsMessengerCreateInfoEXT createInfo;
-	populateDebugMessengerCreateInfo(createInfo);
+std::vector<char> readFile(const std::string& filename)
+{
+	// 'ate' allows us to start reading from the end of the file. 
+	// This can be used to determine the file size at the start,
+	// for use in allocating a buffer size.
+	std::ifstream file(filename, std::ios::ate | std::ios::binary);
 
-	if (CreateDebugUtilsMessengerEXT(app.GetInstance(), &createInfo, nullptr, &app.GetDebugMessenger()) != VK_SUCCESS)
+	if (!file.is_open())
 	{
-		throw std::runtime_error("failed to set up debug messenger!");
+		throw std::runtime_error("failed to open file!");
 	}
+
+	// Create a buffer of the same size as the bytecode.
+	size_t fileSize = static_cast<size_t>(file.tellg());
+	std::vector<char> buffer(fileSize);
+
+	// Return to the start of the file and read the data into the buffer.
+	file.seekg(0);
+	file.read(buffer.data(), fileSize);
+
+	file.close();
+
+	return buffer;
 }
+
+
@@ -1,75 +1,299 @@
 #pragma once
 
+#ifdef _WIN32
 #define VK_USE_PLATFORM_WIN32_KHR
+#endif
 
+#include <array>
+#include <cstddef>
+#include <chrono>
+#include <string>
+#include <unordered_map>
 #include <vector>
 #include <optional>
 #include <vulkan/vulkan.h>
 #include <vulkan/vk_platform.h>
 
-using u8 = uint8_t;
-using u16 = uint16_t;
-using u32 = uint32_t;
-using u64 = uint64_t;
-
-#ifdef NDEBUG
-const bool enableValidationLayers = false;
-#else
-const bool enableValidationLayers = true;
+#include "Types.h"
+#include "VulkanInit.h"
+#include "ShaderPermutation.h"
+#include "FrameTiming.h"
+#include "DrawQueue.h"
+#include "ParticleSystem.h"
+#include "DynamicResolution.h"
+#include "Capture.h"
+#include "HostAllocator.h"
+#include "LinearArena.h"
+#include "MeshLibrary.h"
+#include "OcclusionCulling.h"
+#include "DrawTable.h"
+#include "ClusteredLighting.h"
+#include "FrameDump.h"
+#include "QueueSync.h"
+#include "SceneViews.h"
+
+#ifdef SHADER_HOT_RELOAD
+#include "ShaderHotReload.h"
 #endif
 
 static std::vector<char> readFile(const std::string& filename);
 
-VkResult CreateDebugUtilsMessengerEXT(VkInstance instance,
-	const VkDebugUtilsMessengerCreateInfoEXT* pCreateInfo,
-	const VkAllocationCallbacks* pAllocator,
-	VkDebugUtilsMessengerEXT* pDebugMessenger);
+// How many frames the CPU is allowed to record ahead of the GPU.
+constexpr u32 MAX_FRAMES_IN_FLIGHT = 2;
+
+// Every shader module the app creates. Pipelines refer to their modules by id,
+// so a reloaded module can be traced back to the pipelines built from it.
+enum class ShaderId : u32
+{
+	TriangleVert,
+	TriangleFrag,
+	ParticleVert,
+	ParticleFrag,
+	ParticleComp,
+	MeshVert,
+	MeshFrag,
+	DepthReduceComp,
+	OcclusionCullComp,
+	LightAssignComp,
+	Count
+};
 
-void DestroyDebugUtilsMessengerEXT(VkInstance instance,
-	VkDebugUtilsMessengerEXT debugMessenger,
-	const VkAllocationCallbacks* pAllocator);
+enum class PipelineId : u32
+{
+	Triangle,
+	Particles,
+	Mesh,
+	Count
+};
 
-VKAPI_ATTR VkBool32 VKAPI_CALL debugCallback(VkDebugUtilsMessageSeverityFlagBitsEXT messagSeverity,
-	VkDebugUtilsMessageTypeFlagsEXT messageType,
-	const VkDebugUtilsMessengerCallbackDataEXT* pCallbackData,
-	void* pUserData);
+// The shaders and vertex input a pipeline is built from. The rest of the fixed function state
+// is shared by every pipeline, and specialization constants select a permutation of it, see PipelineVariant.
+struct GraphicsPipeline
+{
+	ShaderId vertShader;
+	ShaderId fragShader;
 
-void populateDebugMessengerCreateInfo(VkDebugUtilsMessengerCreateInfoEXT& createInfo);
+	u32 vertexBindingCount;
+	const VkVertexInputBindingDescription* pVertexBindings;
+	u32 vertexAttributeCount;
+	const VkVertexInputAttributeDescription* pVertexAttributes;
 
-struct QueueFamilyIndices {
-	std::optional<u32> graphicsFamily;
-	std::optional<u32> presentFamily;
+	// Opaque pipelines test and write depth, blended ones do neither and are drawn after them.
+	bool depth;
+};
 
-	bool isComplete() {
-		return graphicsFamily.has_value() && presentFamily.has_value();
-	};
+// One compiled permutation of a GraphicsPipeline. The specialization data is kept
+// so the variant can be rebuilt when one of its shaders is hot reloaded.
+struct PipelineVariant
+{
+	PipelineId pipelineId;
+	std::vector<u32> specializationData;
+	const VkSpecializationMapEntry* pMapEntries;
+	u32 mapEntryCount;
+	VkPipeline handle;
+
+	// Small, dense index given to each variant as it is created, used for the pipeline bits of draw sort keys.
+	u32 sortIndex;
+};
+
+// Per-instance vertex data for the triangle pipeline.
+struct InstanceData
+{
+	float offset[2];
+	float scale;
+	// [0, 1] clip space depth of the whole instance, nearer instances hide farther ones.
+	float depth;
+};
+
+// Vertex input layout for InstanceData, one binding stepped once per instance.
+inline constexpr VkVertexInputBindingDescription g_instanceBinding{ 0, sizeof(InstanceData), VK_VERTEX_INPUT_RATE_INSTANCE };
+
+inline constexpr VkVertexInputAttributeDescription g_instanceAttributes[]
+{
+	{ 0, 0, VK_FORMAT_R32G32_SFLOAT, offsetof(InstanceData, offset) },
+	{ 1, 0, VK_FORMAT_R32_SFLOAT, offsetof(InstanceData, scale) },
+	{ 2, 0, VK_FORMAT_R32_SFLOAT, offsetof(InstanceData, depth) },
 };
 
-const std::vector<const char*> g_deviceExtensions
+// The mesh pipeline reads the same instance data, plus the mesh's vertices on binding 1.
+inline constexpr VkVertexInputBindingDescription g_meshBindings[]{ g_instanceBinding, g_meshVertexBinding };
+
+inline constexpr VkVertexInputAttributeDescription g_meshAttributes[]
 {
-	VK_KHR_SWAPCHAIN_EXTENSION_NAME
+	{ 0, 0, VK_FORMAT_R32G32_SFLOAT, offsetof(InstanceData, offset) },
+	{ 1, 0, VK_FORMAT_R32_SFLOAT, offsetof(InstanceData, scale) },
+	{ 2, 0, VK_FORMAT_R32_SFLOAT, offsetof(InstanceData, depth) },
+	{ 3, 1, VK_FORMAT_R32G32B32_SFLOAT, offsetof(MeshVertex, position) },
+	{ 4, 1, VK_FORMAT_R32G32B32_SFLOAT, offsetof(MeshVertex, normal) },
 };
 
-struct SwapChainSupportDetails {
-	VkSurfaceCapabilitiesKHR capabilities;
-	std::vector<VkSurfaceFormatKHR> formats;
-	std::vector<VkPresentModeKHR> presentModes;
+// SceneDraw::mesh of a draw of the plain triangle.
+constexpr u32 NO_MESH = ~0u;
+
+// One draw of a range of the instances set with SetInstances(), using a given permutation.
+struct SceneDraw
+{
+	TrianglePermutation permutation;
+	u32 firstInstance;
+	u32 instanceCount;
+	// [0, 1], only used to order draws that share the same state.
+	float depth;
+
+	// A mesh added with AddMesh(), drawn instead of the triangle. Each instance gets the coarsest LOD
+	// that stays within AppConfig::lodPixelError, so SetDraws() reorders a mesh draw's instances by
+	// scale, and the instance ranges of mesh draws must not overlap any other draw's.
+	u32 mesh{ NO_MESH };
+
+	// Draws are ordered by pipeline, then material, then depth, so each material's draws are recorded together.
+	// Every material shares the lighting's descriptor set for now, so only the order depends on it.
+	u32 material{ 0 };
 };
 
-class HelloTriangleApp;
+struct AppConfig
+{
+	// Renders into offscreen images instead of a window. No SDL window or surface is created,
+	// so this runs on machines without a display and on software drivers such as lavapipe.
+	bool headless{ false };
+	u32 width{ 1280 };
+	u32 height{ 720 };
+
+	// Defaults to on in debug builds. Worth turning off when timing anything, the layers add a lot of CPU overhead.
+	bool enableValidation{ enableValidationLayers };
+
+	// Where the pipeline cache is loaded from at startup and saved to on shutdown. Empty disables it.
+	std::string pipelineCachePath{ "pipeline_cache.bin" };
+
+	// Particles simulated on the compute queue and drawn over the scene. 0 disables them.
+	u32 particleCount{ 0 };
+
+	// When enabled the scene is rendered offscreen at a resolution chosen from the GPU frame time,
+	// then scaled to the output. Needs GPU timestamps, without them it stays at the maximum scale.
+	DynamicResolutionSettings dynamicResolution;
+
+	// Passes a pooling, counting host allocator to every Vulkan create and destroy call.
+	// Off leaves host allocations to the driver, e.g. to compare the two.
+	bool useHostAllocator{ true };
+
+	// Records the session's resources and per-frame work to this file for VulkanReplay. Empty disables capture.
+	std::string capturePath;
+
+	// Mesh LODs are chosen so that their geometric error covers at most this many pixels on screen.
+	// 0 or less always draws the full detail mesh.
+	float lodPixelError{ 1.0f };
+
+	// Culls opaque instances hidden behind nearer ones on the GPU, see OcclusionCulling.h. Turned off when
+	// the device cannot sample its depth format, and while capturing, as replays only draw what the CPU recorded.
+	bool occlusionCulling{ true };
 
-void setupDebugMessenger(HelloTriangleApp& app);
+	// Records runs of opaque draws sharing a pipeline as single multi-draw-indirect commands, see DrawTable.h.
+	// Needs the multiDrawIndirect and drawIndirectFirstInstance features. Turned off while capturing, as replays
+	// only draw what the CPU recorded. Off records every draw on its own, for comparison.
+	bool multiDraw{ true };
+
+	// The most point lights SetLights() accepts, see ClusteredLighting.h. Sizes the per-frame light buffers.
+	u32 maxLights{ 4096 };
+
+	// Copies every frame's output back and writes it out on worker threads, see FrameDump.h.
+	// Disabled unless a directory is set. Windowed, the surface has to support transfer from its images.
+	FrameDumpSettings frameDump;
+
+	// Cameras over the scene rendered every frame, each into its own tile of the output, see SceneViews.h.
+	// At most MAX_VIEWS, placed with SetViews(). Captures replay the scene through a single default view.
+	u32 viewCount{ 1 };
+
+	// Draws every view in one multiview pass. Off, or with more views than the device's maxMultiviewViewCount,
+	// each view gets a pass of its own instead, which records and submits every draw once per view.
+	bool multiview{ true };
+
+	// Which device to run on, by default the one scoring highest, see VulkanInit::DeviceSelection.
+	// Every device considered and the one chosen are logged unless turned off.
+	VulkanInit::DeviceSelection deviceSelection;
+};
 
 class HelloTriangleApp
 {
 public:
+	explicit HelloTriangleApp(const AppConfig& config = AppConfig{ });
+
 	void Run() {
-		InitWindow();
-		InitVulkan();
+		Init();
 		MainLoop();
 		Cleanup();
 	}
 
+	// Init, DrawFrame and Shutdown let a caller such as the benchmark drive frames itself instead of using Run().
+	void Init() {
+		InitWindow();
+		InitVulkan();
+	}
+
+	void DrawFrame() { drawFrame(); }
+
+	void Shutdown() { Cleanup(); }
+
+	// Waits for all submitted frames to finish and resolves their GPU times.
+	void WaitIdle();
+
+	// Replaces the per-instance data drawn each frame. Waits for the GPU, so not for use every frame.
+	void SetInstances(const std::vector<InstanceData>& instances);
+
+	// Splits the instances into separate draws. Every permutation used is compiled here rather than mid-frame.
+	// Reset by SetInstances(), which goes back to a single draw of every instance.
+	void SetDraws(const std::vector<SceneDraw>& draws);
+
+	// Replaces the particle system with 'count' particles placed from 'seed'. 0 removes it.
+	// Waits for the GPU, so not for use every frame.
+	void SetParticles(u32 count, u32 seed);
+
+	// Replaces the point lights the triangle and meshes are lit by. They are uploaded and assigned to clusters
+	// every frame, so unlike the instances they can change every frame without waiting for the GPU.
+	void SetLights(const std::vector<PointLight>& lights);
+
+	// Builds the mesh's LOD chain and uploads it, returning the id to use in SceneDraw::mesh.
+	// Waits for the GPU, so not for use every frame.
+	u32 AddMesh(const MeshData& mesh);
+
+	// Places the views, which must number AppConfig::viewCount. Only copied, so they can change every frame.
+	void SetViews(const std::vector<CameraView>& views);
+
+	u32 GetViewCount() const { return m_viewCount; }
+
+	// False when the views are drawn in a pass each, or there is only one.
+	bool IsMultiviewEnabled() const { return m_multiviewEnabled; }
+
+	// The resolution the last frame's scene was rendered at, per view. The size of a view's tile of the output
+	// unless dynamic resolution is enabled.
+	VkExtent2D GetRenderExtent() const { return m_renderExtent; }
+
+	// The state changes recorded for the last frame.
+	const DrawStats& GetDrawStats() const { return m_drawStats; }
+
+	bool IsOcclusionCullingEnabled() const { return m_occlusionCullingEnabled; }
+
+	bool IsMultiDrawEnabled() const { return m_multiDrawEnabled; }
+
+	// The instances culled in the last frame whose GPU work has finished. All zero when culling is off.
+	const OcclusionStats& GetOcclusionStats() const { return m_occlusion.GetStats(); }
+
+	// How the lights of the last frame whose GPU work has finished were spread over the clusters.
+	const LightingStats& GetLightingStats() const { return m_lighting.GetStats(); }
+
+	// Frames dumped and dropped so far. All zero unless AppConfig::frameDump is set.
+	FrameDumpStats GetFrameDumpStats() const { return m_frameDump.GetStats(); }
+
+	// When set, the CPU, GPU and particle simulation time of every frame is appended to 'timings'. Pass nullptr to stop recording.
+	void SetFrameTimings(FrameTimings* timings) { m_pFrameTimings = timings; }
+
+	std::string GetDeviceName() const;
+
+	const VulkanInit::DeviceProfile& GetDeviceProfile() const { return m_deviceProfile; }
+
+	// Counters of the driver's host allocations so far. All zero when AppConfig::useHostAllocator is off.
+	HostAllocationStats GetHostAllocationStats() const { return m_hostAllocator.GetStats(); }
+
+	// The most transient memory any frame has used.
+	size_t GetFrameMemoryPeak() const;
+
 	VkInstance& GetInstance() { return m_vkInstance; }
 	VkDebugUtilsMessengerEXT& GetDebugMessenger() { return m_debugMessenger; }
 
@@ -86,45 +310,174 @@ private:
 
 	void createInstance();
 
-	bool checkValidationLayerSupport();
-
 	void pickPhysicalDevice();
 
-	bool isDeviceSuitable(VkPhysicalDevice device);
-
-	bool checkDeviceExtensionSupport(VkPhysicalDevice device);
-
 	void createLogicalDevice();
 
 	void createSwapchain();
 
+	// Headless replacement for the swapchain: plain images the render pass draws into.
+	void createOffscreenTargets();
+
+	void createBuffer(VkDeviceSize size, VkBufferUsageFlags usage, VkMemoryPropertyFlags properties, VkBuffer& buffer, VkDeviceMemory& bufferMemory);
+
+	u32 findMemoryType(u32 typeFilter, VkMemoryPropertyFlags properties);
+
+	void createInstanceBuffer(const std::vector<InstanceData>& instances);
+
+	void destroyInstanceBuffer();
+
+	void createParticleSystem(u32 count, u32 seed);
+
+	// Decides whether draws are merged into multi-draws, and creates the draw table when they are and
+	// occlusion culling, which writes its own commands, is off. Needs the capture started.
+	void createDrawTable();
+
+	// Only when enabled by createDepthBuffer(). Needs the depth buffer, shader modules and pipeline cache.
+	void createOcclusionCulling();
+
+	// Needs the shader modules and pipeline cache. Its set layout is set 0 of every graphics pipeline.
+	void createClusteredLighting();
+
+	// Only when AppConfig::frameDump has a directory. Needs the output images.
+	void createFrameDump();
+
+	// Gives the culling an entry per instance of every draw. Called whenever the instances or draws change.
+	void updateOcclusionScene();
+
+	// Makes room in the draw table for every opaque draw a frame can queue. Called whenever the draws change.
+	void updateDrawTable();
+
+	// The most opaque draws a frame can queue before culling: one per triangle draw and one per LOD of each mesh draw.
+	u32 getMaxOpaqueDraws() const;
+
+	// The sort key of the draw's opaque packets, before culling splits them into passes.
+	u64 getSceneDrawKey(const SceneDraw& draw);
+
+	// Prints the simulation throughput averaged over the frames since the last report.
+	void reportParticleThroughput();
+
+	// Prints the host allocations per frame and the live host memory per scope since the last report.
+	void reportHostAllocations();
+
 	void createImageViews();
 
+	// Opens AppConfig::capturePath. Must run before any captured resource is created.
+	void startCapture();
+
+	// Decides how the views are drawn and tiled, before anything sized from them is created.
+	void initViews();
+
+	// Whether the scene is drawn into m_sceneTargets rather than straight into the swapchain images.
+	bool sceneTargetsEnabled() const { return m_dynamicResolutionEnabled || m_viewCount > 1; }
+
+	// The size of the framebuffers the scene is drawn into, and of the depth buffer.
+	VkExtent2D getFramebufferExtent() const { return m_dynamicResolutionEnabled ? m_dynamicResolution.GetMaxExtent() : m_viewExtent; }
+
+	// Decides whether dynamic resolution can be used on this device, before anything depending on it is created.
+	void initDynamicResolution();
+
+	// The images the scene is rendered into when dynamic resolution is enabled or there are several views,
+	// one per frame in flight, with a layer per view.
+	void createSceneTargets();
+
+	void destroySceneTargets();
+
+	// One depth buffer shared by every frame in flight, sized like the framebuffers it is attached to, with a layer per view.
+	// Frames on the single graphics queue are ordered by the render pass dependencies, so one is enough.
+	// Also decides whether occlusion culling can be used, as its format has to support sampling for that.
+	void createDepthBuffer();
+
+	void destroyDepthBuffer();
+
 	void createRenderPass();
 
 	void createGraphicsPipeline();
 
-	VkSurfaceFormatKHR chooseSwapSurfaceFormat(const std::vector<VkSurfaceFormatKHR>& availableFormats);
+	void createShaderModules();
 
-	VkPresentModeKHR chooseSwapPresentMode(const std::vector<VkPresentModeKHR>& availablePresentModes);
+	VkPipeline createPipeline(const GraphicsPipeline& pipeline, const VkSpecializationInfo* pSpecializationInfo);
 
-	VkExtent2D chooseSwapExtent(const VkSurfaceCapabilitiesKHR& capabilities);
+	void createPipelineCache();
 
-	VkShaderModule createShaderModule(const std::vector<char>& bytecode);
+	// Writes the pipeline cache back to AppConfig::pipelineCachePath for the next run.
+	void savePipelineCache();
+
+	// Returns the pipeline for this permutation, compiling it on first use.
+	// Lookups are a single hash of the key, so this is cheap enough to call per draw.
+	template<typename Key>
+	const PipelineVariant& getPipeline(PipelineId pipelineId, const Key& key)
+	{
+		VkSpecializationInfo specializationInfo = key.GetSpecializationInfo();
+		return getPipelineVariant(pipelineId, key.Hash(), specializationInfo);
+	}
+
+	const PipelineVariant& getPipelineVariant(PipelineId pipelineId, u64 keyHash, const VkSpecializationInfo& specializationInfo);
+
+	void createFramebuffers();
+
+	void createCommandPool();
+
+	void createCommandBuffers();
+
+	void createSyncObjects();
+
+	void drawFrame();
+
+	// Records the frame's CPU time and advances to the next frame in flight.
+	void finishFrame(std::chrono::steady_clock::time_point cpuStart);
+
+	void recordCommandBuffer(VkCommandBuffer commandBuffer, u32 imageIndex);
+
+	// Records the draw passes 'firstPass' to 'lastPass' in 'renderPass': once for every view with multiview,
+	// otherwise once per view into its own layer. Adds to m_drawStats.
+	void recordScenePasses(VkCommandBuffer commandBuffer, VkRenderPass renderPass, u32 imageIndex, DrawPass firstPass, DrawPass lastPass);
+
+	// Scales or copies the rendered part of each view's layer of this frame's scene target into its tile of the output image.
+	void recordComposite(VkCommandBuffer commandBuffer, u32 imageIndex);
+
+	// Reads back the particle simulation time of the last frame submitted in this slot.
+	void resolveParticleTiming(u32 slot);
+
+	// Queues this frame's draws in m_drawQueue.
+	void submitSceneDraws();
+
+	// Queues one draw per LOD the draw's instances need at the current render resolution.
+	// The draw's occlusion culling entries start at 'firstEntry'.
+	void submitMeshDraw(const SceneDraw& draw, u32 firstEntry);
+
+	// Queues an opaque draw, split into its early and late culled draws when occlusion culling is on,
+	// or read from the draw table when that is in use.
+	// 'radius' bounds the geometry of an instance of scale 1 in clip space.
+	void submitOpaqueDraw(const DrawPacket& packet, u32 firstEntry, float radius);
+
+	// Queues an object for destruction once no frame in flight can still reference it.
+	// Either handle may be VK_NULL_HANDLE.
+	void retireObject(VkPipeline pipeline, VkShaderModule shaderModule);
+
+	// The same for a buffer and its memory.
+	void retireBuffer(VkBuffer buffer, VkDeviceMemory memory);
+
+	void destroyRetiredObjects();
+
+#ifdef SHADER_HOT_RELOAD
+	void startShaderHotReload();
+
+	void processShaderReloads();
+#endif
 
-	// Queue families are essentially the render command queues.
-	// These are split into families to handle different kinds of operations.
-	// For example, a memory upload family, a compute command family etc.
-	QueueFamilyIndices findQueueFamilies(VkPhysicalDevice device);
+	VkShaderModule createShaderModule(const std::vector<char>& bytecode);
 
-	SwapChainSupportDetails querySwapChainSupport(VkPhysicalDevice device);
+	VkShaderModule createShaderModule(const u32* pCode, size_t codeSize);
 
 	std::vector<const char*> getRequiredExtensions();
 
-	const std::vector<const char*> validationLayers
-	{
-		"VK_LAYER_KHRONOS_validation"
-	};
+	const AppConfig m_config;
+
+	// Must outlive every object created with it, which Cleanup() has destroyed before the app goes.
+	HostAllocator m_hostAllocator;
+	// Passed as pAllocator everywhere. nullptr when AppConfig::useHostAllocator is off.
+	const VkAllocationCallbacks* m_pAllocator{ nullptr };
 
 	const u32 m_windWidth { 1280 };
 	const u32 m_windHeight { 720 };
@@ -132,17 +485,169 @@ private:
 	VkInstance m_vkInstance{ };
 	VkDebugUtilsMessengerEXT m_debugMessenger;
 
-	VkSurfaceKHR m_vkSurfaceKHR;
+	// Stays VK_NULL_HANDLE when headless.
+	VkSurfaceKHR m_vkSurfaceKHR{ VK_NULL_HANDLE };
 	VkSwapchainKHR m_vkSwapchainKHR;
 	std::vector<VkImage> m_swapchainImages;
 	std::vector<VkImageView> m_swapchainImageViews;
 	VkFormat m_swapchainImageFormat;
 	VkExtent2D m_swapchainExtent;
 
+	// Headless mode only: memory backing the offscreen images that stand in for m_swapchainImages.
+	std::vector<VkDeviceMemory> m_offscreenImageMemory;
+
+	// Layout the colour attachment is left in at the end of the render pass.
+	VkImageLayout m_finalColorLayout { VK_IMAGE_LAYOUT_PRESENT_SRC_KHR };
+
+	// Device extensions required in the current mode. Headless mode does not need a swapchain.
+	std::vector<const char*> m_deviceExtensions;
+
+	// With occlusion culling the scene is drawn over two passes, see OcclusionCulling.h. The first
+	// clears and keeps its depth, the second draws over it and ends like the single pass would.
+	// Without it there is only m_renderPass. The two are compatible, so they share framebuffers and pipelines.
+	VkRenderPass m_renderPass;
+	VkRenderPass m_lateRenderPass{ VK_NULL_HANDLE };
 	VkPipelineLayout m_pipelineLayout;
+	std::array<VkShaderModule, static_cast<size_t>(ShaderId::Count)> m_shaderModules{ };
+	std::array<GraphicsPipeline, static_cast<size_t>(PipelineId::Count)> m_pipelines{ };
+
+	// Every permutation compiled so far, keyed by pipeline id and permutation key hash.
+	// New permutations are compiled through m_pipelineCache, which lets the driver reuse
+	// work shared between variants of the same shaders. Permutations whose hashes collide
+	// share a key, and are told apart by their pipeline id and specialization data.
+	std::unordered_multimap<u64, PipelineVariant> m_pipelineVariants;
+	VkPipelineCache m_pipelineCache;
+
+	TrianglePermutation m_trianglePermutation;
+	ParticlePermutation m_particlePermutation;
+
+	std::vector<VkFramebuffer> m_swapchainFramebuffers;
+
+	// Each view is drawn into the top left corner of its layer of one of these, sized for the maximum
+	// dynamic resolution scale, then blitted or copied to its tile of the swapchain image.
+	// A view and framebuffer per pass: one covering every layer with multiview, otherwise one per layer.
+	struct SceneTarget
+	{
+		VkImage image;
+		VkDeviceMemory memory;
+		std::array<VkImageView, MAX_VIEWS> views;
+		std::array<VkFramebuffer, MAX_VIEWS> framebuffers;
+	};
+
+	// Set by initViews(), see AppConfig::viewCount.
+	u32 m_viewCount{ 1 };
+	bool m_multiviewEnabled{ false };
+	std::array<CameraView, MAX_VIEWS> m_views{ };
+	// Render passes each frame draws the views in: 1 with multiview, otherwise one per view.
+	u32 m_viewPassCount{ 1 };
+	// The size of each view's tile of the output. The whole output with a single view.
+	VkExtent2D m_viewExtent{ };
+
+	bool m_dynamicResolutionEnabled{ false };
+	DynamicResolution m_dynamicResolution;
+	std::array<SceneTarget, MAX_FRAMES_IN_FLIGHT> m_sceneTargets{ };
+	VkFilter m_upscaleFilter{ VK_FILTER_LINEAR };
+	VkExtent2D m_renderExtent{ };
+
+	VkFormat m_depthFormat{ VK_FORMAT_UNDEFINED };
+	VkImage m_depthImage{ VK_NULL_HANDLE };
+	VkDeviceMemory m_depthMemory{ VK_NULL_HANDLE };
+	// Layer 0 only, which is what occlusion culling samples.
+	VkImageView m_depthView{ VK_NULL_HANDLE };
+	// The layers each pass draws into, like SceneTarget::views.
+	std::array<VkImageView, MAX_VIEWS> m_depthPassViews{ };
+
+	VkCommandPool m_commandPool;
+	std::array<VkCommandBuffer, MAX_FRAMES_IN_FLIGHT> m_commandBuffers;
+
+	std::array<VkSemaphore, MAX_FRAMES_IN_FLIGHT> m_imageAvailableSemaphores;
+	std::vector<VkSemaphore> m_renderFinishedSemaphores;
+	// The graphics point of each slot's last frame, waited for before the slot is reused.
+	std::array<SyncPoint, MAX_FRAMES_IN_FLIGHT> m_framePoints{ };
+	u32 m_currentFrame{ 0 };
+	u64 m_frameNumber{ 0 };
+
+	VkBuffer m_instanceBuffer{ VK_NULL_HANDLE };
+	VkDeviceMemory m_instanceBufferMemory{ VK_NULL_HANDLE };
+	u32 m_instanceCount{ 0 };
+
+	// What the instance buffer was last filled with, read when choosing mesh LODs.
+	std::vector<InstanceData> m_instances;
+
+	// Empty means a single draw of every instance with m_trianglePermutation.
+	std::vector<SceneDraw> m_sceneDraws;
+
+	MeshLibrary m_meshes;
+	// The last mesh upload, until a frame's submit has waited for it.
+	SyncPoint m_pendingMeshUpload{ QueueId::Transfer, 0 };
+
+	// Transient CPU data of each frame in flight, reset once its frame has been waited for.
+	// Declared before everything holding memory from them, so they are destroyed last.
+	std::array<LinearArena, MAX_FRAMES_IN_FLIGHT> m_frameArenas;
+
+	// Lives in the recording frame's arena.
+	DrawQueue m_drawQueue;
+	DrawStats m_drawStats;
+
+	GpuTimer m_gpuTimer;
+	FrameTimings* m_pFrameTimings{ nullptr };
+
+	ParticleSystem m_particles;
+
+	bool m_occlusionCullingEnabled{ false };
+	OcclusionCulling m_occlusion;
+
+	bool m_multiDrawEnabled{ false };
+	// Only used when multi-draws are enabled and occlusion culling is not.
+	DrawTable m_drawTable;
+
+	ClusteredLighting m_lighting;
+	std::vector<PointLight> m_lights;
+
+	FrameDump m_frameDump;
+
+	// Only open when AppConfig::capturePath is set.
+	CaptureWriter m_capture;
+
+	// Simulation time accumulated since the last reportParticleThroughput().
+	double m_particleComputeMs{ 0.0 };
+	u32 m_particleComputeSamples{ 0 };
+	std::chrono::steady_clock::time_point m_lastParticleReport;
+
+	// State at the last reportHostAllocations().
+	std::chrono::steady_clock::time_point m_lastHostAllocationReport;
+	u64 m_lastHostAllocationCount{ 0 };
+	u64 m_lastHostAllocationFrame{ 0 };
+
+	struct RetiredObject
+	{
+		// Every submit made before the object was retired, the last that could have used it.
+		ResourceUse lastUse;
+		VkPipeline pipeline;
+		VkShaderModule shaderModule;
+		VkBuffer buffer;
+		VkDeviceMemory memory;
+	};
+
+	std::vector<RetiredObject> m_retiredObjects;
+
+#ifdef SHADER_HOT_RELOAD
+	ShaderWatcher m_shaderWatcher;
+	std::vector<ShaderWatcher::CompiledShader> m_reloadedShaders;
+#endif
 
 	VkPhysicalDevice m_physicalDevice = VK_NULL_HANDLE;
+	// What device selection found out about m_physicalDevice.
+	VulkanInit::DeviceProfile m_deviceProfile;
 	VkDevice m_logicalDevice;
 	VkQueue m_graphicsQueue;
 	VkQueue m_presentQueue;
+	// Same as m_graphicsQueue when the device has no async compute family.
+	VkQueue m_computeQueue;
+	// Same as m_graphicsQueue when the device has no transfer only family.
+	VkQueue m_transferQueue;
+	QueueFamilyIndices m_queueFamilies;
+
+	// Every submit goes through it, except presentation.
+	QueueSync m_sync;
 };
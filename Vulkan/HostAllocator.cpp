@@ -0,0 +1,329 @@
+#include "HostAllocator.h"
+
+#include <algorithm>
+#include <cstring>
+#include <new>
+
+u64 HostAllocationStats::TotalAllocations() const
+{
+	u64 total = 0;
+	for (const HostAllocationScopeStats& scope : scopes)
+	{
+		total += scope.allocations;
+	}
+
+	return total;
+}
+
+u64 HostAllocationStats::TotalLiveBytes() const
+{
+	u64 total = 0;
+	for (const HostAllocationScopeStats& scope : scopes)
+	{
+		total += scope.liveBytes + scope.internalBytes;
+	}
+
+	return total;
+}
+
+const char* GetAllocationScopeName(u32 scope)
+{
+	static const char* const names[HOST_ALLOCATION_SCOPE_COUNT] = { "command", "object", "cache", "device", "instance" };
+	return scope < HOST_ALLOCATION_SCOPE_COUNT ? names[scope] : "unknown";
+}
+
+// The smallest size class holding 'size' bytes at 'alignment', or SIZE_CLASS_COUNT if it is too big to pool.
+static u32 findSizeClass(size_t size, size_t alignment)
+{
+	size_t blockSize = std::max({ size, alignment, HOST_ALLOCATOR_MIN_BLOCK_SIZE });
+
+	u32 sizeClass = 0;
+	for (size_t classSize = HOST_ALLOCATOR_MIN_BLOCK_SIZE; classSize < blockSize; classSize <<= 1)
+	{
+		sizeClass++;
+	}
+
+	return sizeClass;
+}
+
+static size_t getClassSize(u32 sizeClass)
+{
+	return HOST_ALLOCATOR_MIN_BLOCK_SIZE << sizeClass;
+}
+
+HostAllocator::HostAllocator()
+{
+	m_callbacks.pUserData = this;
+	m_callbacks.pfnAllocation = allocationCallback;
+	m_callbacks.pfnReallocation = reallocationCallback;
+	m_callbacks.pfnFree = freeCallback;
+	m_callbacks.pfnInternalAllocation = internalAllocationCallback;
+	m_callbacks.pfnInternalFree = internalFreeCallback;
+}
+
+HostAllocator::~HostAllocator()
+{
+	for (const auto& [chunk, info] : m_chunks)
+	{
+		::operator delete(reinterpret_cast<void*>(chunk), std::align_val_t(HOST_ALLOCATOR_CHUNK_SIZE));
+	}
+
+	// Only left over if something created with these callbacks was never destroyed.
+	for (const auto& [pMemory, allocation] : m_largeAllocations)
+	{
+		::operator delete(pMemory, std::align_val_t(allocation.alignment));
+	}
+}
+
+HostAllocationStats HostAllocator::GetStats() const
+{
+	HostAllocationStats stats;
+
+	for (u32 scope = 0; scope < HOST_ALLOCATION_SCOPE_COUNT; scope++)
+	{
+		const ScopeCounters& counters = m_counters[scope];
+		HostAllocationScopeStats& scopeStats = stats.scopes[scope];
+
+		scopeStats.allocations = counters.allocations.load(std::memory_order_relaxed);
+		scopeStats.frees = counters.frees.load(std::memory_order_relaxed);
+		scopeStats.liveAllocations = counters.liveAllocations.load(std::memory_order_relaxed);
+		scopeStats.liveBytes = counters.liveBytes.load(std::memory_order_relaxed);
+		scopeStats.peakBytes = counters.peakBytes.load(std::memory_order_relaxed);
+		scopeStats.internalBytes = counters.internalBytes.load(std::memory_order_relaxed);
+	}
+
+	stats.pooledBytes = m_pooledBytes.load(std::memory_order_relaxed);
+
+	return stats;
+}
+
+void* HostAllocator::allocationCallback(void* pUserData, size_t size, size_t alignment, VkSystemAllocationScope scope)
+{
+	return static_cast<HostAllocator*>(pUserData)->allocate(size, alignment, scope);
+}
+
+void* HostAllocator::reallocationCallback(void* pUserData, void* pOriginal, size_t size, size_t alignment, VkSystemAllocationScope scope)
+{
+	HostAllocator* pAllocator = static_cast<HostAllocator*>(pUserData);
+
+	if (pOriginal == nullptr)
+	{
+		return pAllocator->allocate(size, alignment, scope);
+	}
+
+	if (size == 0)
+	{
+		pAllocator->deallocate(pOriginal);
+		return nullptr;
+	}
+
+	size_t originalSize;
+	u32 originalScope;
+	if (!pAllocator->findAllocation(pOriginal, originalSize, originalScope))
+	{
+		return nullptr;
+	}
+
+	// Still fits, e.g. a pooled block with room to spare.
+	if (size <= originalSize)
+	{
+		return pOriginal;
+	}
+
+	// On failure the original must be left untouched.
+	void* pMemory = pAllocator->allocate(size, alignment, scope);
+	if (pMemory != nullptr)
+	{
+		memcpy(pMemory, pOriginal, originalSize);
+		pAllocator->deallocate(pOriginal);
+	}
+
+	return pMemory;
+}
+
+void HostAllocator::freeCallback(void* pUserData, void* pMemory)
+{
+	static_cast<HostAllocator*>(pUserData)->deallocate(pMemory);
+}
+
+void HostAllocator::internalAllocationCallback(void* pUserData, size_t size, VkInternalAllocationType type, VkSystemAllocationScope scope)
+{
+	static_cast<HostAllocator*>(pUserData)->m_counters[scope].internalBytes.fetch_add(size, std::memory_order_relaxed);
+}
+
+void HostAllocator::internalFreeCallback(void* pUserData, size_t size, VkInternalAllocationType type, VkSystemAllocationScope scope)
+{
+	static_cast<HostAllocator*>(pUserData)->m_counters[scope].internalBytes.fetch_sub(size, std::memory_order_relaxed);
+}
+
+void* HostAllocator::allocate(size_t size, size_t alignment, VkSystemAllocationScope scope)
+{
+	if (size == 0)
+	{
+		return nullptr;
+	}
+
+	const u32 sizeClass = findSizeClass(size, alignment);
+
+	if (sizeClass >= SIZE_CLASS_COUNT)
+	{
+		void* pMemory = ::operator new(size, std::align_val_t(alignment), std::nothrow);
+		if (pMemory == nullptr)
+		{
+			return nullptr;
+		}
+
+		{
+			std::lock_guard<std::mutex> lock(m_largeMutex);
+			m_largeAllocations[pMemory] = { size, alignment, static_cast<u32>(scope) };
+		}
+
+		countAllocation(scope, size);
+		return pMemory;
+	}
+
+	const size_t classSize = getClassSize(sizeClass);
+	Pool& pool = m_pools[scope][sizeClass];
+
+	void* pBlock;
+	{
+		std::lock_guard<std::mutex> lock(pool.mutex);
+
+		if (pool.pFreeList == nullptr)
+		{
+			// Aligned to its own size, so the chunk a block belongs to can be found by masking its address.
+			u8* pChunk = static_cast<u8*>(::operator new(HOST_ALLOCATOR_CHUNK_SIZE, std::align_val_t(HOST_ALLOCATOR_CHUNK_SIZE), std::nothrow));
+			if (pChunk == nullptr)
+			{
+				return nullptr;
+			}
+
+			{
+				std::unique_lock<std::shared_mutex> chunkLock(m_chunkMutex);
+				m_chunks[reinterpret_cast<uintptr_t>(pChunk)] = { static_cast<u32>(scope), sizeClass };
+			}
+
+			m_pooledBytes.fetch_add(HOST_ALLOCATOR_CHUNK_SIZE, std::memory_order_relaxed);
+
+			// Thread every block onto the free list, in address order.
+			for (size_t offset = HOST_ALLOCATOR_CHUNK_SIZE; offset >= classSize; offset -= classSize)
+			{
+				void* pFree = pChunk + offset - classSize;
+				*static_cast<void**>(pFree) = pool.pFreeList;
+				pool.pFreeList = pFree;
+			}
+		}
+
+		pBlock = pool.pFreeList;
+		pool.pFreeList = *static_cast<void**>(pBlock);
+	}
+
+	countAllocation(scope, classSize);
+	return pBlock;
+}
+
+void HostAllocator::deallocate(void* pMemory)
+{
+	if (pMemory == nullptr)
+	{
+		return;
+	}
+
+	const uintptr_t chunk = reinterpret_cast<uintptr_t>(pMemory) & ~static_cast<uintptr_t>(HOST_ALLOCATOR_CHUNK_SIZE - 1);
+
+	ChunkInfo info;
+	bool pooled;
+	{
+		std::shared_lock<std::shared_mutex> lock(m_chunkMutex);
+
+		auto found = m_chunks.find(chunk);
+		pooled = found != m_chunks.end();
+		if (pooled)
+		{
+			info = found->second;
+		}
+	}
+
+	if (pooled)
+	{
+		Pool& pool = m_pools[info.scope][info.sizeClass];
+		{
+			std::lock_guard<std::mutex> lock(pool.mutex);
+			*static_cast<void**>(pMemory) = pool.pFreeList;
+			pool.pFreeList = pMemory;
+		}
+
+		countFree(info.scope, getClassSize(info.sizeClass));
+		return;
+	}
+
+	LargeAllocation allocation;
+	{
+		std::lock_guard<std::mutex> lock(m_largeMutex);
+
+		auto found = m_largeAllocations.find(pMemory);
+		if (found == m_largeAllocations.end())
+		{
+			// Not ours. Freeing it anyway would corrupt the heap, so leave it.
+			return;
+		}
+
+		allocation = found->second;
+		m_largeAllocations.erase(found);
+	}
+
+	::operator delete(pMemory, std::align_val_t(allocation.alignment));
+	countFree(allocation.scope, allocation.size);
+}
+
+bool HostAllocator::findAllocation(void* pMemory, size_t& size, u32& scope) const
+{
+	const uintptr_t chunk = reinterpret_cast<uintptr_t>(pMemory) & ~static_cast<uintptr_t>(HOST_ALLOCATOR_CHUNK_SIZE - 1);
+
+	{
+		std::shared_lock<std::shared_mutex> lock(m_chunkMutex);
+
+		auto found = m_chunks.find(chunk);
+		if (found != m_chunks.end())
+		{
+			size = getClassSize(found->second.sizeClass);
+			scope = found->second.scope;
+			return true;
+		}
+	}
+
+	std::lock_guard<std::mutex> lock(m_largeMutex);
+
+	auto found = m_largeAllocations.find(pMemory);
+	if (found == m_largeAllocations.end())
+	{
+		return false;
+	}
+
+	size = found->second.size;
+	scope = found->second.scope;
+	return true;
+}
+
+void HostAllocator::countAllocation(u32 scope, size_t size)
+{
+	ScopeCounters& counters = m_counters[scope];
+
+	counters.allocations.fetch_add(1, std::memory_order_relaxed);
+	counters.liveAllocations.fetch_add(1, std::memory_order_relaxed);
+
+	u64 liveBytes = counters.liveBytes.fetch_add(size, std::memory_order_relaxed) + size;
+	u64 peakBytes = counters.peakBytes.load(std::memory_order_relaxed);
+	while (liveBytes > peakBytes && !counters.peakBytes.compare_exchange_weak(peakBytes, liveBytes, std::memory_order_relaxed))
+	{
+	}
+}
+
+void HostAllocator::countFree(u32 scope, size_t size)
+{
+	ScopeCounters& counters = m_counters[scope];
+
+	counters.frees.fetch_add(1, std::memory_order_relaxed);
+	counters.liveAllocations.fetch_sub(1, std::memory_order_relaxed);
+	counters.liveBytes.fetch_sub(size, std::memory_order_relaxed);
+}
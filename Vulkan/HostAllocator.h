@@ -0,0 +1,152 @@
+#pragma once
+
+#include <array>
+#include <atomic>
+#include <cstddef>
+#include <mutex>
+#include <shared_mutex>
+#include <unordered_map>
+#include <vulkan/vulkan.h>
+
+#include "Types.h"
+
+// Host memory allocator handed to every Vulkan create and destroy call as VkAllocationCallbacks.
+//
+// Drivers allocate host memory for most objects they create, and some allocate while recording
+// commands too. Left to the default allocator that is invisible, and many small allocations from
+// several threads all go through the same general purpose malloc. This allocator makes it visible:
+// every allocation is counted against the VkSystemAllocationScope the driver gives for it, along
+// with the driver's internal allocations that it reports through the notification callbacks.
+//
+// Small allocations come from pools of fixed size blocks, one pool per size class and scope, each
+// with its own lock. Blocks are carved out of chunks aligned to their own size, so a block of a
+// power of two size class is always aligned to that size, which covers any alignment the driver asks
+// for up to the class size. Anything larger, or more aligned, goes to the aligned operator new.
+// Freed blocks go back on their pool's free list and chunks are only released with the allocator,
+// which must therefore outlive every Vulkan object created with it.
+
+constexpr u32 HOST_ALLOCATION_SCOPE_COUNT = VK_SYSTEM_ALLOCATION_SCOPE_INSTANCE + 1;
+
+// Pooled size classes are the powers of two from the minimum to the maximum block size.
+constexpr size_t HOST_ALLOCATOR_MIN_BLOCK_SIZE = 16;
+constexpr size_t HOST_ALLOCATOR_MAX_BLOCK_SIZE = 4096;
+constexpr size_t HOST_ALLOCATOR_CHUNK_SIZE = 64 * 1024;
+
+struct HostAllocationScopeStats
+{
+	// Every allocation made, including those made by a reallocation.
+	u64 allocations{ 0 };
+	u64 frees{ 0 };
+	u64 liveAllocations{ 0 };
+
+	// Pooled allocations count their whole block, as that is what they hold on to.
+	u64 liveBytes{ 0 };
+	u64 peakBytes{ 0 };
+
+	// Memory the driver allocated itself, e.g. for executable code, and only told us about.
+	u64 internalBytes{ 0 };
+};
+
+struct HostAllocationStats
+{
+	// Indexed by VkSystemAllocationScope.
+	std::array<HostAllocationScopeStats, HOST_ALLOCATION_SCOPE_COUNT> scopes{ };
+
+	// Host memory reserved for pools, whether or not it is currently handed out.
+	u64 pooledBytes{ 0 };
+
+	u64 TotalAllocations() const;
+
+	u64 TotalLiveBytes() const;
+};
+
+// "command", "object", "cache", "device" or "instance".
+const char* GetAllocationScopeName(u32 scope);
+
+class HostAllocator
+{
+public:
+	HostAllocator();
+
+	~HostAllocator();
+
+	// The callbacks point back at this object, so it cannot be copied or moved.
+	HostAllocator(const HostAllocator&) = delete;
+	HostAllocator& operator=(const HostAllocator&) = delete;
+
+	const VkAllocationCallbacks* GetCallbacks() const { return &m_callbacks; }
+
+	// A snapshot of the counters. Safe to call while other threads are allocating.
+	HostAllocationStats GetStats() const;
+
+private:
+	static VKAPI_ATTR void* VKAPI_CALL allocationCallback(void* pUserData, size_t size, size_t alignment, VkSystemAllocationScope scope);
+
+	static VKAPI_ATTR void* VKAPI_CALL reallocationCallback(void* pUserData, void* pOriginal, size_t size, size_t alignment, VkSystemAllocationScope scope);
+
+	static VKAPI_ATTR void VKAPI_CALL freeCallback(void* pUserData, void* pMemory);
+
+	static VKAPI_ATTR void VKAPI_CALL internalAllocationCallback(void* pUserData, size_t size, VkInternalAllocationType type, VkSystemAllocationScope scope);
+
+	static VKAPI_ATTR void VKAPI_CALL internalFreeCallback(void* pUserData, size_t size, VkInternalAllocationType type, VkSystemAllocationScope scope);
+
+	// Returns nullptr when out of memory, which Vulkan expects rather than an exception.
+	void* allocate(size_t size, size_t alignment, VkSystemAllocationScope scope);
+
+	void deallocate(void* pMemory);
+
+	// Finds the size and scope 'pMemory' was allocated with. Returns false if it was not allocated here.
+	bool findAllocation(void* pMemory, size_t& size, u32& scope) const;
+
+	void countAllocation(u32 scope, size_t size);
+
+	void countFree(u32 scope, size_t size);
+
+	static constexpr u32 SIZE_CLASS_COUNT = 9;
+	static_assert(HOST_ALLOCATOR_MIN_BLOCK_SIZE << (SIZE_CLASS_COUNT - 1) == HOST_ALLOCATOR_MAX_BLOCK_SIZE, "size classes must cover the pooled range");
+
+	struct Pool
+	{
+		std::mutex mutex;
+		// Free blocks, each holding a pointer to the next.
+		void* pFreeList{ nullptr };
+	};
+
+	// Identifies the pool a chunk belongs to.
+	struct ChunkInfo
+	{
+		u32 scope;
+		u32 sizeClass;
+	};
+
+	struct LargeAllocation
+	{
+		size_t size;
+		size_t alignment;
+		u32 scope;
+	};
+
+	struct ScopeCounters
+	{
+		std::atomic<u64> allocations{ 0 };
+		std::atomic<u64> frees{ 0 };
+		std::atomic<u64> liveAllocations{ 0 };
+		std::atomic<u64> liveBytes{ 0 };
+		std::atomic<u64> peakBytes{ 0 };
+		std::atomic<u64> internalBytes{ 0 };
+	};
+
+	std::array<std::array<Pool, SIZE_CLASS_COUNT>, HOST_ALLOCATION_SCOPE_COUNT> m_pools;
+
+	// Keyed by chunk address. Frees look up the chunk a block is in, so this is mostly read.
+	mutable std::shared_mutex m_chunkMutex;
+	std::unordered_map<uintptr_t, ChunkInfo> m_chunks;
+
+	mutable std::mutex m_largeMutex;
+	std::unordered_map<void*, LargeAllocation> m_largeAllocations;
+
+	std::array<ScopeCounters, HOST_ALLOCATION_SCOPE_COUNT> m_counters;
+	std::atomic<u64> m_pooledBytes{ 0 };
+
+	VkAllocationCallbacks m_callbacks{ };
+};
@@ -0,0 +1,462 @@
+// Startup micro-benchmarks.
+//
+// Times each step of bringing the renderer up on its own, over many iterations, using the
+// VulkanInit functions the app itself starts up with. Every step runs with validation layers
+// both off and on, as the layers change startup costs considerably, and pipeline creation is
+// measured with a cold (empty) pipeline cache and with a warm one loaded from a previous run's data.
+//
+// Drivers often keep their own on-disk shader cache as well, which makes every pipeline
+// creation after the first warm regardless of VkPipelineCache. Disable it to see the true cold
+// cost, e.g. MESA_SHADER_CACHE_DISABLE=true or __GL_SHADER_DISK_CACHE=0 (the 'init-bench'
+// Makefile target sets both).
+
+#include <SDL2/SDL.h>
+#include <SDL2/SDL_vulkan.h>
+#include <vulkan/vulkan.h>
+
+#include <chrono>
+#include <cstdlib>
+#include <cstring>
+#include <fstream>
+#include <iomanip>
+#include <iostream>
+#include <string>
+#include <vector>
+
+#include "HelloTriangleApp.h"
+#include "EmbeddedShaders.h"
+#include "VulkanInit.h"
+#include "BenchmarkReport.h"
+
+struct InitBenchmarkOptions
+{
+	u32 iterations{ 20 };
+	bool validationOff{ true };
+	bool validationOn{ true };
+	bool useWindow{ true };
+	std::string outputPath;
+	// See VulkanInit::DeviceSelection::preferred.
+	std::string device;
+};
+
+struct StepResult
+{
+	std::string name;
+	MetricStats stats;
+};
+
+struct ModeResult
+{
+	bool validation;
+	std::vector<StepResult> steps;
+};
+
+using Clock = std::chrono::steady_clock;
+
+static double elapsedMs(Clock::time_point start, Clock::time_point end)
+{
+	return std::chrono::duration<double, std::milli>(end - start).count();
+}
+
+// Runs 'step' for every iteration. The step returns the milliseconds it wants counted,
+// so it can do its own setup and teardown outside of the measured region.
+template<typename Step>
+static void timeStep(ModeResult& mode, const char* name, u32 iterations, Step step)
+{
+	std::vector<double> samples;
+	samples.reserve(iterations);
+
+	for (u32 i = 0; i < iterations; i++)
+	{
+		samples.push_back(step());
+	}
+
+	mode.steps.push_back({ name, ComputeStats(std::move(samples)) });
+
+	const MetricStats& stats = mode.steps.back().stats;
+	std::cout << "  " << std::left << std::setw(18) << name << std::right << std::fixed << std::setprecision(3)
+		<< " mean " << std::setw(9) << stats.mean
+		<< " p50 " << std::setw(9) << stats.p50
+		<< " p95 " << std::setw(9) << stats.p95
+		<< " min " << std::setw(9) << stats.min
+		<< " max " << std::setw(9) << stats.max << " ms" << std::endl;
+}
+
+static ModeResult runMode(const InitBenchmarkOptions& options, bool validation, SDL_Window* pWindow, std::string& deviceName)
+{
+	ModeResult mode{ validation, { } };
+
+	std::cout << "Validation " << (validation ? "on" : "off") << ":" << std::endl;
+
+	VulkanInit::InstanceSettings instanceSettings;
+	instanceSettings.enableValidation = validation;
+
+	if (pWindow != nullptr)
+	{
+		u32 extensionCount = 0;
+		SDL_Vulkan_GetInstanceExtensions(pWindow, &extensionCount, nullptr);
+		instanceSettings.extensions.resize(extensionCount);
+		SDL_Vulkan_GetInstanceExtensions(pWindow, &extensionCount, instanceSettings.extensions.data());
+	}
+
+	timeStep(mode, "instance", options.iterations, [&]()
+	{
+		Clock::time_point start = Clock::now();
+		VkInstance instance = VulkanInit::CreateInstance(instanceSettings);
+		Clock::time_point end = Clock::now();
+
+		vkDestroyInstance(instance, nullptr);
+		return elapsedMs(start, end);
+	});
+
+	// Everything after this builds on a single instance and device.
+	VkInstance instance = VulkanInit::CreateInstance(instanceSettings);
+
+	VkSurfaceKHR surface = VK_NULL_HANDLE;
+	if (pWindow != nullptr && SDL_Vulkan_CreateSurface(pWindow, instance, &surface) == SDL_FALSE)
+	{
+		throw std::runtime_error("Failed to create valid surface!");
+	}
+
+	// Headless does not need the swapchain extension.
+	std::vector<const char*> deviceExtensions = surface != VK_NULL_HANDLE ? g_deviceExtensions : std::vector<const char*>{ };
+
+	// Logging would be timed along with the selection, and repeated every iteration.
+	VulkanInit::DeviceSelection selection;
+	selection.preferred = options.device;
+	selection.log = false;
+
+	timeStep(mode, "physical_device", options.iterations, [&]()
+	{
+		Clock::time_point start = Clock::now();
+		VulkanInit::PickPhysicalDevice(instance, surface, deviceExtensions, selection);
+		return elapsedMs(start, Clock::now());
+	});
+
+	VulkanInit::DeviceProfile profile = VulkanInit::PickPhysicalDevice(instance, surface, deviceExtensions, selection);
+	VkPhysicalDevice physicalDevice = profile.device;
+	deviceName = profile.properties.deviceName;
+
+	timeStep(mode, "device", options.iterations, [&]()
+	{
+		Clock::time_point start = Clock::now();
+		VulkanInit::LogicalDevice logicalDevice = VulkanInit::CreateLogicalDevice(profile, deviceExtensions, validation);
+		Clock::time_point end = Clock::now();
+
+		vkDestroyDevice(logicalDevice.device, nullptr);
+		return elapsedMs(start, end);
+	});
+
+	VulkanInit::LogicalDevice logicalDevice = VulkanInit::CreateLogicalDevice(profile, deviceExtensions, validation);
+	VkDevice device = logicalDevice.device;
+
+	VkFormat colorFormat = VK_FORMAT_R8G8B8A8_UNORM;
+	VkImageLayout finalLayout = VK_IMAGE_LAYOUT_TRANSFER_SRC_OPTIMAL;
+
+	if (surface != VK_NULL_HANDLE)
+	{
+		int width, height;
+		SDL_Vulkan_GetDrawableSize(pWindow, &width, &height);
+		VkExtent2D drawableExtent{ static_cast<u32>(width), static_cast<u32>(height) };
+
+		timeStep(mode, "swapchain", options.iterations, [&]()
+		{
+			Clock::time_point start = Clock::now();
+			VulkanInit::Swapchain swapchain = VulkanInit::CreateSwapchain(physicalDevice, device, surface, logicalDevice.queueFamilies, drawableExtent);
+			Clock::time_point end = Clock::now();
+
+			colorFormat = swapchain.format;
+			vkDestroySwapchainKHR(device, swapchain.handle, nullptr);
+			return elapsedMs(start, end);
+		});
+
+		finalLayout = VK_IMAGE_LAYOUT_PRESENT_SRC_KHR;
+	}
+
+	timeStep(mode, "render_pass", options.iterations, [&]()
+	{
+		Clock::time_point start = Clock::now();
+		VkRenderPass renderPass = VulkanInit::CreateRenderPass(device, colorFormat, finalLayout);
+		Clock::time_point end = Clock::now();
+
+		vkDestroyRenderPass(device, renderPass, nullptr);
+		return elapsedMs(start, end);
+	});
+
+	timeStep(mode, "shader_modules", options.iterations, [&]()
+	{
+		Clock::time_point start = Clock::now();
+		VkShaderModule vert = VulkanInit::CreateShaderModule(device, g_vertShader.pCode, g_vertShader.codeSize);
+		VkShaderModule frag = VulkanInit::CreateShaderModule(device, g_fragShader.pCode, g_fragShader.codeSize);
+		Clock::time_point end = Clock::now();
+
+		vkDestroyShaderModule(device, vert, nullptr);
+		vkDestroyShaderModule(device, frag, nullptr);
+		return elapsedMs(start, end);
+	});
+
+	// The same pipeline the app creates for its first frame.
+	VkRenderPass renderPass = VulkanInit::CreateRenderPass(device, colorFormat, finalLayout);
+
+	VkDescriptorSetLayout lightingSetLayout = ClusteredLighting::CreateSetLayout(device, nullptr);
+
+	VkPipelineLayoutCreateInfo pipelineLayoutInfo{};
+	pipelineLayoutInfo.sType = VK_STRUCTURE_TYPE_PIPELINE_LAYOUT_CREATE_INFO;
+	pipelineLayoutInfo.setLayoutCount = 1;
+	pipelineLayoutInfo.pSetLayouts = &lightingSetLayout;
+
+	VkPipelineLayout pipelineLayout;
+	if (vkCreatePipelineLayout(device, &pipelineLayoutInfo, nullptr, &pipelineLayout) != VK_SUCCESS)
+	{
+		throw std::runtime_error("failed to create pipeline layout!");
+	}
+
+	TrianglePermutation permutation;
+	VkSpecializationInfo specializationInfo = permutation.GetSpecializationInfo();
+
+	VulkanInit::GraphicsPipelineDesc desc;
+	desc.vertShader = VulkanInit::CreateShaderModule(device, g_vertShader.pCode, g_vertShader.codeSize);
+	desc.fragShader = VulkanInit::CreateShaderModule(device, g_fragShader.pCode, g_fragShader.codeSize);
+	desc.pSpecializationInfo = &specializationInfo;
+	desc.vertexBindingCount = 1;
+	desc.pVertexBindings = &g_instanceBinding;
+	desc.vertexAttributeCount = static_cast<u32>(std::size(g_instanceAttributes));
+	desc.pVertexAttributes = g_instanceAttributes;
+	desc.layout = pipelineLayout;
+	desc.renderPass = renderPass;
+
+	// Cold: a new, empty cache every time, like the first launch on a machine.
+	timeStep(mode, "pipeline_cold", options.iterations, [&]()
+	{
+		VkPipelineCache cache = VulkanInit::CreatePipelineCache(device, { });
+
+		Clock::time_point start = Clock::now();
+		VkPipeline pipeline = VulkanInit::CreateGraphicsPipeline(device, cache, desc);
+		Clock::time_point end = Clock::now();
+
+		vkDestroyPipeline(device, pipeline, nullptr);
+		vkDestroyPipelineCache(device, cache, nullptr);
+		return elapsedMs(start, end);
+	});
+
+	// Warm: a cache created from the data a previous run would have saved, like every later launch.
+	// Creating the cache from that data is counted too, as a restart pays for both.
+	std::vector<u8> warmData;
+	{
+		VkPipelineCache cache = VulkanInit::CreatePipelineCache(device, { });
+		VkPipeline pipeline = VulkanInit::CreateGraphicsPipeline(device, cache, desc);
+		warmData = VulkanInit::GetPipelineCacheData(device, cache);
+		vkDestroyPipeline(device, pipeline, nullptr);
+		vkDestroyPipelineCache(device, cache, nullptr);
+	}
+
+	timeStep(mode, "pipeline_warm", options.iterations, [&]()
+	{
+		Clock::time_point start = Clock::now();
+		VkPipelineCache cache = VulkanInit::CreatePipelineCache(device, warmData);
+		VkPipeline pipeline = VulkanInit::CreateGraphicsPipeline(device, cache, desc);
+		Clock::time_point end = Clock::now();
+
+		vkDestroyPipeline(device, pipeline, nullptr);
+		vkDestroyPipelineCache(device, cache, nullptr);
+		return elapsedMs(start, end);
+	});
+
+	std::cout << "  (warm cache data is " << warmData.size() << " bytes)" << std::endl;
+
+	vkDestroyShaderModule(device, desc.vertShader, nullptr);
+	vkDestroyShaderModule(device, desc.fragShader, nullptr);
+	vkDestroyPipelineLayout(device, pipelineLayout, nullptr);
+	vkDestroyDescriptorSetLayout(device, lightingSetLayout, nullptr);
+	vkDestroyRenderPass(device, renderPass, nullptr);
+	vkDestroyDevice(device, nullptr);
+
+	if (surface != VK_NULL_HANDLE)
+	{
+		vkDestroySurfaceKHR(instance, surface, nullptr);
+	}
+
+	vkDestroyInstance(instance, nullptr);
+
+	// The whole chain as the app runs it, through to the first frame finishing on the GPU.
+	// Headless and without a saved pipeline cache, so every iteration starts from the same state.
+	AppConfig config;
+	config.headless = true;
+	config.enableValidation = validation;
+	config.pipelineCachePath.clear();
+
+	timeStep(mode, "app_first_frame", options.iterations, [&]()
+	{
+		HelloTriangleApp app(config);
+
+		Clock::time_point start = Clock::now();
+		app.Init();
+		app.DrawFrame();
+		app.WaitIdle();
+		Clock::time_point end = Clock::now();
+
+		app.Shutdown();
+		return elapsedMs(start, end);
+	});
+
+	return mode;
+}
+
+static bool writeJson(const std::string& path, const std::string& deviceName, u32 iterations, const std::vector<ModeResult>& modes)
+{
+	std::ofstream file(path);
+	if (!file.is_open())
+	{
+		return false;
+	}
+
+	file << std::setprecision(6) << std::fixed;
+
+	file << "{\n";
+	file << "\t\"device\": \"" << deviceName << "\",\n";
+	file << "\t\"iterations\": " << iterations << ",\n";
+	file << "\t\"modes\": [\n";
+
+	for (size_t m = 0; m < modes.size(); m++)
+	{
+		file << "\t\t{\n";
+		file << "\t\t\t\"validation\": " << (modes[m].validation ? "true" : "false") << ",\n";
+		file << "\t\t\t\"steps_ms\": {\n";
+
+		for (size_t s = 0; s < modes[m].steps.size(); s++)
+		{
+			file << "\t\t\t\t\"" << modes[m].steps[s].name << "\": ";
+			WriteStatsJson(file, modes[m].steps[s].stats);
+			file << (s + 1 < modes[m].steps.size() ? "," : "") << "\n";
+		}
+
+		file << "\t\t\t}\n";
+		file << "\t\t}" << (m + 1 < modes.size() ? "," : "") << "\n";
+	}
+
+	file << "\t]\n";
+	file << "}\n";
+
+	return file.good();
+}
+
+static void printUsage()
+{
+	std::cout <<
+		"usage: VulkanInitBench [options]\n"
+		"  --iterations <n>        times to repeat each step (default 20)\n"
+		"  --validation <mode>     off, on or both (default both)\n"
+		"  --no-window             skip the window, surface and swapchain, e.g. on machines without a display\n"
+		"  --output <path>         also write the results as JSON\n"
+		"  --device <uuid|name>    run on the device with this UUID, or whose name contains this\n";
+}
+
+int main(int argc, char** argv)
+{
+	InitBenchmarkOptions options;
+
+	for (int i = 1; i < argc; i++)
+	{
+		std::string arg = argv[i];
+		bool hasValue = i + 1 < argc;
+
+		if (arg == "--iterations" && hasValue)
+		{
+			options.iterations = static_cast<u32>(std::strtoul(argv[++i], nullptr, 10));
+		}
+		else if (arg == "--validation" && hasValue)
+		{
+			std::string mode = argv[++i];
+			options.validationOff = mode == "off" || mode == "both";
+			options.validationOn = mode == "on" || mode == "both";
+		}
+		else if (arg == "--no-window")
+		{
+			options.useWindow = false;
+		}
+		else if (arg == "--output" && hasValue)
+		{
+			options.outputPath = argv[++i];
+		}
+		else if (arg == "--device" && hasValue)
+		{
+			options.device = argv[++i];
+		}
+		else
+		{
+			printUsage();
+			return arg == "--help" || arg == "-h" ? EXIT_SUCCESS : EXIT_FAILURE;
+		}
+	}
+
+	if (options.iterations == 0 || (!options.validationOff && !options.validationOn))
+	{
+		printUsage();
+		return EXIT_FAILURE;
+	}
+
+	// The swapchain needs a real window, but it never has to be shown.
+	SDL_Window* pWindow = nullptr;
+	if (options.useWindow)
+	{
+		if (SDL_Init(SDL_INIT_VIDEO) == 0)
+		{
+			pWindow = SDL_CreateWindow("Vulkan", SDL_WINDOWPOS_UNDEFINED, SDL_WINDOWPOS_UNDEFINED, 1280, 720, SDL_WINDOW_VULKAN | SDL_WINDOW_HIDDEN);
+		}
+
+		if (pWindow == nullptr)
+		{
+			std::cout << "No window available, skipping the swapchain step." << std::endl;
+		}
+	}
+
+	std::vector<ModeResult> modes;
+	std::string deviceName;
+
+	try
+	{
+		if (options.validationOff)
+		{
+			modes.push_back(runMode(options, false, pWindow, deviceName));
+		}
+
+		if (options.validationOn)
+		{
+			if (VulkanInit::CheckValidationLayerSupport())
+			{
+				modes.push_back(runMode(options, true, pWindow, deviceName));
+			}
+			else
+			{
+				std::cout << "Validation layers are not installed, skipping validation on." << std::endl;
+			}
+		}
+	}
+	catch (const std::exception& e)
+	{
+		std::cerr << e.what() << std::endl;
+		return EXIT_FAILURE;
+	}
+
+	if (pWindow != nullptr)
+	{
+		SDL_DestroyWindow(pWindow);
+	}
+
+	SDL_Quit();
+
+	std::cout << "Device: " << deviceName << std::endl;
+
+	if (!options.outputPath.empty())
+	{
+		if (!writeJson(options.outputPath, deviceName, options.iterations, modes))
+		{
+			std::cerr << "failed to write " << options.outputPath << std::endl;
+			return EXIT_FAILURE;
+		}
+
+		std::cout << "Wrote " << options.outputPath << std::endl;
+	}
+
+	return EXIT_SUCCESS;
+}
@@ -0,0 +1,152 @@
+#include "LinearArena.h"
+
+#include <cstdint>
+#include <new>
+
+// Block data starts after the header, rounded up so it is aligned like any operator new result.
+static constexpr size_t BLOCK_HEADER_SIZE = (sizeof(void*) + sizeof(size_t) + alignof(std::max_align_t) - 1) & ~(alignof(std::max_align_t) - 1);
+
+LinearArena::LinearArena(size_t blockSize)
+	: m_blockSize(blockSize)
+{
+}
+
+LinearArena::~LinearArena()
+{
+	freeBlocks();
+}
+
+std::byte* LinearArena::blockData(Block* pBlock)
+{
+	return reinterpret_cast<std::byte*>(pBlock) + BLOCK_HEADER_SIZE;
+}
+
+LinearArena::Block* LinearArena::allocateBlock(size_t size)
+{
+	Block* pBlock = static_cast<Block*>(::operator new(BLOCK_HEADER_SIZE + size));
+	pBlock->pNext = nullptr;
+	pBlock->size = size;
+
+	m_capacity += size;
+	return pBlock;
+}
+
+void LinearArena::freeBlocks()
+{
+	Block* pBlock = m_pFirst;
+	while (pBlock != nullptr)
+	{
+		Block* pNext = pBlock->pNext;
+		::operator delete(pBlock);
+		pBlock = pNext;
+	}
+
+	m_pFirst = nullptr;
+	m_pCurrent = nullptr;
+	m_capacity = 0;
+}
+
+void LinearArena::Reset()
+{
+	// Everything a cycle used now fits one block, so the next cycle does not overflow.
+	if (m_pFirst != nullptr && m_pFirst->pNext != nullptr)
+	{
+		const size_t capacity = m_capacity;
+		freeBlocks();
+		m_pFirst = allocateBlock(capacity);
+	}
+
+	m_pCurrent = nullptr;
+	m_offset = 0;
+	m_usedBefore = 0;
+}
+
+void LinearArena::Rewind(const Marker& marker)
+{
+	if (marker.pBlock == nullptr || (marker.usedBefore == 0 && marker.offset == 0))
+	{
+		Reset();
+		return;
+	}
+
+	m_pCurrent = static_cast<Block*>(marker.pBlock);
+	m_offset = marker.offset;
+	m_usedBefore = marker.usedBefore;
+}
+
+void* LinearArena::allocateFromCurrent(size_t bytes, size_t alignment)
+{
+	if (m_pCurrent == nullptr)
+	{
+		return nullptr;
+	}
+
+	const uintptr_t start = reinterpret_cast<uintptr_t>(blockData(m_pCurrent));
+	const uintptr_t aligned = (start + m_offset + alignment - 1) & ~static_cast<uintptr_t>(alignment - 1);
+
+	if (aligned + bytes > start + m_pCurrent->size)
+	{
+		return nullptr;
+	}
+
+	m_offset = aligned + bytes - start;
+
+	if (GetUsed() > m_peak)
+	{
+		m_peak = GetUsed();
+	}
+
+	return reinterpret_cast<void*>(aligned);
+}
+
+void* LinearArena::do_allocate(size_t bytes, size_t alignment)
+{
+	if (void* pMemory = allocateFromCurrent(bytes, alignment))
+	{
+		return pMemory;
+	}
+
+	// Try the blocks already held from earlier cycles before allocating a new one.
+	// A block that is skipped stays unused until the next reset.
+	for (Block* pNext = m_pCurrent != nullptr ? m_pCurrent->pNext : m_pFirst; pNext != nullptr; pNext = pNext->pNext)
+	{
+		if (m_pCurrent != nullptr)
+		{
+			m_usedBefore += m_pCurrent->size;
+		}
+
+		m_pCurrent = pNext;
+		m_offset = 0;
+
+		if (void* pMemory = allocateFromCurrent(bytes, alignment))
+		{
+			return pMemory;
+		}
+	}
+
+	// Room for the worst case alignment padding, as block data is only aligned to max_align_t.
+	const size_t minimumSize = bytes + (alignment > alignof(std::max_align_t) ? alignment : 0);
+	Block* pBlock = allocateBlock(minimumSize > m_blockSize ? minimumSize : m_blockSize);
+
+	// The loop above left the last block current, so the new one goes on the end.
+	if (m_pCurrent != nullptr)
+	{
+		m_pCurrent->pNext = pBlock;
+		m_usedBefore += m_pCurrent->size;
+	}
+	else
+	{
+		m_pFirst = pBlock;
+	}
+
+	m_pCurrent = pBlock;
+	m_offset = 0;
+
+	return allocateFromCurrent(bytes, alignment);
+}
+
+LinearArena& GetThreadScratch()
+{
+	thread_local LinearArena scratch(LINEAR_ARENA_SCRATCH_BLOCK_SIZE);
+	return scratch;
+}
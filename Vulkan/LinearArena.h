@@ -0,0 +1,123 @@
+#pragma once
+
+#include <cstddef>
+#include <memory_resource>
+
+#include "Types.h"
+
+// Linear (bump) allocator for short lived CPU data, e.g. what a frame builds and throws away.
+//
+// Allocating moves a pointer forward and freeing does nothing; everything is released at once by
+// Reset() or by rewinding to a marker. It derives from std::pmr::memory_resource, so the standard
+// pmr containers are the container layer on top of it:
+//
+//   std::pmr::vector<DrawPacket> packets(&arena);
+//
+// A container must not be used after the arena has been reset underneath it.
+//
+// Memory comes in blocks. A request that does not fit the current block moves on to the next one,
+// allocating it if need be, and Reset() merges the blocks of a cycle that overflowed into a single
+// block of their combined size. So after the first few cycles of a steady workload, such as a frame
+// loop, an arena never touches the heap again.
+
+constexpr size_t LINEAR_ARENA_DEFAULT_BLOCK_SIZE = 1024 * 1024;
+constexpr size_t LINEAR_ARENA_SCRATCH_BLOCK_SIZE = 64 * 1024;
+
+class LinearArena : public std::pmr::memory_resource
+{
+public:
+	// No memory is allocated until the first allocation.
+	explicit LinearArena(size_t blockSize = LINEAR_ARENA_DEFAULT_BLOCK_SIZE);
+
+	~LinearArena() override;
+
+	// Containers hold a pointer to their arena, so it cannot be copied or moved.
+	LinearArena(const LinearArena&) = delete;
+	LinearArena& operator=(const LinearArena&) = delete;
+
+	struct Marker
+	{
+		void* pBlock{ nullptr };
+		size_t offset{ 0 };
+		size_t usedBefore{ 0 };
+	};
+
+	// Releases everything allocated since the last reset.
+	void Reset();
+
+	// The current position, to release everything allocated after it with Rewind().
+	Marker GetMarker() const { return { m_pCurrent, m_offset, m_usedBefore }; }
+
+	// Rewinding to a marker taken on an empty arena is the same as Reset().
+	void Rewind(const Marker& marker);
+
+	// Bytes allocated since the last reset, including alignment padding.
+	size_t GetUsed() const { return m_usedBefore + m_offset; }
+
+	// The most that was ever in use at once.
+	size_t GetPeak() const { return m_peak; }
+
+	// Bytes held in blocks, used or not.
+	size_t GetCapacity() const { return m_capacity; }
+
+private:
+	struct Block
+	{
+		Block* pNext;
+		size_t size;
+	};
+
+	void* do_allocate(size_t bytes, size_t alignment) override;
+
+	// Individual frees are ignored, the memory comes back with the next reset.
+	void do_deallocate(void*, size_t, size_t) override { }
+
+	bool do_is_equal(const std::pmr::memory_resource& other) const noexcept override { return this == &other; }
+
+	// Allocates from the current block, or returns nullptr if it does not fit.
+	void* allocateFromCurrent(size_t bytes, size_t alignment);
+
+	static std::byte* blockData(Block* pBlock);
+
+	Block* allocateBlock(size_t size);
+
+	void freeBlocks();
+
+	const size_t m_blockSize;
+
+	Block* m_pFirst{ nullptr };
+	// nullptr before the first allocation of a cycle.
+	Block* m_pCurrent{ nullptr };
+	size_t m_offset{ 0 };
+	// The size of every block before the current one. Unused space at their ends counts as used.
+	size_t m_usedBefore{ 0 };
+
+	size_t m_capacity{ 0 };
+	size_t m_peak{ 0 };
+};
+
+// The calling thread's scratch arena, for temporaries that do not outlive the function using them.
+// Use it through ScratchScope rather than directly, so nested users give back only their own memory.
+LinearArena& GetThreadScratch();
+
+// Hands out the thread's scratch arena and rewinds it to where it was when the scope ends.
+// Containers using it must be declared after the scope, so they are destroyed before it rewinds.
+//
+//   ScratchScope scratch;
+//   std::pmr::vector<VkQueueFamilyProperties> families(count, scratch.Get());
+class ScratchScope
+{
+public:
+	ScratchScope() : m_arena(GetThreadScratch()), m_marker(m_arena.GetMarker()) { }
+
+	~ScratchScope() { m_arena.Rewind(m_marker); }
+
+	ScratchScope(const ScratchScope&) = delete;
+	ScratchScope& operator=(const ScratchScope&) = delete;
+
+	std::pmr::memory_resource* Get() { return &m_arena; }
+
+private:
+	LinearArena& m_arena;
+	const LinearArena::Marker m_marker;
+};
@@ -3,6 +3,7 @@
 #include <glm/mat4x4.hpp>
 #include <glm/vec4.hpp>
 
+#include <cstdlib>
 #include <iostream>
 #include "HelloTriangleApp.h"
 
@@ -12,9 +13,40 @@ using u32 = uint32_t;
 using u64 = uint64_t;
 
 
+#ifdef _WIN32
 int WinMain()
+#else
+int main()
+#endif
 {
-	HelloTriangleApp app;
+	// The particles report their simulation throughput once a second.
+	AppConfig config;
+	config.particleCount = 1 << 20;
+
+	// Trade resolution for frame rate, holding the GPU a little under 60Hz.
+	config.dynamicResolution.enabled = true;
+	config.dynamicResolution.targetGpuMs = 15.0;
+
+	// Set VULKAN_CAPTURE to a file path to record the session for VulkanReplay.
+	if (const char* capturePath = std::getenv("VULKAN_CAPTURE"))
+	{
+		config.capturePath = capturePath;
+	}
+
+	// Set VULKAN_FRAME_DUMP to an existing directory to write every frame to it, as PNG unless VULKAN_FRAME_DUMP_RAW is set.
+	if (const char* dumpDirectory = std::getenv("VULKAN_FRAME_DUMP"))
+	{
+		config.frameDump.directory = dumpDirectory;
+		config.frameDump.format = std::getenv("VULKAN_FRAME_DUMP_RAW") ? FrameDumpFormat::Raw : FrameDumpFormat::Png;
+	}
+
+	// Set VULKAN_DEVICE to a device UUID, or part of a device name, to run on that device rather than the one scoring highest.
+	if (const char* device = std::getenv("VULKAN_DEVICE"))
+	{
+		config.deviceSelection.preferred = device;
+	}
+
+	HelloTriangleApp app(config);
 
 	try
 	{
@@ -0,0 +1,294 @@
+#include "Mesh.h"
+
+#include <algorithm>
+#include <array>
+#include <cmath>
+#include <stdexcept>
+#include <unordered_map>
+
+static void cross(const float a[3], const float b[3], float result[3])
+{
+	result[0] = a[1] * b[2] - a[2] * b[1];
+	result[1] = a[2] * b[0] - a[0] * b[2];
+	result[2] = a[0] * b[1] - a[1] * b[0];
+}
+
+static float dot(const float a[3], const float b[3])
+{
+	return a[0] * b[0] + a[1] * b[1] + a[2] * b[2];
+}
+
+MeshData CreateSphereMesh(u32 segments, u32 rings)
+{
+	if (segments < 3 || rings < 2)
+	{
+		throw std::runtime_error("a sphere needs at least 3 segments and 2 rings!");
+	}
+
+	constexpr float pi = 3.14159265358979f;
+
+	MeshData mesh;
+
+	// A single vertex at each pole, and a ring of 'segments' vertices at each latitude between them.
+	auto addVertex = [&mesh](float theta, float phi)
+	{
+		MeshVertex vertex;
+		vertex.position[0] = std::sin(theta) * std::cos(phi);
+		vertex.position[1] = std::cos(theta);
+		vertex.position[2] = std::sin(theta) * std::sin(phi);
+
+		// On a unit sphere the normal is the position.
+		vertex.normal[0] = vertex.position[0];
+		vertex.normal[1] = vertex.position[1];
+		vertex.normal[2] = vertex.position[2];
+
+		mesh.vertices.push_back(vertex);
+	};
+
+	addVertex(0.0f, 0.0f);
+	for (u32 ring = 1; ring < rings; ring++)
+	{
+		for (u32 segment = 0; segment < segments; segment++)
+		{
+			addVertex(pi * ring / rings, 2.0f * pi * segment / segments);
+		}
+	}
+	addVertex(pi, 0.0f);
+
+	const u32 southPole = static_cast<u32>(mesh.vertices.size() - 1);
+	auto ringVertex = [segments](u32 ring, u32 segment) { return 1 + (ring - 1) * segments + segment % segments; };
+
+	// Wound so the face's cross product points into the sphere, which makes the faces towards -z clockwise on screen.
+	auto addTriangle = [&mesh](u32 a, u32 b, u32 c)
+	{
+		const float* pA = mesh.vertices[a].position;
+		const float* pB = mesh.vertices[b].position;
+		const float* pC = mesh.vertices[c].position;
+
+		float ab[3] = { pB[0] - pA[0], pB[1] - pA[1], pB[2] - pA[2] };
+		float ac[3] = { pC[0] - pA[0], pC[1] - pA[1], pC[2] - pA[2] };
+		float faceNormal[3];
+		cross(ab, ac, faceNormal);
+
+		// The centroid points outwards from the centre.
+		float centroid[3] = { pA[0] + pB[0] + pC[0], pA[1] + pB[1] + pC[1], pA[2] + pB[2] + pC[2] };
+
+		mesh.indices.insert(mesh.indices.end(), { a, b, c });
+		if (dot(faceNormal, centroid) > 0.0f)
+		{
+			std::swap(mesh.indices[mesh.indices.size() - 2], mesh.indices[mesh.indices.size() - 1]);
+		}
+	};
+
+	for (u32 segment = 0; segment < segments; segment++)
+	{
+		addTriangle(0, ringVertex(1, segment), ringVertex(1, segment + 1));
+
+		for (u32 ring = 1; ring + 1 < rings; ring++)
+		{
+			addTriangle(ringVertex(ring, segment), ringVertex(ring + 1, segment), ringVertex(ring + 1, segment + 1));
+			addTriangle(ringVertex(ring, segment), ringVertex(ring + 1, segment + 1), ringVertex(ring, segment + 1));
+		}
+
+		addTriangle(southPole, ringVertex(rings - 1, segment + 1), ringVertex(rings - 1, segment));
+	}
+
+	return mesh;
+}
+
+// Merges the vertices of each grid cell into one and drops the triangles that collapse.
+// 'error' is set to the furthest any vertex moved.
+static MeshData clusterVertices(const MeshData& mesh, const float boundsMin[3], float cellSize, u32 resolution, float& error)
+{
+	struct Cluster
+	{
+		float position[3]{ };
+		float normal[3]{ };
+		u32 count{ 0 };
+	};
+
+	std::vector<Cluster> clusters;
+	std::unordered_map<u64, u32> clusterOfCell;
+	std::vector<u32> clusterOfVertex(mesh.vertices.size());
+
+	for (size_t i = 0; i < mesh.vertices.size(); i++)
+	{
+		const MeshVertex& vertex = mesh.vertices[i];
+
+		u64 cellKey = 0;
+		for (u32 axis = 0; axis < 3; axis++)
+		{
+			// The far side of the bounds lands exactly on 'resolution', which belongs in the last cell.
+			u32 cell = static_cast<u32>((vertex.position[axis] - boundsMin[axis]) / cellSize);
+			cellKey |= static_cast<u64>(std::min(cell, resolution - 1)) << (21 * axis);
+		}
+
+		auto [found, inserted] = clusterOfCell.try_emplace(cellKey, static_cast<u32>(clusters.size()));
+		if (inserted)
+		{
+			clusters.emplace_back();
+		}
+
+		Cluster& cluster = clusters[found->second];
+		for (u32 axis = 0; axis < 3; axis++)
+		{
+			cluster.position[axis] += vertex.position[axis];
+			cluster.normal[axis] += vertex.normal[axis];
+		}
+		cluster.count++;
+
+		clusterOfVertex[i] = found->second;
+	}
+
+	// Triangles with two corners in one cell have no area left. Several triangles can also collapse
+	// onto the same three cells, so duplicates are removed after rotating each to start at its lowest
+	// index, which keeps the winding.
+	std::vector<std::array<u32, 3>> triangles;
+	triangles.reserve(mesh.indices.size() / 3);
+
+	for (size_t i = 0; i + 2 < mesh.indices.size(); i += 3)
+	{
+		std::array<u32, 3> triangle{ clusterOfVertex[mesh.indices[i]], clusterOfVertex[mesh.indices[i + 1]], clusterOfVertex[mesh.indices[i + 2]] };
+
+		if (triangle[0] == triangle[1] || triangle[1] == triangle[2] || triangle[0] == triangle[2])
+		{
+			continue;
+		}
+
+		std::rotate(triangle.begin(), std::min_element(triangle.begin(), triangle.end()), triangle.end());
+		triangles.push_back(triangle);
+	}
+
+	std::sort(triangles.begin(), triangles.end());
+	triangles.erase(std::unique(triangles.begin(), triangles.end()), triangles.end());
+
+	for (Cluster& cluster : clusters)
+	{
+		for (u32 axis = 0; axis < 3; axis++)
+		{
+			cluster.position[axis] /= cluster.count;
+		}
+	}
+
+	// Measured over every vertex, including those only used by dropped triangles, as their surface collapsed onto the rest.
+	float maxDistanceSquared = 0.0f;
+	for (size_t i = 0; i < mesh.vertices.size(); i++)
+	{
+		const float* original = mesh.vertices[i].position;
+		const float* merged = clusters[clusterOfVertex[i]].position;
+		float offset[3] = { merged[0] - original[0], merged[1] - original[1], merged[2] - original[2] };
+		maxDistanceSquared = std::max(maxDistanceSquared, dot(offset, offset));
+	}
+	error = std::sqrt(maxDistanceSquared);
+
+	// Only clusters still used by a triangle become vertices.
+	constexpr u32 unused = ~0u;
+	std::vector<u32> vertexOfCluster(clusters.size(), unused);
+
+	MeshData result;
+	result.indices.reserve(triangles.size() * 3);
+
+	for (const std::array<u32, 3>& triangle : triangles)
+	{
+		for (u32 clusterIndex : triangle)
+		{
+			if (vertexOfCluster[clusterIndex] == unused)
+			{
+				const Cluster& cluster = clusters[clusterIndex];
+
+				MeshVertex vertex;
+				for (u32 axis = 0; axis < 3; axis++)
+				{
+					vertex.position[axis] = cluster.position[axis];
+				}
+
+				// Opposite normals can cancel out in a thin part of the mesh, which leaves any direction as good as another.
+				float length = std::sqrt(dot(cluster.normal, cluster.normal));
+				for (u32 axis = 0; axis < 3; axis++)
+				{
+					vertex.normal[axis] = length > 1e-6f ? cluster.normal[axis] / length : (axis == 2 ? -1.0f : 0.0f);
+				}
+
+				vertexOfCluster[clusterIndex] = static_cast<u32>(result.vertices.size());
+				result.vertices.push_back(vertex);
+			}
+
+			result.indices.push_back(vertexOfCluster[clusterIndex]);
+		}
+	}
+
+	return result;
+}
+
+static void appendLod(MeshLodChain& chain, const MeshData& mesh, float error)
+{
+	MeshLod lod;
+	lod.firstIndex = static_cast<u32>(chain.indices.size());
+	lod.indexCount = static_cast<u32>(mesh.indices.size());
+	lod.firstVertex = static_cast<u32>(chain.vertices.size());
+	lod.vertexCount = static_cast<u32>(mesh.vertices.size());
+	lod.error = error;
+
+	chain.vertices.insert(chain.vertices.end(), mesh.vertices.begin(), mesh.vertices.end());
+	chain.indices.insert(chain.indices.end(), mesh.indices.begin(), mesh.indices.end());
+	chain.lods.push_back(lod);
+}
+
+MeshLodChain BuildMeshLods(const MeshData& mesh, const MeshLodSettings& settings)
+{
+	if (mesh.vertices.empty() || mesh.indices.empty() || mesh.indices.size() % 3 != 0)
+	{
+		throw std::runtime_error("mesh must be a non-empty triangle list!");
+	}
+
+	MeshLodChain chain;
+
+	float boundsMin[3] = { mesh.vertices[0].position[0], mesh.vertices[0].position[1], mesh.vertices[0].position[2] };
+	float boundsMax[3] = { boundsMin[0], boundsMin[1], boundsMin[2] };
+
+	for (const MeshVertex& vertex : mesh.vertices)
+	{
+		for (u32 axis = 0; axis < 3; axis++)
+		{
+			boundsMin[axis] = std::min(boundsMin[axis], vertex.position[axis]);
+			boundsMax[axis] = std::max(boundsMax[axis], vertex.position[axis]);
+		}
+
+		chain.boundingRadius = std::max(chain.boundingRadius, std::sqrt(dot(vertex.position, vertex.position)));
+	}
+
+	const float extent = std::max({ boundsMax[0] - boundsMin[0], boundsMax[1] - boundsMin[1], boundsMax[2] - boundsMin[2] });
+
+	appendLod(chain, mesh, 0.0f);
+
+	// Every LOD is built from the full detail mesh rather than the previous LOD, so errors do not add up.
+	u32 previousTriangles = static_cast<u32>(mesh.indices.size() / 3);
+
+	for (u32 resolution = settings.gridResolution; resolution > 0 && extent > 0.0f; resolution /= 2)
+	{
+		if (chain.lods.size() >= settings.maxLods || previousTriangles <= settings.minTriangles)
+		{
+			break;
+		}
+
+		float error;
+		MeshData simplified = clusterVertices(mesh, boundsMin, extent / resolution, resolution, error);
+
+		const u32 triangles = static_cast<u32>(simplified.indices.size() / 3);
+		if (triangles < settings.minTriangles)
+		{
+			break;
+		}
+
+		if (triangles > previousTriangles * settings.maxTriangleRatio)
+		{
+			continue;
+		}
+
+		// Kept increasing along the chain, so that a coarser LOD never claims to be more accurate than a finer one.
+		appendLod(chain, simplified, std::max(error, chain.lods.back().error));
+		previousTriangles = triangles;
+	}
+
+	return chain;
+}
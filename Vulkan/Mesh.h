@@ -0,0 +1,83 @@
+#pragma once
+
+#include <cstddef>
+#include <vector>
+#include <vulkan/vulkan.h>
+
+#include "Types.h"
+
+// Triangle meshes and their level of detail chains.
+//
+// A mesh is simplified once, when it is imported, into a chain of LODs. Each LOD is built from
+// the full detail mesh by vertex clustering: space is divided into a grid of cubic cells, every
+// vertex in a cell is merged into one at their average position, and triangles that collapse are
+// dropped. The average of points in a cell lies in the cell, so no vertex moves further than the
+// cell diagonal. The surface between vertices is interpolated from them, so no point on it moves
+// further than its furthest vertex, and that distance is kept as the LOD's geometric error: a bound
+// on how far the simplified surface is from the original, rather than an estimate.
+//
+// At draw time the error is projected to the screen, and each instance is drawn with the coarsest
+// LOD whose error stays under a pixel threshold (see MeshLibrary).
+
+// Vertex input layout of MeshVertex, binding 1. Binding 0 is the per-instance data.
+struct MeshVertex
+{
+	float position[3];
+	float normal[3];
+};
+
+inline constexpr VkVertexInputBindingDescription g_meshVertexBinding{ 1, sizeof(MeshVertex), VK_VERTEX_INPUT_RATE_VERTEX };
+
+// Triangle lists, wound clockwise as seen from -z, i.e. facing the viewer when drawn with x and y as clip space.
+struct MeshData
+{
+	std::vector<MeshVertex> vertices;
+	std::vector<u32> indices;
+};
+
+// A unit sphere of 'segments' around by 'rings' from pole to pole, 2 * segments * (rings - 1) triangles.
+MeshData CreateSphereMesh(u32 segments, u32 rings);
+
+constexpr u32 MESH_MAX_LODS = 8;
+
+struct MeshLodSettings
+{
+	// Cells along the longest side of the mesh's bounds for the first simplified LOD.
+	// Each further LOD halves it.
+	u32 gridResolution{ 64 };
+
+	// A LOD is only kept if it has at most this fraction of the previous LOD's triangles,
+	// otherwise it would cost memory without saving much vertex work.
+	float maxTriangleRatio{ 0.6f };
+
+	// No LOD is built below this many triangles.
+	u32 minTriangles{ 8 };
+
+	u32 maxLods{ MESH_MAX_LODS };
+};
+
+struct MeshLod
+{
+	// Indices are relative to firstVertex, as vkCmdDrawIndexed's vertexOffset.
+	u32 firstIndex;
+	u32 indexCount;
+	u32 firstVertex;
+	u32 vertexCount;
+
+	// The furthest any point of the surface has moved from the full detail mesh, in mesh units. 0 for LOD 0.
+	float error;
+};
+
+// Every LOD of a mesh, finest first, stored one after another.
+struct MeshLodChain
+{
+	std::vector<MeshVertex> vertices;
+	std::vector<u32> indices;
+	std::vector<MeshLod> lods;
+
+	// Around the origin, enclosing every vertex.
+	float boundingRadius{ 0.0f };
+};
+
+// LOD 0 is 'mesh' unchanged, followed by up to settings.maxLods - 1 simplified LODs of increasing error.
+MeshLodChain BuildMeshLods(const MeshData& mesh, const MeshLodSettings& settings = MeshLodSettings{ });
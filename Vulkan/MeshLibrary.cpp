@@ -0,0 +1,162 @@
+#include "MeshLibrary.h"
+
+#include <cstring>
+#include <stdexcept>
+
+#include "VulkanInit.h"
+#include "Capture.h"
+
+void MeshLibrary::Init(const MeshLibraryDesc& desc)
+{
+	m_physicalDevice = desc.physicalDevice;
+	m_device = desc.device;
+	m_graphicsFamily = desc.graphicsFamily;
+	m_transferFamily = desc.transferFamily;
+	m_pSync = desc.pSync;
+	m_pAllocator = desc.pAllocator;
+	m_pCapture = desc.pCapture;
+}
+
+void MeshLibrary::Destroy()
+{
+	destroyBuffers();
+
+	m_meshes.clear();
+	m_lods.clear();
+	m_vertices.clear();
+	m_indices.clear();
+}
+
+u32 MeshLibrary::AddMesh(const MeshData& mesh, const MeshLodSettings& settings)
+{
+	MeshLodChain chain = BuildMeshLods(mesh, settings);
+
+	MeshInfo info;
+	info.firstLod = static_cast<u32>(m_lods.size());
+	info.lodCount = static_cast<u32>(chain.lods.size());
+	info.boundingRadius = chain.boundingRadius;
+
+	// The chain's ranges are relative to its own arrays, so they move along with it.
+	for (MeshLod lod : chain.lods)
+	{
+		lod.firstIndex += static_cast<u32>(m_indices.size());
+		lod.firstVertex += static_cast<u32>(m_vertices.size());
+		m_lods.push_back(lod);
+	}
+
+	m_vertices.insert(m_vertices.end(), chain.vertices.begin(), chain.vertices.end());
+	m_indices.insert(m_indices.end(), chain.indices.begin(), chain.indices.end());
+	m_meshes.push_back(info);
+
+	destroyBuffers();
+	createBuffers();
+
+	return static_cast<u32>(m_meshes.size() - 1);
+}
+
+void MeshLibrary::createBuffers()
+{
+	const VkDeviceSize vertexSize = sizeof(MeshVertex) * m_vertices.size();
+	const VkDeviceSize indexSize = sizeof(u32) * m_indices.size();
+
+	// Concurrent when the families differ, so the graphics queue can draw what the transfer queue wrote.
+	const std::vector<u32> families{ m_graphicsFamily, m_transferFamily };
+
+	VulkanInit::CreateBuffer(m_physicalDevice, m_device, vertexSize, VK_BUFFER_USAGE_VERTEX_BUFFER_BIT | VK_BUFFER_USAGE_TRANSFER_DST_BIT,
+		VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT, m_vertexBuffer, m_vertexBufferMemory, families, m_pAllocator);
+	VulkanInit::CreateBuffer(m_physicalDevice, m_device, indexSize, VK_BUFFER_USAGE_INDEX_BUFFER_BIT | VK_BUFFER_USAGE_TRANSFER_DST_BIT,
+		VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT, m_indexBuffer, m_indexBufferMemory, families, m_pAllocator);
+
+	// Both go through one staging buffer, vertices first.
+	VkBuffer stagingBuffer;
+	VkDeviceMemory stagingMemory;
+	VulkanInit::CreateBuffer(m_physicalDevice, m_device, vertexSize + indexSize, VK_BUFFER_USAGE_TRANSFER_SRC_BIT,
+		VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT | VK_MEMORY_PROPERTY_HOST_COHERENT_BIT, stagingBuffer, stagingMemory, { }, m_pAllocator);
+
+	void* data;
+	vkMapMemory(m_device, stagingMemory, 0, vertexSize + indexSize, 0, &data);
+	memcpy(data, m_vertices.data(), vertexSize);
+	memcpy(static_cast<u8*>(data) + vertexSize, m_indices.data(), indexSize);
+	vkUnmapMemory(m_device, stagingMemory);
+
+	VkCommandPoolCreateInfo poolInfo{};
+	poolInfo.sType = VK_STRUCTURE_TYPE_COMMAND_POOL_CREATE_INFO;
+	poolInfo.flags = VK_COMMAND_POOL_CREATE_TRANSIENT_BIT;
+	poolInfo.queueFamilyIndex = m_transferFamily;
+
+	VkCommandPool commandPool;
+	if (vkCreateCommandPool(m_device, &poolInfo, m_pAllocator, &commandPool) != VK_SUCCESS)
+	{
+		throw std::runtime_error("failed to create mesh upload command pool!");
+	}
+
+	VkCommandBufferAllocateInfo allocInfo{};
+	allocInfo.sType = VK_STRUCTURE_TYPE_COMMAND_BUFFER_ALLOCATE_INFO;
+	allocInfo.commandPool = commandPool;
+	allocInfo.level = VK_COMMAND_BUFFER_LEVEL_PRIMARY;
+	allocInfo.commandBufferCount = 1;
+
+	VkCommandBuffer commandBuffer;
+	vkAllocateCommandBuffers(m_device, &allocInfo, &commandBuffer);
+
+	VkCommandBufferBeginInfo beginInfo{};
+	beginInfo.sType = VK_STRUCTURE_TYPE_COMMAND_BUFFER_BEGIN_INFO;
+	beginInfo.flags = VK_COMMAND_BUFFER_USAGE_ONE_TIME_SUBMIT_BIT;
+	vkBeginCommandBuffer(commandBuffer, &beginInfo);
+
+	VkBufferCopy vertexCopy{ 0, 0, vertexSize };
+	vkCmdCopyBuffer(commandBuffer, stagingBuffer, m_vertexBuffer, 1, &vertexCopy);
+
+	VkBufferCopy indexCopy{ vertexSize, 0, indexSize };
+	vkCmdCopyBuffer(commandBuffer, stagingBuffer, m_indexBuffer, 1, &indexCopy);
+
+	// No barrier for the vertex input stage, which a transfer only queue does not have. The graphics
+	// submit waiting for the upload's point at that stage makes the writes visible instead.
+	vkEndCommandBuffer(commandBuffer);
+
+	SubmitBatch batch;
+	batch.commandBufferCount = 1;
+	batch.pCommandBuffers = &commandBuffer;
+
+	m_uploadPoint = m_pSync->Submit(QueueId::Transfer, batch);
+
+	// Meshes are only added while loading, so waiting for the upload before freeing its staging buffer is fine.
+	m_pSync->Wait(m_uploadPoint);
+
+	vkDestroyCommandPool(m_device, commandPool, m_pAllocator);
+	vkDestroyBuffer(m_device, stagingBuffer, m_pAllocator);
+	vkFreeMemory(m_device, stagingMemory, m_pAllocator);
+
+	if (m_pCapture && m_pCapture->IsOpen())
+	{
+		// The staging buffer is not part of the replay, the buffers are captured with their final contents.
+		m_pCapture->AddBuffer(m_vertexBuffer, vertexSize, VK_BUFFER_USAGE_VERTEX_BUFFER_BIT | VK_BUFFER_USAGE_TRANSFER_DST_BIT,
+			VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT, m_vertices.data());
+		m_pCapture->AddBuffer(m_indexBuffer, indexSize, VK_BUFFER_USAGE_INDEX_BUFFER_BIT | VK_BUFFER_USAGE_TRANSFER_DST_BIT,
+			VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT, m_indices.data());
+	}
+}
+
+void MeshLibrary::destroyBuffers()
+{
+	if (m_vertexBuffer == VK_NULL_HANDLE)
+	{
+		return;
+	}
+
+	if (m_pCapture && m_pCapture->IsOpen())
+	{
+		m_pCapture->DestroyBuffer(m_vertexBuffer);
+		m_pCapture->DestroyBuffer(m_indexBuffer);
+	}
+
+	vkDestroyBuffer(m_device, m_vertexBuffer, m_pAllocator);
+	vkFreeMemory(m_device, m_vertexBufferMemory, m_pAllocator);
+	vkDestroyBuffer(m_device, m_indexBuffer, m_pAllocator);
+	vkFreeMemory(m_device, m_indexBufferMemory, m_pAllocator);
+
+	m_vertexBuffer = VK_NULL_HANDLE;
+	m_vertexBufferMemory = VK_NULL_HANDLE;
+	m_indexBuffer = VK_NULL_HANDLE;
+	m_indexBufferMemory = VK_NULL_HANDLE;
+}
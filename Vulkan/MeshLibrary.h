@@ -0,0 +1,102 @@
+#pragma once
+
+#include <vector>
+#include <vulkan/vulkan.h>
+
+#include "Types.h"
+#include "Mesh.h"
+#include "QueueSync.h"
+
+class CaptureWriter;
+
+// Every mesh's LOD chain, stored one after another in a single vertex buffer and a single index buffer.
+//
+// Because all meshes and all of their LODs share the two buffers, switching mesh or LOD between
+// draws never rebinds anything: a draw only picks its index range and vertex offset. The buffers
+// are device local and only change when a mesh is added.
+//
+// Uploads go through the transfer queue, which is a DMA engine on devices with a transfer only family,
+// and the buffers are shared with the graphics family, so no ownership transfer is needed.
+
+struct MeshLibraryDesc
+{
+	VkPhysicalDevice physicalDevice{ VK_NULL_HANDLE };
+	VkDevice device{ VK_NULL_HANDLE };
+
+	// The buffers are drawn from the graphics family and uploaded from the transfer family.
+	u32 graphicsFamily{ 0 };
+	u32 transferFamily{ 0 };
+
+	// Submits the uploads to QueueId::Transfer. Must outlive the library.
+	QueueSync* pSync{ nullptr };
+
+	// Host allocator for every object the library creates. Must outlive the library.
+	const VkAllocationCallbacks* pAllocator{ nullptr };
+
+	// Records the shared buffers when set. Must outlive the library.
+	CaptureWriter* pCapture{ nullptr };
+};
+
+// Where a mesh's LODs are in the library.
+struct MeshInfo
+{
+	u32 firstLod;
+	u32 lodCount;
+	float boundingRadius;
+};
+
+class MeshLibrary
+{
+public:
+	void Init(const MeshLibraryDesc& desc);
+
+	void Destroy();
+
+	// Builds the mesh's LOD chain and appends it to the shared buffers, returning the mesh's index.
+	// The buffers are recreated and the upload is waited for, so the GPU must not be using them.
+	// The first draw from the new buffers must still wait for GetUploadPoint(), which makes the upload visible to it.
+	u32 AddMesh(const MeshData& mesh, const MeshLodSettings& settings = MeshLodSettings{ });
+
+	u32 GetMeshCount() const { return static_cast<u32>(m_meshes.size()); }
+
+	const MeshInfo& GetMesh(u32 mesh) const { return m_meshes[mesh]; }
+
+	// firstIndex and firstVertex are positions in the shared buffers.
+	const MeshLod& GetLod(u32 mesh, u32 lod) const { return m_lods[m_meshes[mesh].firstLod + lod]; }
+
+	// Vertex binding 1, see g_meshVertexBinding.
+	VkBuffer GetVertexBuffer() const { return m_vertexBuffer; }
+
+	// 32-bit indices.
+	VkBuffer GetIndexBuffer() const { return m_indexBuffer; }
+
+	// The transfer queue's point the buffers were last uploaded by, value 0 before anything is.
+	SyncPoint GetUploadPoint() const { return m_uploadPoint; }
+
+private:
+	void createBuffers();
+
+	void destroyBuffers();
+
+	VkPhysicalDevice m_physicalDevice{ VK_NULL_HANDLE };
+	VkDevice m_device{ VK_NULL_HANDLE };
+	u32 m_graphicsFamily{ 0 };
+	u32 m_transferFamily{ 0 };
+	QueueSync* m_pSync{ nullptr };
+	const VkAllocationCallbacks* m_pAllocator{ nullptr };
+	CaptureWriter* m_pCapture{ nullptr };
+
+	std::vector<MeshInfo> m_meshes;
+	std::vector<MeshLod> m_lods;
+
+	// Everything uploaded so far, kept so the buffers can be rebuilt when a mesh is added.
+	std::vector<MeshVertex> m_vertices;
+	std::vector<u32> m_indices;
+
+	VkBuffer m_vertexBuffer{ VK_NULL_HANDLE };
+	VkDeviceMemory m_vertexBufferMemory{ VK_NULL_HANDLE };
+	VkBuffer m_indexBuffer{ VK_NULL_HANDLE };
+	VkDeviceMemory m_indexBufferMemory{ VK_NULL_HANDLE };
+
+	SyncPoint m_uploadPoint{ QueueId::Transfer, 0 };
+};
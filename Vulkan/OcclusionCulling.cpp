@@ -0,0 +1,688 @@
+#include "OcclusionCulling.h"
+#include "VulkanInit.h"
+
+#include <algorithm>
+#include <stdexcept>
+
+// Matches the Batch struct in Shaders/occlusion_cull.comp.
+struct OcclusionBatch
+{
+	// The first thread of the dispatch culling this batch, one thread per instance.
+	u32 firstThread;
+	u32 firstInstance;
+	u32 instanceCount;
+	u32 firstEntry;
+	float radius;
+};
+
+// Matches the DrawCommand struct in Shaders/occlusion_cull.comp. Laid out as a VkDrawIndexedIndirectCommand,
+// whose first four members read as a VkDrawIndirectCommand with firstInstance taking the vertex offset's place.
+struct OcclusionDrawCommand
+{
+	u32 count;
+	u32 instanceCount;
+	u32 first;
+	u32 vertexOffsetOrFirstInstance;
+	u32 firstInstance;
+};
+
+static_assert(sizeof(OcclusionDrawCommand) == sizeof(VkDrawIndexedIndirectCommand));
+
+// Matches the push constant block in Shaders/depth_reduce.comp.
+struct DepthReduceParams
+{
+	int32_t inputSize[2];
+	int32_t outputSize[2];
+};
+
+// Matches the push constant block in Shaders/occlusion_cull.comp.
+struct OcclusionCullParams
+{
+	u32 threadCount;
+	u32 batchCount;
+	u32 phase;
+	u32 lateCommandOffset;
+	int32_t pyramidSize[2];
+	u32 pyramidLevelCount;
+	u32 padding;
+	// ViewBounds of every view.
+	float bounds[4];
+	// The CameraView the depth is drawn through, centre in xy and zoom in z.
+	float depthView[4];
+};
+
+// The largest power of two no greater than 'value', which must not be 0.
+static u32 floorPowerOfTwo(u32 value)
+{
+	u32 result = 1;
+	while (result <= value / 2)
+	{
+		result *= 2;
+	}
+	return result;
+}
+
+void OcclusionCulling::Init(const OcclusionCullingDesc& desc)
+{
+	m_physicalDevice = desc.physicalDevice;
+	m_device = desc.device;
+	m_pipelineCache = desc.pipelineCache;
+	m_pAllocator = desc.pAllocator;
+	m_multiDraw = desc.multiDraw;
+	m_depthImage = desc.depthImage;
+	m_depthView = desc.depthView;
+
+	// Without separateDepthStencilLayouts a combined format has to change layout in both aspects at once.
+	m_depthAspects = VK_IMAGE_ASPECT_DEPTH_BIT;
+	if (desc.depthFormat == VK_FORMAT_D32_SFLOAT_S8_UINT || desc.depthFormat == VK_FORMAT_D24_UNORM_S8_UINT ||
+		desc.depthFormat == VK_FORMAT_D16_UNORM_S8_UINT)
+	{
+		m_depthAspects |= VK_IMAGE_ASPECT_STENCIL_BIT;
+	}
+
+	m_frames.assign(desc.slotCount, FrameBuffers{ });
+
+	createPyramid(desc.depthExtent);
+	createPipelines(desc.reduceShader, desc.cullShader);
+	createDescriptorSets();
+}
+
+void OcclusionCulling::SetViews(const CameraView* pViews, u32 viewCount)
+{
+	m_viewBounds = GetCombinedViewBounds(pViews, viewCount);
+	m_depthCamera = pViews[0];
+}
+
+void OcclusionCulling::Destroy()
+{
+	if (m_device == VK_NULL_HANDLE)
+	{
+		return;
+	}
+
+	destroySceneBuffers();
+
+	vkDestroyPipeline(m_device, m_reducePipeline, m_pAllocator);
+	vkDestroyPipelineLayout(m_device, m_reduceLayout, m_pAllocator);
+	vkDestroyDescriptorSetLayout(m_device, m_reduceSetLayout, m_pAllocator);
+	vkDestroyPipeline(m_device, m_cullPipeline, m_pAllocator);
+	vkDestroyPipelineLayout(m_device, m_cullLayout, m_pAllocator);
+	vkDestroyDescriptorSetLayout(m_device, m_cullSetLayout, m_pAllocator);
+	vkDestroyDescriptorPool(m_device, m_descriptorPool, m_pAllocator);
+
+	vkDestroySampler(m_device, m_sampler, m_pAllocator);
+	for (VkImageView view : m_pyramidLevelViews)
+	{
+		vkDestroyImageView(m_device, view, m_pAllocator);
+	}
+	vkDestroyImageView(m_device, m_pyramidView, m_pAllocator);
+	vkDestroyImage(m_device, m_pyramidImage, m_pAllocator);
+	vkFreeMemory(m_device, m_pyramidMemory, m_pAllocator);
+
+	m_pyramidLevelViews.clear();
+	m_reduceSets.clear();
+	m_cullSets.clear();
+	m_frames.clear();
+	m_pyramidInitialised = false;
+	m_device = VK_NULL_HANDLE;
+}
+
+void OcclusionCulling::SetScene(VkBuffer instanceBuffer, VkDeviceSize instanceSize, u32 entryCount, u32 maxBatches)
+{
+	destroySceneBuffers();
+
+	m_instanceSize = instanceSize;
+	m_entryCount = entryCount;
+	m_batchCapacity = maxBatches;
+
+	// Vulkan has no empty buffers, an empty scene still gets one of everything.
+	const VkDeviceSize instanceBytes = std::max<VkDeviceSize>(instanceSize * entryCount, instanceSize);
+
+	VulkanInit::CreateBuffer(m_physicalDevice, m_device, std::max<VkDeviceSize>(sizeof(u32) * entryCount, sizeof(u32)),
+		VK_BUFFER_USAGE_STORAGE_BUFFER_BIT | VK_BUFFER_USAGE_TRANSFER_DST_BIT,
+		VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT, m_visibilityBuffer, m_visibilityMemory, { }, m_pAllocator);
+	VulkanInit::CreateBuffer(m_physicalDevice, m_device, instanceBytes, VK_BUFFER_USAGE_STORAGE_BUFFER_BIT | VK_BUFFER_USAGE_VERTEX_BUFFER_BIT,
+		VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT, m_earlyInstanceBuffer, m_earlyInstanceMemory, { }, m_pAllocator);
+	VulkanInit::CreateBuffer(m_physicalDevice, m_device, instanceBytes, VK_BUFFER_USAGE_STORAGE_BUFFER_BIT | VK_BUFFER_USAGE_VERTEX_BUFFER_BIT,
+		VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT, m_lateInstanceBuffer, m_lateInstanceMemory, { }, m_pAllocator);
+
+	const VkDeviceSize batchBytes = sizeof(OcclusionBatch) * std::max(maxBatches, 1u);
+	// The early commands, then the late ones.
+	const VkDeviceSize commandBytes = sizeof(OcclusionDrawCommand) * 2 * std::max(maxBatches, 1u);
+
+	for (u32 slot = 0; slot < m_frames.size(); slot++)
+	{
+		FrameBuffers& frame = m_frames[slot];
+
+		// Rewritten by the CPU every frame, so host visible rather than staged.
+		VulkanInit::CreateBuffer(m_physicalDevice, m_device, batchBytes, VK_BUFFER_USAGE_STORAGE_BUFFER_BIT,
+			VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT | VK_MEMORY_PROPERTY_HOST_COHERENT_BIT, frame.batchBuffer, frame.batchMemory, { }, m_pAllocator);
+		VulkanInit::CreateBuffer(m_physicalDevice, m_device, commandBytes, VK_BUFFER_USAGE_STORAGE_BUFFER_BIT | VK_BUFFER_USAGE_INDIRECT_BUFFER_BIT,
+			VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT | VK_MEMORY_PROPERTY_HOST_COHERENT_BIT, frame.commandBuffer, frame.commandMemory, { }, m_pAllocator);
+
+		vkMapMemory(m_device, frame.batchMemory, 0, batchBytes, 0, &frame.pBatches);
+		vkMapMemory(m_device, frame.commandMemory, 0, commandBytes, 0, &frame.pCommands);
+
+		frame.batchCount = 0;
+		frame.threadCount = 0;
+
+		VkDescriptorBufferInfo bufferInfos[6]{};
+		bufferInfos[0] = { instanceBuffer, 0, VK_WHOLE_SIZE };
+		bufferInfos[1] = { frame.batchBuffer, 0, VK_WHOLE_SIZE };
+		bufferInfos[2] = { frame.commandBuffer, 0, VK_WHOLE_SIZE };
+		bufferInfos[3] = { m_visibilityBuffer, 0, VK_WHOLE_SIZE };
+		bufferInfos[4] = { m_earlyInstanceBuffer, 0, VK_WHOLE_SIZE };
+		bufferInfos[5] = { m_lateInstanceBuffer, 0, VK_WHOLE_SIZE };
+
+		VkWriteDescriptorSet write{};
+		write.sType = VK_STRUCTURE_TYPE_WRITE_DESCRIPTOR_SET;
+		write.dstSet = m_cullSets[slot];
+		write.dstBinding = 0;
+		write.descriptorCount = 6;
+		write.descriptorType = VK_DESCRIPTOR_TYPE_STORAGE_BUFFER;
+		write.pBufferInfo = bufferInfos;
+
+		vkUpdateDescriptorSets(m_device, 1, &write, 0, nullptr);
+	}
+
+	m_clearVisibility = true;
+	m_stats = OcclusionStats{ };
+}
+
+void OcclusionCulling::BeginFrame(u32 slot)
+{
+	FrameBuffers& frame = m_frames[slot];
+
+	// The frame last recorded in this slot has finished, and the late cull made its counts available to the host.
+	const OcclusionDrawCommand* pCommands = static_cast<const OcclusionDrawCommand*>(frame.pCommands);
+
+	m_stats = OcclusionStats{ };
+	m_stats.tested = frame.threadCount;
+	for (u32 i = 0; i < frame.batchCount; i++)
+	{
+		m_stats.drawnEarly += pCommands[i].instanceCount;
+		m_stats.drawnLate += pCommands[m_batchCapacity + i].instanceCount;
+	}
+
+	frame.batchCount = 0;
+	frame.threadCount = 0;
+}
+
+void OcclusionCulling::AddBatch(u32 slot, const DrawPacket& packet, u32 firstEntry, float radius, DrawPacket& early, DrawPacket& late)
+{
+	FrameBuffers& frame = m_frames[slot];
+
+	if (frame.batchCount == m_batchCapacity || firstEntry + packet.instanceCount > m_entryCount)
+	{
+		throw std::runtime_error("occlusion culling batch does not fit the scene!");
+	}
+
+	const u32 index = frame.batchCount++;
+	const bool indexed = packet.indexBuffer != VK_NULL_HANDLE;
+
+	// The shader reads from the start of the instance buffer, so the packet's own offset is folded into its first instance.
+	OcclusionBatch* pBatches = static_cast<OcclusionBatch*>(frame.pBatches);
+	pBatches[index].firstThread = frame.threadCount;
+	pBatches[index].firstInstance = packet.firstInstance + static_cast<u32>(packet.vertexBufferOffset / m_instanceSize);
+	pBatches[index].instanceCount = packet.instanceCount;
+	pBatches[index].firstEntry = firstEntry;
+	pBatches[index].radius = radius;
+
+	frame.threadCount += packet.instanceCount;
+
+	// The instance counts start at zero, the culls count the instances they keep into them.
+	// The kept instances are compacted to the start of the batch's entries, which the commands start from
+	// when they can have a first instance.
+	const u32 commandFirstInstance = m_multiDraw ? firstEntry : 0;
+	OcclusionDrawCommand command{ packet.vertexCount, 0, packet.firstVertex, indexed ? static_cast<u32>(packet.vertexOffset) : commandFirstInstance,
+		commandFirstInstance };
+
+	OcclusionDrawCommand* pCommands = static_cast<OcclusionDrawCommand*>(frame.pCommands);
+	pCommands[index] = command;
+	pCommands[m_batchCapacity + index] = command;
+
+	// Otherwise binding the buffer at the batch's entries keeps firstInstance at zero, which unlike a non-zero one
+	// does not need the drawIndirectFirstInstance feature, but every batch is then a draw of its own.
+	early = packet;
+	early.key = SetDrawKeyPass(packet.key, DrawPass::Opaque);
+	early.vertexBuffer = m_earlyInstanceBuffer;
+	early.vertexBufferOffset = m_multiDraw ? 0 : firstEntry * m_instanceSize;
+	early.firstInstance = 0;
+	early.indirectBuffer = frame.commandBuffer;
+	early.indirectOffset = sizeof(OcclusionDrawCommand) * index;
+	early.indirectStride = m_multiDraw ? sizeof(OcclusionDrawCommand) : 0;
+
+	late = early;
+	late.key = SetDrawKeyPass(packet.key, DrawPass::OpaqueLate);
+	late.vertexBuffer = m_lateInstanceBuffer;
+	late.indirectOffset = sizeof(OcclusionDrawCommand) * (m_batchCapacity + index);
+}
+
+void OcclusionCulling::RecordEarlyCull(VkCommandBuffer commandBuffer, u32 slot)
+{
+	// The previous frame's late pass read the compacted instances and commands, and its late cull wrote the visibility.
+	VkMemoryBarrier barrier{};
+	barrier.sType = VK_STRUCTURE_TYPE_MEMORY_BARRIER;
+	barrier.srcAccessMask = VK_ACCESS_SHADER_WRITE_BIT;
+	barrier.dstAccessMask = VK_ACCESS_SHADER_READ_BIT | VK_ACCESS_SHADER_WRITE_BIT | VK_ACCESS_TRANSFER_WRITE_BIT;
+
+	vkCmdPipelineBarrier(commandBuffer, VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT | VK_PIPELINE_STAGE_DRAW_INDIRECT_BIT | VK_PIPELINE_STAGE_VERTEX_INPUT_BIT,
+		VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT | VK_PIPELINE_STAGE_TRANSFER_BIT, 0, 1, &barrier, 0, nullptr, 0, nullptr);
+
+	if (m_clearVisibility)
+	{
+		// A new scene has nothing visible yet, so its first frame draws everything in the late pass.
+		vkCmdFillBuffer(commandBuffer, m_visibilityBuffer, 0, VK_WHOLE_SIZE, 0);
+
+		VkMemoryBarrier clearBarrier{};
+		clearBarrier.sType = VK_STRUCTURE_TYPE_MEMORY_BARRIER;
+		clearBarrier.srcAccessMask = VK_ACCESS_TRANSFER_WRITE_BIT;
+		clearBarrier.dstAccessMask = VK_ACCESS_SHADER_READ_BIT | VK_ACCESS_SHADER_WRITE_BIT;
+
+		vkCmdPipelineBarrier(commandBuffer, VK_PIPELINE_STAGE_TRANSFER_BIT, VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT, 0,
+			1, &clearBarrier, 0, nullptr, 0, nullptr);
+
+		m_clearVisibility = false;
+	}
+
+	recordCull(commandBuffer, slot, 0);
+}
+
+void OcclusionCulling::RecordDepthPyramid(VkCommandBuffer commandBuffer, VkExtent2D renderExtent)
+{
+	VkImageMemoryBarrier barriers[2]{};
+
+	// The early pass's depth, read by the first level.
+	barriers[0].sType = VK_STRUCTURE_TYPE_IMAGE_MEMORY_BARRIER;
+	barriers[0].srcAccessMask = VK_ACCESS_DEPTH_STENCIL_ATTACHMENT_WRITE_BIT;
+	barriers[0].dstAccessMask = VK_ACCESS_SHADER_READ_BIT;
+	barriers[0].oldLayout = VK_IMAGE_LAYOUT_DEPTH_STENCIL_ATTACHMENT_OPTIMAL;
+	barriers[0].newLayout = VK_IMAGE_LAYOUT_DEPTH_STENCIL_READ_ONLY_OPTIMAL;
+	barriers[0].srcQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED;
+	barriers[0].dstQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED;
+	barriers[0].image = m_depthImage;
+	barriers[0].subresourceRange = { m_depthAspects, 0, 1, 0, 1 };
+
+	// The previous frame's late cull read the pyramid that is about to be overwritten.
+	// Its contents are never needed again, so the first use can start from undefined.
+	barriers[1].sType = VK_STRUCTURE_TYPE_IMAGE_MEMORY_BARRIER;
+	barriers[1].srcAccessMask = 0;
+	barriers[1].dstAccessMask = VK_ACCESS_SHADER_WRITE_BIT;
+	barriers[1].oldLayout = m_pyramidInitialised ? VK_IMAGE_LAYOUT_GENERAL : VK_IMAGE_LAYOUT_UNDEFINED;
+	barriers[1].newLayout = VK_IMAGE_LAYOUT_GENERAL;
+	barriers[1].srcQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED;
+	barriers[1].dstQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED;
+	barriers[1].image = m_pyramidImage;
+	barriers[1].subresourceRange = { VK_IMAGE_ASPECT_COLOR_BIT, 0, m_pyramidLevelCount, 0, 1 };
+
+	vkCmdPipelineBarrier(commandBuffer,
+		VK_PIPELINE_STAGE_EARLY_FRAGMENT_TESTS_BIT | VK_PIPELINE_STAGE_LATE_FRAGMENT_TESTS_BIT | VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT,
+		VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT, 0, 0, nullptr, 0, nullptr, 2, barriers);
+
+	m_pyramidInitialised = true;
+
+	vkCmdBindPipeline(commandBuffer, VK_PIPELINE_BIND_POINT_COMPUTE, m_reducePipeline);
+
+	VkExtent2D inputExtent = renderExtent;
+	for (u32 level = 0; level < m_pyramidLevelCount; level++)
+	{
+		VkExtent2D outputExtent = { std::max(m_pyramidExtent.width >> level, 1u), std::max(m_pyramidExtent.height >> level, 1u) };
+
+		DepthReduceParams params{ { static_cast<int32_t>(inputExtent.width), static_cast<int32_t>(inputExtent.height) },
+			{ static_cast<int32_t>(outputExtent.width), static_cast<int32_t>(outputExtent.height) } };
+
+		vkCmdBindDescriptorSets(commandBuffer, VK_PIPELINE_BIND_POINT_COMPUTE, m_reduceLayout, 0, 1, &m_reduceSets[level], 0, nullptr);
+		vkCmdPushConstants(commandBuffer, m_reduceLayout, VK_SHADER_STAGE_COMPUTE_BIT, 0, sizeof(params), &params);
+		vkCmdDispatch(commandBuffer, (outputExtent.width + DEPTH_REDUCE_WORKGROUP_SIZE - 1) / DEPTH_REDUCE_WORKGROUP_SIZE,
+			(outputExtent.height + DEPTH_REDUCE_WORKGROUP_SIZE - 1) / DEPTH_REDUCE_WORKGROUP_SIZE, 1);
+
+		// Each level is read by the next one, and the last by the late cull.
+		VkMemoryBarrier barrier{};
+		barrier.sType = VK_STRUCTURE_TYPE_MEMORY_BARRIER;
+		barrier.srcAccessMask = VK_ACCESS_SHADER_WRITE_BIT;
+		barrier.dstAccessMask = VK_ACCESS_SHADER_READ_BIT;
+
+		vkCmdPipelineBarrier(commandBuffer, VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT, VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT, 0,
+			1, &barrier, 0, nullptr, 0, nullptr);
+
+		inputExtent = outputExtent;
+	}
+
+	// Back to an attachment for the late pass, which keeps testing against the early pass's depth.
+	VkImageMemoryBarrier depthBarrier = barriers[0];
+	depthBarrier.srcAccessMask = 0;
+	depthBarrier.dstAccessMask = VK_ACCESS_DEPTH_STENCIL_ATTACHMENT_READ_BIT | VK_ACCESS_DEPTH_STENCIL_ATTACHMENT_WRITE_BIT;
+	depthBarrier.oldLayout = VK_IMAGE_LAYOUT_DEPTH_STENCIL_READ_ONLY_OPTIMAL;
+	depthBarrier.newLayout = VK_IMAGE_LAYOUT_DEPTH_STENCIL_ATTACHMENT_OPTIMAL;
+
+	vkCmdPipelineBarrier(commandBuffer, VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT,
+		VK_PIPELINE_STAGE_EARLY_FRAGMENT_TESTS_BIT | VK_PIPELINE_STAGE_LATE_FRAGMENT_TESTS_BIT, 0, 0, nullptr, 0, nullptr, 1, &depthBarrier);
+}
+
+void OcclusionCulling::RecordLateCull(VkCommandBuffer commandBuffer, u32 slot)
+{
+	recordCull(commandBuffer, slot, 1);
+}
+
+void OcclusionCulling::recordCull(VkCommandBuffer commandBuffer, u32 slot, u32 phase)
+{
+	const FrameBuffers& frame = m_frames[slot];
+
+	if (frame.batchCount == 0)
+	{
+		return;
+	}
+
+	OcclusionCullParams params{};
+	params.threadCount = frame.threadCount;
+	params.batchCount = frame.batchCount;
+	params.phase = phase;
+	params.lateCommandOffset = m_batchCapacity;
+	params.pyramidSize[0] = static_cast<int32_t>(m_pyramidExtent.width);
+	params.pyramidSize[1] = static_cast<int32_t>(m_pyramidExtent.height);
+	params.pyramidLevelCount = m_pyramidLevelCount;
+	params.bounds[0] = m_viewBounds.min[0];
+	params.bounds[1] = m_viewBounds.min[1];
+	params.bounds[2] = m_viewBounds.max[0];
+	params.bounds[3] = m_viewBounds.max[1];
+	params.depthView[0] = m_depthCamera.center[0];
+	params.depthView[1] = m_depthCamera.center[1];
+	params.depthView[2] = m_depthCamera.zoom;
+
+	vkCmdBindPipeline(commandBuffer, VK_PIPELINE_BIND_POINT_COMPUTE, m_cullPipeline);
+	vkCmdBindDescriptorSets(commandBuffer, VK_PIPELINE_BIND_POINT_COMPUTE, m_cullLayout, 0, 1, &m_cullSets[slot], 0, nullptr);
+	vkCmdPushConstants(commandBuffer, m_cullLayout, VK_SHADER_STAGE_COMPUTE_BIT, 0, sizeof(params), &params);
+	vkCmdDispatch(commandBuffer, (frame.threadCount + OCCLUSION_CULL_WORKGROUP_SIZE - 1) / OCCLUSION_CULL_WORKGROUP_SIZE, 1, 1);
+
+	// The counts and instances are read by the pass's draws. The late counts are also read back by
+	// BeginFrame() once the frame's timeline point is reached, which makes them visible to the host.
+	VkMemoryBarrier barrier{};
+	barrier.sType = VK_STRUCTURE_TYPE_MEMORY_BARRIER;
+	barrier.srcAccessMask = VK_ACCESS_SHADER_WRITE_BIT;
+	barrier.dstAccessMask = VK_ACCESS_INDIRECT_COMMAND_READ_BIT | VK_ACCESS_VERTEX_ATTRIBUTE_READ_BIT | VK_ACCESS_HOST_READ_BIT;
+
+	vkCmdPipelineBarrier(commandBuffer, VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT,
+		VK_PIPELINE_STAGE_DRAW_INDIRECT_BIT | VK_PIPELINE_STAGE_VERTEX_INPUT_BIT | VK_PIPELINE_STAGE_HOST_BIT, 0,
+		1, &barrier, 0, nullptr, 0, nullptr);
+}
+
+VkPipeline OcclusionCulling::ReplaceReducePipeline(VkShaderModule reduceShader)
+{
+	VkPipeline oldPipeline = m_reducePipeline;
+	m_reducePipeline = VulkanInit::CreateComputePipeline(m_device, m_pipelineCache, reduceShader, m_reduceLayout, nullptr, m_pAllocator);
+	return oldPipeline;
+}
+
+VkPipeline OcclusionCulling::ReplaceCullPipeline(VkShaderModule cullShader)
+{
+	VkPipeline oldPipeline = m_cullPipeline;
+	m_cullPipeline = VulkanInit::CreateComputePipeline(m_device, m_pipelineCache, cullShader, m_cullLayout, nullptr, m_pAllocator);
+	return oldPipeline;
+}
+
+void OcclusionCulling::createPyramid(VkExtent2D depthExtent)
+{
+	// Rounding down rather than up keeps the first level from being larger than the depth it reduces.
+	m_pyramidExtent = { floorPowerOfTwo(std::max(depthExtent.width, 1u)), floorPowerOfTwo(std::max(depthExtent.height, 1u)) };
+
+	m_pyramidLevelCount = 1;
+	while ((std::max(m_pyramidExtent.width, m_pyramidExtent.height) >> m_pyramidLevelCount) != 0)
+	{
+		m_pyramidLevelCount++;
+	}
+
+	VkImageCreateInfo imageInfo{};
+	imageInfo.sType = VK_STRUCTURE_TYPE_IMAGE_CREATE_INFO;
+	imageInfo.imageType = VK_IMAGE_TYPE_2D;
+	imageInfo.format = VK_FORMAT_R32_SFLOAT;
+	imageInfo.extent = { m_pyramidExtent.width, m_pyramidExtent.height, 1 };
+	imageInfo.mipLevels = m_pyramidLevelCount;
+	imageInfo.arrayLayers = 1;
+	imageInfo.samples = VK_SAMPLE_COUNT_1_BIT;
+	imageInfo.tiling = VK_IMAGE_TILING_OPTIMAL;
+	imageInfo.usage = VK_IMAGE_USAGE_STORAGE_BIT | VK_IMAGE_USAGE_SAMPLED_BIT;
+	imageInfo.sharingMode = VK_SHARING_MODE_EXCLUSIVE;
+	imageInfo.initialLayout = VK_IMAGE_LAYOUT_UNDEFINED;
+
+	if (vkCreateImage(m_device, &imageInfo, m_pAllocator, &m_pyramidImage) != VK_SUCCESS)
+	{
+		throw std::runtime_error("failed to create depth pyramid image!");
+	}
+
+	VkMemoryRequirements memRequirements;
+	vkGetImageMemoryRequirements(m_device, m_pyramidImage, &memRequirements);
+
+	VkMemoryAllocateInfo allocInfo{};
+	allocInfo.sType = VK_STRUCTURE_TYPE_MEMORY_ALLOCATE_INFO;
+	allocInfo.allocationSize = memRequirements.size;
+	allocInfo.memoryTypeIndex = VulkanInit::FindMemoryType(m_physicalDevice, memRequirements.memoryTypeBits, VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT);
+
+	if (vkAllocateMemory(m_device, &allocInfo, m_pAllocator, &m_pyramidMemory) != VK_SUCCESS)
+	{
+		throw std::runtime_error("failed to allocate depth pyramid memory!");
+	}
+
+	vkBindImageMemory(m_device, m_pyramidImage, m_pyramidMemory, 0);
+
+	VkImageViewCreateInfo viewInfo{};
+	viewInfo.sType = VK_STRUCTURE_TYPE_IMAGE_VIEW_CREATE_INFO;
+	viewInfo.image = m_pyramidImage;
+	viewInfo.viewType = VK_IMAGE_VIEW_TYPE_2D;
+	viewInfo.format = VK_FORMAT_R32_SFLOAT;
+	viewInfo.subresourceRange = { VK_IMAGE_ASPECT_COLOR_BIT, 0, m_pyramidLevelCount, 0, 1 };
+
+	if (vkCreateImageView(m_device, &viewInfo, m_pAllocator, &m_pyramidView) != VK_SUCCESS)
+	{
+		throw std::runtime_error("failed to create depth pyramid image view!");
+	}
+
+	m_pyramidLevelViews.resize(m_pyramidLevelCount);
+	for (u32 level = 0; level < m_pyramidLevelCount; level++)
+	{
+		viewInfo.subresourceRange = { VK_IMAGE_ASPECT_COLOR_BIT, level, 1, 0, 1 };
+
+		if (vkCreateImageView(m_device, &viewInfo, m_pAllocator, &m_pyramidLevelViews[level]) != VK_SUCCESS)
+		{
+			throw std::runtime_error("failed to create depth pyramid level view!");
+		}
+	}
+
+	// Every read is a texelFetch, which ignores filtering, but combined image samplers still need one.
+	VkSamplerCreateInfo samplerInfo{};
+	samplerInfo.sType = VK_STRUCTURE_TYPE_SAMPLER_CREATE_INFO;
+	samplerInfo.magFilter = VK_FILTER_NEAREST;
+	samplerInfo.minFilter = VK_FILTER_NEAREST;
+	samplerInfo.mipmapMode = VK_SAMPLER_MIPMAP_MODE_NEAREST;
+	samplerInfo.addressModeU = VK_SAMPLER_ADDRESS_MODE_CLAMP_TO_EDGE;
+	samplerInfo.addressModeV = VK_SAMPLER_ADDRESS_MODE_CLAMP_TO_EDGE;
+	samplerInfo.addressModeW = VK_SAMPLER_ADDRESS_MODE_CLAMP_TO_EDGE;
+	samplerInfo.maxLod = VK_LOD_CLAMP_NONE;
+
+	if (vkCreateSampler(m_device, &samplerInfo, m_pAllocator, &m_sampler) != VK_SUCCESS)
+	{
+		throw std::runtime_error("failed to create depth pyramid sampler!");
+	}
+}
+
+void OcclusionCulling::createPipelines(VkShaderModule reduceShader, VkShaderModule cullShader)
+{
+	VkDescriptorSetLayoutBinding reduceBindings[2]{};
+	reduceBindings[0] = { 0, VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER, 1, VK_SHADER_STAGE_COMPUTE_BIT, nullptr };
+	reduceBindings[1] = { 1, VK_DESCRIPTOR_TYPE_STORAGE_IMAGE, 1, VK_SHADER_STAGE_COMPUTE_BIT, nullptr };
+
+	VkDescriptorSetLayoutBinding cullBindings[7]{};
+	for (u32 i = 0; i < 6; i++)
+	{
+		cullBindings[i] = { i, VK_DESCRIPTOR_TYPE_STORAGE_BUFFER, 1, VK_SHADER_STAGE_COMPUTE_BIT, nullptr };
+	}
+	cullBindings[6] = { 6, VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER, 1, VK_SHADER_STAGE_COMPUTE_BIT, nullptr };
+
+	VkDescriptorSetLayoutCreateInfo layoutInfo{};
+	layoutInfo.sType = VK_STRUCTURE_TYPE_DESCRIPTOR_SET_LAYOUT_CREATE_INFO;
+	layoutInfo.bindingCount = 2;
+	layoutInfo.pBindings = reduceBindings;
+
+	if (vkCreateDescriptorSetLayout(m_device, &layoutInfo, m_pAllocator, &m_reduceSetLayout) != VK_SUCCESS)
+	{
+		throw std::runtime_error("failed to create depth reduce descriptor set layout!");
+	}
+
+	layoutInfo.bindingCount = 7;
+	layoutInfo.pBindings = cullBindings;
+
+	if (vkCreateDescriptorSetLayout(m_device, &layoutInfo, m_pAllocator, &m_cullSetLayout) != VK_SUCCESS)
+	{
+		throw std::runtime_error("failed to create occlusion cull descriptor set layout!");
+	}
+
+	VkPushConstantRange pushConstantRange{};
+	pushConstantRange.stageFlags = VK_SHADER_STAGE_COMPUTE_BIT;
+	pushConstantRange.offset = 0;
+	pushConstantRange.size = sizeof(DepthReduceParams);
+
+	VkPipelineLayoutCreateInfo pipelineLayoutInfo{};
+	pipelineLayoutInfo.sType = VK_STRUCTURE_TYPE_PIPELINE_LAYOUT_CREATE_INFO;
+	pipelineLayoutInfo.setLayoutCount = 1;
+	pipelineLayoutInfo.pSetLayouts = &m_reduceSetLayout;
+	pipelineLayoutInfo.pushConstantRangeCount = 1;
+	pipelineLayoutInfo.pPushConstantRanges = &pushConstantRange;
+
+	if (vkCreatePipelineLayout(m_device, &pipelineLayoutInfo, m_pAllocator, &m_reduceLayout) != VK_SUCCESS)
+	{
+		throw std::runtime_error("failed to create depth reduce pipeline layout!");
+	}
+
+	pushConstantRange.size = sizeof(OcclusionCullParams);
+	pipelineLayoutInfo.pSetLayouts = &m_cullSetLayout;
+
+	if (vkCreatePipelineLayout(m_device, &pipelineLayoutInfo, m_pAllocator, &m_cullLayout) != VK_SUCCESS)
+	{
+		throw std::runtime_error("failed to create occlusion cull pipeline layout!");
+	}
+
+	m_reducePipeline = VulkanInit::CreateComputePipeline(m_device, m_pipelineCache, reduceShader, m_reduceLayout, nullptr, m_pAllocator);
+	m_cullPipeline = VulkanInit::CreateComputePipeline(m_device, m_pipelineCache, cullShader, m_cullLayout, nullptr, m_pAllocator);
+}
+
+void OcclusionCulling::createDescriptorSets()
+{
+	const u32 slotCount = static_cast<u32>(m_frames.size());
+
+	VkDescriptorPoolSize poolSizes[3]{};
+	poolSizes[0] = { VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER, m_pyramidLevelCount + slotCount };
+	poolSizes[1] = { VK_DESCRIPTOR_TYPE_STORAGE_IMAGE, m_pyramidLevelCount };
+	poolSizes[2] = { VK_DESCRIPTOR_TYPE_STORAGE_BUFFER, 6 * slotCount };
+
+	VkDescriptorPoolCreateInfo poolInfo{};
+	poolInfo.sType = VK_STRUCTURE_TYPE_DESCRIPTOR_POOL_CREATE_INFO;
+	poolInfo.maxSets = m_pyramidLevelCount + slotCount;
+	poolInfo.poolSizeCount = 3;
+	poolInfo.pPoolSizes = poolSizes;
+
+	if (vkCreateDescriptorPool(m_device, &poolInfo, m_pAllocator, &m_descriptorPool) != VK_SUCCESS)
+	{
+		throw std::runtime_error("failed to create occlusion culling descriptor pool!");
+	}
+
+	std::vector<VkDescriptorSetLayout> reduceLayouts(m_pyramidLevelCount, m_reduceSetLayout);
+	std::vector<VkDescriptorSetLayout> cullLayouts(slotCount, m_cullSetLayout);
+
+	VkDescriptorSetAllocateInfo allocInfo{};
+	allocInfo.sType = VK_STRUCTURE_TYPE_DESCRIPTOR_SET_ALLOCATE_INFO;
+	allocInfo.descriptorPool = m_descriptorPool;
+	allocInfo.descriptorSetCount = m_pyramidLevelCount;
+	allocInfo.pSetLayouts = reduceLayouts.data();
+
+	m_reduceSets.resize(m_pyramidLevelCount);
+	if (vkAllocateDescriptorSets(m_device, &allocInfo, m_reduceSets.data()) != VK_SUCCESS)
+	{
+		throw std::runtime_error("failed to allocate depth reduce descriptor sets!");
+	}
+
+	allocInfo.descriptorSetCount = slotCount;
+	allocInfo.pSetLayouts = cullLayouts.data();
+
+	m_cullSets.resize(slotCount);
+	if (vkAllocateDescriptorSets(m_device, &allocInfo, m_cullSets.data()) != VK_SUCCESS)
+	{
+		throw std::runtime_error("failed to allocate occlusion cull descriptor sets!");
+	}
+
+	for (u32 level = 0; level < m_pyramidLevelCount; level++)
+	{
+		VkDescriptorImageInfo inputInfo{};
+		inputInfo.sampler = m_sampler;
+		inputInfo.imageView = level == 0 ? m_depthView : m_pyramidLevelViews[level - 1];
+		inputInfo.imageLayout = level == 0 ? VK_IMAGE_LAYOUT_DEPTH_STENCIL_READ_ONLY_OPTIMAL : VK_IMAGE_LAYOUT_GENERAL;
+
+		VkDescriptorImageInfo outputInfo{};
+		outputInfo.imageView = m_pyramidLevelViews[level];
+		outputInfo.imageLayout = VK_IMAGE_LAYOUT_GENERAL;
+
+		VkWriteDescriptorSet writes[2]{};
+		writes[0].sType = VK_STRUCTURE_TYPE_WRITE_DESCRIPTOR_SET;
+		writes[0].dstSet = m_reduceSets[level];
+		writes[0].dstBinding = 0;
+		writes[0].descriptorCount = 1;
+		writes[0].descriptorType = VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER;
+		writes[0].pImageInfo = &inputInfo;
+
+		writes[1] = writes[0];
+		writes[1].dstBinding = 1;
+		writes[1].descriptorType = VK_DESCRIPTOR_TYPE_STORAGE_IMAGE;
+		writes[1].pImageInfo = &outputInfo;
+
+		vkUpdateDescriptorSets(m_device, 2, writes, 0, nullptr);
+	}
+
+	// The pyramid never changes, so only the buffers are left to SetScene().
+	for (VkDescriptorSet cullSet : m_cullSets)
+	{
+		VkDescriptorImageInfo pyramidInfo{};
+		pyramidInfo.sampler = m_sampler;
+		pyramidInfo.imageView = m_pyramidView;
+		pyramidInfo.imageLayout = VK_IMAGE_LAYOUT_GENERAL;
+
+		VkWriteDescriptorSet write{};
+		write.sType = VK_STRUCTURE_TYPE_WRITE_DESCRIPTOR_SET;
+		write.dstSet = cullSet;
+		write.dstBinding = 6;
+		write.descriptorCount = 1;
+		write.descriptorType = VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER;
+		write.pImageInfo = &pyramidInfo;
+
+		vkUpdateDescriptorSets(m_device, 1, &write, 0, nullptr);
+	}
+}
+
+void OcclusionCulling::destroySceneBuffers()
+{
+	if (m_visibilityBuffer == VK_NULL_HANDLE)
+	{
+		return;
+	}
+
+	for (FrameBuffers& frame : m_frames)
+	{
+		vkDestroyBuffer(m_device, frame.batchBuffer, m_pAllocator);
+		vkFreeMemory(m_device, frame.batchMemory, m_pAllocator);
+		vkDestroyBuffer(m_device, frame.commandBuffer, m_pAllocator);
+		vkFreeMemory(m_device, frame.commandMemory, m_pAllocator);
+
+		frame = FrameBuffers{ };
+	}
+
+	vkDestroyBuffer(m_device, m_visibilityBuffer, m_pAllocator);
+	vkFreeMemory(m_device, m_visibilityMemory, m_pAllocator);
+	vkDestroyBuffer(m_device, m_earlyInstanceBuffer, m_pAllocator);
+	vkFreeMemory(m_device, m_earlyInstanceMemory, m_pAllocator);
+	vkDestroyBuffer(m_device, m_lateInstanceBuffer, m_pAllocator);
+	vkFreeMemory(m_device, m_lateInstanceMemory, m_pAllocator);
+
+	m_visibilityBuffer = VK_NULL_HANDLE;
+	m_visibilityMemory = VK_NULL_HANDLE;
+	m_earlyInstanceBuffer = VK_NULL_HANDLE;
+	m_earlyInstanceMemory = VK_NULL_HANDLE;
+	m_lateInstanceBuffer = VK_NULL_HANDLE;
+	m_lateInstanceMemory = VK_NULL_HANDLE;
+}
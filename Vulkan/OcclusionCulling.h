@@ -0,0 +1,212 @@
+#pragma once
+
+#include <vector>
+#include <vulkan/vulkan.h>
+
+#include "Types.h"
+#include "DrawQueue.h"
+#include "SceneViews.h"
+
+// Two-phase occlusion culling against a hierarchical depth pyramid, on the GPU.
+//
+// Every instance of every culled draw has an entry recording whether it passed the late test last
+// frame. A frame then goes:
+//
+//   1. Early cull: the instances visible last frame (and inside the frustum) are compacted into
+//      the early instance buffer, with their counts written into indirect draw commands.
+//   2. Early pass: those are drawn, which fills the depth buffer with roughly last frame's occluders.
+//   3. Depth pyramid: the depth is reduced into a mip chain, each texel holding the farthest depth
+//      of the texels it covers.
+//   4. Late cull: every instance is tested against the pyramid. Those that pass but were not drawn
+//      early are compacted into the late instance buffer, and every entry is updated.
+//   5. Late pass: the newly visible instances are drawn into the same depth and colour.
+//
+// Nothing is drawn from stale visibility alone: an instance that appears is drawn in the late pass
+// of the same frame it appears, and one that was visible keeps being drawn until a late test fails.
+// So there is no popping, at the cost of drawing newly disoccluded instances a pass later.
+//
+// The instances are tested as circles in clip space, flat at their depth, which is exact for this
+// renderer's instances. A circle is occluded if its depth is behind the pyramid texels covering it,
+// taken at the level where it is at most one texel across, so at most four texels are read per test.
+//
+// With several views (see SceneViews.h) every instance is still tested once, for all of them. The frustum
+// test takes the rectangle covering every view, and the pyramid is built from view 0's layer of the depth
+// only. Views only pan and zoom, so what view 0 sees hidden is hidden in every view, but its depth says
+// nothing about what lies outside it: instances not entirely inside view 0 are never culled as occluded.
+//
+// The per-frame batch and command data is written by the CPU into host visible buffers, one set per
+// frame in flight. The instance, visibility and pyramid resources are shared: each frame's use of
+// them is ordered after the previous frame's by barriers on the single graphics queue.
+
+// Must match local_size_x in Shaders/occlusion_cull.comp.
+constexpr u32 OCCLUSION_CULL_WORKGROUP_SIZE = 64;
+
+// Must match local_size_x and local_size_y in Shaders/depth_reduce.comp.
+constexpr u32 DEPTH_REDUCE_WORKGROUP_SIZE = 8;
+
+struct OcclusionCullingDesc
+{
+	VkPhysicalDevice physicalDevice{ VK_NULL_HANDLE };
+	VkDevice device{ VK_NULL_HANDLE };
+
+	// The scene's depth buffer, created with VK_IMAGE_USAGE_SAMPLED_BIT. The passes leave it in
+	// VK_IMAGE_LAYOUT_DEPTH_STENCIL_ATTACHMENT_OPTIMAL, and so does building the pyramid.
+	// Only layer 0, view 0's, is read, through a 2D view of it.
+	VkImage depthImage{ VK_NULL_HANDLE };
+	VkImageView depthView{ VK_NULL_HANDLE };
+	VkFormat depthFormat{ VK_FORMAT_UNDEFINED };
+	VkExtent2D depthExtent{ };
+
+	VkShaderModule reduceShader{ VK_NULL_HANDLE };
+	VkShaderModule cullShader{ VK_NULL_HANDLE };
+	VkPipelineCache pipelineCache{ VK_NULL_HANDLE };
+
+	// The number of frames in flight. Batch and draw command buffers are kept per slot.
+	u32 slotCount{ 2 };
+
+	// The device has the drawIndirectFirstInstance and multiDrawIndirect features enabled. The draws then
+	// share an instance buffer binding and only differ in their commands, so DrawQueue merges consecutive batches.
+	bool multiDraw{ false };
+
+	// Host allocator for every object the culling creates. Must outlive it.
+	const VkAllocationCallbacks* pAllocator{ nullptr };
+};
+
+// What the last frame recorded in a slot drew, read back once the frame has been waited for.
+struct OcclusionStats
+{
+	u32 tested{ 0 };
+	u32 drawnEarly{ 0 };
+	u32 drawnLate{ 0 };
+
+	u32 Culled() const { return tested - drawnEarly - drawnLate; }
+};
+
+class OcclusionCulling
+{
+public:
+	void Init(const OcclusionCullingDesc& desc);
+
+	void Destroy();
+
+	// Points the culling at a new instance buffer. Instances are read as InstanceData (see HelloTriangleApp.h),
+	// 'instanceSize' bytes apart. 'entryCount' is the total instance count of every culled draw, and
+	// 'maxBatches' the most batches a frame may add. Every entry starts out not visible.
+	// The GPU must not be using any of the culling's resources.
+	void SetScene(VkBuffer instanceBuffer, VkDeviceSize instanceSize, u32 entryCount, u32 maxBatches);
+
+	// The views the following frames are drawn with, one by default. View 0 is the one whose depth is
+	// in the depth buffer's layer 0. Only changes push constants, so frames already recorded are unaffected.
+	void SetViews(const CameraView* pViews, u32 viewCount);
+
+	// Starts adding the batches of the frame in 'slot', whose previous frame the caller has waited for.
+	void BeginFrame(u32 slot);
+
+	// Culls the instances of 'packet', a direct draw, into 'early' and 'late' indirect draws of the
+	// DrawPass::Opaque and DrawPass::OpaqueLate passes. The packet's instances use the entries from
+	// 'firstEntry' on, which must stay the same from frame to frame for visibility to carry over.
+	// 'radius' bounds the geometry of an instance of scale 1 in clip space.
+	void AddBatch(u32 slot, const DrawPacket& packet, u32 firstEntry, float radius, DrawPacket& early, DrawPacket& late);
+
+	// Before the early pass.
+	void RecordEarlyCull(VkCommandBuffer commandBuffer, u32 slot);
+
+	// After the early pass. 'renderExtent' is the part of the depth buffer the pass drew.
+	void RecordDepthPyramid(VkCommandBuffer commandBuffer, VkExtent2D renderExtent);
+
+	// After the depth pyramid, before the late pass.
+	void RecordLateCull(VkCommandBuffer commandBuffer, u32 slot);
+
+	// Of the frame read back by the last BeginFrame().
+	const OcclusionStats& GetStats() const { return m_stats; }
+
+	// Build the pipeline from a new shader module and return the old one, which the caller
+	// destroys once no frame in flight can still be using it.
+	VkPipeline ReplaceReducePipeline(VkShaderModule reduceShader);
+	VkPipeline ReplaceCullPipeline(VkShaderModule cullShader);
+
+private:
+	void createPyramid(VkExtent2D depthExtent);
+
+	void createPipelines(VkShaderModule reduceShader, VkShaderModule cullShader);
+
+	void createDescriptorSets();
+
+	void destroySceneBuffers();
+
+	void recordCull(VkCommandBuffer commandBuffer, u32 slot, u32 phase);
+
+	VkPhysicalDevice m_physicalDevice{ VK_NULL_HANDLE };
+	VkDevice m_device{ VK_NULL_HANDLE };
+	VkPipelineCache m_pipelineCache{ VK_NULL_HANDLE };
+	const VkAllocationCallbacks* m_pAllocator{ nullptr };
+	bool m_multiDraw{ false };
+
+	// Every view's rectangle, and the one the depth is drawn through.
+	ViewBounds m_viewBounds{ { -1.0f, -1.0f }, { 1.0f, 1.0f } };
+	CameraView m_depthCamera;
+
+	VkImage m_depthImage{ VK_NULL_HANDLE };
+	VkImageView m_depthView{ VK_NULL_HANDLE };
+	VkImageAspectFlags m_depthAspects{ 0 };
+
+	// Power of two sizes, so every level halves the one above exactly.
+	VkExtent2D m_pyramidExtent{ };
+	u32 m_pyramidLevelCount{ 0 };
+	VkImage m_pyramidImage{ VK_NULL_HANDLE };
+	VkDeviceMemory m_pyramidMemory{ VK_NULL_HANDLE };
+	// The whole chain, read by the cull shader.
+	VkImageView m_pyramidView{ VK_NULL_HANDLE };
+	// One per level, written by the reduce shader and read by the next level's.
+	std::vector<VkImageView> m_pyramidLevelViews;
+	VkSampler m_sampler{ VK_NULL_HANDLE };
+	// The pyramid starts undefined and then stays in VK_IMAGE_LAYOUT_GENERAL.
+	bool m_pyramidInitialised{ false };
+
+	VkDescriptorSetLayout m_reduceSetLayout{ VK_NULL_HANDLE };
+	VkPipelineLayout m_reduceLayout{ VK_NULL_HANDLE };
+	VkPipeline m_reducePipeline{ VK_NULL_HANDLE };
+
+	VkDescriptorSetLayout m_cullSetLayout{ VK_NULL_HANDLE };
+	VkPipelineLayout m_cullLayout{ VK_NULL_HANDLE };
+	VkPipeline m_cullPipeline{ VK_NULL_HANDLE };
+
+	VkDescriptorPool m_descriptorPool{ VK_NULL_HANDLE };
+	// Level i reads level i - 1, or the depth buffer for level 0.
+	std::vector<VkDescriptorSet> m_reduceSets;
+	// One per slot.
+	std::vector<VkDescriptorSet> m_cullSets;
+
+	VkDeviceSize m_instanceSize{ 0 };
+	u32 m_entryCount{ 0 };
+	u32 m_batchCapacity{ 0 };
+
+	VkBuffer m_visibilityBuffer{ VK_NULL_HANDLE };
+	VkDeviceMemory m_visibilityMemory{ VK_NULL_HANDLE };
+	// Cleared by the next early cull after SetScene().
+	bool m_clearVisibility{ false };
+
+	VkBuffer m_earlyInstanceBuffer{ VK_NULL_HANDLE };
+	VkDeviceMemory m_earlyInstanceMemory{ VK_NULL_HANDLE };
+	VkBuffer m_lateInstanceBuffer{ VK_NULL_HANDLE };
+	VkDeviceMemory m_lateInstanceMemory{ VK_NULL_HANDLE };
+
+	// Per slot, host visible and kept mapped.
+	struct FrameBuffers
+	{
+		VkBuffer batchBuffer;
+		VkDeviceMemory batchMemory;
+		void* pBatches;
+
+		VkBuffer commandBuffer;
+		VkDeviceMemory commandMemory;
+		void* pCommands;
+
+		u32 batchCount;
+		u32 threadCount;
+	};
+
+	std::vector<FrameBuffers> m_frames;
+
+	OcclusionStats m_stats;
+};
@@ -0,0 +1,387 @@
+#include "ParticleSystem.h"
+#include "VulkanInit.h"
+#include "Capture.h"
+
+#include <algorithm>
+#include <cmath>
+#include <cstring>
+#include <random>
+#include <stdexcept>
+
+// Matches the push constant block in Shaders/particle.comp.
+struct ParticleParams
+{
+	float deltaTime;
+	u32 particleCount;
+};
+
+static std::vector<Particle> generateParticles(u32 count, u32 seed)
+{
+	std::mt19937 rng(seed);
+	std::uniform_real_distribution<float> unit(0.0f, 1.0f);
+
+	std::vector<Particle> particles(count);
+
+	for (Particle& particle : particles)
+	{
+		// A disc around the centre, each particle already orbiting so the swirl starts straight away.
+		float angle = unit(rng) * 6.2831853f;
+		float radius = 0.1f + std::sqrt(unit(rng)) * 0.8f;
+		float speed = 0.2f + unit(rng) * 0.2f;
+
+		particle.position[0] = std::cos(angle) * radius;
+		particle.position[1] = std::sin(angle) * radius;
+		particle.velocity[0] = -std::sin(angle) * speed;
+		particle.velocity[1] = std::cos(angle) * speed;
+
+		// Blue on the inside to orange on the outside, mostly transparent so dense regions glow.
+		float t = (radius - 0.1f) / 0.8f;
+		particle.color[0] = 0.2f + 0.8f * t;
+		particle.color[1] = 0.4f + 0.1f * t;
+		particle.color[2] = 1.0f - 0.8f * t;
+		particle.color[3] = 0.35f;
+	}
+
+	return particles;
+}
+
+void ParticleSystem::Init(const ParticleSystemDesc& desc)
+{
+	m_physicalDevice = desc.physicalDevice;
+	m_device = desc.device;
+	m_graphicsFamily = desc.graphicsFamily;
+	m_computeFamily = desc.computeFamily;
+	m_pSync = desc.pSync;
+	m_pipelineCache = desc.pipelineCache;
+	m_pAllocator = desc.pAllocator;
+	m_pCapture = desc.pCapture;
+	m_particleCount = desc.particleCount;
+
+	if (m_particleCount == 0)
+	{
+		return;
+	}
+
+	createCommandObjects(desc.slotCount);
+	createBuffers(generateParticles(m_particleCount, desc.seed));
+	createDescriptorSets();
+
+	VkPushConstantRange pushConstantRange{};
+	pushConstantRange.stageFlags = VK_SHADER_STAGE_COMPUTE_BIT;
+	pushConstantRange.offset = 0;
+	pushConstantRange.size = sizeof(ParticleParams);
+
+	VkPipelineLayoutCreateInfo pipelineLayoutInfo{};
+	pipelineLayoutInfo.sType = VK_STRUCTURE_TYPE_PIPELINE_LAYOUT_CREATE_INFO;
+	pipelineLayoutInfo.setLayoutCount = 1;
+	pipelineLayoutInfo.pSetLayouts = &m_descriptorSetLayout;
+	pipelineLayoutInfo.pushConstantRangeCount = 1;
+	pipelineLayoutInfo.pPushConstantRanges = &pushConstantRange;
+
+	if (vkCreatePipelineLayout(m_device, &pipelineLayoutInfo, m_pAllocator, &m_pipelineLayout) != VK_SUCCESS)
+	{
+		throw std::runtime_error("failed to create particle pipeline layout!");
+	}
+
+	m_pipeline = VulkanInit::CreateComputePipeline(m_device, m_pipelineCache, desc.computeShader, m_pipelineLayout, nullptr, m_pAllocator);
+
+	if (m_pCapture && m_pCapture->IsOpen())
+	{
+		// The sets are captured against the pipeline, whose layout the replayer rebuilds from its binding count.
+		m_pCapture->AddComputePipeline(m_pipeline, desc.computeShader, 2, sizeof(ParticleParams));
+
+		const size_t setCount = m_descriptorSets.size();
+		for (size_t i = 0; i < setCount; i++)
+		{
+			m_pCapture->AddDescriptorSet(m_descriptorSets[i], m_pipeline, { m_buffers[(i + setCount - 1) % setCount], m_buffers[i] });
+		}
+	}
+
+	// Timestamps are written on the compute queue, so the timer must use that family's timestamp support.
+	m_timer.Init(m_physicalDevice, m_device, m_computeFamily, desc.slotCount, m_pAllocator);
+}
+
+void ParticleSystem::Destroy()
+{
+	if (m_particleCount == 0)
+	{
+		return;
+	}
+
+	m_timer.Destroy();
+
+	vkDestroyCommandPool(m_device, m_commandPool, m_pAllocator);
+	vkDestroyPipeline(m_device, m_pipeline, m_pAllocator);
+	vkDestroyPipelineLayout(m_device, m_pipelineLayout, m_pAllocator);
+	vkDestroyDescriptorPool(m_device, m_descriptorPool, m_pAllocator);
+	vkDestroyDescriptorSetLayout(m_device, m_descriptorSetLayout, m_pAllocator);
+
+	for (size_t i = 0; i < m_buffers.size(); i++)
+	{
+		if (m_pCapture && m_pCapture->IsOpen())
+		{
+			m_pCapture->DestroyBuffer(m_buffers[i]);
+		}
+
+		vkDestroyBuffer(m_device, m_buffers[i], m_pAllocator);
+		vkFreeMemory(m_device, m_bufferMemory[i], m_pAllocator);
+	}
+
+	m_buffers.clear();
+	m_bufferMemory.clear();
+	m_descriptorSets.clear();
+	m_commandBuffers.clear();
+	m_particleCount = 0;
+}
+
+SyncPoint ParticleSystem::Simulate(u32 slot, u64 frameNumber, float deltaTime)
+{
+	VkCommandBuffer commandBuffer = m_commandBuffers[slot];
+	vkResetCommandBuffer(commandBuffer, 0);
+
+	VkCommandBufferBeginInfo beginInfo{};
+	beginInfo.sType = VK_STRUCTURE_TYPE_COMMAND_BUFFER_BEGIN_INFO;
+	beginInfo.flags = VK_COMMAND_BUFFER_USAGE_ONE_TIME_SUBMIT_BIT;
+
+	if (vkBeginCommandBuffer(commandBuffer, &beginInfo) != VK_SUCCESS)
+	{
+		throw std::runtime_error("failed to begin recording particle command buffer!");
+	}
+
+	m_timer.Begin(commandBuffer, slot);
+
+	// The input buffer was written by the previous step on this same queue.
+	// Submission order alone does not make those writes visible, so wait for them explicitly.
+	VkMemoryBarrier barrier{};
+	barrier.sType = VK_STRUCTURE_TYPE_MEMORY_BARRIER;
+	barrier.srcAccessMask = VK_ACCESS_SHADER_WRITE_BIT;
+	barrier.dstAccessMask = VK_ACCESS_SHADER_READ_BIT;
+
+	vkCmdPipelineBarrier(commandBuffer, VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT, VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT, 0,
+		1, &barrier, 0, nullptr, 0, nullptr);
+
+	ParticleParams params{ deltaTime, m_particleCount };
+	VkDescriptorSet descriptorSet = m_descriptorSets[frameNumber % m_descriptorSets.size()];
+
+	vkCmdBindPipeline(commandBuffer, VK_PIPELINE_BIND_POINT_COMPUTE, m_pipeline);
+	vkCmdBindDescriptorSets(commandBuffer, VK_PIPELINE_BIND_POINT_COMPUTE, m_pipelineLayout, 0, 1, &descriptorSet, 0, nullptr);
+	vkCmdPushConstants(commandBuffer, m_pipelineLayout, VK_SHADER_STAGE_COMPUTE_BIT, 0, sizeof(params), &params);
+	const u32 groupCount = (m_particleCount + PARTICLE_WORKGROUP_SIZE - 1) / PARTICLE_WORKGROUP_SIZE;
+	vkCmdDispatch(commandBuffer, groupCount, 1, 1);
+
+	if (m_pCapture && m_pCapture->IsOpen())
+	{
+		m_pCapture->AddDispatch(m_pipeline, descriptorSet, &params, sizeof(params), groupCount, 1, 1);
+	}
+
+	m_timer.End(commandBuffer, slot);
+
+	if (vkEndCommandBuffer(commandBuffer) != VK_SUCCESS)
+	{
+		throw std::runtime_error("failed to record particle command buffer!");
+	}
+
+	// Nothing to wait for: the buffer being written was last drawn by the frame the caller has
+	// already waited for. The graphics submit waits for the returned point instead.
+	SubmitBatch batch;
+	batch.commandBufferCount = 1;
+	batch.pCommandBuffers = &commandBuffer;
+
+	return m_pSync->Submit(QueueId::Compute, batch);
+}
+
+VkPipeline ParticleSystem::ReplacePipeline(VkShaderModule computeShader)
+{
+	VkPipeline oldPipeline = m_pipeline;
+	m_pipeline = VulkanInit::CreateComputePipeline(m_device, m_pipelineCache, computeShader, m_pipelineLayout, nullptr, m_pAllocator);
+
+	if (m_pCapture && m_pCapture->IsOpen())
+	{
+		m_pCapture->AddComputePipeline(m_pipeline, computeShader, 2, sizeof(ParticleParams));
+
+		// Sets are captured against a pipeline, so they are recorded again for the new one.
+		const size_t setCount = m_descriptorSets.size();
+		for (size_t i = 0; i < setCount; i++)
+		{
+			m_pCapture->AddDescriptorSet(m_descriptorSets[i], m_pipeline, { m_buffers[(i + setCount - 1) % setCount], m_buffers[i] });
+		}
+	}
+
+	return oldPipeline;
+}
+
+void ParticleSystem::createBuffers(const std::vector<Particle>& particles)
+{
+	VkDeviceSize bufferSize = sizeof(Particle) * particles.size();
+
+	// At least two buffers, as a step can never read and write the same one.
+	size_t bufferCount = std::max<size_t>(m_commandBuffers.size(), 2);
+	m_buffers.resize(bufferCount);
+	m_bufferMemory.resize(bufferCount);
+
+	for (size_t i = 0; i < bufferCount; i++)
+	{
+		// Written by compute and read as vertex data by graphics. Shared concurrently when those
+		// are different families, which avoids an ownership transfer on both queues every frame.
+		VulkanInit::CreateBuffer(m_physicalDevice, m_device, bufferSize,
+			VK_BUFFER_USAGE_STORAGE_BUFFER_BIT | VK_BUFFER_USAGE_VERTEX_BUFFER_BIT | VK_BUFFER_USAGE_TRANSFER_DST_BIT,
+			VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT, m_buffers[i], m_bufferMemory[i], { m_graphicsFamily, m_computeFamily }, m_pAllocator);
+	}
+
+	// The buffers are device local, so the initial state goes through a staging buffer.
+	VkBuffer stagingBuffer;
+	VkDeviceMemory stagingMemory;
+	VulkanInit::CreateBuffer(m_physicalDevice, m_device, bufferSize, VK_BUFFER_USAGE_TRANSFER_SRC_BIT,
+		VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT | VK_MEMORY_PROPERTY_HOST_COHERENT_BIT, stagingBuffer, stagingMemory, { }, m_pAllocator);
+
+	void* data;
+	vkMapMemory(m_device, stagingMemory, 0, bufferSize, 0, &data);
+	memcpy(data, particles.data(), bufferSize);
+	vkUnmapMemory(m_device, stagingMemory);
+
+	// Compute queues always support transfers, so the upload uses the simulation's own pool and queue.
+	VkCommandBuffer commandBuffer = m_commandBuffers[0];
+
+	VkCommandBufferBeginInfo beginInfo{};
+	beginInfo.sType = VK_STRUCTURE_TYPE_COMMAND_BUFFER_BEGIN_INFO;
+	beginInfo.flags = VK_COMMAND_BUFFER_USAGE_ONE_TIME_SUBMIT_BIT;
+	vkBeginCommandBuffer(commandBuffer, &beginInfo);
+
+	// Every buffer starts with the same state, the first step reads the last one.
+	VkBufferCopy copyRegion{ 0, 0, bufferSize };
+	for (VkBuffer buffer : m_buffers)
+	{
+		vkCmdCopyBuffer(commandBuffer, stagingBuffer, buffer, 1, &copyRegion);
+	}
+
+	VkMemoryBarrier barrier{};
+	barrier.sType = VK_STRUCTURE_TYPE_MEMORY_BARRIER;
+	barrier.srcAccessMask = VK_ACCESS_TRANSFER_WRITE_BIT;
+	barrier.dstAccessMask = VK_ACCESS_SHADER_READ_BIT;
+
+	vkCmdPipelineBarrier(commandBuffer, VK_PIPELINE_STAGE_TRANSFER_BIT, VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT, 0,
+		1, &barrier, 0, nullptr, 0, nullptr);
+
+	vkEndCommandBuffer(commandBuffer);
+
+	SubmitBatch batch;
+	batch.commandBufferCount = 1;
+	batch.pCommandBuffers = &commandBuffer;
+
+	// Only happens at startup or when the particle count changes, so blocking on the upload is fine.
+	m_pSync->Wait(m_pSync->Submit(QueueId::Compute, batch));
+
+	vkDestroyBuffer(m_device, stagingBuffer, m_pAllocator);
+	vkFreeMemory(m_device, stagingMemory, m_pAllocator);
+
+	if (m_pCapture && m_pCapture->IsOpen())
+	{
+		// The staging buffer is not part of the replay: the first buffer carries the initial state
+		// and the rest are filled from it, which leaves them with the same contents.
+		const VkBufferUsageFlags usage = VK_BUFFER_USAGE_STORAGE_BUFFER_BIT | VK_BUFFER_USAGE_VERTEX_BUFFER_BIT |
+			VK_BUFFER_USAGE_TRANSFER_SRC_BIT | VK_BUFFER_USAGE_TRANSFER_DST_BIT;
+
+		m_pCapture->AddBuffer(m_buffers[0], bufferSize, usage, VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT, particles.data());
+		for (size_t i = 1; i < m_buffers.size(); i++)
+		{
+			m_pCapture->AddBuffer(m_buffers[i], bufferSize, usage, VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT, nullptr);
+			m_pCapture->CopyBuffer(m_buffers[0], m_buffers[i], bufferSize);
+		}
+	}
+}
+
+void ParticleSystem::createDescriptorSets()
+{
+	VkDescriptorSetLayoutBinding bindings[2]{};
+	for (u32 i = 0; i < 2; i++)
+	{
+		bindings[i].binding = i;
+		bindings[i].descriptorType = VK_DESCRIPTOR_TYPE_STORAGE_BUFFER;
+		bindings[i].descriptorCount = 1;
+		bindings[i].stageFlags = VK_SHADER_STAGE_COMPUTE_BIT;
+	}
+
+	VkDescriptorSetLayoutCreateInfo layoutInfo{};
+	layoutInfo.sType = VK_STRUCTURE_TYPE_DESCRIPTOR_SET_LAYOUT_CREATE_INFO;
+	layoutInfo.bindingCount = 2;
+	layoutInfo.pBindings = bindings;
+
+	if (vkCreateDescriptorSetLayout(m_device, &layoutInfo, m_pAllocator, &m_descriptorSetLayout) != VK_SUCCESS)
+	{
+		throw std::runtime_error("failed to create particle descriptor set layout!");
+	}
+
+	const u32 setCount = static_cast<u32>(m_buffers.size());
+
+	VkDescriptorPoolSize poolSize{};
+	poolSize.type = VK_DESCRIPTOR_TYPE_STORAGE_BUFFER;
+	poolSize.descriptorCount = setCount * 2;
+
+	VkDescriptorPoolCreateInfo poolInfo{};
+	poolInfo.sType = VK_STRUCTURE_TYPE_DESCRIPTOR_POOL_CREATE_INFO;
+	poolInfo.maxSets = setCount;
+	poolInfo.poolSizeCount = 1;
+	poolInfo.pPoolSizes = &poolSize;
+
+	if (vkCreateDescriptorPool(m_device, &poolInfo, m_pAllocator, &m_descriptorPool) != VK_SUCCESS)
+	{
+		throw std::runtime_error("failed to create particle descriptor pool!");
+	}
+
+	std::vector<VkDescriptorSetLayout> layouts(setCount, m_descriptorSetLayout);
+
+	VkDescriptorSetAllocateInfo allocInfo{};
+	allocInfo.sType = VK_STRUCTURE_TYPE_DESCRIPTOR_SET_ALLOCATE_INFO;
+	allocInfo.descriptorPool = m_descriptorPool;
+	allocInfo.descriptorSetCount = setCount;
+	allocInfo.pSetLayouts = layouts.data();
+
+	m_descriptorSets.resize(setCount);
+	if (vkAllocateDescriptorSets(m_device, &allocInfo, m_descriptorSets.data()) != VK_SUCCESS)
+	{
+		throw std::runtime_error("failed to allocate particle descriptor sets!");
+	}
+
+	for (u32 i = 0; i < setCount; i++)
+	{
+		VkDescriptorBufferInfo bufferInfos[2]{};
+		bufferInfos[0] = { m_buffers[(i + setCount - 1) % setCount], 0, VK_WHOLE_SIZE };
+		bufferInfos[1] = { m_buffers[i], 0, VK_WHOLE_SIZE };
+
+		VkWriteDescriptorSet write{};
+		write.sType = VK_STRUCTURE_TYPE_WRITE_DESCRIPTOR_SET;
+		write.dstSet = m_descriptorSets[i];
+		write.dstBinding = 0;
+		write.descriptorCount = 2;
+		write.descriptorType = VK_DESCRIPTOR_TYPE_STORAGE_BUFFER;
+		write.pBufferInfo = bufferInfos;
+
+		vkUpdateDescriptorSets(m_device, 1, &write, 0, nullptr);
+	}
+}
+
+void ParticleSystem::createCommandObjects(u32 slotCount)
+{
+	VkCommandPoolCreateInfo poolInfo{};
+	poolInfo.sType = VK_STRUCTURE_TYPE_COMMAND_POOL_CREATE_INFO;
+	poolInfo.flags = VK_COMMAND_POOL_CREATE_RESET_COMMAND_BUFFER_BIT;
+	poolInfo.queueFamilyIndex = m_computeFamily;
+
+	if (vkCreateCommandPool(m_device, &poolInfo, m_pAllocator, &m_commandPool) != VK_SUCCESS)
+	{
+		throw std::runtime_error("failed to create particle command pool!");
+	}
+
+	m_commandBuffers.resize(slotCount);
+
+	VkCommandBufferAllocateInfo allocInfo{};
+	allocInfo.sType = VK_STRUCTURE_TYPE_COMMAND_BUFFER_ALLOCATE_INFO;
+	allocInfo.commandPool = m_commandPool;
+	allocInfo.level = VK_COMMAND_BUFFER_LEVEL_PRIMARY;
+	allocInfo.commandBufferCount = slotCount;
+
+	if (vkAllocateCommandBuffers(m_device, &allocInfo, m_commandBuffers.data()) != VK_SUCCESS)
+	{
+		throw std::runtime_error("failed to allocate particle command buffers!");
+	}
+}
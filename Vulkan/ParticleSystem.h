@@ -0,0 +1,139 @@
+#pragma once
+
+#include <cstddef>
+#include <vector>
+#include <vulkan/vulkan.h>
+
+#include "Types.h"
+#include "FrameTiming.h"
+#include "QueueSync.h"
+
+class CaptureWriter;
+
+// GPU particle simulation on the async compute queue.
+//
+// Each frame's simulation step is submitted to the compute queue on its own, ahead of the
+// graphics work for the same frame, and the graphics submit waits on the compute timeline
+// value it signals at the vertex input stage. Everything the graphics queue does before that point, and the
+// whole of the previous frame still in flight, can overlap with the simulation. On devices
+// without a separate compute family the same submits go to the graphics queue instead,
+// which keeps the code path identical but serialises the work.
+//
+// The particle state lives in a ring of device local buffers, one per frame in flight (at least two).
+// Frame N reads buffer N - 1 and writes buffer N, and frame N's draw reads buffer N straight
+// as per-instance vertex data, so nothing is copied between the simulation and the draw.
+// Frame N overwrites the buffer frame N - ringSize drew from, which the caller has already
+// waited for through that frame's timeline value.
+
+// Must match local_size_x in Shaders/particle.comp.
+constexpr u32 PARTICLE_WORKGROUP_SIZE = 256;
+
+// Matches the std430 layout of Particle in Shaders/particle.comp.
+struct Particle
+{
+	float position[2];
+	float velocity[2];
+	float color[4];
+};
+
+// Vertex input layout for drawing a particle buffer, one instance per particle.
+inline constexpr VkVertexInputBindingDescription g_particleBinding{ 0, sizeof(Particle), VK_VERTEX_INPUT_RATE_INSTANCE };
+
+inline constexpr VkVertexInputAttributeDescription g_particleAttributes[]
+{
+	{ 0, 0, VK_FORMAT_R32G32_SFLOAT, offsetof(Particle, position) },
+	{ 1, 0, VK_FORMAT_R32G32B32A32_SFLOAT, offsetof(Particle, color) },
+};
+
+struct ParticleSystemDesc
+{
+	VkPhysicalDevice physicalDevice{ VK_NULL_HANDLE };
+	VkDevice device{ VK_NULL_HANDLE };
+
+	// The particle buffers are shared with the graphics family, which draws them.
+	u32 graphicsFamily{ 0 };
+	u32 computeFamily{ 0 };
+	// Submits to QueueId::Compute. Must outlive the system.
+	QueueSync* pSync{ nullptr };
+
+	VkShaderModule computeShader{ VK_NULL_HANDLE };
+	VkPipelineCache pipelineCache{ VK_NULL_HANDLE };
+
+	u32 particleCount{ 0 };
+	// Seeds the initial positions, so runs with the same seed simulate the same particles.
+	u32 seed{ 0 };
+
+	// The number of frames in flight. Command buffers and timestamps are kept per slot.
+	u32 slotCount{ 2 };
+
+	// Host allocator for every object the system creates. Must outlive the system.
+	const VkAllocationCallbacks* pAllocator{ nullptr };
+
+	// Records the simulation's buffers, pipeline and dispatches when set. Must outlive the system.
+	CaptureWriter* pCapture{ nullptr };
+};
+
+class ParticleSystem
+{
+public:
+	// Creates the buffers and uploads the initial particles. Blocks until the upload is done.
+	void Init(const ParticleSystemDesc& desc);
+
+	void Destroy();
+
+	bool IsEnabled() const { return m_particleCount > 0; }
+
+	// True when the simulation runs on a different queue family to graphics.
+	bool IsAsync() const { return m_computeFamily != m_graphicsFamily; }
+
+	u32 GetCount() const { return m_particleCount; }
+
+	// Records and submits the simulation step for 'frameNumber' on the compute queue, and returns the
+	// point it has finished writing its buffer by, which the frame's draw must wait for.
+	// Only call once the slot's last frame has been waited for.
+	SyncPoint Simulate(u32 slot, u64 frameNumber, float deltaTime);
+
+	// The buffer the step for 'frameNumber' writes, to be drawn in the same frame.
+	VkBuffer GetOutputBuffer(u64 frameNumber) const { return m_buffers[frameNumber % m_buffers.size()]; }
+
+	// GPU time of the last step submitted for this slot. Same rules as GpuTimer::Resolve.
+	bool ResolveTiming(u32 slot, double& computeMs) { return m_timer.Resolve(slot, computeMs); }
+
+	// Builds the pipeline from a new shader module and returns the old pipeline,
+	// which the caller destroys once no frame in flight can still be using it.
+	VkPipeline ReplacePipeline(VkShaderModule computeShader);
+
+private:
+	void createBuffers(const std::vector<Particle>& particles);
+
+	void createDescriptorSets();
+
+	void createCommandObjects(u32 slotCount);
+
+	VkPhysicalDevice m_physicalDevice{ VK_NULL_HANDLE };
+	VkDevice m_device{ VK_NULL_HANDLE };
+	u32 m_graphicsFamily{ 0 };
+	u32 m_computeFamily{ 0 };
+	QueueSync* m_pSync{ nullptr };
+	VkPipelineCache m_pipelineCache{ VK_NULL_HANDLE };
+	const VkAllocationCallbacks* m_pAllocator{ nullptr };
+	CaptureWriter* m_pCapture{ nullptr };
+
+	u32 m_particleCount{ 0 };
+
+	std::vector<VkBuffer> m_buffers;
+	std::vector<VkDeviceMemory> m_bufferMemory;
+
+	VkDescriptorSetLayout m_descriptorSetLayout{ VK_NULL_HANDLE };
+	VkDescriptorPool m_descriptorPool{ VK_NULL_HANDLE };
+	// Set i reads buffer i - 1 and writes buffer i.
+	std::vector<VkDescriptorSet> m_descriptorSets;
+
+	VkPipelineLayout m_pipelineLayout{ VK_NULL_HANDLE };
+	VkPipeline m_pipeline{ VK_NULL_HANDLE };
+
+	VkCommandPool m_commandPool{ VK_NULL_HANDLE };
+	std::vector<VkCommandBuffer> m_commandBuffers;
+
+	GpuTimer m_timer;
+};
@@ -0,0 +1,200 @@
+#include "QueueSync.h"
+
+#include <stdexcept>
+
+void QueueSync::Init(VkDevice device, const std::array<VkQueue, QUEUE_COUNT>& queues, const VkAllocationCallbacks* pAllocator)
+{
+	m_device = device;
+	m_pAllocator = pAllocator;
+
+	VkSemaphoreTypeCreateInfo typeInfo{};
+	typeInfo.sType = VK_STRUCTURE_TYPE_SEMAPHORE_TYPE_CREATE_INFO;
+	typeInfo.semaphoreType = VK_SEMAPHORE_TYPE_TIMELINE;
+	typeInfo.initialValue = 0;
+
+	VkSemaphoreCreateInfo semaphoreInfo{};
+	semaphoreInfo.sType = VK_STRUCTURE_TYPE_SEMAPHORE_CREATE_INFO;
+	semaphoreInfo.pNext = &typeInfo;
+
+	m_timelines.reserve(QUEUE_COUNT);
+
+	for (u32 i = 0; i < QUEUE_COUNT; i++)
+	{
+		// A queue given for more than one id keeps a single timeline, as its submits are ordered anyway.
+		u32 index = 0;
+		while (index < m_timelines.size() && m_timelines[index].queue != queues[i])
+		{
+			index++;
+		}
+
+		if (index == m_timelines.size())
+		{
+			Timeline timeline;
+			timeline.queue = queues[i];
+
+			if (vkCreateSemaphore(m_device, &semaphoreInfo, m_pAllocator, &timeline.semaphore) != VK_SUCCESS)
+			{
+				throw std::runtime_error("failed to create timeline semaphore!");
+			}
+
+			m_timelines.push_back(timeline);
+		}
+
+		m_timelineIndex[i] = index;
+	}
+}
+
+void QueueSync::Destroy()
+{
+	if (m_timelines.empty())
+	{
+		return;
+	}
+
+	WaitIdle();
+
+	for (const Timeline& timeline : m_timelines)
+	{
+		vkDestroySemaphore(m_device, timeline.semaphore, m_pAllocator);
+	}
+
+	m_timelines.clear();
+}
+
+SyncPoint QueueSync::Submit(QueueId queue, const SubmitBatch& batch)
+{
+	Timeline& target = timeline(queue);
+
+	VkSemaphore waitSemaphores[MAX_SUBMIT_WAITS];
+	u64 waitValues[MAX_SUBMIT_WAITS];
+	VkPipelineStageFlags waitStages[MAX_SUBMIT_WAITS];
+	u32 waitCount = 0;
+
+	// Binary semaphores take no value, the one given for them is ignored.
+	if (batch.binaryWait != VK_NULL_HANDLE)
+	{
+		waitSemaphores[waitCount] = batch.binaryWait;
+		waitValues[waitCount] = 0;
+		waitStages[waitCount++] = batch.binaryWaitStage;
+	}
+
+	for (u32 i = 0; i < batch.waitCount; i++)
+	{
+		const SyncPoint& wait = batch.pWaits[i];
+		if (wait.value == 0)
+		{
+			continue;
+		}
+
+		if (waitCount == MAX_SUBMIT_WAITS)
+		{
+			throw std::runtime_error("too many waits in one submit!");
+		}
+
+		waitSemaphores[waitCount] = timeline(wait.queue).semaphore;
+		waitValues[waitCount] = wait.value;
+		waitStages[waitCount++] = batch.pWaitStages[i];
+	}
+
+	const u64 signalValue = target.lastSubmitted + 1;
+
+	VkSemaphore signalSemaphores[2] = { target.semaphore, batch.binarySignal };
+	const u64 signalValues[2] = { signalValue, 0 };
+	const u32 signalCount = batch.binarySignal != VK_NULL_HANDLE ? 2 : 1;
+
+	VkTimelineSemaphoreSubmitInfo timelineInfo{};
+	timelineInfo.sType = VK_STRUCTURE_TYPE_TIMELINE_SEMAPHORE_SUBMIT_INFO;
+	timelineInfo.waitSemaphoreValueCount = waitCount;
+	timelineInfo.pWaitSemaphoreValues = waitValues;
+	timelineInfo.signalSemaphoreValueCount = signalCount;
+	timelineInfo.pSignalSemaphoreValues = signalValues;
+
+	VkSubmitInfo submitInfo{};
+	submitInfo.sType = VK_STRUCTURE_TYPE_SUBMIT_INFO;
+	submitInfo.pNext = &timelineInfo;
+	submitInfo.waitSemaphoreCount = waitCount;
+	submitInfo.pWaitSemaphores = waitSemaphores;
+	submitInfo.pWaitDstStageMask = waitStages;
+	submitInfo.commandBufferCount = batch.commandBufferCount;
+	submitInfo.pCommandBuffers = batch.pCommandBuffers;
+	submitInfo.signalSemaphoreCount = signalCount;
+	submitInfo.pSignalSemaphores = signalSemaphores;
+
+	if (vkQueueSubmit(target.queue, 1, &submitInfo, VK_NULL_HANDLE) != VK_SUCCESS)
+	{
+		throw std::runtime_error("failed to submit to queue!");
+	}
+
+	target.lastSubmitted = signalValue;
+
+	return { queue, signalValue };
+}
+
+ResourceUse QueueSync::GetLastSubmitted() const
+{
+	ResourceUse use;
+	for (u32 i = 0; i < QUEUE_COUNT; i++)
+	{
+		use.values[i] = timeline(static_cast<QueueId>(i)).lastSubmitted;
+	}
+	return use;
+}
+
+bool QueueSync::IsComplete(SyncPoint point)
+{
+	Timeline& target = timeline(point.queue);
+	if (point.value <= target.completed)
+	{
+		return true;
+	}
+
+	vkGetSemaphoreCounterValue(m_device, target.semaphore, &target.completed);
+	return point.value <= target.completed;
+}
+
+bool QueueSync::IsComplete(const ResourceUse& use)
+{
+	for (u32 i = 0; i < QUEUE_COUNT; i++)
+	{
+		if (!IsComplete({ static_cast<QueueId>(i), use.values[i] }))
+		{
+			return false;
+		}
+	}
+	return true;
+}
+
+void QueueSync::Wait(SyncPoint point)
+{
+	Timeline& target = timeline(point.queue);
+	if (point.value <= target.completed)
+	{
+		return;
+	}
+
+	VkSemaphoreWaitInfo waitInfo{};
+	waitInfo.sType = VK_STRUCTURE_TYPE_SEMAPHORE_WAIT_INFO;
+	waitInfo.semaphoreCount = 1;
+	waitInfo.pSemaphores = &target.semaphore;
+	waitInfo.pValues = &point.value;
+
+	if (vkWaitSemaphores(m_device, &waitInfo, UINT64_MAX) != VK_SUCCESS)
+	{
+		throw std::runtime_error("failed to wait for timeline semaphore!");
+	}
+
+	target.completed = point.value;
+}
+
+void QueueSync::Wait(const ResourceUse& use)
+{
+	for (u32 i = 0; i < QUEUE_COUNT; i++)
+	{
+		Wait({ static_cast<QueueId>(i), use.values[i] });
+	}
+}
+
+void QueueSync::WaitIdle()
+{
+	Wait(GetLastSubmitted());
+}
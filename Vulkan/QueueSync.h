@@ -0,0 +1,129 @@
+#pragma once
+
+#include <array>
+#include <vector>
+#include <vulkan/vulkan.h>
+
+#include "Types.h"
+
+// CPU/GPU synchronisation through one timeline semaphore per queue.
+//
+// Every submit made through QueueSync signals its queue's timeline with the next value, one more than
+// the last, so a value names exactly the work submitted up to and including that submit. That one
+// counter per queue replaces a fence per submit and a binary semaphore per queue to queue dependency:
+//
+// - A submit that depends on another queue's work waits for that queue's value, at the stage that needs it.
+// - The CPU waits for exactly the value it needs, e.g. a frame slot's last frame, rather than a fence
+//   that may cover more work than that, and nothing has to be reset before it is reused.
+// - A resource remembers the value of each queue that last used it (ResourceUse), and is destroyed
+//   once every queue has passed those values, rather than after waiting for the device to go idle.
+//
+// Devices without a separate compute or transfer family run that work on the graphics queue. The queue
+// ids then share the graphics queue's timeline, so values stay in submission order whichever id is used.
+//
+// Binary semaphores are only left for the swapchain, whose acquire and present cannot use timelines.
+
+enum class QueueId : u32
+{
+	Graphics,
+	Compute,
+	Transfer,
+	Count
+};
+
+constexpr u32 QUEUE_COUNT = static_cast<u32>(QueueId::Count);
+
+// The point a queue's timeline reaches once its submit with 'value' has finished. Value 0 is always reached.
+struct SyncPoint
+{
+	QueueId queue{ QueueId::Graphics };
+	u64 value{ 0 };
+};
+
+// Where a resource was last used on each queue, 0 for queues that have not used it.
+struct ResourceUse
+{
+	std::array<u64, QUEUE_COUNT> values{ };
+
+	void Add(SyncPoint point)
+	{
+		u64& value = values[static_cast<u32>(point.queue)];
+		value = point.value > value ? point.value : value;
+	}
+};
+
+// Most a single submit can wait on: the swapchain image, plus a value of each queue.
+constexpr u32 MAX_SUBMIT_WAITS = QUEUE_COUNT + 1;
+
+// One batch of command buffers for QueueSync::Submit.
+struct SubmitBatch
+{
+	u32 commandBufferCount{ 0 };
+	const VkCommandBuffer* pCommandBuffers{ nullptr };
+
+	// Other work the batch waits for, each at its own stage. Points whose value is 0 are skipped.
+	u32 waitCount{ 0 };
+	const SyncPoint* pWaits{ nullptr };
+	const VkPipelineStageFlags* pWaitStages{ nullptr };
+
+	// Swapchain semaphores, VK_NULL_HANDLE for none.
+	VkSemaphore binaryWait{ VK_NULL_HANDLE };
+	VkPipelineStageFlags binaryWaitStage{ 0 };
+	VkSemaphore binarySignal{ VK_NULL_HANDLE };
+};
+
+class QueueSync
+{
+public:
+	// 'queues' is indexed by QueueId. Queues given more than once share one timeline.
+	void Init(VkDevice device, const std::array<VkQueue, QUEUE_COUNT>& queues, const VkAllocationCallbacks* pAllocator);
+
+	// Waits for every queue to finish what was submitted through it first.
+	void Destroy();
+
+	VkQueue GetQueue(QueueId queue) const { return timeline(queue).queue; }
+
+	// Submits the batch to the queue and returns the point it signals. Throws if the submit fails.
+	SyncPoint Submit(QueueId queue, const SubmitBatch& batch);
+
+	// The point of the last submit to the queue, which every earlier one is also complete by.
+	SyncPoint GetLastSubmitted(QueueId queue) const { return { queue, timeline(queue).lastSubmitted }; }
+
+	// The last submit to each queue, what anything used up to now was last used by.
+	ResourceUse GetLastSubmitted() const;
+
+	// Never blocks. Only asks the driver when the last value it reported is not enough.
+	bool IsComplete(SyncPoint point);
+
+	bool IsComplete(const ResourceUse& use);
+
+	// Blocks until the point is reached. Returns straight away when it already has been.
+	void Wait(SyncPoint point);
+
+	void Wait(const ResourceUse& use);
+
+	// Waits for everything submitted through QueueSync so far. Unlike vkDeviceWaitIdle this leaves out
+	// presentation, and work other queues were given directly.
+	void WaitIdle();
+
+private:
+	struct Timeline
+	{
+		VkQueue queue{ VK_NULL_HANDLE };
+		VkSemaphore semaphore{ VK_NULL_HANDLE };
+		u64 lastSubmitted{ 0 };
+		// The highest value the driver has reported as reached, so most checks need not ask it.
+		u64 completed{ 0 };
+	};
+
+	Timeline& timeline(QueueId queue) { return m_timelines[m_timelineIndex[static_cast<u32>(queue)]]; }
+
+	const Timeline& timeline(QueueId queue) const { return m_timelines[m_timelineIndex[static_cast<u32>(queue)]]; }
+
+	VkDevice m_device{ VK_NULL_HANDLE };
+	const VkAllocationCallbacks* m_pAllocator{ nullptr };
+
+	// One per distinct queue.
+	std::vector<Timeline> m_timelines;
+	std::array<u32, QUEUE_COUNT> m_timelineIndex{ };
+};
@@ -0,0 +1,1097 @@
+// Headless replay of a captured session.
+//
+// Plays back a file written with AppConfig::capturePath (VULKAN_CAPTURE=<path> for the app,
+// --capture <path> for VulkanBench) without the app, its window or its scene generation, and reports
+// the CPU and GPU frame times in the same JSON format as the benchmark. Given a baseline report
+// it also fails on a regression, so a capture of a real session can be used as a fixed workload
+// when checking a renderer change.
+//
+// Resources are rebuilt from the capture with VulkanInit, the same functions the app creates
+// them with, and each frame's draws go through DrawQueue exactly as in the app, so changes to
+// sorting or recording show up in the replay's times. What is replayed is the renderer's own
+// packets, not the app's raw command buffers:
+//  - Dispatches are recorded into the frame's graphics command buffer, ahead of the render pass,
+//    instead of on an async compute queue. Their GPU time is reported separately as "compute".
+//  - The scene is drawn straight into an output sized image. With dynamic resolution only the
+//    captured render area is drawn and the upscale is not replayed.
+//  - Lights are not captured, so the lit shaders read empty light clusters.
+
+#include <vulkan/vulkan.h>
+
+#include <algorithm>
+#include <array>
+#include <chrono>
+#include <cstdlib>
+#include <cstring>
+#include <iostream>
+#include <stdexcept>
+#include <string>
+#include <unordered_map>
+#include <vector>
+
+#include "Capture.h"
+#include "VulkanInit.h"
+#include "FrameTiming.h"
+#include "DrawQueue.h"
+#include "BenchmarkReport.h"
+#include "ClusteredLighting.h"
+#include "QueueSync.h"
+#include "SceneViews.h"
+
+constexpr u32 REPLAY_FRAMES_IN_FLIGHT = 2;
+
+struct ReplayOptions
+{
+	std::string capturePath;
+	// Frames at the start of the capture that are replayed but not measured.
+	u32 warmupFrames{ 60 };
+	std::string outputPath{ "replay.json" };
+	std::string baselinePath;
+	RegressionThresholds thresholds;
+	bool enableValidation{ false };
+	// See VulkanInit::DeviceSelection::preferred.
+	std::string device;
+};
+
+class Replayer
+{
+public:
+	void Init(const CaptureHeader& header, const ReplayOptions& options);
+
+	void Destroy();
+
+	// Creates the resource or submits the frame the record describes. Frames are not waited on,
+	// up to REPLAY_FRAMES_IN_FLIGHT of them are in flight at once as in the app.
+	void Execute(const CaptureRecord& record);
+
+	// Waits for every submitted frame and resolves its GPU times.
+	void WaitIdle();
+
+	std::string GetDeviceName() const;
+
+	const FrameTimings& GetTimings() const { return m_timings; }
+
+	u64 GetFrameCount() const { return m_frameNumber; }
+
+	// Totals over the measured frames.
+	u64 GetMeasuredFrameCount() const { return m_measuredFrames; }
+	const DrawStats& GetDrawTotals() const { return m_drawTotals; }
+	u64 GetDispatchTotal() const { return m_dispatchTotal; }
+
+private:
+	struct Buffer
+	{
+		VkBuffer handle;
+		VkDeviceMemory memory;
+	};
+
+	struct ComputePipeline
+	{
+		VkPipeline handle;
+		VkDescriptorSetLayout setLayout;
+		VkPipelineLayout layout;
+		u32 storageBufferCount;
+	};
+
+	struct DescriptorSet
+	{
+		VkDescriptorPool pool;
+		VkDescriptorSet handle;
+	};
+
+	// Returns the object for a captured id, or a null object for id 0. Throws for an id the capture never created.
+	template<typename T>
+	static T find(const std::unordered_map<u32, T>& objects, u32 id, const char* what)
+	{
+		if (id == 0)
+		{
+			return T{ };
+		}
+
+		auto found = objects.find(id);
+		if (found == objects.end())
+		{
+			throw std::runtime_error(std::string("capture references an unknown ") + what + "!");
+		}
+
+		return found->second;
+	}
+
+	void createTargets();
+
+	// Records 'record' into a one time command buffer, submits it and waits for it.
+	template<typename Record>
+	void submitOneTime(Record record);
+
+	void createBuffer(const CaptureBuffer& buffer);
+
+	void copyBuffer(const CaptureBufferCopy& copy);
+
+	void destroyBuffer(u32 id);
+
+	void createGraphicsPipeline(const CaptureGraphicsPipeline& pipeline);
+
+	void createComputePipeline(const CaptureComputePipeline& pipeline);
+
+	void createDescriptorSet(const CaptureDescriptorSet& descriptorSet);
+
+	void drawFrame(const CaptureFrame& frame);
+
+	void recordDispatches(VkCommandBuffer commandBuffer, const CaptureFrame& frame);
+
+	// Reads back the GPU times of the last frame submitted in this slot, once it has been waited for.
+	void resolveTimings(u32 slot);
+
+	CaptureHeader m_header;
+	u32 m_warmupFrames{ 0 };
+	bool m_enableValidation{ false };
+
+	VkInstance m_instance{ VK_NULL_HANDLE };
+	VkDebugUtilsMessengerEXT m_debugMessenger{ VK_NULL_HANDLE };
+	VkPhysicalDevice m_physicalDevice{ VK_NULL_HANDLE };
+	VulkanInit::DeviceProfile m_deviceProfile;
+	VkDevice m_device{ VK_NULL_HANDLE };
+	VkQueue m_queue{ VK_NULL_HANDLE };
+	u32 m_queueFamily{ 0 };
+	// Everything is replayed on the graphics queue, so every queue id shares its timeline.
+	QueueSync m_sync;
+
+	VkRenderPass m_renderPass{ VK_NULL_HANDLE };
+	// Graphics pipelines in the app use the light clusters as set 0, and no push constants.
+	VkPipelineLayout m_graphicsLayout{ VK_NULL_HANDLE };
+	// Never given any lights, it only keeps the clusters the lit shaders read empty.
+	ClusteredLighting m_lighting;
+
+	// Stand ins for the app's output images, one per frame in flight.
+	std::array<VkImage, REPLAY_FRAMES_IN_FLIGHT> m_images{ };
+	std::array<VkDeviceMemory, REPLAY_FRAMES_IN_FLIGHT> m_imageMemory{ };
+	std::array<VkImageView, REPLAY_FRAMES_IN_FLIGHT> m_imageViews{ };
+	std::array<VkFramebuffer, REPLAY_FRAMES_IN_FLIGHT> m_framebuffers{ };
+
+	VkCommandPool m_commandPool{ VK_NULL_HANDLE };
+	std::array<VkCommandBuffer, REPLAY_FRAMES_IN_FLIGHT> m_commandBuffers{ };
+	// The point of the last frame submitted in each slot.
+	std::array<SyncPoint, REPLAY_FRAMES_IN_FLIGHT> m_framePoints{ };
+	// The frame number last submitted in each slot, so timings of warmup frames can be dropped.
+	std::array<u64, REPLAY_FRAMES_IN_FLIGHT> m_slotFrames{ };
+
+	GpuTimer m_gpuTimer;
+	GpuTimer m_computeTimer;
+
+	std::unordered_map<u32, Buffer> m_buffers;
+	std::unordered_map<u32, VkShaderModule> m_shaderModules;
+	std::unordered_map<u32, VkPipeline> m_graphicsPipelines;
+	std::unordered_map<u32, ComputePipeline> m_computePipelines;
+	std::unordered_map<u32, DescriptorSet> m_descriptorSets;
+
+	DrawQueue m_drawQueue;
+
+	u32 m_currentFrame{ 0 };
+	u64 m_frameNumber{ 0 };
+
+	FrameTimings m_timings;
+	u64 m_measuredFrames{ 0 };
+	DrawStats m_drawTotals;
+	u64 m_dispatchTotal{ 0 };
+};
+
+void Replayer::Init(const CaptureHeader& header, const ReplayOptions& options)
+{
+	m_header = header;
+	m_warmupFrames = options.warmupFrames;
+	m_enableValidation = options.enableValidation;
+
+	VulkanInit::InstanceSettings instanceSettings;
+	instanceSettings.enableValidation = m_enableValidation;
+	m_instance = VulkanInit::CreateInstance(instanceSettings);
+
+	if (m_enableValidation)
+	{
+		m_debugMessenger = VulkanInit::CreateDebugMessenger(m_instance);
+	}
+
+	// No surface and no device extensions, as for the app's headless mode.
+	VulkanInit::DeviceSelection selection;
+	selection.preferred = options.device;
+	m_deviceProfile = VulkanInit::PickPhysicalDevice(m_instance, VK_NULL_HANDLE, { }, selection);
+	m_physicalDevice = m_deviceProfile.device;
+
+	VulkanInit::LogicalDevice logicalDevice = VulkanInit::CreateLogicalDevice(m_deviceProfile, { }, m_enableValidation);
+	m_device = logicalDevice.device;
+	m_queue = logicalDevice.graphicsQueue;
+	m_queueFamily = logicalDevice.queueFamilies.graphicsFamily.value();
+
+	m_sync.Init(m_device, { m_queue, m_queue, m_queue }, nullptr);
+
+	m_renderPass = VulkanInit::CreateRenderPass(m_device, m_header.colorFormat, VK_IMAGE_LAYOUT_TRANSFER_SRC_OPTIMAL);
+
+	ClusteredLightingDesc lightingDesc;
+	lightingDesc.physicalDevice = m_physicalDevice;
+	lightingDesc.device = m_device;
+	lightingDesc.slotCount = REPLAY_FRAMES_IN_FLIGHT;
+	m_lighting.Init(lightingDesc);
+
+	VkDescriptorSetLayout lightingSetLayout = m_lighting.GetSetLayout();
+
+	// The app's vertex shaders read their views from push constants, see SceneViews.h.
+	VkPushConstantRange viewRange{};
+	viewRange.stageFlags = VK_SHADER_STAGE_VERTEX_BIT;
+	viewRange.offset = 0;
+	viewRange.size = sizeof(ViewConstants);
+
+	VkPipelineLayoutCreateInfo pipelineLayoutInfo{};
+	pipelineLayoutInfo.sType = VK_STRUCTURE_TYPE_PIPELINE_LAYOUT_CREATE_INFO;
+	pipelineLayoutInfo.setLayoutCount = 1;
+	pipelineLayoutInfo.pSetLayouts = &lightingSetLayout;
+	pipelineLayoutInfo.pushConstantRangeCount = 1;
+	pipelineLayoutInfo.pPushConstantRanges = &viewRange;
+
+	if (vkCreatePipelineLayout(m_device, &pipelineLayoutInfo, nullptr, &m_graphicsLayout) != VK_SUCCESS)
+	{
+		throw std::runtime_error("failed to create pipeline layout!");
+	}
+
+	createTargets();
+
+	VkCommandPoolCreateInfo poolInfo{};
+	poolInfo.sType = VK_STRUCTURE_TYPE_COMMAND_POOL_CREATE_INFO;
+	poolInfo.flags = VK_COMMAND_POOL_CREATE_RESET_COMMAND_BUFFER_BIT;
+	poolInfo.queueFamilyIndex = m_queueFamily;
+
+	if (vkCreateCommandPool(m_device, &poolInfo, nullptr, &m_commandPool) != VK_SUCCESS)
+	{
+		throw std::runtime_error("failed to create command pool!");
+	}
+
+	VkCommandBufferAllocateInfo allocInfo{};
+	allocInfo.sType = VK_STRUCTURE_TYPE_COMMAND_BUFFER_ALLOCATE_INFO;
+	allocInfo.commandPool = m_commandPool;
+	allocInfo.level = VK_COMMAND_BUFFER_LEVEL_PRIMARY;
+	allocInfo.commandBufferCount = REPLAY_FRAMES_IN_FLIGHT;
+
+	if (vkAllocateCommandBuffers(m_device, &allocInfo, m_commandBuffers.data()) != VK_SUCCESS)
+	{
+		throw std::runtime_error("failed to allocate command buffers!");
+	}
+
+	m_gpuTimer.Init(m_physicalDevice, m_device, m_queueFamily, REPLAY_FRAMES_IN_FLIGHT);
+	m_computeTimer.Init(m_physicalDevice, m_device, m_queueFamily, REPLAY_FRAMES_IN_FLIGHT);
+}
+
+void Replayer::Destroy()
+{
+	m_computeTimer.Destroy();
+	m_gpuTimer.Destroy();
+
+	for (const auto& [id, descriptorSet] : m_descriptorSets)
+	{
+		vkDestroyDescriptorPool(m_device, descriptorSet.pool, nullptr);
+	}
+
+	for (const auto& [id, pipeline] : m_computePipelines)
+	{
+		vkDestroyPipeline(m_device, pipeline.handle, nullptr);
+		vkDestroyPipelineLayout(m_device, pipeline.layout, nullptr);
+		vkDestroyDescriptorSetLayout(m_device, pipeline.setLayout, nullptr);
+	}
+
+	for (const auto& [id, pipeline] : m_graphicsPipelines)
+	{
+		vkDestroyPipeline(m_device, pipeline, nullptr);
+	}
+
+	for (const auto& [id, shaderModule] : m_shaderModules)
+	{
+		vkDestroyShaderModule(m_device, shaderModule, nullptr);
+	}
+
+	for (const auto& [id, buffer] : m_buffers)
+	{
+		vkDestroyBuffer(m_device, buffer.handle, nullptr);
+		vkFreeMemory(m_device, buffer.memory, nullptr);
+	}
+
+	m_descriptorSets.clear();
+	m_computePipelines.clear();
+	m_graphicsPipelines.clear();
+	m_shaderModules.clear();
+	m_buffers.clear();
+
+	vkDestroyCommandPool(m_device, m_commandPool, nullptr);
+
+	for (u32 i = 0; i < REPLAY_FRAMES_IN_FLIGHT; i++)
+	{
+		vkDestroyFramebuffer(m_device, m_framebuffers[i], nullptr);
+		vkDestroyImageView(m_device, m_imageViews[i], nullptr);
+		vkDestroyImage(m_device, m_images[i], nullptr);
+		vkFreeMemory(m_device, m_imageMemory[i], nullptr);
+	}
+
+	vkDestroyPipelineLayout(m_device, m_graphicsLayout, nullptr);
+	m_lighting.Destroy();
+	vkDestroyRenderPass(m_device, m_renderPass, nullptr);
+	m_sync.Destroy();
+	vkDestroyDevice(m_device, nullptr);
+
+	if (m_enableValidation)
+	{
+		DestroyDebugUtilsMessengerEXT(m_instance, m_debugMessenger, nullptr);
+	}
+
+	vkDestroyInstance(m_instance, nullptr);
+}
+
+void Replayer::Execute(const CaptureRecord& record)
+{
+	switch (record.type)
+	{
+	case CaptureRecordType::Buffer:
+		createBuffer(record.buffer);
+		break;
+	case CaptureRecordType::BufferCopy:
+		copyBuffer(record.bufferCopy);
+		break;
+	case CaptureRecordType::DestroyBuffer:
+		destroyBuffer(record.destroyedBuffer);
+		break;
+	case CaptureRecordType::ShaderModule:
+		m_shaderModules[record.shaderModule.id] = VulkanInit::CreateShaderModule(m_device,
+			record.shaderModule.spirv.data(), record.shaderModule.spirv.size() * sizeof(u32));
+		break;
+	case CaptureRecordType::GraphicsPipeline:
+		createGraphicsPipeline(record.graphicsPipeline);
+		break;
+	case CaptureRecordType::ComputePipeline:
+		createComputePipeline(record.computePipeline);
+		break;
+	case CaptureRecordType::DescriptorSet:
+		createDescriptorSet(record.descriptorSet);
+		break;
+	case CaptureRecordType::Frame:
+		drawFrame(record.frame);
+		break;
+	}
+}
+
+void Replayer::WaitIdle()
+{
+	m_sync.WaitIdle();
+
+	for (u32 slot = 0; slot < REPLAY_FRAMES_IN_FLIGHT; slot++)
+	{
+		resolveTimings(slot);
+	}
+}
+
+std::string Replayer::GetDeviceName() const
+{
+	return m_deviceProfile.properties.deviceName;
+}
+
+void Replayer::createTargets()
+{
+	for (u32 i = 0; i < REPLAY_FRAMES_IN_FLIGHT; i++)
+	{
+		VkImageCreateInfo imageInfo{};
+		imageInfo.sType = VK_STRUCTURE_TYPE_IMAGE_CREATE_INFO;
+		imageInfo.imageType = VK_IMAGE_TYPE_2D;
+		imageInfo.format = m_header.colorFormat;
+		imageInfo.extent = { m_header.width, m_header.height, 1 };
+		imageInfo.mipLevels = 1;
+		imageInfo.arrayLayers = 1;
+		imageInfo.samples = VK_SAMPLE_COUNT_1_BIT;
+		imageInfo.tiling = VK_IMAGE_TILING_OPTIMAL;
+		imageInfo.usage = VK_IMAGE_USAGE_COLOR_ATTACHMENT_BIT | VK_IMAGE_USAGE_TRANSFER_SRC_BIT;
+		imageInfo.sharingMode = VK_SHARING_MODE_EXCLUSIVE;
+		imageInfo.initialLayout = VK_IMAGE_LAYOUT_UNDEFINED;
+
+		if (vkCreateImage(m_device, &imageInfo, nullptr, &m_images[i]) != VK_SUCCESS)
+		{
+			throw std::runtime_error("failed to create replay target!");
+		}
+
+		VkMemoryRequirements memRequirements;
+		vkGetImageMemoryRequirements(m_device, m_images[i], &memRequirements);
+
+		VkMemoryAllocateInfo allocInfo{};
+		allocInfo.sType = VK_STRUCTURE_TYPE_MEMORY_ALLOCATE_INFO;
+		allocInfo.allocationSize = memRequirements.size;
+		allocInfo.memoryTypeIndex = VulkanInit::FindMemoryType(m_physicalDevice, memRequirements.memoryTypeBits, VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT);
+
+		if (vkAllocateMemory(m_device, &allocInfo, nullptr, &m_imageMemory[i]) != VK_SUCCESS)
+		{
+			throw std::runtime_error("failed to allocate replay target memory!");
+		}
+
+		vkBindImageMemory(m_device, m_images[i], m_imageMemory[i], 0);
+
+		VkImageViewCreateInfo viewInfo{};
+		viewInfo.sType = VK_STRUCTURE_TYPE_IMAGE_VIEW_CREATE_INFO;
+		viewInfo.image = m_images[i];
+		viewInfo.viewType = VK_IMAGE_VIEW_TYPE_2D;
+		viewInfo.format = m_header.colorFormat;
+		viewInfo.subresourceRange = { VK_IMAGE_ASPECT_COLOR_BIT, 0, 1, 0, 1 };
+
+		if (vkCreateImageView(m_device, &viewInfo, nullptr, &m_imageViews[i]) != VK_SUCCESS)
+		{
+			throw std::runtime_error("failed to create replay target view!");
+		}
+
+		VkFramebufferCreateInfo framebufferInfo{};
+		framebufferInfo.sType = VK_STRUCTURE_TYPE_FRAMEBUFFER_CREATE_INFO;
+		framebufferInfo.renderPass = m_renderPass;
+		framebufferInfo.attachmentCount = 1;
+		framebufferInfo.pAttachments = &m_imageViews[i];
+		framebufferInfo.width = m_header.width;
+		framebufferInfo.height = m_header.height;
+		framebufferInfo.layers = 1;
+
+		if (vkCreateFramebuffer(m_device, &framebufferInfo, nullptr, &m_framebuffers[i]) != VK_SUCCESS)
+		{
+			throw std::runtime_error("failed to create replay framebuffer!");
+		}
+	}
+}
+
+template<typename Record>
+void Replayer::submitOneTime(Record record)
+{
+	VkCommandBufferAllocateInfo allocInfo{};
+	allocInfo.sType = VK_STRUCTURE_TYPE_COMMAND_BUFFER_ALLOCATE_INFO;
+	allocInfo.commandPool = m_commandPool;
+	allocInfo.level = VK_COMMAND_BUFFER_LEVEL_PRIMARY;
+	allocInfo.commandBufferCount = 1;
+
+	VkCommandBuffer commandBuffer;
+	if (vkAllocateCommandBuffers(m_device, &allocInfo, &commandBuffer) != VK_SUCCESS)
+	{
+		throw std::runtime_error("failed to allocate upload command buffer!");
+	}
+
+	VkCommandBufferBeginInfo beginInfo{};
+	beginInfo.sType = VK_STRUCTURE_TYPE_COMMAND_BUFFER_BEGIN_INFO;
+	beginInfo.flags = VK_COMMAND_BUFFER_USAGE_ONE_TIME_SUBMIT_BIT;
+	vkBeginCommandBuffer(commandBuffer, &beginInfo);
+
+	record(commandBuffer);
+
+	// Whatever reads the result next, in a later submit, sees the transfer's writes.
+	VkMemoryBarrier barrier{};
+	barrier.sType = VK_STRUCTURE_TYPE_MEMORY_BARRIER;
+	barrier.srcAccessMask = VK_ACCESS_TRANSFER_WRITE_BIT;
+	barrier.dstAccessMask = VK_ACCESS_MEMORY_READ_BIT | VK_ACCESS_MEMORY_WRITE_BIT;
+
+	vkCmdPipelineBarrier(commandBuffer, VK_PIPELINE_STAGE_TRANSFER_BIT, VK_PIPELINE_STAGE_ALL_COMMANDS_BIT, 0,
+		1, &barrier, 0, nullptr, 0, nullptr);
+
+	vkEndCommandBuffer(commandBuffer);
+
+	SubmitBatch batch;
+	batch.commandBufferCount = 1;
+	batch.pCommandBuffers = &commandBuffer;
+
+	// Resources are created between frames as in the app, so waiting for the upload is fine here too.
+	m_sync.Wait(m_sync.Submit(QueueId::Graphics, batch));
+
+	vkFreeCommandBuffers(m_device, m_commandPool, 1, &commandBuffer);
+}
+
+void Replayer::createBuffer(const CaptureBuffer& capture)
+{
+	// Transfer usage is added to every buffer, so any of them can be the source or destination of a BufferCopy.
+	const VkBufferUsageFlags usage = capture.usage | VK_BUFFER_USAGE_TRANSFER_SRC_BIT | VK_BUFFER_USAGE_TRANSFER_DST_BIT;
+
+	Buffer buffer;
+	VulkanInit::CreateBuffer(m_physicalDevice, m_device, capture.size, usage, capture.memoryProperties, buffer.handle, buffer.memory);
+	m_buffers[capture.id] = buffer;
+
+	if (capture.data.empty())
+	{
+		return;
+	}
+
+	const VkDeviceSize dataSize = std::min<VkDeviceSize>(capture.data.size(), capture.size);
+
+	if (capture.memoryProperties & VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT)
+	{
+		void* data;
+		vkMapMemory(m_device, buffer.memory, 0, dataSize, 0, &data);
+		memcpy(data, capture.data.data(), dataSize);
+		vkUnmapMemory(m_device, buffer.memory);
+		return;
+	}
+
+	VkBuffer stagingBuffer;
+	VkDeviceMemory stagingMemory;
+	VulkanInit::CreateBuffer(m_physicalDevice, m_device, dataSize, VK_BUFFER_USAGE_TRANSFER_SRC_BIT,
+		VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT | VK_MEMORY_PROPERTY_HOST_COHERENT_BIT, stagingBuffer, stagingMemory);
+
+	void* data;
+	vkMapMemory(m_device, stagingMemory, 0, dataSize, 0, &data);
+	memcpy(data, capture.data.data(), dataSize);
+	vkUnmapMemory(m_device, stagingMemory);
+
+	submitOneTime([&](VkCommandBuffer commandBuffer)
+	{
+		VkBufferCopy copyRegion{ 0, 0, dataSize };
+		vkCmdCopyBuffer(commandBuffer, stagingBuffer, buffer.handle, 1, &copyRegion);
+	});
+
+	vkDestroyBuffer(m_device, stagingBuffer, nullptr);
+	vkFreeMemory(m_device, stagingMemory, nullptr);
+}
+
+void Replayer::copyBuffer(const CaptureBufferCopy& copy)
+{
+	Buffer src = find(m_buffers, copy.srcBuffer, "buffer");
+	Buffer dst = find(m_buffers, copy.dstBuffer, "buffer");
+
+	submitOneTime([&](VkCommandBuffer commandBuffer)
+	{
+		VkBufferCopy copyRegion{ 0, 0, copy.size };
+		vkCmdCopyBuffer(commandBuffer, src.handle, dst.handle, 1, &copyRegion);
+	});
+}
+
+void Replayer::destroyBuffer(u32 id)
+{
+	Buffer buffer = find(m_buffers, id, "buffer");
+
+	// The app retires buffers until the frames using them finish, which waiting for them all matches closely enough.
+	m_sync.WaitIdle();
+
+	vkDestroyBuffer(m_device, buffer.handle, nullptr);
+	vkFreeMemory(m_device, buffer.memory, nullptr);
+	m_buffers.erase(id);
+}
+
+void Replayer::createGraphicsPipeline(const CaptureGraphicsPipeline& capture)
+{
+	VkSpecializationInfo specializationInfo{};
+	specializationInfo.mapEntryCount = static_cast<u32>(capture.specializationEntries.size());
+	specializationInfo.pMapEntries = capture.specializationEntries.data();
+	specializationInfo.dataSize = capture.specializationData.size();
+	specializationInfo.pData = capture.specializationData.data();
+
+	VulkanInit::GraphicsPipelineDesc desc;
+	desc.vertShader = find(m_shaderModules, capture.vertShader, "shader module");
+	desc.fragShader = find(m_shaderModules, capture.fragShader, "shader module");
+	desc.pSpecializationInfo = capture.specializationEntries.empty() ? nullptr : &specializationInfo;
+
+	desc.vertexBindingCount = static_cast<u32>(capture.vertexBindings.size());
+	desc.pVertexBindings = capture.vertexBindings.data();
+	desc.vertexAttributeCount = static_cast<u32>(capture.vertexAttributes.size());
+	desc.pVertexAttributes = capture.vertexAttributes.data();
+
+	desc.layout = m_graphicsLayout;
+	desc.renderPass = m_renderPass;
+
+	m_graphicsPipelines[capture.id] = VulkanInit::CreateGraphicsPipeline(m_device, VK_NULL_HANDLE, desc);
+}
+
+void Replayer::createComputePipeline(const CaptureComputePipeline& capture)
+{
+	ComputePipeline pipeline{};
+	pipeline.storageBufferCount = capture.storageBufferCount;
+
+	std::vector<VkDescriptorSetLayoutBinding> bindings(capture.storageBufferCount);
+	for (u32 i = 0; i < capture.storageBufferCount; i++)
+	{
+		bindings[i].binding = i;
+		bindings[i].descriptorType = VK_DESCRIPTOR_TYPE_STORAGE_BUFFER;
+		bindings[i].descriptorCount = 1;
+		bindings[i].stageFlags = VK_SHADER_STAGE_COMPUTE_BIT;
+	}
+
+	VkDescriptorSetLayoutCreateInfo layoutInfo{};
+	layoutInfo.sType = VK_STRUCTURE_TYPE_DESCRIPTOR_SET_LAYOUT_CREATE_INFO;
+	layoutInfo.bindingCount = capture.storageBufferCount;
+	layoutInfo.pBindings = bindings.data();
+
+	if (vkCreateDescriptorSetLayout(m_device, &layoutInfo, nullptr, &pipeline.setLayout) != VK_SUCCESS)
+	{
+		throw std::runtime_error("failed to create compute descriptor set layout!");
+	}
+
+	VkPushConstantRange pushConstantRange{};
+	pushConstantRange.stageFlags = VK_SHADER_STAGE_COMPUTE_BIT;
+	pushConstantRange.offset = 0;
+	pushConstantRange.size = capture.pushConstantSize;
+
+	VkPipelineLayoutCreateInfo pipelineLayoutInfo{};
+	pipelineLayoutInfo.sType = VK_STRUCTURE_TYPE_PIPELINE_LAYOUT_CREATE_INFO;
+	pipelineLayoutInfo.setLayoutCount = 1;
+	pipelineLayoutInfo.pSetLayouts = &pipeline.setLayout;
+	pipelineLayoutInfo.pushConstantRangeCount = capture.pushConstantSize > 0 ? 1 : 0;
+	pipelineLayoutInfo.pPushConstantRanges = &pushConstantRange;
+
+	if (vkCreatePipelineLayout(m_device, &pipelineLayoutInfo, nullptr, &pipeline.layout) != VK_SUCCESS)
+	{
+		throw std::runtime_error("failed to create compute pipeline layout!");
+	}
+
+	pipeline.handle = VulkanInit::CreateComputePipeline(m_device, VK_NULL_HANDLE, find(m_shaderModules, capture.shader, "shader module"), pipeline.layout);
+	m_computePipelines[capture.id] = pipeline;
+}
+
+void Replayer::createDescriptorSet(const CaptureDescriptorSet& capture)
+{
+	ComputePipeline pipeline = find(m_computePipelines, capture.pipeline, "compute pipeline");
+
+	if (capture.storageBuffers.size() != pipeline.storageBufferCount)
+	{
+		throw std::runtime_error("capture descriptor set does not match its pipeline!");
+	}
+
+	// A pool per set keeps this simple. Sets are only created at startup and on a hot reload.
+	VkDescriptorPoolSize poolSize{};
+	poolSize.type = VK_DESCRIPTOR_TYPE_STORAGE_BUFFER;
+	poolSize.descriptorCount = std::max<u32>(pipeline.storageBufferCount, 1);
+
+	VkDescriptorPoolCreateInfo poolInfo{};
+	poolInfo.sType = VK_STRUCTURE_TYPE_DESCRIPTOR_POOL_CREATE_INFO;
+	poolInfo.maxSets = 1;
+	poolInfo.poolSizeCount = 1;
+	poolInfo.pPoolSizes = &poolSize;
+
+	DescriptorSet descriptorSet;
+	if (vkCreateDescriptorPool(m_device, &poolInfo, nullptr, &descriptorSet.pool) != VK_SUCCESS)
+	{
+		throw std::runtime_error("failed to create descriptor pool!");
+	}
+
+	VkDescriptorSetAllocateInfo allocInfo{};
+	allocInfo.sType = VK_STRUCTURE_TYPE_DESCRIPTOR_SET_ALLOCATE_INFO;
+	allocInfo.descriptorPool = descriptorSet.pool;
+	allocInfo.descriptorSetCount = 1;
+	allocInfo.pSetLayouts = &pipeline.setLayout;
+
+	if (vkAllocateDescriptorSets(m_device, &allocInfo, &descriptorSet.handle) != VK_SUCCESS)
+	{
+		throw std::runtime_error("failed to allocate descriptor set!");
+	}
+
+	std::vector<VkDescriptorBufferInfo> bufferInfos(capture.storageBuffers.size());
+	for (size_t i = 0; i < capture.storageBuffers.size(); i++)
+	{
+		bufferInfos[i] = { find(m_buffers, capture.storageBuffers[i], "buffer").handle, 0, VK_WHOLE_SIZE };
+	}
+
+	if (!bufferInfos.empty())
+	{
+		VkWriteDescriptorSet write{};
+		write.sType = VK_STRUCTURE_TYPE_WRITE_DESCRIPTOR_SET;
+		write.dstSet = descriptorSet.handle;
+		write.dstBinding = 0;
+		write.descriptorCount = static_cast<u32>(bufferInfos.size());
+		write.descriptorType = VK_DESCRIPTOR_TYPE_STORAGE_BUFFER;
+		write.pBufferInfo = bufferInfos.data();
+
+		vkUpdateDescriptorSets(m_device, 1, &write, 0, nullptr);
+	}
+
+	m_descriptorSets[capture.id] = descriptorSet;
+}
+
+void Replayer::drawFrame(const CaptureFrame& frame)
+{
+	auto cpuStart = std::chrono::steady_clock::now();
+
+	m_sync.Wait(m_framePoints[m_currentFrame]);
+	resolveTimings(m_currentFrame);
+
+	VkCommandBuffer commandBuffer = m_commandBuffers[m_currentFrame];
+	vkResetCommandBuffer(commandBuffer, 0);
+
+	VkCommandBufferBeginInfo beginInfo{};
+	beginInfo.sType = VK_STRUCTURE_TYPE_COMMAND_BUFFER_BEGIN_INFO;
+	beginInfo.flags = VK_COMMAND_BUFFER_USAGE_ONE_TIME_SUBMIT_BIT;
+
+	if (vkBeginCommandBuffer(commandBuffer, &beginInfo) != VK_SUCCESS)
+	{
+		throw std::runtime_error("failed to begin recording command buffer!");
+	}
+
+	m_gpuTimer.Begin(commandBuffer, m_currentFrame);
+
+	recordDispatches(commandBuffer, frame);
+
+	m_lighting.BeginFrame(m_currentFrame, nullptr, 0);
+	m_lighting.RecordLightAssignment(commandBuffer, m_currentFrame);
+
+	// A capture from a larger window than the output never happens in practice, but clamp rather than draw out of bounds.
+	VkExtent2D renderExtent{ std::min(frame.renderExtent.width, m_header.width), std::min(frame.renderExtent.height, m_header.height) };
+
+	// Rebuilt and sorted as in the app. The captured order is already sorted, and sorting is stable,
+	// so this gives the same order while still measuring the cost of sorting.
+	m_drawQueue.Clear();
+	for (const CaptureDraw& draw : frame.draws)
+	{
+		DrawPacket packet{};
+		packet.key = draw.key;
+		packet.pipeline = find(m_graphicsPipelines, draw.pipeline, "graphics pipeline");
+		packet.descriptorSet = m_lighting.GetDescriptorSet(m_currentFrame);
+		packet.vertexBuffer = find(m_buffers, draw.vertexBuffer, "buffer").handle;
+		packet.vertexBufferOffset = draw.vertexBufferOffset;
+		packet.meshVertexBuffer = find(m_buffers, draw.meshVertexBuffer, "buffer").handle;
+		packet.indexBuffer = find(m_buffers, draw.indexBuffer, "buffer").handle;
+		packet.vertexCount = draw.vertexCount;
+		packet.instanceCount = draw.instanceCount;
+		packet.firstVertex = draw.firstVertex;
+		packet.firstInstance = draw.firstInstance;
+		packet.vertexOffset = draw.vertexOffset;
+		m_drawQueue.Submit(packet);
+	}
+	m_drawQueue.Sort();
+
+	VkClearValue clearColor{};
+	clearColor.color = { { 0.0f, 0.0f, 0.0f, 1.0f } };
+
+	VkRenderPassBeginInfo renderPassInfo{};
+	renderPassInfo.sType = VK_STRUCTURE_TYPE_RENDER_PASS_BEGIN_INFO;
+	renderPassInfo.renderPass = m_renderPass;
+	renderPassInfo.framebuffer = m_framebuffers[m_currentFrame];
+	renderPassInfo.renderArea.offset = { 0, 0 };
+	renderPassInfo.renderArea.extent = renderExtent;
+	renderPassInfo.clearValueCount = 1;
+	renderPassInfo.pClearValues = &clearColor;
+
+	vkCmdBeginRenderPass(commandBuffer, &renderPassInfo, VK_SUBPASS_CONTENTS_INLINE);
+
+	VkViewport viewport{};
+	viewport.width = static_cast<float>(renderExtent.width);
+	viewport.height = static_cast<float>(renderExtent.height);
+	viewport.maxDepth = 1.0f;
+	vkCmdSetViewport(commandBuffer, 0, 1, &viewport);
+
+	VkRect2D scissor{ { 0, 0 }, renderExtent };
+	vkCmdSetScissor(commandBuffer, 0, 1, &scissor);
+
+	// Captures do not record the views, the scene is replayed through a single one that neither pans nor zooms.
+	const CameraView view;
+	const ViewConstants viewConstants = MakeViewConstants(&view, 1, 0);
+	vkCmdPushConstants(commandBuffer, m_graphicsLayout, VK_SHADER_STAGE_VERTEX_BIT, 0, sizeof(viewConstants), &viewConstants);
+
+	DrawStats drawStats;
+	m_drawQueue.Record(commandBuffer, m_graphicsLayout, drawStats);
+
+	vkCmdEndRenderPass(commandBuffer);
+
+	m_gpuTimer.End(commandBuffer, m_currentFrame);
+
+	if (vkEndCommandBuffer(commandBuffer) != VK_SUCCESS)
+	{
+		throw std::runtime_error("failed to record command buffer!");
+	}
+
+	SubmitBatch batch;
+	batch.commandBufferCount = 1;
+	batch.pCommandBuffers = &commandBuffer;
+
+	m_framePoints[m_currentFrame] = m_sync.Submit(QueueId::Graphics, batch);
+
+	if (m_frameNumber >= m_warmupFrames)
+	{
+		std::chrono::duration<double, std::milli> cpuTime = std::chrono::steady_clock::now() - cpuStart;
+		m_timings.cpuMs.push_back(cpuTime.count());
+
+		m_measuredFrames++;
+		m_drawTotals.draws += drawStats.draws;
+		m_drawTotals.pipelineBinds += drawStats.pipelineBinds;
+		m_drawTotals.descriptorSetBinds += drawStats.descriptorSetBinds;
+		m_drawTotals.vertexBufferBinds += drawStats.vertexBufferBinds;
+		m_drawTotals.indexBufferBinds += drawStats.indexBufferBinds;
+		m_drawTotals.unsortedBinds += drawStats.unsortedBinds;
+		m_drawTotals.triangles += drawStats.triangles;
+		m_dispatchTotal += frame.dispatches.size();
+	}
+
+	m_slotFrames[m_currentFrame] = m_frameNumber;
+	m_currentFrame = (m_currentFrame + 1) % REPLAY_FRAMES_IN_FLIGHT;
+	m_frameNumber++;
+}
+
+void Replayer::recordDispatches(VkCommandBuffer commandBuffer, const CaptureFrame& frame)
+{
+	if (frame.dispatches.empty())
+	{
+		return;
+	}
+
+	m_computeTimer.Begin(commandBuffer, m_currentFrame);
+
+	for (const CaptureDispatch& dispatch : frame.dispatches)
+	{
+		ComputePipeline pipeline = find(m_computePipelines, dispatch.pipeline, "compute pipeline");
+		DescriptorSet descriptorSet = find(m_descriptorSets, dispatch.descriptorSet, "descriptor set");
+
+		// In the app the simulation runs on its own queue and is ordered against the draws by a semaphore.
+		// Here everything is on one queue, so the same ordering comes from barriers: earlier vertex reads
+		// and compute writes finish before a dispatch touches its buffers.
+		VkMemoryBarrier barrier{};
+		barrier.sType = VK_STRUCTURE_TYPE_MEMORY_BARRIER;
+		barrier.srcAccessMask = VK_ACCESS_SHADER_WRITE_BIT;
+		barrier.dstAccessMask = VK_ACCESS_SHADER_READ_BIT | VK_ACCESS_SHADER_WRITE_BIT;
+
+		vkCmdPipelineBarrier(commandBuffer, VK_PIPELINE_STAGE_VERTEX_INPUT_BIT | VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT,
+			VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT, 0, 1, &barrier, 0, nullptr, 0, nullptr);
+
+		vkCmdBindPipeline(commandBuffer, VK_PIPELINE_BIND_POINT_COMPUTE, pipeline.handle);
+		vkCmdBindDescriptorSets(commandBuffer, VK_PIPELINE_BIND_POINT_COMPUTE, pipeline.layout, 0, 1, &descriptorSet.handle, 0, nullptr);
+
+		if (!dispatch.pushConstants.empty())
+		{
+			vkCmdPushConstants(commandBuffer, pipeline.layout, VK_SHADER_STAGE_COMPUTE_BIT, 0,
+				static_cast<u32>(dispatch.pushConstants.size()), dispatch.pushConstants.data());
+		}
+
+		vkCmdDispatch(commandBuffer, dispatch.groupCount[0], dispatch.groupCount[1], dispatch.groupCount[2]);
+	}
+
+	// The draws read the simulation's output as vertex data.
+	VkMemoryBarrier barrier{};
+	barrier.sType = VK_STRUCTURE_TYPE_MEMORY_BARRIER;
+	barrier.srcAccessMask = VK_ACCESS_SHADER_WRITE_BIT;
+	barrier.dstAccessMask = VK_ACCESS_VERTEX_ATTRIBUTE_READ_BIT;
+
+	vkCmdPipelineBarrier(commandBuffer, VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT, VK_PIPELINE_STAGE_VERTEX_INPUT_BIT, 0,
+		1, &barrier, 0, nullptr, 0, nullptr);
+
+	m_computeTimer.End(commandBuffer, m_currentFrame);
+}
+
+void Replayer::resolveTimings(u32 slot)
+{
+	const bool measured = m_slotFrames[slot] >= m_warmupFrames;
+
+	// Resolved even for warmup frames, which clears the slot for its next frame.
+	double gpuMs;
+	if (m_gpuTimer.Resolve(slot, gpuMs) && measured)
+	{
+		m_timings.gpuMs.push_back(gpuMs);
+	}
+
+	double computeMs;
+	if (m_computeTimer.Resolve(slot, computeMs) && measured)
+	{
+		m_timings.computeMs.push_back(computeMs);
+	}
+}
+
+static void printUsage()
+{
+	std::cout <<
+		"usage: VulkanReplay <capture> [options]\n"
+		"  --warmup <n>            replayed but unmeasured frames at the start (default 60)\n"
+		"  --output <path>         where to write the JSON report (default replay.json)\n"
+		"  --baseline <path>       compare against an earlier report, exit 1 on regression\n"
+		"  --threshold <pct>       allowed slowdown for every metric (default 10)\n"
+		"  --metric-threshold <metric> <pct>\n"
+		"                          allowed slowdown for one metric, e.g. gpu.p99 20\n"
+		"  --min-delta-ms <ms>     ignore slowdowns smaller than this (default 0.05)\n"
+		"  --validation            enable the validation layers\n"
+		"  --device <uuid|name>    replay on the device with this UUID, or whose name contains this\n";
+}
+
+static bool parseArgs(int argc, char** argv, ReplayOptions& options)
+{
+	for (int i = 1; i < argc; i++)
+	{
+		std::string arg = argv[i];
+
+		// Number of values following the current flag that are still available.
+		int remaining = argc - i - 1;
+
+		if (arg == "--warmup" && remaining >= 1)
+		{
+			options.warmupFrames = static_cast<u32>(std::strtoul(argv[++i], nullptr, 10));
+		}
+		else if (arg == "--output" && remaining >= 1)
+		{
+			options.outputPath = argv[++i];
+		}
+		else if (arg == "--baseline" && remaining >= 1)
+		{
+			options.baselinePath = argv[++i];
+		}
+		else if (arg == "--threshold" && remaining >= 1)
+		{
+			options.thresholds.percent = std::strtod(argv[++i], nullptr);
+		}
+		else if (arg == "--metric-threshold" && remaining >= 2)
+		{
+			std::string metric = argv[++i];
+			options.thresholds.perMetricPercent[metric] = std::strtod(argv[++i], nullptr);
+		}
+		else if (arg == "--min-delta-ms" && remaining >= 1)
+		{
+			options.thresholds.minDeltaMs = std::strtod(argv[++i], nullptr);
+		}
+		else if (arg == "--validation")
+		{
+			options.enableValidation = true;
+		}
+		else if (arg == "--device" && remaining >= 1)
+		{
+			options.device = argv[++i];
+		}
+		else if (options.capturePath.empty() && arg.rfind("--", 0) != 0)
+		{
+			options.capturePath = arg;
+		}
+		else
+		{
+			std::cerr << "unknown or incomplete option " << arg << std::endl;
+			return false;
+		}
+	}
+
+	if (options.capturePath.empty())
+	{
+		std::cerr << "no capture file given" << std::endl;
+		return false;
+	}
+
+	return true;
+}
+
+int main(int argc, char** argv)
+{
+	ReplayOptions options;
+
+	if (argc > 1 && (std::strcmp(argv[1], "--help") == 0 || std::strcmp(argv[1], "-h") == 0))
+	{
+		printUsage();
+		return EXIT_SUCCESS;
+	}
+
+	if (!parseArgs(argc, argv, options))
+	{
+		printUsage();
+		return EXIT_FAILURE;
+	}
+
+	BenchmarkReport report;
+
+	try
+	{
+		CaptureReader reader;
+		CaptureHeader header;
+
+		if (!reader.Open(options.capturePath, header))
+		{
+			std::cerr << "failed to read capture " << options.capturePath << std::endl;
+			return EXIT_FAILURE;
+		}
+
+		Replayer replayer;
+		replayer.Init(header, options);
+
+		report.device = replayer.GetDeviceName();
+		report.width = header.width;
+		report.height = header.height;
+		report.warmupFrames = options.warmupFrames;
+
+		std::cout << "Replaying " << options.capturePath << " on " << report.device << " at " << header.width << "x" << header.height;
+		if (report.device != header.device)
+		{
+			std::cout << " (captured on " << header.device << ")";
+		}
+		std::cout << std::endl;
+
+		// One record is reused throughout, so reading frames does not allocate once it has grown.
+		CaptureRecord record;
+		auto start = std::chrono::steady_clock::now();
+
+		while (reader.Next(record))
+		{
+			replayer.Execute(record);
+		}
+
+		replayer.WaitIdle();
+		std::chrono::duration<double, std::milli> elapsed = std::chrono::steady_clock::now() - start;
+
+		const u64 measuredFrames = replayer.GetMeasuredFrameCount();
+		report.measuredFrames = static_cast<u32>(measuredFrames);
+
+		if (measuredFrames == 0)
+		{
+			replayer.Destroy();
+			std::cerr << "capture has " << replayer.GetFrameCount() << " frames, none left to measure after " << options.warmupFrames << " warmup frames" << std::endl;
+			return EXIT_FAILURE;
+		}
+
+		const FrameTimings& timings = replayer.GetTimings();
+		const DrawStats& drawTotals = replayer.GetDrawTotals();
+
+		SceneResult result;
+		result.name = "replay";
+		result.cpu = ComputeStats(timings.cpuMs);
+		result.gpu = ComputeStats(timings.gpuMs);
+		result.compute = ComputeStats(timings.computeMs);
+
+		// The capture's scenes may change part way through, so these are averages over the measured frames.
+		result.counters =
+		{
+			{ "frames", measuredFrames },
+			{ "draws", drawTotals.draws / measuredFrames },
+			{ "pipeline_binds", drawTotals.pipelineBinds / measuredFrames },
+			{ "descriptor_set_binds", drawTotals.descriptorSetBinds / measuredFrames },
+			{ "vertex_buffer_binds", drawTotals.vertexBufferBinds / measuredFrames },
+			{ "index_buffer_binds", drawTotals.indexBufferBinds / measuredFrames },
+			{ "unsorted_binds", drawTotals.unsortedBinds / measuredFrames },
+			{ "triangles", drawTotals.triangles / measuredFrames },
+			{ "dispatches", replayer.GetDispatchTotal() / measuredFrames },
+		};
+
+		report.scenes.push_back(result);
+
+		std::cout << replayer.GetFrameCount() << " frames in " << elapsed.count() << " ms, cpu mean " << result.cpu.mean << " ms p99 " << result.cpu.p99 << " ms";
+		if (result.gpu.count > 0)
+		{
+			std::cout << ", gpu mean " << result.gpu.mean << " ms p99 " << result.gpu.p99 << " ms";
+		}
+		if (result.compute.count > 0)
+		{
+			std::cout << ", compute mean " << result.compute.mean << " ms";
+		}
+		std::cout << std::endl;
+
+		replayer.Destroy();
+	}
+	catch (const std::exception& e)
+	{
+		std::cerr << e.what() << std::endl;
+		return EXIT_FAILURE;
+	}
+
+	if (!WriteReportJson(report, options.outputPath))
+	{
+		std::cerr << "failed to write " << options.outputPath << std::endl;
+		return EXIT_FAILURE;
+	}
+
+	std::cout << "Wrote " << options.outputPath << std::endl;
+
+	if (options.baselinePath.empty())
+	{
+		return EXIT_SUCCESS;
+	}
+
+	BenchmarkReport baseline;
+	if (!ReadReportJson(options.baselinePath, baseline))
+	{
+		std::cerr << "failed to read baseline " << options.baselinePath << std::endl;
+		return EXIT_FAILURE;
+	}
+
+	u32 regressions = CompareReports(baseline, report, options.thresholds, std::cout);
+	if (regressions > 0)
+	{
+		std::cout << regressions << " metric(s) regressed against " << options.baselinePath << std::endl;
+		return EXIT_FAILURE;
+	}
+
+	std::cout << "No regressions against " << options.baselinePath << std::endl;
+	return EXIT_SUCCESS;
+}
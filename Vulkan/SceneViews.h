@@ -0,0 +1,80 @@
+#pragma once
+
+#include <algorithm>
+
+#include "Types.h"
+
+// Several cameras over the same scene, rendered together every frame, e.g. a stereo pair plus monitoring views.
+//
+// The scene is laid out in clip space, as a single camera covering [-1, 1] would see it. Each view pans
+// and zooms over that, showing the square 'center' +/- 1 / 'zoom', and is tiled into its own part of the
+// output. The vertex shaders read every view from the push constants (ViewConstants) and place their
+// vertices with the one gl_ViewIndex selects, so:
+//
+// - With multiview, one render pass draws every view into the layers of the scene targets. The draws are
+//   recorded once, and the device runs the vertex work of each view over the same commands.
+// - Without it, the same shaders and draws are recorded in a pass per view, each rendering one layer,
+//   with ViewConstants::baseView selecting the view as gl_ViewIndex is always 0.
+//
+// Views only pan and zoom, so depth order is the same in every view. That lets culling test an instance
+// once for all of them: against the bounds of every view's square, and for occlusion against view 0's depth.
+
+// Must match MAX_VIEWS in the vertex shaders.
+constexpr u32 MAX_VIEWS = 4;
+
+struct CameraView
+{
+	float center[2]{ 0.0f, 0.0f };
+	// Greater than 0. Above 1 magnifies the scene.
+	float zoom{ 1.0f };
+};
+
+// The push constants of every graphics pipeline, matching the block in the vertex shaders.
+struct ViewConstants
+{
+	// Each view's centre in xy and zoom in z, w is unused.
+	float views[MAX_VIEWS][4];
+	// Added to gl_ViewIndex to find the view being drawn.
+	int32_t baseView;
+};
+
+inline ViewConstants MakeViewConstants(const CameraView* pViews, u32 viewCount, u32 baseView)
+{
+	ViewConstants constants{ };
+	for (u32 i = 0; i < viewCount; i++)
+	{
+		constants.views[i][0] = pViews[i].center[0];
+		constants.views[i][1] = pViews[i].center[1];
+		constants.views[i][2] = pViews[i].zoom;
+	}
+	constants.baseView = static_cast<int32_t>(baseView);
+	return constants;
+}
+
+// An axis aligned rectangle of the scene.
+struct ViewBounds
+{
+	float min[2];
+	float max[2];
+};
+
+// The rectangle that covers every view.
+inline ViewBounds GetCombinedViewBounds(const CameraView* pViews, u32 viewCount)
+{
+	ViewBounds bounds{ { pViews[0].center[0], pViews[0].center[1] }, { pViews[0].center[0], pViews[0].center[1] } };
+	for (u32 i = 0; i < viewCount; i++)
+	{
+		const float halfSize = 1.0f / pViews[i].zoom;
+		for (u32 axis = 0; axis < 2; axis++)
+		{
+			bounds.min[axis] = std::min(bounds.min[axis], pViews[i].center[axis] - halfSize);
+			bounds.max[axis] = std::max(bounds.max[axis], pViews[i].center[axis] + halfSize);
+		}
+	}
+	return bounds;
+}
+
+// Views are tiled over the output at most two to a row, so a stereo pair sits side by side.
+inline u32 GetViewColumns(u32 viewCount) { return std::min(viewCount, 2u); }
+
+inline u32 GetViewRows(u32 viewCount) { return (viewCount + 1) / 2; }
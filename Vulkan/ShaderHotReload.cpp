@@ -0,0 +1,215 @@
+#include "ShaderHotReload.h"
+
+#ifdef SHADER_HOT_RELOAD
+
+#include <iostream>
+#include <fstream>
+#include <sstream>
+#include <algorithm>
+#include <chrono>
+#include <stdexcept>
+#include <cstring>
+#include <poll.h>
+#include <unistd.h>
+#include <sys/inotify.h>
+#include <shaderc/shaderc.h>
+
+void ShaderWatcher::Watch(u32 shaderId, const std::string& sourcePath)
+{
+	size_t slash = sourcePath.find_last_of('/');
+	std::string fileName = slash == std::string::npos ? sourcePath : sourcePath.substr(slash + 1);
+
+	m_watchedFiles.push_back({ shaderId, sourcePath, fileName });
+}
+
+void ShaderWatcher::Start(const std::string& directory)
+{
+	m_directory = directory;
+
+	m_inotifyFd = inotify_init1(IN_NONBLOCK | IN_CLOEXEC);
+	if (m_inotifyFd < 0)
+	{
+		throw std::runtime_error("Failed to initialise inotify for shader hot reload!");
+	}
+
+	// Watch the directory rather than the files themselves. Many editors save by writing
+	// a temporary file and renaming it over the original, which would drop a per-file watch.
+	if (inotify_add_watch(m_inotifyFd, m_directory.c_str(), IN_CLOSE_WRITE | IN_MOVED_TO) < 0)
+	{
+		close(m_inotifyFd);
+		m_inotifyFd = -1;
+		throw std::runtime_error("Failed to watch shader directory " + m_directory);
+	}
+
+	m_stopRequested = false;
+	m_thread = std::thread(&ShaderWatcher::watchThread, this);
+
+	std::cout << "Shader hot reload watching " << m_directory << std::endl;
+}
+
+void ShaderWatcher::Stop()
+{
+	m_stopRequested = true;
+
+	if (m_thread.joinable())
+	{
+		m_thread.join();
+	}
+
+	if (m_inotifyFd >= 0)
+	{
+		close(m_inotifyFd);
+		m_inotifyFd = -1;
+	}
+}
+
+void ShaderWatcher::TakeCompiled(std::vector<CompiledShader>& compiled)
+{
+	compiled.clear();
+
+	if (!m_hasCompiled.load(std::memory_order_acquire))
+	{
+		return;
+	}
+
+	std::lock_guard<std::mutex> lock(m_compiledMutex);
+	compiled.swap(m_compiled);
+	m_hasCompiled.store(false, std::memory_order_release);
+}
+
+void ShaderWatcher::watchThread()
+{
+	// inotify_event has a variable length name, so read into a buffer aligned for the header.
+	alignas(inotify_event) char buffer[4096];
+
+	std::vector<bool> changed(m_watchedFiles.size());
+
+	while (!m_stopRequested)
+	{
+		// Wake up periodically so Stop() does not block on an idle directory.
+		pollfd pfd{ m_inotifyFd, POLLIN, 0 };
+		if (poll(&pfd, 1, 100) <= 0)
+		{
+			continue;
+		}
+
+		// A single save can generate several events in quick succession.
+		// Give the editor a moment to finish, then coalesce everything into one compile per file.
+		std::this_thread::sleep_for(std::chrono::milliseconds(50));
+
+		std::fill(changed.begin(), changed.end(), false);
+
+		ssize_t length;
+		while ((length = read(m_inotifyFd, buffer, sizeof(buffer))) > 0)
+		{
+			for (char* ptr = buffer; ptr < buffer + length; ptr += sizeof(inotify_event) + reinterpret_cast<inotify_event*>(ptr)->len)
+			{
+				const inotify_event* event = reinterpret_cast<const inotify_event*>(ptr);
+
+				if (event->len == 0)
+				{
+					continue;
+				}
+
+				for (size_t i = 0; i < m_watchedFiles.size(); i++)
+				{
+					if (m_watchedFiles[i].fileName == event->name)
+					{
+						changed[i] = true;
+					}
+				}
+			}
+		}
+
+		for (size_t i = 0; i < m_watchedFiles.size(); i++)
+		{
+			if (changed[i])
+			{
+				compile(m_watchedFiles[i]);
+			}
+		}
+	}
+}
+
+void ShaderWatcher::compile(const WatchedFile& file)
+{
+	std::ifstream sourceFile(file.sourcePath);
+	if (!sourceFile.is_open())
+	{
+		std::cerr << "Shader hot reload: failed to open " << file.sourcePath << std::endl;
+		return;
+	}
+
+	std::stringstream source;
+	source << sourceFile.rdbuf();
+	std::string sourceText = source.str();
+
+	// glslc picks the stage from the file extension, so do the same here.
+	shaderc_shader_kind kind;
+	if (file.fileName.ends_with(".vert"))
+	{
+		kind = shaderc_vertex_shader;
+	}
+	else if (file.fileName.ends_with(".frag"))
+	{
+		kind = shaderc_fragment_shader;
+	}
+	else if (file.fileName.ends_with(".comp"))
+	{
+		kind = shaderc_compute_shader;
+	}
+	else
+	{
+		kind = shaderc_glsl_infer_from_source;
+	}
+
+	// The compiler objects are cheap to create relative to a compile,
+	// and keeping them local means nothing is shared with other threads.
+	shaderc_compiler_t compiler = shaderc_compiler_initialize();
+	shaderc_compile_options_t options = shaderc_compile_options_initialize();
+	shaderc_compile_options_set_optimization_level(options, shaderc_optimization_level_performance);
+
+	shaderc_compilation_result_t result = shaderc_compile_into_spv(compiler, sourceText.data(), sourceText.size(),
+		kind, file.sourcePath.c_str(), "main", options);
+
+	if (shaderc_result_get_compilation_status(result) != shaderc_compilation_status_success)
+	{
+		// Keep running with the previous module; the next save will try again.
+		std::cerr << "Shader hot reload: " << shaderc_result_get_error_message(result) << std::endl;
+	}
+	else
+	{
+		CompiledShader compiled;
+		compiled.shaderId = file.shaderId;
+		compiled.spirv.resize(shaderc_result_get_length(result) / sizeof(u32));
+		memcpy(compiled.spirv.data(), shaderc_result_get_bytes(result), compiled.spirv.size() * sizeof(u32));
+
+		std::cout << "Shader hot reload: recompiled " << file.sourcePath << std::endl;
+
+		std::lock_guard<std::mutex> lock(m_compiledMutex);
+
+		// Only the newest SPIR-V for a shader matters if the render thread has not collected the last one yet.
+		bool replaced = false;
+		for (CompiledShader& pending : m_compiled)
+		{
+			if (pending.shaderId == compiled.shaderId)
+			{
+				pending.spirv = std::move(compiled.spirv);
+				replaced = true;
+			}
+		}
+
+		if (!replaced)
+		{
+			m_compiled.push_back(std::move(compiled));
+		}
+
+		m_hasCompiled.store(true, std::memory_order_release);
+	}
+
+	shaderc_result_release(result);
+	shaderc_compile_options_release(options);
+	shaderc_compiler_release(compiler);
+}
+
+#endif
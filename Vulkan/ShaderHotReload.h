@@ -0,0 +1,61 @@
+#pragma once
+
+#include <atomic>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include "Types.h"
+
+// Development-only shader hot reload, enabled by building with SHADER_HOT_RELOAD (make HOT_RELOAD=1).
+// A background thread watches the shader source directory with inotify and recompiles
+// any changed source with shaderc. The render thread collects the results at a frame boundary
+// and decides which pipelines need rebuilding, so no Vulkan objects are touched here.
+class ShaderWatcher
+{
+public:
+	struct CompiledShader
+	{
+		u32 shaderId;
+		std::vector<u32> spirv;
+	};
+
+	~ShaderWatcher() { Stop(); }
+
+	// Registers a source file to watch. The id is handed back with the compiled SPIR-V.
+	// Must be called before Start().
+	void Watch(u32 shaderId, const std::string& sourcePath);
+
+	void Start(const std::string& directory);
+
+	void Stop();
+
+	// Moves every compilation finished since the last call into 'compiled'.
+	// Cheap when nothing changed, so it can be called every frame.
+	void TakeCompiled(std::vector<CompiledShader>& compiled);
+
+private:
+	struct WatchedFile
+	{
+		u32 shaderId;
+		std::string sourcePath;
+		std::string fileName;
+	};
+
+	void watchThread();
+
+	void compile(const WatchedFile& file);
+
+	std::vector<WatchedFile> m_watchedFiles;
+	std::string m_directory;
+
+	std::thread m_thread;
+	std::atomic<bool> m_stopRequested{ false };
+	int m_inotifyFd{ -1 };
+
+	std::mutex m_compiledMutex;
+	std::vector<CompiledShader> m_compiled;
+	// Lets TakeCompiled() skip the lock in the common case of no changes.
+	std::atomic<bool> m_hasCompiled{ false };
+};
@@ -0,0 +1,178 @@
+#pragma once
+
+#include <array>
+#include <bit>
+#include <cstring>
+#include <type_traits>
+#include <utility>
+#include <vulkan/vulkan.h>
+
+#include "Types.h"
+
+// Shader permutations are expressed as specialization constants rather than runtime uniforms.
+// The values are baked in when the pipeline is created, so the driver constant folds them
+// and strips any branch that can never be taken. An uber-shader keeps a single source,
+// but each pipeline only pays for the features it actually uses.
+//
+// Each constant is declared once as its own type, which ties together its constant_id in the
+// shader, its C++ type and its default value:
+//
+//     struct UseVertexColour : SpecConstant<0, bool, true> {};
+//
+// A PermutationKey is then a typed list of those constants, set and read by type.
+
+template<u32 ID, typename T, T Default>
+struct SpecConstant
+{
+	// Specialization constants are 32-bit scalars in GLSL (bool is a 32-bit VkBool32).
+	static_assert(std::is_same_v<T, bool> || std::is_same_v<T, u32> || std::is_same_v<T, int32_t> || std::is_same_v<T, float>,
+		"Specialization constants must be bool, u32, int32_t or float.");
+
+	using ValueType = T;
+	static constexpr u32 id = ID;
+	static constexpr T defaultValue = Default;
+};
+
+template<typename... Constants>
+class PermutationKey
+{
+public:
+	static constexpr u32 ConstantCount = sizeof...(Constants);
+
+	constexpr PermutationKey()
+		: m_data{ toWord(Constants::defaultValue)... }
+	{
+	}
+
+	template<typename Constant>
+	constexpr PermutationKey& Set(typename Constant::ValueType value)
+	{
+		static_assert(indexOf<Constant>() < ConstantCount, "The constant is not part of this permutation key.");
+		m_data[indexOf<Constant>()] = toWord(value);
+		return *this;
+	}
+
+	template<typename Constant>
+	constexpr typename Constant::ValueType Get() const
+	{
+		static_assert(indexOf<Constant>() < ConstantCount, "The constant is not part of this permutation key.");
+		return fromWord<typename Constant::ValueType>(m_data[indexOf<Constant>()]);
+	}
+
+	// FNV-1a over the packed values. Used to look the permutation up in the pipeline cache.
+	constexpr u64 Hash() const
+	{
+		u64 hash = 14695981039346656037ull;
+		for (u32 word : m_data)
+		{
+			hash = (hash ^ word) * 1099511628211ull;
+		}
+		return hash;
+	}
+
+	constexpr bool operator==(const PermutationKey&) const = default;
+
+	// The returned struct points into this key, so the key must outlive the pipeline creation call.
+	VkSpecializationInfo GetSpecializationInfo() const
+	{
+		VkSpecializationInfo specializationInfo{};
+		specializationInfo.mapEntryCount = ConstantCount;
+		specializationInfo.pMapEntries = s_mapEntries.data();
+		specializationInfo.dataSize = sizeof(m_data);
+		specializationInfo.pData = m_data.data();
+		return specializationInfo;
+	}
+
+	const u32* GetData() const { return m_data.data(); }
+
+private:
+	template<typename T>
+	static constexpr u32 toWord(T value)
+	{
+		if constexpr (std::is_same_v<T, bool>)
+		{
+			return value ? VK_TRUE : VK_FALSE;
+		}
+		else
+		{
+			return std::bit_cast<u32>(value);
+		}
+	}
+
+	template<typename T>
+	static constexpr T fromWord(u32 word)
+	{
+		if constexpr (std::is_same_v<T, bool>)
+		{
+			return word != VK_FALSE;
+		}
+		else
+		{
+			return std::bit_cast<T>(word);
+		}
+	}
+
+	template<typename Constant>
+	static constexpr u32 indexOf()
+	{
+		constexpr bool matches[] = { std::is_same_v<Constant, Constants>... };
+		for (u32 i = 0; i < ConstantCount; i++)
+		{
+			if (matches[i])
+			{
+				return i;
+			}
+		}
+		// Not in the key. Set() and Get() reject it at compile time.
+		return ConstantCount;
+	}
+
+	static constexpr bool hasUniqueIds()
+	{
+		constexpr u32 ids[] = { Constants::id... };
+		for (u32 i = 0; i < ConstantCount; i++)
+		{
+			for (u32 j = i + 1; j < ConstantCount; j++)
+			{
+				if (ids[i] == ids[j])
+				{
+					return false;
+				}
+			}
+		}
+		return true;
+	}
+
+	static_assert(ConstantCount > 0, "A permutation key needs at least one constant.");
+	static_assert(hasUniqueIds(), "Two constants in a permutation key share a constant_id.");
+
+	// Every value is stored as one 32-bit word, so constant i lives at byte offset i * 4.
+	template<size_t... I>
+	static constexpr std::array<VkSpecializationMapEntry, ConstantCount> makeMapEntries(std::index_sequence<I...>)
+	{
+		return { { { Constants::id, static_cast<u32>(I * sizeof(u32)), sizeof(u32) }... } };
+	}
+
+	static constexpr std::array<VkSpecializationMapEntry, ConstantCount> s_mapEntries = makeMapEntries(std::index_sequence_for<Constants...>{});
+
+	std::array<u32, ConstantCount> m_data;
+};
+
+// The permutations used by the app's shaders.
+// The ids here must match the layout(constant_id = N) declarations in Shaders/.
+// Constants a stage does not declare are ignored by that stage, so one key can cover
+// both the vertex and fragment shader of a pipeline.
+
+// Fragment: take the colour from the vertex shader, or output a flat tint instead.
+struct UseVertexColour : SpecConstant<0, bool, true> {};
+// Fragment: multiplier applied to the output colour.
+struct Brightness : SpecConstant<1, float, 1.0f> {};
+// Vertex: uniform scale applied to the triangle.
+struct TriangleScale : SpecConstant<2, float, 1.0f> {};
+
+using TrianglePermutation = PermutationKey<UseVertexColour, Brightness, TriangleScale>;
+
+// Vertex: half the width of each particle's quad, in clip space.
+struct ParticleSize : SpecConstant<3, float, 0.004f> {};
+
+using ParticlePermutation = PermutationKey<ParticleSize>;
@@ -0,0 +1,72 @@
+#version 450
+
+layout(location = 0) in vec3 fragNormal;
+layout(location = 1) in vec3 fragPosition;
+
+layout(location = 0) out vec4 outColor;
+
+// Specialization constants, see TrianglePermutation in ShaderPermutation.h.
+layout(constant_id = 0) const bool USE_VERTEX_COLOUR = true;
+layout(constant_id = 1) const float BRIGHTNESS = 1.0;
+
+const vec3 flatTint = vec3(1.0, 0.5, 0.0);
+
+// Towards the light, from the upper left and in front of the screen.
+const vec3 lightDirection = normalize(vec3(-0.4, -0.6, -0.7));
+
+// Clustered point lights, see ClusteredLighting.h. Must match the same declarations in shader.frag.
+const uvec3 clusterCounts = uvec3(16, 9, 24);
+
+struct Light
+{
+    vec4 positionRadius;
+    vec4 color;
+};
+
+layout(std430, set = 0, binding = 0) readonly buffer Lights
+{
+    Light lights[];
+};
+
+layout(std430, set = 0, binding = 1) readonly buffer LightClusters
+{
+    uvec2 clusters[];
+};
+
+layout(std430, set = 0, binding = 2) readonly buffer LightIndices
+{
+    uint lightIndices[];
+};
+
+// The light reaching a surface at 'position' facing 'normal', from only the lights assigned to its cluster.
+vec3 clusteredLighting(vec3 position, vec3 normal)
+{
+    vec3 clusterCoord = clamp(vec3(position.xy * 0.5 + 0.5, position.z) * vec3(clusterCounts), vec3(0.0), vec3(clusterCounts - 1u));
+    uvec3 coord = uvec3(clusterCoord);
+    uvec2 cluster = clusters[coord.x + clusterCounts.x * (coord.y + clusterCounts.y * coord.z)];
+
+    vec3 lighting = vec3(0.0);
+    for (uint i = 0; i < cluster.y; i++)
+    {
+        Light light = lights[lightIndices[cluster.x + i]];
+
+        vec3 toLight = light.positionRadius.xyz - position;
+        float distance = length(toLight);
+        float falloff = clamp(1.0 - distance / light.positionRadius.w, 0.0, 1.0);
+
+        lighting += light.color.rgb * max(dot(normal, toLight / max(distance, 1e-5)), 0.0) * falloff * falloff;
+    }
+
+    return lighting;
+}
+
+void main() 
+{
+    vec3 normal = normalize(fragNormal);
+
+    // The vertex colour of a mesh is its normal, which makes the LOD changes easy to see.
+    vec3 albedo = USE_VERTEX_COLOUR ? normal * 0.5 + 0.5 : flatTint;
+    vec3 lighting = 0.2 + 0.8 * max(dot(normal, lightDirection), 0.0) + clusteredLighting(fragPosition, normal);
+
+    outColor = vec4(albedo * lighting * BRIGHTNESS, 1.0);
+}
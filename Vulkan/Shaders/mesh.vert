@@ -0,0 +1,41 @@
+#version 450
+#extension GL_EXT_multiview : require
+
+// Per-instance data, see InstanceData in HelloTriangleApp.h.
+layout(location = 0) in vec2 inInstanceOffset;
+layout(location = 1) in float inInstanceScale;
+layout(location = 2) in float inInstanceDepth;
+
+// Per-vertex data from the shared mesh buffer, see MeshVertex in Mesh.h.
+layout(location = 3) in vec3 inPosition;
+layout(location = 4) in vec3 inNormal;
+
+layout(location = 0) out vec3 fragNormal;
+// Scene space, the clip space of a view that neither pans nor zooms, which the lights are placed in.
+layout(location = 1) out vec3 fragPosition;
+
+// Specialization constant, see TrianglePermutation in ShaderPermutation.h.
+layout(constant_id = 2) const float TRIANGLE_SCALE = 1.0;
+
+// Must match MAX_VIEWS in SceneViews.h.
+const int MAX_VIEWS = 4;
+
+// See ViewConstants in SceneViews.h.
+layout(push_constant) uniform Views
+{
+    // Centre in xy and zoom in z.
+    vec4 views[MAX_VIEWS];
+    int baseView;
+} constants;
+
+void main() 
+{
+    // Placed like the triangle: x and y are scaled into scene space, and z only decides which faces are culled.
+    // The whole instance is drawn flat at its depth, which is what occlusion culling tests it as.
+    vec2 position = inPosition.xy * TRIANGLE_SCALE * inInstanceScale + inInstanceOffset;
+    // Then seen through the view being drawn, see SceneViews.h.
+    vec4 view = constants.views[gl_ViewIndex + constants.baseView];
+    gl_Position = vec4((position - view.xy) * view.z, inInstanceDepth, 1.0);
+    fragNormal = inNormal;
+    fragPosition = vec3(position, inInstanceDepth);
+}
@@ -0,0 +1,19 @@
+#version 450
+
+layout(location = 0) in vec4 fragColor;
+layout(location = 1) in vec2 fragCorner;
+
+layout(location = 0) out vec4 outColor;
+
+void main() 
+{
+    // Round the quad off into a soft disc.
+    float distanceSq = dot(fragCorner, fragCorner);
+
+    if (distanceSq > 1.0)
+    {
+        discard;
+    }
+
+    outColor = vec4(fragColor.rgb, fragColor.a * (1.0 - distanceSq));
+}
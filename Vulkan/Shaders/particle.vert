@@ -0,0 +1,43 @@
+#version 450
+#extension GL_EXT_multiview : require
+
+// Per-instance data, read straight from the buffer the compute shader wrote. See Particle in ParticleSystem.h.
+layout(location = 0) in vec2 inParticlePosition;
+layout(location = 1) in vec4 inParticleColor;
+
+layout(location = 0) out vec4 fragColor;
+layout(location = 1) out vec2 fragCorner;
+
+// Specialization constant, see ParticlePermutation in ShaderPermutation.h.
+layout(constant_id = 3) const float PARTICLE_SIZE = 0.004;
+
+// Must match MAX_VIEWS in SceneViews.h.
+const int MAX_VIEWS = 4;
+
+// See ViewConstants in SceneViews.h.
+layout(push_constant) uniform Views
+{
+    // Centre in xy and zoom in z.
+    vec4 views[MAX_VIEWS];
+    int baseView;
+} constants;
+
+// Each instance is a screen aligned quad, two triangles wound the same way as the triangle pipeline.
+vec2 corners[6] = vec2[](
+    vec2(-1.0, -1.0),
+    vec2(1.0, -1.0),
+    vec2(1.0, 1.0),
+    vec2(-1.0, -1.0),
+    vec2(1.0, 1.0),
+    vec2(-1.0, 1.0)
+);
+
+void main() 
+{
+    vec2 corner = corners[gl_VertexIndex];
+    // Zoomed views magnify the particles along with the scene.
+    vec4 view = constants.views[gl_ViewIndex + constants.baseView];
+    gl_Position = vec4((inParticlePosition + corner * PARTICLE_SIZE - view.xy) * view.z, 0.0, 1.0);
+    fragColor = inParticleColor;
+    fragCorner = corner;
+}
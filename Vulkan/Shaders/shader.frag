@@ -1,10 +1,69 @@
 #version 450
 
 layout(location = 0) in vec3 fragColor;
+layout(location = 1) in vec3 fragPosition;
 
 layout(location = 0) out vec4 outColor;
 
+// Specialization constants, see TrianglePermutation in ShaderPermutation.h.
+// These are fixed at pipeline creation, so the unused side of the branch is compiled out.
+layout(constant_id = 0) const bool USE_VERTEX_COLOUR = true;
+layout(constant_id = 1) const float BRIGHTNESS = 1.0;
+
+const vec3 flatTint = vec3(1.0, 0.5, 0.0);
+
+// Clustered point lights, see ClusteredLighting.h. Must match the same declarations in mesh.frag.
+const uvec3 clusterCounts = uvec3(16, 9, 24);
+
+struct Light
+{
+    vec4 positionRadius;
+    vec4 color;
+};
+
+layout(std430, set = 0, binding = 0) readonly buffer Lights
+{
+    Light lights[];
+};
+
+layout(std430, set = 0, binding = 1) readonly buffer LightClusters
+{
+    uvec2 clusters[];
+};
+
+layout(std430, set = 0, binding = 2) readonly buffer LightIndices
+{
+    uint lightIndices[];
+};
+
+// The light reaching a surface at 'position' facing 'normal', from only the lights assigned to its cluster.
+vec3 clusteredLighting(vec3 position, vec3 normal)
+{
+    vec3 clusterCoord = clamp(vec3(position.xy * 0.5 + 0.5, position.z) * vec3(clusterCounts), vec3(0.0), vec3(clusterCounts - 1u));
+    uvec3 coord = uvec3(clusterCoord);
+    uvec2 cluster = clusters[coord.x + clusterCounts.x * (coord.y + clusterCounts.y * coord.z)];
+
+    vec3 lighting = vec3(0.0);
+    for (uint i = 0; i < cluster.y; i++)
+    {
+        Light light = lights[lightIndices[cluster.x + i]];
+
+        vec3 toLight = light.positionRadius.xyz - position;
+        float distance = length(toLight);
+        float falloff = clamp(1.0 - distance / light.positionRadius.w, 0.0, 1.0);
+
+        lighting += light.color.rgb * max(dot(normal, toLight / max(distance, 1e-5)), 0.0) * falloff * falloff;
+    }
+
+    return lighting;
+}
+
 void main() 
 {
-    outColor = vec4(fragColor, 1.0);
-}
\ No newline at end of file
+    vec3 color = USE_VERTEX_COLOUR ? fragColor : flatTint;
+
+    // The triangle is flat and faces the viewer, so only lights in front of it reach it.
+    vec3 lighting = 1.0 + clusteredLighting(fragPosition, vec3(0.0, 0.0, -1.0));
+
+    outColor = vec4(color * lighting * BRIGHTNESS, 1.0);
+}
@@ -1,6 +1,28 @@
 #version 450
+#extension GL_EXT_multiview : require
+
+// Per-instance data, see InstanceData in HelloTriangleApp.h.
+layout(location = 0) in vec2 inInstanceOffset;
+layout(location = 1) in float inInstanceScale;
+layout(location = 2) in float inInstanceDepth;
 
 layout(location = 0) out vec3 fragColor;
+// Scene space, the clip space of a view that neither pans nor zooms, which the lights are placed in.
+layout(location = 1) out vec3 fragPosition;
+
+// Specialization constant, see TrianglePermutation in ShaderPermutation.h.
+layout(constant_id = 2) const float TRIANGLE_SCALE = 1.0;
+
+// Must match MAX_VIEWS in SceneViews.h.
+const int MAX_VIEWS = 4;
+
+// See ViewConstants in SceneViews.h.
+layout(push_constant) uniform Views
+{
+    // Centre in xy and zoom in z.
+    vec4 views[MAX_VIEWS];
+    int baseView;
+} constants;
 
 vec2 positions[3] = vec2[](
     vec2(0.0, -0.5),
@@ -16,6 +38,9 @@ vec3 colors[3] = vec3[](
 
 void main() 
 {
-    gl_Position = vec4(positions[gl_VertexIndex], 0.0, 1.0);
+    vec2 position = positions[gl_VertexIndex] * TRIANGLE_SCALE * inInstanceScale + inInstanceOffset;
+    vec4 view = constants.views[gl_ViewIndex + constants.baseView];
+    gl_Position = vec4((position - view.xy) * view.z, inInstanceDepth, 1.0);
     fragColor = colors[gl_VertexIndex];
+    fragPosition = vec3(position, inInstanceDepth);
 }
\ No newline at end of file
@@ -0,0 +1,1424 @@
+#define NOMINMAX
+
+#include "VulkanInit.h"
+
+#include <iostream>
+#include <vector>
+#include <array>
+#include <algorithm>
+#include <limits>
+#include <fstream>
+#include <cstring>
+#include <stdexcept>
+#include <filesystem>
+#include <cctype>
+
+#include "LinearArena.h"
+
+VkResult CreateDebugUtilsMessengerEXT(VkInstance instance,
+									  const VkDebugUtilsMessengerCreateInfoEXT* pCreateInfo, 
+									  const VkAllocationCallbacks* pAllocator, 
+									  VkDebugUtilsMessengerEXT* pDebugMessenger)
+{
+	auto func = (PFN_vkCreateDebugUtilsMessengerEXT)vkGetInstanceProcAddr(instance, "vkCreateDebugUtilsMessengerEXT");
+
+	if (func != nullptr)
+	{
+		return func(instance, pCreateInfo, pAllocator, pDebugMessenger);
+	}
+	else
+	{
+		return VK_ERROR_EXTENSION_NOT_PRESENT;
+	}
+}
+
+void DestroyDebugUtilsMessengerEXT(VkInstance instance, 
+								   VkDebugUtilsMessengerEXT debugMessenger, 
+								   const VkAllocationCallbacks* pAllocator)
+{
+	auto func = (PFN_vkDestroyDebugUtilsMessengerEXT)vkGetInstanceProcAddr(instance, "vkDestroyDebugUtilsMessengerEXT");
+
+	if (func != nullptr) 
+	{
+		func(instance, debugMessenger, pAllocator);
+	}
+}
+
+VKAPI_ATTR VkBool32 VKAPI_CALL debugCallback(VkDebugUtilsMessageSeverityFlagBitsEXT messagSeverity, 
+											 VkDebugUtilsMessageTypeFlagsEXT messageType, 
+											 const VkDebugUtilsMessengerCallbackDataEXT* pCallbackData, 
+											 void* pUserData)
+{
+	std::cerr << "Validation layer: " << pCallbackData->pMessage << std::endl;
+
+	return VK_FALSE;
+}
+
+void populateDebugMessengerCreateInfo(VkDebugUtilsMessengerCreateInfoEXT& createInfo)
+{
+	createInfo = {};
+	createInfo.sType = VK_STRUCTURE_TYPE_DEBUG_UTILS_MESSENGER_CREATE_INFO_EXT;
+	createInfo.messageSeverity = VK_DEBUG_UTILS_MESSAGE_SEVERITY_VERBOSE_BIT_EXT | VK_DEBUG_UTILS_MESSAGE_SEVERITY_WARNING_BIT_EXT | VK_DEBUG_UTILS_MESSAGE_SEVERITY_ERROR_BIT_EXT;
+	createInfo.messageType = VK_DEBUG_UTILS_MESSAGE_TYPE_GENERAL_BIT_EXT | VK_DEBUG_UTILS_MESSAGE_TYPE_VALIDATION_BIT_EXT | VK_DEBUG_UTILS_MESSAGE_TYPE_PERFORMANCE_BIT_EXT;
+	createInfo.pfnUserCallback = debugCallback;
+}
+
+bool VulkanInit::CheckValidationLayerSupport()
+{
+	u32 layerCount;
+	vkEnumerateInstanceLayerProperties(&layerCount, nullptr);
+
+	ScratchScope scratch;
+	std::pmr::vector<VkLayerProperties> availableLayers(layerCount, scratch.Get());
+	vkEnumerateInstanceLayerProperties(&layerCount, availableLayers.data());
+
+	for (const char* layerName : g_validationLayers)
+	{
+		bool layerFound = false;
+
+		for (const auto& layerProperties : availableLayers) 
+		{
+			if (strcmp(layerName, layerProperties.layerName) == 0) {
+				layerFound = true;
+				break;
+			}
+		}
+
+		if (!layerFound) {
+			return false;
+		}
+	}
+
+	return true;
+}
+
+VkInstance VulkanInit::CreateInstance(const InstanceSettings& settings)
+{
+	//Check if we want validation layers + if they are supported.
+	if (settings.enableValidation && !CheckValidationLayerSupport())
+	{
+		throw std::runtime_error("Validation layers requested, but not available.");
+	}
+
+	// vkEnumerateInstanceVersion only exists from 1.1 on, so a 1.0 loader has no entry point for it.
+	u32 instanceVersion = VK_API_VERSION_1_0;
+	auto enumerateInstanceVersion = (PFN_vkEnumerateInstanceVersion)vkGetInstanceProcAddr(nullptr, "vkEnumerateInstanceVersion");
+	if (enumerateInstanceVersion != nullptr)
+	{
+		enumerateInstanceVersion(&instanceVersion);
+	}
+
+	if (instanceVersion < VULKAN_API_VERSION)
+	{
+		throw std::runtime_error("Vulkan 1.2 is required, but the loader does not support it.");
+	}
+
+	VkApplicationInfo appInfo{ };
+	appInfo.sType = VK_STRUCTURE_TYPE_APPLICATION_INFO;
+	appInfo.pApplicationName = "Vulkan Triangle";
+	appInfo.applicationVersion = VK_MAKE_VERSION(1, 0, 0);
+	appInfo.pEngineName = "No Engine";
+	appInfo.engineVersion = VK_MAKE_VERSION(1, 0, 0);
+	appInfo.apiVersion = VULKAN_API_VERSION;
+
+	VkInstanceCreateInfo createInfo{ };
+	createInfo.sType = VK_STRUCTURE_TYPE_INSTANCE_CREATE_INFO;
+	createInfo.pApplicationInfo = &appInfo;
+
+	ScratchScope scratch;
+	std::pmr::vector<const char*> extensionNames(settings.extensions.begin(), settings.extensions.end(), scratch.Get());
+
+	VkDebugUtilsMessengerCreateInfoEXT debugCreateInfo{};
+
+	// If validation layers are enabled, add them to the create info.
+	// The debug messenger is also chained in, so instance creation and destruction are covered too.
+	if (settings.enableValidation) 
+	{
+		extensionNames.push_back(VK_EXT_DEBUG_UTILS_EXTENSION_NAME);
+
+		createInfo.enabledLayerCount = static_cast<uint32_t>(g_validationLayers.size());
+		createInfo.ppEnabledLayerNames = g_validationLayers.data();
+
+		populateDebugMessengerCreateInfo(debugCreateInfo);
+		createInfo.pNext = (VkDebugUtilsMessengerCreateInfoEXT*)&debugCreateInfo;
+	}
+	else 
+	{
+		createInfo.enabledLayerCount = 0;
+
+		createInfo.pNext = nullptr;
+	}
+
+	createInfo.enabledExtensionCount = static_cast<u32>(extensionNames.size());
+	createInfo.ppEnabledExtensionNames = extensionNames.data();
+
+	VkInstance instance;
+	if (vkCreateInstance(&createInfo, settings.pAllocator, &instance) != VK_SUCCESS)
+	{
+		throw std::runtime_error("failed to create instance!");
+	}
+
+	return instance;
+}
+
+VkDebugUtilsMessengerEXT VulkanInit::CreateDebugMessenger(VkInstance instance, const VkAllocationCallbacks* pAllocator)
+{
+	VkDebugUtilsMessengerCreateInfoEXT createInfo;
+	populateDebugMessengerCreateInfo(createInfo);
+
+	VkDebugUtilsMessengerEXT debugMessenger;
+	if (CreateDebugUtilsMessengerEXT(instance, &createInfo, pAllocator, &debugMessenger) != VK_SUCCESS)
+	{
+		throw std::runtime_error("failed to set up debug messenger!");
+	}
+
+	return debugMessenger;
+}
+
+// Queue families are essentially the render command queues.
+// These are split into families to handle different kinds of operations.
+// For example, a memory upload family, a compute command family etc.
+static QueueFamilyIndices findQueueFamilies(VkPhysicalDevice device, VkSurfaceKHR surface, const std::vector<VkQueueFamilyProperties>& queueFamilies)
+{
+	QueueFamilyIndices familyIndices;
+
+	// Every family is visited, as a compute only family may come after the graphics one.
+	int i = 0;
+	for (const auto& queueFamily : queueFamilies)
+	{
+		// Use a bitwise & to check if queue family supports Graphics_Bit.
+		if ((queueFamily.queueFlags & VK_QUEUE_GRAPHICS_BIT) && !familyIndices.graphicsFamily.has_value())
+		{
+			familyIndices.graphicsFamily = i;
+
+			// Without a surface nothing is presented, so the graphics queue stands in for the present queue.
+			if (surface == VK_NULL_HANDLE)
+			{
+				familyIndices.presentFamily = i;
+			}
+		}
+
+		// A family with compute but no graphics is usually backed by separate hardware queues,
+		// so work submitted to it can run alongside the graphics queue rather than after it.
+		if ((queueFamily.queueFlags & VK_QUEUE_COMPUTE_BIT) && !(queueFamily.queueFlags & VK_QUEUE_GRAPHICS_BIT) &&
+			!familyIndices.computeFamily.has_value())
+		{
+			familyIndices.computeFamily = i;
+		}
+
+		// Likewise a family with transfer but neither graphics nor compute.
+		if ((queueFamily.queueFlags & VK_QUEUE_TRANSFER_BIT) && !(queueFamily.queueFlags & (VK_QUEUE_GRAPHICS_BIT | VK_QUEUE_COMPUTE_BIT)) &&
+			!familyIndices.transferFamily.has_value())
+		{
+			familyIndices.transferFamily = i;
+		}
+
+		if (surface != VK_NULL_HANDLE && !familyIndices.presentFamily.has_value())
+		{
+			VkBool32 presentSupport = false;
+			vkGetPhysicalDeviceSurfaceSupportKHR(device, i, surface, &presentSupport);
+
+			if (presentSupport)
+			{
+				familyIndices.presentFamily = i;
+			}
+		}
+
+		i++;
+	}
+
+	// Without an async compute family, compute runs on the graphics queue.
+	// Vulkan guarantees a graphics capable device has a family supporting both.
+	if (!familyIndices.computeFamily.has_value() && familyIndices.graphicsFamily.has_value() &&
+		(queueFamilies[familyIndices.graphicsFamily.value()].queueFlags & VK_QUEUE_COMPUTE_BIT))
+	{
+		familyIndices.computeFamily = familyIndices.graphicsFamily;
+	}
+
+	// Graphics families always support transfer, whether they say so or not.
+	if (!familyIndices.transferFamily.has_value())
+	{
+		familyIndices.transferFamily = familyIndices.graphicsFamily;
+	}
+
+	return familyIndices;
+}
+
+SwapChainSupportDetails VulkanInit::QuerySwapChainSupport(VkPhysicalDevice device, VkSurfaceKHR surface, std::pmr::memory_resource* pMemory)
+{
+	SwapChainSupportDetails details{ {}, std::pmr::vector<VkSurfaceFormatKHR>(pMemory), std::pmr::vector<VkPresentModeKHR>(pMemory) };
+
+	vkGetPhysicalDeviceSurfaceCapabilitiesKHR(device, surface, &details.capabilities);
+
+	uint32_t formatCount;
+	vkGetPhysicalDeviceSurfaceFormatsKHR(device, surface, &formatCount, nullptr);
+
+	if (formatCount != 0) 
+	{
+		details.formats.resize(formatCount);
+		vkGetPhysicalDeviceSurfaceFormatsKHR(device, surface, &formatCount, details.formats.data());
+	}
+
+	uint32_t presentModeCount;
+	vkGetPhysicalDeviceSurfacePresentModesKHR(device, surface, &presentModeCount, nullptr);
+
+	if (presentModeCount != 0) {
+		details.presentModes.resize(presentModeCount);
+		vkGetPhysicalDeviceSurfacePresentModesKHR(device, surface, &presentModeCount, details.presentModes.data());
+	}
+
+	return details;
+}
+
+static bool checkDeviceExtensionSupport(const std::vector<VkExtensionProperties>& availableExtensions, const std::vector<const char*>& deviceExtensions)
+{
+	// Only a handful of extensions are required, so each is looked for directly rather than
+	// copying the names into a set.
+	for (const char* required : deviceExtensions)
+	{
+		auto matches = [required](const VkExtensionProperties& extension) { return strcmp(extension.extensionName, required) == 0; };
+
+		if (std::none_of(availableExtensions.begin(), availableExtensions.end(), matches))
+		{
+			return false;
+		}
+	}
+
+	return true;
+}
+
+// Example function for how to check if device supports features we require.
+// 
+//bool VulkanInit::IsDeviceSuitable(VkPhysicalDevice device)
+//{
+//	// Queries basice properties
+//	// Name, type, supported VK version etc.
+//	VkPhysicalDeviceProperties deviceProperties;
+//	vkGetPhysicalDeviceProperties(device, &deviceProperties);
+//
+//	// Queries supported features
+//	// Texture compression, 64bit float, multi-viewport rendering etc.
+//	VkPhysicalDeviceFeatures deviceFeatures;
+//	vkGetPhysicalDeviceFeatures(device, &deviceFeatures);
+//
+//	// We want out GPU to be dedicated and support geometry shaders.
+//	// Return a check for that.
+//	return deviceProperties.deviceType == VK_PHYSICAL_DEVICE_TYPE_DISCRETE_GPU &&
+//		deviceFeatures.geometryShader;
+//}
+
+// Whether the device supports VULKAN_API_VERSION and the features CreateLogicalDevice enables.
+static bool checkFeatureSupport(VkPhysicalDevice device, const VkPhysicalDeviceProperties& properties)
+{
+	// The instance may be newer than the device, and a 1.1 device's features cannot be asked about 1.2 structures.
+	if (properties.apiVersion < VULKAN_API_VERSION)
+	{
+		return false;
+	}
+
+	// Multiview has been required of every device since 1.1, but it still has to be enabled to be used.
+	VkPhysicalDeviceVulkan11Features vulkan11Features{ };
+	vulkan11Features.sType = VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_VULKAN_1_1_FEATURES;
+
+	VkPhysicalDeviceVulkan12Features vulkan12Features{ };
+	vulkan12Features.sType = VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_VULKAN_1_2_FEATURES;
+	vulkan12Features.pNext = &vulkan11Features;
+
+	VkPhysicalDeviceFeatures2 features{ };
+	features.sType = VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_FEATURES_2;
+	features.pNext = &vulkan12Features;
+
+	vkGetPhysicalDeviceFeatures2(device, &features);
+
+	return vulkan12Features.timelineSemaphore == VK_TRUE && vulkan11Features.multiview == VK_TRUE;
+}
+
+const char* VulkanInit::DeviceProfile::GetUnsuitableReason() const
+{
+	if (!featuresSupported)
+	{
+		return "needs Vulkan 1.2 with timeline semaphores and multiview";
+	}
+
+	if (!queueFamilies.isComplete())
+	{
+		return "no graphics or present queue";
+	}
+
+	if (!extensionsSupported)
+	{
+		return "missing device extensions";
+	}
+
+	if (!surfaceSupported)
+	{
+		return "cannot present to the surface";
+	}
+
+	return nullptr;
+}
+
+VkDeviceSize VulkanInit::DeviceProfile::GetDeviceLocalBytes() const
+{
+	VkDeviceSize bytes = 0;
+	for (u32 i = 0; i < memory.memoryHeapCount; i++)
+	{
+		if (memory.memoryHeaps[i].flags & VK_MEMORY_HEAP_DEVICE_LOCAL_BIT)
+		{
+			bytes += memory.memoryHeaps[i].size;
+		}
+	}
+	return bytes;
+}
+
+std::string VulkanInit::FormatDeviceUuid(const u8* pUuid)
+{
+	static const char digits[] = "0123456789abcdef";
+
+	std::string text;
+	text.reserve(VK_UUID_SIZE * 2 + 4);
+
+	for (u32 i = 0; i < VK_UUID_SIZE; i++)
+	{
+		if (i == 4 || i == 6 || i == 8 || i == 10)
+		{
+			text += '-';
+		}
+
+		text += digits[pUuid[i] >> 4];
+		text += digits[pUuid[i] & 0xF];
+	}
+
+	return text;
+}
+
+VulkanInit::DeviceProfile VulkanInit::QueryDeviceProfile(VkPhysicalDevice device, VkSurfaceKHR surface, const std::vector<const char*>& deviceExtensions)
+{
+	DeviceProfile profile;
+	profile.device = device;
+
+	vkGetPhysicalDeviceProperties(device, &profile.properties);
+	vkGetPhysicalDeviceFeatures(device, &profile.features);
+
+	// As with the features, a 1.0 device cannot be asked about 1.1 structures.
+	if (profile.properties.apiVersion >= VK_API_VERSION_1_1)
+	{
+		VkPhysicalDeviceIDProperties idProperties{ };
+		idProperties.sType = VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_ID_PROPERTIES;
+
+		VkPhysicalDeviceMultiviewProperties multiviewProperties{ };
+		multiviewProperties.sType = VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_MULTIVIEW_PROPERTIES;
+		multiviewProperties.pNext = &idProperties;
+
+		VkPhysicalDeviceProperties2 properties{ };
+		properties.sType = VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_PROPERTIES_2;
+		properties.pNext = &multiviewProperties;
+
+		vkGetPhysicalDeviceProperties2(device, &properties);
+
+		std::memcpy(profile.uuid, idProperties.deviceUUID, VK_UUID_SIZE);
+		profile.maxMultiviewViewCount = multiviewProperties.maxMultiviewViewCount;
+	}
+
+	vkGetPhysicalDeviceMemoryProperties(device, &profile.memory);
+
+	u32 queueFamilyCount = 0;
+	vkGetPhysicalDeviceQueueFamilyProperties(device, &queueFamilyCount, nullptr);
+	profile.queueFamilyProperties.resize(queueFamilyCount);
+	vkGetPhysicalDeviceQueueFamilyProperties(device, &queueFamilyCount, profile.queueFamilyProperties.data());
+
+	u32 extensionCount = 0;
+	vkEnumerateDeviceExtensionProperties(device, nullptr, &extensionCount, nullptr);
+	profile.extensions.resize(extensionCount);
+	vkEnumerateDeviceExtensionProperties(device, nullptr, &extensionCount, profile.extensions.data());
+
+	profile.queueFamilies = findQueueFamilies(device, surface, profile.queueFamilyProperties);
+	profile.extensionsSupported = checkDeviceExtensionSupport(profile.extensions, deviceExtensions);
+	profile.featuresSupported = checkFeatureSupport(device, profile.properties);
+
+	// Headless rendering never creates a swapchain, so it has nothing to check.
+	// The surface's capabilities change as the window does, so CreateSwapchain() asks again rather than using these.
+	profile.surfaceSupported = surface == VK_NULL_HANDLE;
+	if (profile.extensionsSupported && surface != VK_NULL_HANDLE)
+	{
+		ScratchScope scratch;
+		SwapChainSupportDetails swapChainSupport = QuerySwapChainSupport(device, surface, scratch.Get());
+		profile.surfaceSupported = !swapChainSupport.formats.empty() && !swapChainSupport.presentModes.empty();
+	}
+
+	return profile;
+}
+
+static const char* deviceTypeName(VkPhysicalDeviceType type)
+{
+	switch (type)
+	{
+	case VK_PHYSICAL_DEVICE_TYPE_INTEGRATED_GPU:
+		return "integrated";
+	case VK_PHYSICAL_DEVICE_TYPE_DISCRETE_GPU:
+		return "discrete";
+	case VK_PHYSICAL_DEVICE_TYPE_VIRTUAL_GPU:
+		return "virtual";
+	case VK_PHYSICAL_DEVICE_TYPE_CPU:
+		return "cpu";
+	default:
+		return "other";
+	}
+}
+
+static std::string toLower(std::string text)
+{
+	std::transform(text.begin(), text.end(), text.begin(), [](unsigned char c) { return static_cast<char>(std::tolower(c)); });
+	return text;
+}
+
+// See DeviceSelection::preferred.
+static bool matchesPreferredDevice(const VulkanInit::DeviceProfile& profile, const std::string& preferred)
+{
+	const std::string wanted = toLower(preferred);
+
+	std::string wantedUuid = wanted;
+	wantedUuid.erase(std::remove(wantedUuid.begin(), wantedUuid.end(), '-'), wantedUuid.end());
+
+	std::string uuid = VulkanInit::FormatDeviceUuid(profile.uuid);
+	uuid.erase(std::remove(uuid.begin(), uuid.end(), '-'), uuid.end());
+
+	return wantedUuid == uuid || toLower(profile.properties.deviceName).find(wanted) != std::string::npos;
+}
+
+int64_t VulkanInit::ScoreDevice(const DeviceProfile& profile, const DeviceSelection& selection)
+{
+	int64_t score = 0;
+
+	switch (profile.properties.deviceType)
+	{
+	case VK_PHYSICAL_DEVICE_TYPE_INTEGRATED_GPU:
+		score = selection.integratedScore;
+		break;
+	case VK_PHYSICAL_DEVICE_TYPE_DISCRETE_GPU:
+		score = selection.discreteScore;
+		break;
+	case VK_PHYSICAL_DEVICE_TYPE_VIRTUAL_GPU:
+		score = selection.virtualScore;
+		break;
+	case VK_PHYSICAL_DEVICE_TYPE_CPU:
+		score = selection.cpuScore;
+		break;
+	default:
+		score = selection.otherScore;
+		break;
+	}
+
+	if (profile.properties.deviceType != VK_PHYSICAL_DEVICE_TYPE_CPU)
+	{
+		score += static_cast<int64_t>(profile.GetDeviceLocalBytes() >> 30) * selection.scorePerDeviceLocalGiB;
+	}
+
+	if (profile.HasDedicatedComputeQueue())
+	{
+		score += selection.dedicatedComputeScore;
+	}
+
+	if (profile.HasDedicatedTransferQueue())
+	{
+		score += selection.dedicatedTransferScore;
+	}
+
+	return score;
+}
+
+// Enough to tell from a log which device a run was on, and why it might behave differently from another.
+static void logDeviceProfile(const VulkanInit::DeviceProfile& profile, int64_t score, const VulkanInit::DeviceSelection& selection)
+{
+	const VkPhysicalDeviceProperties& properties = profile.properties;
+	const QueueFamilyIndices& families = profile.queueFamilies;
+
+	std::cout << "Using " << properties.deviceName << " (score " << score;
+	if (!selection.preferred.empty())
+	{
+		std::cout << ", matching \"" << selection.preferred << "\"";
+	}
+	std::cout << ")\n";
+
+	std::cout << "  " << deviceTypeName(properties.deviceType) << ", uuid " << VulkanInit::FormatDeviceUuid(profile.uuid)
+		<< std::hex << ", vendor 0x" << properties.vendorID << ", device 0x" << properties.deviceID
+		<< ", driver 0x" << properties.driverVersion << std::dec << "\n";
+
+	std::cout << "  Vulkan " << VK_API_VERSION_MAJOR(properties.apiVersion) << "." << VK_API_VERSION_MINOR(properties.apiVersion)
+		<< "." << VK_API_VERSION_PATCH(properties.apiVersion) << ", " << profile.extensions.size() << " extensions, "
+		<< profile.maxMultiviewViewCount << " views per multiview pass" << (profile.features.multiDrawIndirect ? ", multi-draw indirect" : "") << "\n";
+
+	std::cout << "  " << (profile.GetDeviceLocalBytes() >> 20) << " MiB device local memory in " << profile.memory.memoryHeapCount << " heaps\n";
+
+	std::cout << "  queue families: graphics " << families.graphicsFamily.value() << ", present " << families.presentFamily.value()
+		<< ", compute " << families.computeFamily.value() << (profile.HasDedicatedComputeQueue() ? " (dedicated)" : "")
+		<< ", transfer " << families.transferFamily.value() << (profile.HasDedicatedTransferQueue() ? " (dedicated)" : "") << std::endl;
+}
+
+VulkanInit::DeviceProfile VulkanInit::PickPhysicalDevice(VkInstance instance, VkSurfaceKHR surface, const std::vector<const char*>& deviceExtensions,
+	const DeviceSelection& selection)
+{
+	u32 deviceCount{ 0 };
+	vkEnumeratePhysicalDevices(instance, &deviceCount, nullptr);
+
+	if (deviceCount == 0)
+	{
+		throw std::runtime_error("Failed to find GPUs with Vulkan Support!");
+	}
+
+	ScratchScope scratch;
+	std::pmr::vector<VkPhysicalDevice> devices(deviceCount, scratch.Get());
+
+	vkEnumeratePhysicalDevices(instance, &deviceCount, devices.data());
+
+	if (selection.log)
+	{
+		std::cout << "Vulkan devices:" << std::endl;
+	}
+
+	DeviceProfile best;
+	int64_t bestScore = 0;
+
+	for (const VkPhysicalDevice& device : devices)
+	{
+		DeviceProfile profile = QueryDeviceProfile(device, surface, deviceExtensions);
+
+		const int64_t score = ScoreDevice(profile, selection);
+		const char* pUnsuitableReason = profile.GetUnsuitableReason();
+		const bool preferred = selection.preferred.empty() || matchesPreferredDevice(profile, selection.preferred);
+
+		if (selection.log)
+		{
+			std::cout << "  " << profile.properties.deviceName << " [" << deviceTypeName(profile.properties.deviceType) << ", "
+				<< FormatDeviceUuid(profile.uuid) << "] ";
+
+			if (pUnsuitableReason != nullptr)
+			{
+				std::cout << "unsuitable: " << pUnsuitableReason;
+			}
+			else
+			{
+				std::cout << "score " << score << (preferred ? "" : ", not the preferred device");
+			}
+
+			std::cout << std::endl;
+		}
+
+		if (pUnsuitableReason == nullptr && preferred && (best.device == VK_NULL_HANDLE || score > bestScore))
+		{
+			best = std::move(profile);
+			bestScore = score;
+		}
+	}
+
+	if (best.device == VK_NULL_HANDLE)
+	{
+		// Falling back to another device would quietly run somewhere other than asked.
+		if (!selection.preferred.empty())
+		{
+			throw std::runtime_error("Failed to find a suitable GPU matching \"" + selection.preferred + "\"!");
+		}
+
+		throw std::runtime_error("Failed to find a suitable GPU!");
+	}
+
+	if (selection.log)
+	{
+		logDeviceProfile(best, bestScore, selection);
+	}
+
+	return best;
+}
+
+VulkanInit::LogicalDevice VulkanInit::CreateLogicalDevice(const DeviceProfile& profile, const std::vector<const char*>& deviceExtensions, bool enableValidation,
+	const VkAllocationCallbacks* pAllocator)
+{
+	const QueueFamilyIndices& indices = profile.queueFamilies;
+
+	// At most four families, so duplicates are dropped with a sort rather than a set.
+	ScratchScope scratch;
+	std::pmr::vector<u32> uniqueQueueFamilies({ indices.graphicsFamily.value(), indices.presentFamily.value() }, scratch.Get());
+
+	if (indices.computeFamily.has_value())
+	{
+		uniqueQueueFamilies.push_back(indices.computeFamily.value());
+	}
+
+	uniqueQueueFamilies.push_back(indices.transferFamily.value());
+
+	std::sort(uniqueQueueFamilies.begin(), uniqueQueueFamilies.end());
+	uniqueQueueFamilies.erase(std::unique(uniqueQueueFamilies.begin(), uniqueQueueFamilies.end()), uniqueQueueFamilies.end());
+
+	std::pmr::vector<VkDeviceQueueCreateInfo> queueCreateInfos(scratch.Get());
+
+	float queuePriority = 1.0f;
+	for (uint32_t queueFamily : uniqueQueueFamilies) {
+		VkDeviceQueueCreateInfo queueCreateInfo{};
+		queueCreateInfo.sType = VK_STRUCTURE_TYPE_DEVICE_QUEUE_CREATE_INFO;
+		queueCreateInfo.queueFamilyIndex = queueFamily;
+		queueCreateInfo.queueCount = 1;
+		queueCreateInfo.pQueuePriorities = &queuePriority;
+		queueCreateInfos.push_back(queueCreateInfo);
+	}
+
+	// Lets DrawQueue merge draws whose commands are next to each other into one multi-draw, see DrawPacket::indirectStride.
+	VkPhysicalDeviceFeatures deviceFeatures{ };
+	deviceFeatures.multiDrawIndirect = profile.features.multiDrawIndirect;
+	deviceFeatures.drawIndirectFirstInstance = profile.features.drawIndirectFirstInstance;
+
+	// The vertex shaders read gl_ViewIndex whether or not they are drawn in a multiview pass.
+	VkPhysicalDeviceVulkan11Features vulkan11Features{ };
+	vulkan11Features.sType = VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_VULKAN_1_1_FEATURES;
+	vulkan11Features.multiview = VK_TRUE;
+
+	VkPhysicalDeviceVulkan12Features vulkan12Features{ };
+	vulkan12Features.sType = VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_VULKAN_1_2_FEATURES;
+	vulkan12Features.pNext = &vulkan11Features;
+	vulkan12Features.timelineSemaphore = VK_TRUE;
+
+	VkDeviceCreateInfo createInfo{ };
+	createInfo.sType = VK_STRUCTURE_TYPE_DEVICE_CREATE_INFO;
+	createInfo.pNext = &vulkan12Features;
+
+	createInfo.queueCreateInfoCount = static_cast<uint32_t>(queueCreateInfos.size());
+	createInfo.pQueueCreateInfos = queueCreateInfos.data();
+
+	createInfo.pEnabledFeatures = &deviceFeatures;
+
+	createInfo.enabledExtensionCount = static_cast<uint32_t>(deviceExtensions.size());
+	createInfo.ppEnabledExtensionNames = deviceExtensions.data();
+
+	if (enableValidation) {
+		createInfo.enabledLayerCount = static_cast<uint32_t>(g_validationLayers.size());
+		createInfo.ppEnabledLayerNames = g_validationLayers.data();
+	}
+	else {
+		createInfo.enabledLayerCount = 0;
+	}
+
+	LogicalDevice result;
+	result.queueFamilies = indices;
+
+	if (vkCreateDevice(profile.device, &createInfo, pAllocator, &result.device) != VK_SUCCESS) 
+	{
+		throw std::runtime_error("failed to create logical device!");
+	}
+
+	vkGetDeviceQueue(result.device, indices.graphicsFamily.value(), 0, &result.graphicsQueue);
+	vkGetDeviceQueue(result.device, indices.presentFamily.value(), 0, &result.presentQueue);
+
+	// When compute shares the graphics family this is the graphics queue itself.
+	if (indices.computeFamily.has_value())
+	{
+		vkGetDeviceQueue(result.device, indices.computeFamily.value(), 0, &result.computeQueue);
+	}
+
+	vkGetDeviceQueue(result.device, indices.transferFamily.value(), 0, &result.transferQueue);
+
+	return result;
+}
+
+static VkSurfaceFormatKHR chooseSwapSurfaceFormat(const std::pmr::vector<VkSurfaceFormatKHR>& availableFormats)
+{
+	for (const auto& availableFormat : availableFormats) 
+	{
+		if (availableFormat.format == VK_FORMAT_B8G8R8A8_SRGB && availableFormat.colorSpace == VK_COLOR_SPACE_SRGB_NONLINEAR_KHR) 
+		{
+			return availableFormat;
+		}
+	}
+
+	return availableFormats[0];
+}
+
+static VkPresentModeKHR chooseSwapPresentMode(const std::pmr::vector<VkPresentModeKHR>& availablePresentModes)
+{
+	for (const auto& availablePresentMode : availablePresentModes) 
+	{
+		if (availablePresentMode == VK_PRESENT_MODE_MAILBOX_KHR) 
+		{
+			return availablePresentMode;
+		}
+	}
+	return VK_PRESENT_MODE_FIFO_KHR;
+}
+
+static VkExtent2D chooseSwapExtent(const VkSurfaceCapabilitiesKHR& capabilities, VkExtent2D drawableExtent)
+{
+	if (capabilities.currentExtent.width != std::numeric_limits<u32>::max()) 
+	{
+		return capabilities.currentExtent;
+	}
+	else 
+	{
+		VkExtent2D actualExtent = drawableExtent;
+
+		actualExtent.width = std::clamp(actualExtent.width, capabilities.minImageExtent.width, capabilities.maxImageExtent.width);
+		actualExtent.height = std::clamp(actualExtent.height, capabilities.minImageExtent.height, capabilities.maxImageExtent.height);
+
+		return actualExtent;
+	}
+}
+
+VulkanInit::Swapchain VulkanInit::CreateSwapchain(VkPhysicalDevice physicalDevice, VkDevice device, VkSurfaceKHR surface, const QueueFamilyIndices& queueFamilies,
+	VkExtent2D drawableExtent, VkImageUsageFlags extraUsage, const VkAllocationCallbacks* pAllocator)
+{
+	ScratchScope scratch;
+	SwapChainSupportDetails swapChainSupport = QuerySwapChainSupport(physicalDevice, surface, scratch.Get());
+
+	VkSurfaceFormatKHR surfaceFormat = chooseSwapSurfaceFormat(swapChainSupport.formats);
+	VkPresentModeKHR presentMode = chooseSwapPresentMode(swapChainSupport.presentModes);
+	VkExtent2D extent = chooseSwapExtent(swapChainSupport.capabilities, drawableExtent);
+
+	// Recommended to request 1 more image than the minimum for swap chain.
+	u32 imageCount = swapChainSupport.capabilities.minImageCount + 1;
+
+	// Make sure we do not exceed the maximum support number of images for the swap chain.
+	if (swapChainSupport.capabilities.maxImageCount > 0 && imageCount > swapChainSupport.capabilities.maxImageCount) 
+	{
+		imageCount = swapChainSupport.capabilities.maxImageCount;
+	}
+
+	VkSwapchainCreateInfoKHR createInfo{};
+	createInfo.sType = VK_STRUCTURE_TYPE_SWAPCHAIN_CREATE_INFO_KHR;
+	createInfo.surface = surface;
+
+	createInfo.minImageCount = imageCount;
+	createInfo.imageFormat = surfaceFormat.format;
+	createInfo.imageColorSpace = surfaceFormat.colorSpace;
+	createInfo.imageExtent = extent;
+	createInfo.imageArrayLayers = 1;
+	createInfo.imageUsage = VK_IMAGE_USAGE_COLOR_ATTACHMENT_BIT | extraUsage;
+
+	if ((swapChainSupport.capabilities.supportedUsageFlags & createInfo.imageUsage) != createInfo.imageUsage)
+	{
+		throw std::runtime_error("swapchain does not support the requested image usage!");
+	}
+
+	const QueueFamilyIndices& indices = queueFamilies;
+	uint32_t queueFamilyIndices[] = { indices.graphicsFamily.value(), indices.presentFamily.value() };
+
+	// If the graphics queue family and present queue family are not the same queue family,
+	// then we can allow concurrent use of images between these queues.
+	// This requires two distinct family queues.
+	if (indices.graphicsFamily != indices.presentFamily) 
+	{
+		createInfo.imageSharingMode = VK_SHARING_MODE_CONCURRENT;
+		createInfo.queueFamilyIndexCount = 2;
+		createInfo.pQueueFamilyIndices = queueFamilyIndices;
+	}
+	// If the queues are the same, which is usually the case on most hardware,
+	// we need to use exclsive mode due to the minimum distinct queue requirement.
+	else 
+	{
+		createInfo.imageSharingMode = VK_SHARING_MODE_EXCLUSIVE;
+		createInfo.queueFamilyIndexCount = 0; // Optional
+		createInfo.pQueueFamilyIndices = nullptr; // Optional
+	}
+
+	createInfo.preTransform = swapChainSupport.capabilities.currentTransform;
+
+	// Prevents alpha channel from blending this window with other windows.
+	createInfo.compositeAlpha = VK_COMPOSITE_ALPHA_OPAQUE_BIT_KHR;
+
+	createInfo.presentMode = presentMode;
+
+	// Enabling clipped means pixels obscured by other windows will be clipped.
+	createInfo.clipped = VK_TRUE;
+
+	// This parameter is only used when the window is resized.
+	// During resizing, a new window is created and a reference to the old one is required for initialization.
+	createInfo.oldSwapchain = VK_NULL_HANDLE;
+
+	Swapchain swapchain;
+
+	if (vkCreateSwapchainKHR(device, &createInfo, pAllocator, &swapchain.handle) != VK_SUCCESS)
+	{
+		throw std::runtime_error("Failed to create swapchain!");
+	}
+
+
+	// Retrieve the swapchain images from the newly created swapchain
+	// and store them for later use.
+	vkGetSwapchainImagesKHR(device, swapchain.handle, &imageCount, nullptr);
+	swapchain.images.resize(imageCount);
+	vkGetSwapchainImagesKHR(device, swapchain.handle, &imageCount, swapchain.images.data());
+
+	// Store format and extent for later use too.
+	swapchain.format = surfaceFormat.format;
+	swapchain.extent = extent;
+
+	return swapchain;
+}
+
+VkRenderPass VulkanInit::CreateRenderPass(VkDevice device, VkFormat colorFormat, VkImageLayout finalColorLayout, const VkAllocationCallbacks* pAllocator)
+{
+	RenderPassDesc desc;
+	desc.colorFormat = colorFormat;
+	desc.finalColorLayout = finalColorLayout;
+
+	return CreateRenderPass(device, desc, pAllocator);
+}
+
+VkRenderPass VulkanInit::CreateRenderPass(VkDevice device, const RenderPassDesc& desc, const VkAllocationCallbacks* pAllocator)
+{
+	// Attachment descriptions are render targets
+	// This is where we tell Vulkan how many render targets
+	// there are, what they will be and how to sample/handle them.
+	VkAttachmentDescription colorAttachment{ };
+	colorAttachment.format = desc.colorFormat;
+	colorAttachment.samples = VK_SAMPLE_COUNT_1_BIT;
+
+	// loadOp and storeOp determine what is done with data
+	// before and after rendering respectively. 
+	// VK_ATTACHMENT_LOAD_OP_LOAD: Preserve the existing contents of the attachment
+	// VK_ATTACHMENT_LOAD_OP_CLEAR: Clear the values to a constant at the start
+	// VK_ATTACHMENT_LOAD_OP_DONT_CARE : Existing contents are undefined; we dont care about them
+	colorAttachment.loadOp = desc.loadContents ? VK_ATTACHMENT_LOAD_OP_LOAD : VK_ATTACHMENT_LOAD_OP_CLEAR;
+
+	// VK_ATTACHMENT_STORE_OP_STORE: Rendered contents will be stored in memory and can be read later
+	// VK_ATTACHMENT_STORE_OP_DONT_CARE : Contents of the framebuffer will be undefined after the rendering operation
+	// We want to render, so should store the operation.
+	colorAttachment.storeOp = VK_ATTACHMENT_STORE_OP_STORE;
+
+	// These are the same as the above, but for stencil data.
+	colorAttachment.stencilLoadOp = VK_ATTACHMENT_LOAD_OP_DONT_CARE;
+	colorAttachment.stencilStoreOp = VK_ATTACHMENT_STORE_OP_DONT_CARE;
+
+	// VkImage represent Textures and framebuffers. Their layout in memory
+	// can change based on their usage. The below parameters describe the 
+	// VkImage layout before and after the render pass respectively. 
+	// VK_IMAGE_LAYOUT_UNDEFINED - don't care about the layout, can't guarantee data is preserved
+	// VK_IMAGE_LAYOUT_COLOR_ATTACHMENT_OPTIMAL: Images used as color attachment
+	// VK_IMAGE_LAYOUT_PRESENT_SRC_KHR : Images to be presented in the swap chain
+	// VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL : Images to be used as destination for a memory copy operation
+	colorAttachment.initialLayout = desc.loadContents ? VK_IMAGE_LAYOUT_COLOR_ATTACHMENT_OPTIMAL : VK_IMAGE_LAYOUT_UNDEFINED;
+	colorAttachment.finalLayout = desc.finalColorLayout;
+
+	// Depth is cleared to the far plane unless it carries on from an earlier pass, and is only
+	// written back to memory when something reads it afterwards.
+	VkAttachmentDescription depthAttachment{ };
+	depthAttachment.format = desc.depthFormat;
+	depthAttachment.samples = VK_SAMPLE_COUNT_1_BIT;
+	depthAttachment.loadOp = desc.loadContents ? VK_ATTACHMENT_LOAD_OP_LOAD : VK_ATTACHMENT_LOAD_OP_CLEAR;
+	depthAttachment.storeOp = desc.storeDepth ? VK_ATTACHMENT_STORE_OP_STORE : VK_ATTACHMENT_STORE_OP_DONT_CARE;
+	depthAttachment.stencilLoadOp = VK_ATTACHMENT_LOAD_OP_DONT_CARE;
+	depthAttachment.stencilStoreOp = VK_ATTACHMENT_STORE_OP_DONT_CARE;
+	depthAttachment.initialLayout = desc.loadContents ? VK_IMAGE_LAYOUT_DEPTH_STENCIL_ATTACHMENT_OPTIMAL : VK_IMAGE_LAYOUT_UNDEFINED;
+	depthAttachment.finalLayout = VK_IMAGE_LAYOUT_DEPTH_STENCIL_ATTACHMENT_OPTIMAL;
+
+	const bool hasDepth = desc.depthFormat != VK_FORMAT_UNDEFINED;
+
+	// Vulkan allows for subpasses within a render pass.
+	// These are just subsequent rendering operations that rely
+	// on a previous one. Good use case is Post Processing effects.
+	// Using these allows Vulkan to try reorder operations for better
+	// optimisation.
+
+	// The attachment parameter specifies which attachment to reference
+	// by its index in the attachment descriptions array.
+	VkAttachmentReference colorAttachmentRef{};
+	colorAttachmentRef.attachment = 0;
+	colorAttachmentRef.layout = VK_IMAGE_LAYOUT_COLOR_ATTACHMENT_OPTIMAL;
+
+	// Describes subpass.
+	VkSubpassDescription subpass{};
+	subpass.pipelineBindPoint = VK_PIPELINE_BIND_POINT_GRAPHICS;
+
+
+	subpass.colorAttachmentCount = 1;
+	subpass.pColorAttachments = &colorAttachmentRef;
+
+	VkAttachmentReference depthAttachmentRef{};
+	depthAttachmentRef.attachment = 1;
+	depthAttachmentRef.layout = VK_IMAGE_LAYOUT_DEPTH_STENCIL_ATTACHMENT_OPTIMAL;
+
+	if (hasDepth)
+	{
+		subpass.pDepthStencilAttachment = &depthAttachmentRef;
+	}
+
+	// The image is transitioned at the start of the render pass, but the swapchain image
+	// may still be in use by the presentation engine at that point. Make the transition
+	// wait for the colour output stage, which is also where we wait on image acquisition.
+	// There is a single depth buffer shared by every frame, so its clear must also wait
+	// for the previous frame's depth tests to finish with it.
+	VkSubpassDependency dependency{};
+	dependency.srcSubpass = VK_SUBPASS_EXTERNAL;
+	dependency.dstSubpass = 0;
+	dependency.srcStageMask = VK_PIPELINE_STAGE_COLOR_ATTACHMENT_OUTPUT_BIT;
+	dependency.srcAccessMask = 0;
+	dependency.dstStageMask = VK_PIPELINE_STAGE_COLOR_ATTACHMENT_OUTPUT_BIT;
+	dependency.dstAccessMask = VK_ACCESS_COLOR_ATTACHMENT_WRITE_BIT;
+
+	if (desc.loadContents)
+	{
+		// Blending reads what the earlier pass wrote.
+		dependency.srcAccessMask |= VK_ACCESS_COLOR_ATTACHMENT_WRITE_BIT;
+		dependency.dstAccessMask |= VK_ACCESS_COLOR_ATTACHMENT_READ_BIT;
+	}
+
+	if (hasDepth)
+	{
+		dependency.srcStageMask |= VK_PIPELINE_STAGE_EARLY_FRAGMENT_TESTS_BIT | VK_PIPELINE_STAGE_LATE_FRAGMENT_TESTS_BIT;
+		dependency.srcAccessMask |= VK_ACCESS_DEPTH_STENCIL_ATTACHMENT_WRITE_BIT;
+		dependency.dstStageMask |= VK_PIPELINE_STAGE_EARLY_FRAGMENT_TESTS_BIT | VK_PIPELINE_STAGE_LATE_FRAGMENT_TESTS_BIT;
+		dependency.dstAccessMask |= VK_ACCESS_DEPTH_STENCIL_ATTACHMENT_READ_BIT | VK_ACCESS_DEPTH_STENCIL_ATTACHMENT_WRITE_BIT;
+	}
+
+	const VkAttachmentDescription attachments[] = { colorAttachment, depthAttachment };
+
+	VkRenderPassCreateInfo renderPassInfo{};
+	renderPassInfo.sType = VK_STRUCTURE_TYPE_RENDER_PASS_CREATE_INFO;
+	renderPassInfo.attachmentCount = hasDepth ? 2 : 1;
+	renderPassInfo.pAttachments = attachments;
+	renderPassInfo.subpassCount = 1;
+	renderPassInfo.pSubpasses = &subpass;
+	renderPassInfo.dependencyCount = 1;
+	renderPassInfo.pDependencies = &dependency;
+
+	// The one subpass draws every view. The views look at the same scene, so they are also marked as
+	// correlated, which lets the implementation render them together rather than one after another.
+	const u32 viewMask = (1u << desc.viewCount) - 1;
+
+	VkRenderPassMultiviewCreateInfo multiviewInfo{};
+	multiviewInfo.sType = VK_STRUCTURE_TYPE_RENDER_PASS_MULTIVIEW_CREATE_INFO;
+	multiviewInfo.subpassCount = 1;
+	multiviewInfo.pViewMasks = &viewMask;
+	multiviewInfo.correlationMaskCount = 1;
+	multiviewInfo.pCorrelationMasks = &viewMask;
+
+	if (desc.viewCount > 1)
+	{
+		renderPassInfo.pNext = &multiviewInfo;
+	}
+
+	VkRenderPass renderPass;
+	if (vkCreateRenderPass(device, &renderPassInfo, pAllocator, &renderPass) != VK_SUCCESS)
+	{
+		throw std::runtime_error("failed to create render pass!");
+	}
+
+	return renderPass;
+}
+
+VkFormat VulkanInit::FindDepthFormat(VkPhysicalDevice physicalDevice, VkFormatFeatureFlags features)
+{
+	// Only depth is needed, so the formats without stencil come first.
+	const VkFormat candidates[] = { VK_FORMAT_D32_SFLOAT, VK_FORMAT_D32_SFLOAT_S8_UINT, VK_FORMAT_D24_UNORM_S8_UINT };
+
+	for (VkFormat format : candidates)
+	{
+		VkFormatProperties properties;
+		vkGetPhysicalDeviceFormatProperties(physicalDevice, format, &properties);
+
+		if ((properties.optimalTilingFeatures & features) == features)
+		{
+			return format;
+		}
+	}
+
+	return VK_FORMAT_UNDEFINED;
+}
+
+VkShaderModule VulkanInit::CreateShaderModule(VkDevice device, const u32* pCode, size_t codeSize, const VkAllocationCallbacks* pAllocator)
+{
+	VkShaderModuleCreateInfo createInfo{};
+	createInfo.sType = VK_STRUCTURE_TYPE_SHADER_MODULE_CREATE_INFO;
+	createInfo.codeSize = codeSize;
+	createInfo.pCode = pCode;
+
+	VkShaderModule shaderModule;
+	if (vkCreateShaderModule(device, &createInfo, pAllocator, &shaderModule) != VK_SUCCESS) 
+	{
+		throw std::runtime_error("failed to create shader module!");
+	}
+
+	return shaderModule;
+}
+
+VkPipeline VulkanInit::CreateGraphicsPipeline(VkDevice device, VkPipelineCache pipelineCache, const GraphicsPipelineDesc& desc, const VkAllocationCallbacks* pAllocator)
+{
+	// Create the Vertex Shader portion of the pipeline
+	VkPipelineShaderStageCreateInfo vertShaderStageInfo{ };
+	vertShaderStageInfo.sType = VK_STRUCTURE_TYPE_PIPELINE_SHADER_STAGE_CREATE_INFO;
+	vertShaderStageInfo.stage = VK_SHADER_STAGE_VERTEX_BIT;
+
+	// Specify the shader module to attach to the pipeline stage
+	vertShaderStageInfo.module = desc.vertShader;
+
+	// Specify the entry point for that module.
+	vertShaderStageInfo.pName = "main";
+
+	// Specialization constants for this permutation. Both stages share the same data;
+	// constants a stage does not declare are simply ignored.
+	vertShaderStageInfo.pSpecializationInfo = desc.pSpecializationInfo;
+
+	// Create the Fragment Shader portion of the pipeline
+	VkPipelineShaderStageCreateInfo fragShaderStageInfo{};
+	fragShaderStageInfo.sType = VK_STRUCTURE_TYPE_PIPELINE_SHADER_STAGE_CREATE_INFO;
+	fragShaderStageInfo.stage = VK_SHADER_STAGE_FRAGMENT_BIT;
+
+	// Specify the shader module to attach to the pipeline stage
+	fragShaderStageInfo.module = desc.fragShader;
+
+	// Specify the entry point for that module.
+	fragShaderStageInfo.pName = "main";
+
+	fragShaderStageInfo.pSpecializationInfo = desc.pSpecializationInfo;
+
+	// Store these Pipeline Stage create infos in an array for use in pipeline creation.
+	VkPipelineShaderStageCreateInfo shaderStages[] = { vertShaderStageInfo, fragShaderStageInfo };
+
+	// Pipelines in Vulkan are generally immutable, but some parts can be dynamic.
+	// For that to be the case, we have to specify which we want to be dynamic.
+	// Having these states be dynamic *can* reduce complexity later down the lane,
+	// as opposed to creating a new pipeline representing each state.
+	const std::array<VkDynamicState, 2> dynamicStates
+	{
+		// Viewport and scissor rect can both be dynamic.
+		// It is often recommended to do so. 
+		// These are setup later.
+		VK_DYNAMIC_STATE_VIEWPORT,
+		VK_DYNAMIC_STATE_SCISSOR
+	};
+
+	VkPipelineDynamicStateCreateInfo dynamicState{ };
+	dynamicState.sType = VK_STRUCTURE_TYPE_PIPELINE_DYNAMIC_STATE_CREATE_INFO;
+	dynamicState.dynamicStateCount = static_cast<u32>(dynamicStates.size());
+	dynamicState.pDynamicStates = dynamicStates.data();
+
+	// Structure used to describe vertex data format.
+	// Specifies bindings, that being spacing between data and whether it is instanced.
+	// Specifices attributes, the extra data like Vertex Colours.
+	// The vertex layout comes from the caller, as it depends on the shaders.
+	VkPipelineVertexInputStateCreateInfo vertexInputInfo{};
+	vertexInputInfo.sType = VK_STRUCTURE_TYPE_PIPELINE_VERTEX_INPUT_STATE_CREATE_INFO;
+	vertexInputInfo.vertexBindingDescriptionCount = desc.vertexBindingCount;
+	vertexInputInfo.pVertexBindingDescriptions = desc.pVertexBindings;
+	vertexInputInfo.vertexAttributeDescriptionCount = desc.vertexAttributeCount;
+	vertexInputInfo.pVertexAttributeDescriptions = desc.pVertexAttributes;
+
+	// Structure used to describe the geometry (topology) and primitive restart.
+	// Primitve restart allows STRIP modes to break up geometry when enabled.
+	// We are using LIST mode so this is disabled.
+	VkPipelineInputAssemblyStateCreateInfo inputAssembly{};
+	inputAssembly.sType = VK_STRUCTURE_TYPE_PIPELINE_INPUT_ASSEMBLY_STATE_CREATE_INFO;
+	inputAssembly.topology = VK_PRIMITIVE_TOPOLOGY_TRIANGLE_LIST;
+	inputAssembly.primitiveRestartEnable = VK_FALSE;
+
+	// The viewport is the area being drawn to, and the scissor rect clips pixels outside of it.
+	// Both are dynamic state, set when recording, so the pipeline does not depend on the target size.
+	// Here we describe the Viewport with the above information.
+	VkPipelineViewportStateCreateInfo viewportState{};
+	viewportState.sType = VK_STRUCTURE_TYPE_PIPELINE_VIEWPORT_STATE_CREATE_INFO;
+	viewportState.viewportCount = 1;
+	viewportState.scissorCount = 1;
+
+	// If we were creating non-dynamic viewport and scissor,
+	// they would have to be assigned with pViewports and pScissors.
+	// This would make them immutable along with the pipeline.
+
+	// Setup the structure which describes rasterizer state.
+	// Depth clamp will clamp fragments beyond the near and far planes
+	// rather than discarding them. Can be useful for shadow maps.
+	VkPipelineRasterizationStateCreateInfo rasterizer{};
+	rasterizer.sType = VK_STRUCTURE_TYPE_PIPELINE_RASTERIZATION_STATE_CREATE_INFO;
+	rasterizer.depthClampEnable = VK_FALSE;
+
+	// This will cull all geometry passed to the rasterizer. We do not want this.
+	rasterizer.rasterizerDiscardEnable = VK_FALSE;
+
+	// Determines how geometry from the vertex shader is converted to fragments.
+	// Modes other than fill require enabling specific GPU features.
+	// VK_POLYGON_MODE_FILL: fill the area of the polygon with fragments
+	// VK_POLYGON_MODE_LINE : polygon edges are drawn as lines
+	// VK_POLYGON_MODE_POINT : polygon vertices are drawn as point
+	rasterizer.polygonMode = VK_POLYGON_MODE_FILL;
+
+	// Determines the thickness of lines in fragments. 
+	// Max value is hardware dependent, we generally want value of 1.
+	// Value greater then 1 also requires enabling GPU features.
+	rasterizer.lineWidth = 1.0f;
+
+	// Cull mode determines face culling.
+	// frontFace specifies which vertices to consider forward facing,
+	// and their winding order.
+	rasterizer.cullMode = VK_CULL_MODE_BACK_BIT;
+	rasterizer.frontFace = VK_FRONT_FACE_CLOCKWISE;
+
+	// These values allow the rasterizer to bias depth values.
+	// Can be useful for shadow maps.
+	rasterizer.depthBiasEnable = VK_FALSE;
+	rasterizer.depthBiasConstantFactor = 0.0f; // Optional
+	rasterizer.depthBiasClamp = 0.0f; // Optional
+	rasterizer.depthBiasSlopeFactor = 0.0f; // Optional
+
+	// The below structure describes the multisampling state of the pipeline.
+	// Multisampling is a means of anti-aliasing (MSAA).
+	// Having the hardware do it is more efficient.
+	// Requires enabling of GPU features.
+	VkPipelineMultisampleStateCreateInfo multisampling{};
+	multisampling.sType = VK_STRUCTURE_TYPE_PIPELINE_MULTISAMPLE_STATE_CREATE_INFO;
+	multisampling.sampleShadingEnable = VK_FALSE;
+	multisampling.rasterizationSamples = VK_SAMPLE_COUNT_1_BIT;
+	multisampling.minSampleShading = 1.0f; // Optional
+	multisampling.pSampleMask = nullptr; // Optional
+	multisampling.alphaToCoverageEnable = VK_FALSE; // Optional
+	multisampling.alphaToOneEnable = VK_FALSE; // Optional
+
+	// Describes per framebuffer data for blendmodes.
+	VkPipelineColorBlendAttachmentState colorBlendAttachment{};
+	colorBlendAttachment.colorWriteMask = VK_COLOR_COMPONENT_R_BIT | VK_COLOR_COMPONENT_G_BIT | VK_COLOR_COMPONENT_B_BIT | VK_COLOR_COMPONENT_A_BIT;
+	colorBlendAttachment.blendEnable = VK_TRUE;
+	colorBlendAttachment.srcColorBlendFactor = VK_BLEND_FACTOR_SRC_ALPHA;
+	colorBlendAttachment.dstColorBlendFactor = VK_BLEND_FACTOR_ONE_MINUS_SRC_ALPHA;
+	colorBlendAttachment.colorBlendOp = VK_BLEND_OP_ADD;
+	colorBlendAttachment.srcAlphaBlendFactor = VK_BLEND_FACTOR_ONE;
+	colorBlendAttachment.dstAlphaBlendFactor = VK_BLEND_FACTOR_ZERO;
+	colorBlendAttachment.alphaBlendOp = VK_BLEND_OP_ADD;
+
+	// Describes global data for blendmodes.
+	VkPipelineColorBlendStateCreateInfo colorBlending{};
+	colorBlending.sType = VK_STRUCTURE_TYPE_PIPELINE_COLOR_BLEND_STATE_CREATE_INFO;
+	colorBlending.logicOpEnable = VK_FALSE;
+	colorBlending.logicOp = VK_LOGIC_OP_COPY; // Optional
+	colorBlending.attachmentCount = 1;
+	colorBlending.pAttachments = &colorBlendAttachment;
+	colorBlending.blendConstants[0] = 0.0f; // Optional
+	colorBlending.blendConstants[1] = 0.0f; // Optional
+	colorBlending.blendConstants[2] = 0.0f; // Optional
+	colorBlending.blendConstants[3] = 0.0f; // Optional
+
+	// Closer fragments have smaller depth. Pipelines without depth testing leave the buffer alone,
+	// e.g. blended particles drawn over the scene.
+	VkPipelineDepthStencilStateCreateInfo depthStencil{};
+	depthStencil.sType = VK_STRUCTURE_TYPE_PIPELINE_DEPTH_STENCIL_STATE_CREATE_INFO;
+	depthStencil.depthTestEnable = desc.depthTest ? VK_TRUE : VK_FALSE;
+	depthStencil.depthWriteEnable = desc.depthWrite ? VK_TRUE : VK_FALSE;
+	depthStencil.depthCompareOp = VK_COMPARE_OP_LESS;
+	depthStencil.depthBoundsTestEnable = VK_FALSE;
+	depthStencil.stencilTestEnable = VK_FALSE;
+
+	VkGraphicsPipelineCreateInfo pipelineInfo{};
+	pipelineInfo.sType = VK_STRUCTURE_TYPE_GRAPHICS_PIPELINE_CREATE_INFO;
+	pipelineInfo.stageCount = 2;
+	pipelineInfo.pStages = shaderStages;
+	pipelineInfo.pVertexInputState = &vertexInputInfo;
+	pipelineInfo.pInputAssemblyState = &inputAssembly;
+	pipelineInfo.pViewportState = &viewportState;
+	pipelineInfo.pRasterizationState = &rasterizer;
+	pipelineInfo.pMultisampleState = &multisampling;
+	pipelineInfo.pDepthStencilState = &depthStencil;
+	pipelineInfo.pColorBlendState = &colorBlending;
+	pipelineInfo.pDynamicState = &dynamicState;
+	pipelineInfo.layout = desc.layout;
+	pipelineInfo.renderPass = desc.renderPass;
+	pipelineInfo.subpass = 0;
+
+	VkPipeline graphicsPipeline;
+	if (vkCreateGraphicsPipelines(device, pipelineCache, 1, &pipelineInfo, pAllocator, &graphicsPipeline) != VK_SUCCESS)
+	{
+		throw std::runtime_error("failed to create graphics pipeline!");
+	}
+
+	return graphicsPipeline;
+}
+
+VkPipeline VulkanInit::CreateComputePipeline(VkDevice device, VkPipelineCache pipelineCache, VkShaderModule computeShader,
+	VkPipelineLayout layout, const VkSpecializationInfo* pSpecializationInfo, const VkAllocationCallbacks* pAllocator)
+{
+	VkPipelineShaderStageCreateInfo stageInfo{};
+	stageInfo.sType = VK_STRUCTURE_TYPE_PIPELINE_SHADER_STAGE_CREATE_INFO;
+	stageInfo.stage = VK_SHADER_STAGE_COMPUTE_BIT;
+	stageInfo.module = computeShader;
+	stageInfo.pName = "main";
+	stageInfo.pSpecializationInfo = pSpecializationInfo;
+
+	VkComputePipelineCreateInfo pipelineInfo{};
+	pipelineInfo.sType = VK_STRUCTURE_TYPE_COMPUTE_PIPELINE_CREATE_INFO;
+	pipelineInfo.stage = stageInfo;
+	pipelineInfo.layout = layout;
+
+	VkPipeline computePipeline;
+	if (vkCreateComputePipelines(device, pipelineCache, 1, &pipelineInfo, pAllocator, &computePipeline) != VK_SUCCESS)
+	{
+		throw std::runtime_error("failed to create compute pipeline!");
+	}
+
+	return computePipeline;
+}
+
+u32 VulkanInit::FindMemoryType(VkPhysicalDevice physicalDevice, u32 typeFilter, VkMemoryPropertyFlags properties)
+{
+	VkPhysicalDeviceMemoryProperties memProperties;
+	vkGetPhysicalDeviceMemoryProperties(physicalDevice, &memProperties);
+
+	// typeFilter is a bitmask of the memory types the resource can live in.
+	// Pick the first of those that also has every property we asked for.
+	for (u32 i = 0; i < memProperties.memoryTypeCount; i++)
+	{
+		if ((typeFilter & (1 << i)) && (memProperties.memoryTypes[i].propertyFlags & properties) == properties)
+		{
+			return i;
+		}
+	}
+
+	throw std::runtime_error("failed to find suitable memory type!");
+}
+
+void VulkanInit::CreateBuffer(VkPhysicalDevice physicalDevice, VkDevice device, VkDeviceSize size, VkBufferUsageFlags usage,
+	VkMemoryPropertyFlags properties, VkBuffer& buffer, VkDeviceMemory& bufferMemory, const std::vector<u32>& queueFamilies,
+	const VkAllocationCallbacks* pAllocator)
+{
+	ScratchScope scratch;
+	std::pmr::vector<u32> sharedFamilies(queueFamilies.begin(), queueFamilies.end(), scratch.Get());
+	std::sort(sharedFamilies.begin(), sharedFamilies.end());
+	sharedFamilies.erase(std::unique(sharedFamilies.begin(), sharedFamilies.end()), sharedFamilies.end());
+
+	VkBufferCreateInfo bufferInfo{};
+	bufferInfo.sType = VK_STRUCTURE_TYPE_BUFFER_CREATE_INFO;
+	bufferInfo.size = size;
+	bufferInfo.usage = usage;
+
+	// Concurrent sharing lets every listed family use the buffer without ownership transfers.
+	// It is only worth it when the families actually differ, so a single family stays exclusive.
+	if (sharedFamilies.size() > 1)
+	{
+		bufferInfo.sharingMode = VK_SHARING_MODE_CONCURRENT;
+		bufferInfo.queueFamilyIndexCount = static_cast<u32>(sharedFamilies.size());
+		bufferInfo.pQueueFamilyIndices = sharedFamilies.data();
+	}
+	else
+	{
+		bufferInfo.sharingMode = VK_SHARING_MODE_EXCLUSIVE;
+	}
+
+	if (vkCreateBuffer(device, &bufferInfo, pAllocator, &buffer) != VK_SUCCESS)
+	{
+		throw std::runtime_error("failed to create buffer!");
+	}
+
+	VkMemoryRequirements memRequirements;
+	vkGetBufferMemoryRequirements(device, buffer, &memRequirements);
+
+	VkMemoryAllocateInfo allocInfo{};
+	allocInfo.sType = VK_STRUCTURE_TYPE_MEMORY_ALLOCATE_INFO;
+	allocInfo.allocationSize = memRequirements.size;
+	allocInfo.memoryTypeIndex = FindMemoryType(physicalDevice, memRequirements.memoryTypeBits, properties);
+
+	if (vkAllocateMemory(device, &allocInfo, pAllocator, &bufferMemory) != VK_SUCCESS)
+	{
+		throw std::runtime_error("failed to allocate buffer memory!");
+	}
+
+	vkBindBufferMemory(device, buffer, bufferMemory, 0);
+}
+
+VkPipelineCache VulkanInit::CreatePipelineCache(VkDevice device, const std::vector<u8>& initialData, const VkAllocationCallbacks* pAllocator)
+{
+	VkPipelineCacheCreateInfo cacheInfo{};
+	cacheInfo.sType = VK_STRUCTURE_TYPE_PIPELINE_CACHE_CREATE_INFO;
+	cacheInfo.initialDataSize = initialData.size();
+	cacheInfo.pInitialData = initialData.empty() ? nullptr : initialData.data();
+
+	VkPipelineCache pipelineCache;
+	if (vkCreatePipelineCache(device, &cacheInfo, pAllocator, &pipelineCache) != VK_SUCCESS)
+	{
+		throw std::runtime_error("failed to create pipeline cache!");
+	}
+
+	return pipelineCache;
+}
+
+std::vector<u8> VulkanInit::GetPipelineCacheData(VkDevice device, VkPipelineCache pipelineCache)
+{
+	size_t dataSize = 0;
+	vkGetPipelineCacheData(device, pipelineCache, &dataSize, nullptr);
+
+	std::vector<u8> data(dataSize);
+	if (dataSize > 0 && vkGetPipelineCacheData(device, pipelineCache, &dataSize, data.data()) != VK_SUCCESS)
+	{
+		return { };
+	}
+
+	data.resize(dataSize);
+	return data;
+}
+
+std::vector<u8> VulkanInit::LoadPipelineCacheFile(const std::string& path, VkPhysicalDevice physicalDevice)
+{
+	std::ifstream file(path, std::ios::ate | std::ios::binary);
+
+	if (!file.is_open())
+	{
+		return { };
+	}
+
+	std::vector<u8> data(static_cast<size_t>(file.tellg()));
+	file.seekg(0);
+	file.read(reinterpret_cast<char*>(data.data()), data.size());
+
+	// Every pipeline cache starts with a header identifying the device that wrote it:
+	// header size, header version, vendor id, device id, then the pipeline cache UUID.
+	// A GPU or driver update changes the UUID, so check it rather than hand stale data to the driver.
+	constexpr size_t headerSize = 4 * sizeof(u32) + VK_UUID_SIZE;
+	if (!file || data.size() < headerSize)
+	{
+		return { };
+	}
+
+	u32 header[4];
+	memcpy(header, data.data(), sizeof(header));
+
+	VkPhysicalDeviceProperties properties;
+	vkGetPhysicalDeviceProperties(physicalDevice, &properties);
+
+	if (header[1] != VK_PIPELINE_CACHE_HEADER_VERSION_ONE ||
+		header[2] != properties.vendorID ||
+		header[3] != properties.deviceID ||
+		memcmp(data.data() + sizeof(header), properties.pipelineCacheUUID, VK_UUID_SIZE) != 0)
+	{
+		return { };
+	}
+
+	return data;
+}
+
+bool VulkanInit::SavePipelineCacheFile(const std::string& path, const std::vector<u8>& data)
+{
+	if (data.empty())
+	{
+		return false;
+	}
+
+	// Write to a temporary file first, so a crash mid-write cannot leave a truncated cache behind.
+	std::string tempPath = path + ".tmp";
+
+	bool written = false;
+	{
+		std::ofstream file(tempPath, std::ios::binary | std::ios::trunc);
+		if (!file.is_open())
+		{
+			return false;
+		}
+
+		file.write(reinterpret_cast<const char*>(data.data()), data.size());
+		written = static_cast<bool>(file);
+	}
+
+	// Unlike std::rename() on Windows, std::filesystem::rename() replaces the cache a previous run left.
+	std::error_code error;
+	if (written)
+	{
+		std::filesystem::rename(tempPath, path, error);
+	}
+
+	if (!written || error)
+	{
+		std::filesystem::remove(tempPath, error);
+		return false;
+	}
+
+	return true;
+}
@@ -0,0 +1,295 @@
+#pragma once
+
+#include <memory_resource>
+#include <optional>
+#include <string>
+#include <vector>
+#include <vulkan/vulkan.h>
+
+#include "Types.h"
+
+// The steps of bringing Vulkan up, as free functions with no state of their own.
+// HelloTriangleApp runs them in order at startup, but each one only takes the handles it
+// depends on, so they can also be called (and timed) individually, see InitBenchmark.cpp.
+//
+// Anything that needs a surface accepts VK_NULL_HANDLE instead, meaning headless:
+// no present queue or swapchain support is required.
+
+#ifdef NDEBUG
+const bool enableValidationLayers = false;
+#else
+const bool enableValidationLayers = true;
+#endif
+
+const std::vector<const char*> g_validationLayers
+{
+	"VK_LAYER_KHRONOS_validation"
+};
+
+// Timeline semaphores, which QueueSync is built on, are core from Vulkan 1.2.
+constexpr u32 VULKAN_API_VERSION = VK_API_VERSION_1_2;
+
+const std::vector<const char*> g_deviceExtensions
+{
+	VK_KHR_SWAPCHAIN_EXTENSION_NAME
+};
+
+struct QueueFamilyIndices {
+	std::optional<u32> graphicsFamily;
+	std::optional<u32> presentFamily;
+	// A compute only family when the device has one, so compute can run asynchronously
+	// to graphics. Otherwise the graphics family.
+	std::optional<u32> computeFamily;
+	// A transfer only family when the device has one, usually a DMA engine that copies without
+	// taking time from graphics or compute. Otherwise the graphics family.
+	std::optional<u32> transferFamily;
+
+	bool isComplete() const {
+		return graphicsFamily.has_value() && presentFamily.has_value();
+	};
+};
+
+// The lists live in the memory resource given to QuerySwapChainSupport.
+struct SwapChainSupportDetails {
+	VkSurfaceCapabilitiesKHR capabilities;
+	std::pmr::vector<VkSurfaceFormatKHR> formats;
+	std::pmr::vector<VkPresentModeKHR> presentModes;
+};
+
+VkResult CreateDebugUtilsMessengerEXT(VkInstance instance,
+	const VkDebugUtilsMessengerCreateInfoEXT* pCreateInfo,
+	const VkAllocationCallbacks* pAllocator,
+	VkDebugUtilsMessengerEXT* pDebugMessenger);
+
+void DestroyDebugUtilsMessengerEXT(VkInstance instance,
+	VkDebugUtilsMessengerEXT debugMessenger,
+	const VkAllocationCallbacks* pAllocator);
+
+VKAPI_ATTR VkBool32 VKAPI_CALL debugCallback(VkDebugUtilsMessageSeverityFlagBitsEXT messagSeverity,
+	VkDebugUtilsMessageTypeFlagsEXT messageType,
+	const VkDebugUtilsMessengerCallbackDataEXT* pCallbackData,
+	void* pUserData);
+
+void populateDebugMessengerCreateInfo(VkDebugUtilsMessengerCreateInfoEXT& createInfo);
+
+namespace VulkanInit
+{
+	struct InstanceSettings
+	{
+		bool enableValidation{ enableValidationLayers };
+
+		// Window system extensions, e.g. from SDL. Empty when headless.
+		// The debug utils extension is added automatically when validation is enabled.
+		std::vector<const char*> extensions;
+
+		// Host allocator for the instance. Destroying it must use the same callbacks.
+		const VkAllocationCallbacks* pAllocator{ nullptr };
+	};
+
+	bool CheckValidationLayerSupport();
+
+	// Throws if the loader only supports versions older than VULKAN_API_VERSION.
+	VkInstance CreateInstance(const InstanceSettings& settings);
+
+	VkDebugUtilsMessengerEXT CreateDebugMessenger(VkInstance instance, const VkAllocationCallbacks* pAllocator = nullptr);
+
+	// Callers only look at the details briefly, so 'pMemory' is usually a ScratchScope.
+	SwapChainSupportDetails QuerySwapChainSupport(VkPhysicalDevice device, VkSurfaceKHR surface,
+		std::pmr::memory_resource* pMemory = std::pmr::get_default_resource());
+
+	// Everything device selection looks at, queried once per device. The chosen device's profile is kept,
+	// so creating the logical device and its users need not ask again.
+	struct DeviceProfile
+	{
+		VkPhysicalDevice device{ VK_NULL_HANDLE };
+		VkPhysicalDeviceProperties properties{ };
+		// The optional Vulkan 1.0 features, of which CreateLogicalDevice enables those the app can use.
+		VkPhysicalDeviceFeatures features{ };
+
+		// Stable across processes and runs on the same machine, unlike the order devices are enumerated in.
+		// Both are core from Vulkan 1.1, and left zero on older devices.
+		u8 uuid[VK_UUID_SIZE]{ };
+		u32 maxMultiviewViewCount{ 0 };
+
+		VkPhysicalDeviceMemoryProperties memory{ };
+		std::vector<VkQueueFamilyProperties> queueFamilyProperties;
+		std::vector<VkExtensionProperties> extensions;
+
+		// Queue families are essentially the render command queues.
+		// These are split into families to handle different kinds of operations.
+		// For example, a memory upload family, a compute command family etc.
+		QueueFamilyIndices queueFamilies;
+
+		// Whether the device has every extension asked for.
+		bool extensionsSupported{ false };
+		// Whether the device supports VULKAN_API_VERSION and the features CreateLogicalDevice enables.
+		bool featuresSupported{ false };
+		// Whether the surface has formats and present modes on the device. Always true headless.
+		bool surfaceSupported{ false };
+
+		// Why the app cannot run on the device, nullptr if it can.
+		const char* GetUnsuitableReason() const;
+		bool IsSuitable() const { return GetUnsuitableReason() == nullptr; }
+
+		// The total size of the device local heaps.
+		VkDeviceSize GetDeviceLocalBytes() const;
+
+		// Whether compute and transfer have families of their own, see QueueFamilyIndices.
+		bool HasDedicatedComputeQueue() const { return queueFamilies.computeFamily.has_value() && queueFamilies.computeFamily != queueFamilies.graphicsFamily; }
+		bool HasDedicatedTransferQueue() const { return queueFamilies.transferFamily.has_value() && queueFamilies.transferFamily != queueFamilies.graphicsFamily; }
+	};
+
+	// A device's UUID as 32 hex digits, dashed in the usual 8-4-4-4-12 groups.
+	std::string FormatDeviceUuid(const u8* pUuid);
+
+	// 'surface' may be VK_NULL_HANDLE, see the top of this file.
+	DeviceProfile QueryDeviceProfile(VkPhysicalDevice device, VkSurfaceKHR surface, const std::vector<const char*>& deviceExtensions);
+
+	// How PickPhysicalDevice() chooses among the suitable devices. Each device scores the weight of its type,
+	// plus the weights of what it has, and the highest score wins. Ties go to the device enumerated first.
+	struct DeviceSelection
+	{
+		// A device UUID, with or without dashes, or part of a device name, both ignoring case. Restricts the choice
+		// to the suitable devices that match, and throws if there are none. Empty considers every device.
+		std::string preferred;
+
+		// By VkPhysicalDeviceType. Far enough apart that the type decides between devices before anything else
+		// does, unless a device has hundreds of GiB of device local memory.
+		int32_t otherScore{ 0 };
+		int32_t integratedScore{ 3000 };
+		int32_t discreteScore{ 10000 };
+		int32_t virtualScore{ 2000 };
+		// Software implementations such as lavapipe, only picked when there is nothing else.
+		int32_t cpuScore{ 0 };
+
+		// For every whole GiB of device local heaps. Not counted for CPU devices, whose heaps are system memory.
+		int32_t scorePerDeviceLocalGiB{ 10 };
+
+		// For a compute or transfer family of its own, which async compute and uploads run on.
+		int32_t dedicatedComputeScore{ 100 };
+		int32_t dedicatedTransferScore{ 50 };
+
+		// Writes every device considered, and the chosen device's profile, to std::cout.
+		bool log{ true };
+	};
+
+	// The device's score under 'selection', whether or not it is suitable.
+	int64_t ScoreDevice(const DeviceProfile& profile, const DeviceSelection& selection);
+
+	// Profiles every device and returns the suitable one 'selection' scores highest. Throws if there is none.
+	DeviceProfile PickPhysicalDevice(VkInstance instance, VkSurfaceKHR surface, const std::vector<const char*>& deviceExtensions,
+		const DeviceSelection& selection = DeviceSelection{ });
+
+	struct LogicalDevice
+	{
+		VkDevice device{ VK_NULL_HANDLE };
+		VkQueue graphicsQueue{ VK_NULL_HANDLE };
+		VkQueue presentQueue{ VK_NULL_HANDLE };
+		// The same queue as graphicsQueue when the device has no separate compute family.
+		VkQueue computeQueue{ VK_NULL_HANDLE };
+		// The same queue as graphicsQueue when the device has no separate transfer family.
+		VkQueue transferQueue{ VK_NULL_HANDLE };
+		QueueFamilyIndices queueFamilies;
+	};
+
+	// Enables the timelineSemaphore and multiview features, which DeviceProfile::featuresSupported has checked for,
+	// multiDrawIndirect and drawIndirectFirstInstance where the profile has them, and creates a queue of every family in the profile's queueFamilies.
+	// Every function below that creates an object takes the host allocator to create it with, nullptr for the driver's own.
+	// The object must be destroyed with the same callbacks.
+	LogicalDevice CreateLogicalDevice(const DeviceProfile& profile, const std::vector<const char*>& deviceExtensions, bool enableValidation,
+		const VkAllocationCallbacks* pAllocator = nullptr);
+
+	struct Swapchain
+	{
+		VkSwapchainKHR handle{ VK_NULL_HANDLE };
+		std::vector<VkImage> images;
+		VkFormat format{ VK_FORMAT_UNDEFINED };
+		VkExtent2D extent{ };
+	};
+
+	// 'drawableExtent' is the window size in pixels, used when the surface leaves the extent up to us.
+	// The images are always colour attachments; 'extraUsage' adds to that, e.g. transfer destination
+	// for images that are blitted into. Throws if the surface does not support the extra usage.
+	Swapchain CreateSwapchain(VkPhysicalDevice physicalDevice, VkDevice device, VkSurfaceKHR surface, const QueueFamilyIndices& queueFamilies,
+		VkExtent2D drawableExtent, VkImageUsageFlags extraUsage = 0, const VkAllocationCallbacks* pAllocator = nullptr);
+
+	VkRenderPass CreateRenderPass(VkDevice device, VkFormat colorFormat, VkImageLayout finalColorLayout, const VkAllocationCallbacks* pAllocator = nullptr);
+
+	// A single subpass drawing into one colour attachment and, optionally, a depth attachment.
+	struct RenderPassDesc
+	{
+		VkFormat colorFormat{ VK_FORMAT_UNDEFINED };
+		VkImageLayout finalColorLayout{ VK_IMAGE_LAYOUT_PRESENT_SRC_KHR };
+
+		// VK_FORMAT_UNDEFINED for no depth attachment. The depth attachment is always left in
+		// VK_IMAGE_LAYOUT_DEPTH_STENCIL_ATTACHMENT_OPTIMAL.
+		VkFormat depthFormat{ VK_FORMAT_UNDEFINED };
+
+		// Continues drawing into what an earlier pass left, instead of clearing. The earlier pass must have
+		// left the colour attachment in VK_IMAGE_LAYOUT_COLOR_ATTACHMENT_OPTIMAL and stored its depth.
+		bool loadContents{ false };
+
+		// Keeps the depth once the pass ends, for a later pass or a shader to read.
+		bool storeDepth{ false };
+
+		// Above 1 draws every view into its own layer of the attachments in one multiview pass, views 0 to
+		// viewCount - 1, which the framebuffer must have the layers for. Needs the multiview feature.
+		u32 viewCount{ 1 };
+	};
+
+	// Passes differing only in load and store operations and final layouts are compatible, as long as their view counts match,
+	// so they can share framebuffers and pipelines.
+	VkRenderPass CreateRenderPass(VkDevice device, const RenderPassDesc& desc, const VkAllocationCallbacks* pAllocator = nullptr);
+
+	// The first depth format with optimal tiling support for 'features', in order of precision.
+	// VK_FORMAT_UNDEFINED if there is none.
+	VkFormat FindDepthFormat(VkPhysicalDevice physicalDevice, VkFormatFeatureFlags features);
+
+	VkShaderModule CreateShaderModule(VkDevice device, const u32* pCode, size_t codeSize, const VkAllocationCallbacks* pAllocator = nullptr);
+
+	// The shaders and layout of a graphics pipeline. The fixed function state is the same for every pipeline.
+	struct GraphicsPipelineDesc
+	{
+		VkShaderModule vertShader{ VK_NULL_HANDLE };
+		VkShaderModule fragShader{ VK_NULL_HANDLE };
+
+		// Shared by both stages; constants a stage does not declare are ignored.
+		const VkSpecializationInfo* pSpecializationInfo{ nullptr };
+
+		u32 vertexBindingCount{ 0 };
+		const VkVertexInputBindingDescription* pVertexBindings{ nullptr };
+		u32 vertexAttributeCount{ 0 };
+		const VkVertexInputAttributeDescription* pVertexAttributes{ nullptr };
+
+		// Needs a render pass with a depth attachment. Depth is tested with VK_COMPARE_OP_LESS.
+		bool depthTest{ false };
+		bool depthWrite{ false };
+
+		VkPipelineLayout layout{ VK_NULL_HANDLE };
+		VkRenderPass renderPass{ VK_NULL_HANDLE };
+	};
+
+	VkPipeline CreateGraphicsPipeline(VkDevice device, VkPipelineCache pipelineCache, const GraphicsPipelineDesc& desc, const VkAllocationCallbacks* pAllocator = nullptr);
+
+	VkPipeline CreateComputePipeline(VkDevice device, VkPipelineCache pipelineCache, VkShaderModule computeShader,
+		VkPipelineLayout layout, const VkSpecializationInfo* pSpecializationInfo = nullptr, const VkAllocationCallbacks* pAllocator = nullptr);
+
+	u32 FindMemoryType(VkPhysicalDevice physicalDevice, u32 typeFilter, VkMemoryPropertyFlags properties);
+
+	// Creates a buffer with its own dedicated allocation. If 'queueFamilies' lists more than one
+	// distinct family the buffer is shared between them concurrently, otherwise it is exclusive.
+	void CreateBuffer(VkPhysicalDevice physicalDevice, VkDevice device, VkDeviceSize size, VkBufferUsageFlags usage,
+		VkMemoryPropertyFlags properties, VkBuffer& buffer, VkDeviceMemory& bufferMemory, const std::vector<u32>& queueFamilies = { },
+		const VkAllocationCallbacks* pAllocator = nullptr);
+
+	// 'initialData' may be empty, giving a cold cache.
+	VkPipelineCache CreatePipelineCache(VkDevice device, const std::vector<u8>& initialData, const VkAllocationCallbacks* pAllocator = nullptr);
+
+	std::vector<u8> GetPipelineCacheData(VkDevice device, VkPipelineCache pipelineCache);
+
+	// Returns the cache saved at 'path', or nothing if there is no file or it was written
+	// by a different device or driver, in which case the driver would ignore it anyway.
+	std::vector<u8> LoadPipelineCacheFile(const std::string& path, VkPhysicalDevice physicalDevice);
+
+	bool SavePipelineCacheFile(const std::string& path, const std::vector<u8>& data);
+}